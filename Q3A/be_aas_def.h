@@ -144,6 +144,7 @@ typedef struct aas_settings_s
 typedef struct aas_routingcache_s
 {
 	byte type;									//portal or area cache
+	byte intable;								//travel times are stored in the route table
 	float time;									//last time accessed or updated
 	int size;									//size of the routing cache
 	int cluster;								//cluster the cache is for
@@ -154,9 +155,25 @@ typedef struct aas_routingcache_s
 	struct aas_routingcache_s *prev, *next;
 	struct aas_routingcache_s *time_prev, *time_next;
 	unsigned char *reachabilities;				//reachabilities used for routing
-	unsigned short int traveltimes[1];			//travel time for every area (variable sized)
+	unsigned short int *traveltimes;			//travel time for every area
 } aas_routingcache_t;
 
+#define MAX_ROUTETABLE_TRAVELFLAGS		16
+
+//precomputed routing caches for a whole map
+typedef struct aas_routetable_s
+{
+	int numtravelflags;							//number of travel flag combinations in the table
+	int travelflags[MAX_ROUTETABLE_TRAVELFLAGS];	//the travel flag combinations
+	byte *data;									//everything after the file header, used in place
+	byte *disabled;								//areas that were disabled when the table was created
+	int *clusteroffsets;						//offset of the area caches of every cluster for every combination
+	int *portaloffsets;							//offset of the portal caches for every combination
+	int *clusterchanges;						//areas per cluster with a different disabled state than in the table
+	int numchanges;								//areas with a different disabled state than in the table
+	unsigned char *portalreachabilities;		//portal caches never store reachabilities
+} aas_routetable_t;
+
 //fields for the routing algorithm
 typedef struct aas_routingupdate_s
 {
@@ -166,10 +183,19 @@ typedef struct aas_routingupdate_s
 	unsigned short int tmptraveltime;			//temporary travel time
 	unsigned short int *areatraveltimes;		//travel times within the area
 	qboolean inlist;							//true if the update is in the list
+	int heapindex;								//index in the update heap + 1, 0 if not in the heap
 	struct aas_routingupdate_s *next;
 	struct aas_routingupdate_s *prev;
 } aas_routingupdate_t;
 
+//routing update heap node, the travel time is kept in the node so
+//the heap can be ordered without touching the updates themselves
+typedef struct aas_routingheapnode_s
+{
+	unsigned short int tmptraveltime;			//travel time of the update
+	int updatenum;								//index of the update
+} aas_routingheapnode_t;
+
 //reversed reachability link
 typedef struct aas_reversedlink_s
 {
@@ -267,6 +293,9 @@ typedef struct aas_s
 	//routing update
 	aas_routingupdate_t *areaupdate;
 	aas_routingupdate_t *portalupdate;
+	//routing update heaps sorted on travel time
+	aas_routingheapnode_t *areaupdateheap;
+	aas_routingheapnode_t *portalupdateheap;
 	//number of routing updates during a frame (reset every frame)
 	int frameroutingupdates;
 	//reversed reachability links
@@ -284,6 +313,11 @@ typedef struct aas_s
 	//areas the reachabilities go through
 	int *reachabilityareaindex;
 	aas_reachabilityareas_t *reachabilityareas;
+	//precomputed routing caches
+	aas_routetable_t routetable;
+	//travel flag combinations used for routing since the map was loaded
+	int usedtravelflags[MAX_ROUTETABLE_TRAVELFLAGS];
+	int numusedtravelflags;
 } aas_t;
 
 #define AASINTERN
@@ -47,6 +47,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 aas_t aasworld;
 
 libvar_t *saveroutingcache;
+libvar_t *routingbenchmark;
+libvar_t *writeroutetable;
 
 //===========================================================================
 // Parameter:				-
@@ -260,6 +262,18 @@ int AAS_StartFrame (float time)
 		LibVarSet ("saveroutingcache", "0");
 	} //end if
 
+	if (routingbenchmark->value)
+	{
+		AAS_RoutingBenchmark ();
+		LibVarSet ("routingbenchmark", "0");
+	} //end if
+
+	if (writeroutetable->value)
+	{
+		if (aasworld.initialized) AAS_WriteRouteTable ();
+		LibVarSet ("writeroutetable", "0");
+	} //end if
+
 	aasworld.numframes++;
 	return BLERR_NOERROR;
 } //end of the function AAS_StartFrame
@@ -369,6 +383,10 @@ int AAS_Setup (void)
 	aasworld.maxentities = (int) LibVarValue ("maxentities", "1024");
 	// as soon as it's set to 1 the routing cache will be saved
 	saveroutingcache = LibVar ("saveroutingcache", "0");
+	// as soon as it's set to 1 the routing benchmark is run
+	routingbenchmark = LibVar ("routingbenchmark", "0");
+	// as soon as it's set to 1 the route table is written
+	writeroutetable = LibVar ("writeroutetable", "0");
 	//allocate memory for the entities
 	if (aasworld.entities) FreeMemory (aasworld.entities);
 	aasworld.entities = (aas_entity_t *) GetClearedHunkMemory (aasworld.maxentities * sizeof (aas_entity_t));
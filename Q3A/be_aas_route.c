@@ -84,6 +84,10 @@ int numportalcacheupdates;
 int routingcachesize;
 int max_routingcachesize;
 
+void AAS_UpdateAreaRoutingCache (aas_routingcache_t *areacache);
+void AAS_UpdatePortalRoutingCache (aas_routingcache_t *portalcache);
+void AAS_RouteTableAreaChanged (int areanum);
+
 //===========================================================================
 // Parameter:			-
 // Returns:				-
@@ -309,6 +313,8 @@ int AAS_EnableRoutingArea (int areanum, int enable)
 	// if the status of the area changed
 	if ((flags & AREA_DISABLED) != (aasworld.areasettings[areanum].areaflags & AREA_DISABLED))
 	{
+		//keep track of where the route table can still be used
+		AAS_RouteTableAreaChanged (areanum);
 		//remove all routing cache involving this area
 		AAS_RemoveRoutingCacheUsingArea (areanum);
 	} //end if
@@ -716,7 +722,8 @@ aas_routingcache_t *AAS_AllocRoutingCache (int numtraveltimes)
 	routingcachesize += size;
 
 	cache = (aas_routingcache_t *) GetClearedMemory (size);
-	cache->reachabilities = (unsigned char *) cache + sizeof (aas_routingcache_t)
+	cache->traveltimes = (unsigned short int *) ((unsigned char *) cache + sizeof (aas_routingcache_t));
+	cache->reachabilities = (unsigned char *) cache->traveltimes
 		+ numtraveltimes * sizeof (unsigned short int);
 	cache->size = size;
 	return cache;
@@ -838,10 +845,20 @@ void AAS_InitRoutingUpdate (void)
 	aasworld.areaupdate = (aas_routingupdate_t *) GetClearedMemory (
 		maxreachabilityareas * sizeof (aas_routingupdate_t));
 
+	if (aasworld.areaupdateheap) FreeMemory (aasworld.areaupdateheap);
+	//allocate memory for the area update heap
+	aasworld.areaupdateheap = (aas_routingheapnode_t *) GetClearedMemory (
+		maxreachabilityareas * sizeof (aas_routingheapnode_t));
+
 	if (aasworld.portalupdate) FreeMemory (aasworld.portalupdate);
 	//allocate memory for the portal update fields
 	aasworld.portalupdate = (aas_routingupdate_t *) GetClearedMemory (
 		(aasworld.numportals + 1) * sizeof (aas_routingupdate_t));
+
+	if (aasworld.portalupdateheap) FreeMemory (aasworld.portalupdateheap);
+	//allocate memory for the portal update heap
+	aasworld.portalupdateheap = (aas_routingheapnode_t *) GetClearedMemory (
+		(aasworld.numportals + 1) * sizeof (aas_routingheapnode_t));
 } //end of the function AAS_InitRoutingUpdate
 //===========================================================================
 // Parameter:			-
@@ -889,7 +906,7 @@ typedef struct routecacheheader_s
 } routecacheheader_t;
 
 #define RCID						(('C'<<24)+('R'<<16)+('E'<<8)+'M')
-#define RCVERSION					2
+#define RCVERSION					3
 
 //void AAS_DecompressVis(byte *in, int numareas, byte *decompressed);
 //int AAS_CompressVis(byte *vis, int numareas, byte *dest);
@@ -908,6 +925,8 @@ void AAS_WriteRouteCache (void)
 	{
 		for (cache = aasworld.portalcache[i]; cache; cache = cache->next)
 		{
+			//the route table caches are already on disk
+			if (cache->intable) continue;
 			numportalcache++;
 		} //end for
 	} //end for
@@ -919,6 +938,7 @@ void AAS_WriteRouteCache (void)
 		{
 			for (cache = aasworld.clusterareacache[i][j]; cache; cache = cache->next)
 			{
+				if (cache->intable) continue;
 				numareacache++;
 			} //end for
 		} //end for
@@ -949,6 +969,8 @@ void AAS_WriteRouteCache (void)
 	{
 		for (cache = aasworld.portalcache[i]; cache; cache = cache->next)
 		{
+			if (cache->intable) continue;
+			botimport.FS_Write (&cache->size, sizeof (cache->size), fp);
 			botimport.FS_Write (cache, cache->size, fp);
 			totalsize += cache->size;
 		} //end for
@@ -960,6 +982,8 @@ void AAS_WriteRouteCache (void)
 		{
 			for (cache = aasworld.clusterareacache[i][j]; cache; cache = cache->next)
 			{
+				if (cache->intable) continue;
+				botimport.FS_Write (&cache->size, sizeof (cache->size), fp);
 				botimport.FS_Write (cache, cache->size, fp);
 				totalsize += cache->size;
 			} //end for
@@ -997,10 +1021,12 @@ aas_routingcache_t *AAS_ReadCache (fileHandle_t fp)
 
 	botimport.FS_Read (&size, sizeof (size), fp);
 	cache = (aas_routingcache_t *) GetMemory (size);
+	botimport.FS_Read (cache, size, fp);
 	cache->size = size;
-	botimport.FS_Read ((unsigned char *) cache + sizeof (size), size - sizeof (size), fp);
-	cache->reachabilities = (unsigned char *) cache + sizeof (aas_routingcache_t) - sizeof (unsigned short) +
-		(size - sizeof (aas_routingcache_t) + sizeof (unsigned short)) / 3 * 2;
+	//the travel times and reachabilities directly follow the cache
+	cache->traveltimes = (unsigned short int *) ((unsigned char *) cache + sizeof (aas_routingcache_t));
+	cache->reachabilities = (unsigned char *) cache->traveltimes +
+		(size - sizeof (aas_routingcache_t)) / 3 * 2;
 	return cache;
 } //end of the function AAS_ReadCache
 //===========================================================================
@@ -1064,6 +1090,7 @@ int AAS_ReadRouteCache (void)
 		if (aasworld.portalcache[cache->areanum])
 			aasworld.portalcache[cache->areanum]->prev = cache;
 		aasworld.portalcache[cache->areanum] = cache;
+		AAS_LinkCache (cache);
 	} //end for
 	//read all the cluster area cache
 	for (i = 0; i < routecacheheader.numareacache; i++)
@@ -1075,6 +1102,7 @@ int AAS_ReadRouteCache (void)
 		if (aasworld.clusterareacache[cache->cluster][clusterareanum])
 			aasworld.clusterareacache[cache->cluster][clusterareanum]->prev = cache;
 		aasworld.clusterareacache[cache->cluster][clusterareanum] = cache;
+		AAS_LinkCache (cache);
 	} //end for
 	// read the visareas
 	/*
@@ -1094,6 +1122,513 @@ int AAS_ReadRouteCache (void)
 	return qtrue;
 } //end of the function AAS_ReadRouteCache
 //===========================================================================
+// the route table stores the area routing cache of every area in every
+// cluster and the portal routing cache of every area for the travel flag
+// combinations used on the map, so bots never have to wait for a routing
+// update
+//
+// the table file has a header, the disabled state of every area when the
+// table was created and then for every travel flag combination the area
+// caches of all clusters followed by the portal caches of all areas
+// everything after the header is read in one piece and the routing caches
+// point straight into it
+//===========================================================================
+
+typedef struct routetableheader_s
+{
+	int ident;
+	int version;
+	int numareas;
+	int numclusters;
+	int numportals;
+	int areacrc;
+	int clustercrc;
+	int numtravelflags;
+	int travelflags[MAX_ROUTETABLE_TRAVELFLAGS];
+	int datasize;
+} routetableheader_t;
+
+#define RTID						(('L'<<24)+('B'<<16)+('T'<<8)+'R')
+#define RTVERSION					1
+
+//travel flag combinations that are always put in the route table
+int routetabledefaulttravelflags[] =
+{
+	TFL_DEFAULT,
+	TFL_DEFAULT | TFL_ROCKETJUMP
+};
+
+//===========================================================================
+// returns the size of one area cache in the route table
+// the travel times are followed by the reachabilities and padded to four bytes
+// Parameter:			numtraveltimes	: number of reachability areas in the cluster
+// Returns:				size in bytes
+// Changes Globals:		-
+//===========================================================================
+int AAS_RouteTableRecordSize (int numtraveltimes)
+{
+	return (numtraveltimes * (sizeof (unsigned short int) + sizeof (unsigned char)) + 3) & ~3;
+} //end of the function AAS_RouteTableRecordSize
+//===========================================================================
+// returns the cluster the portal routing cache towards the given area uses
+// Parameter:			areanum			: goal area
+// Returns:				cluster number
+// Changes Globals:		-
+//===========================================================================
+int AAS_RouteTablePortalCluster (int areanum)
+{
+	int clusternum;
+
+	clusternum = aasworld.areasettings[areanum].cluster;
+	//just like AAS_AreaRouteToGoalArea use the front cluster of a portal
+	if (clusternum < 0) clusternum = aasworld.portals[-clusternum].frontcluster;
+	return clusternum;
+} //end of the function AAS_RouteTablePortalCluster
+//===========================================================================
+// allocates the offsets for the travel flag combinations of the table
+// Parameter:			table			: route table with the travel flags set
+// Returns:				size of the table data after the header
+// Changes Globals:		-
+//===========================================================================
+int AAS_RouteTableLayout (aas_routetable_t *table)
+{
+	int i, j, offset, numtraveltimes;
+
+	table->clusteroffsets = (int *) GetClearedMemory (table->numtravelflags * aasworld.numclusters * sizeof (int));
+	table->portaloffsets = (int *) GetClearedMemory (table->numtravelflags * sizeof (int));
+	//the disabled state of all the areas comes first
+	offset = (aasworld.numareas + 3) & ~3;
+	for (i = 0; i < table->numtravelflags; i++)
+	{
+		for (j = 0; j < aasworld.numclusters; j++)
+		{
+			table->clusteroffsets[i * aasworld.numclusters + j] = offset;
+			numtraveltimes = aasworld.clusters[j].numreachabilityareas;
+			offset += numtraveltimes * AAS_RouteTableRecordSize (numtraveltimes);
+		} //end for
+		table->portaloffsets[i] = offset;
+		offset += (aasworld.numareas * aasworld.numportals * sizeof (unsigned short int) + 3) & ~3;
+	} //end for
+	return offset;
+} //end of the function AAS_RouteTableLayout
+//===========================================================================
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FreeRouteTable (void)
+{
+	aas_routetable_t *table = &aasworld.routetable;
+
+	if (table->data) FreeMemory (table->data);
+	if (table->clusteroffsets) FreeMemory (table->clusteroffsets);
+	if (table->portaloffsets) FreeMemory (table->portaloffsets);
+	if (table->clusterchanges) FreeMemory (table->clusterchanges);
+	if (table->portalreachabilities) FreeMemory (table->portalreachabilities);
+	Com_Memset (table, 0, sizeof (aas_routetable_t));
+} //end of the function AAS_FreeRouteTable
+//===========================================================================
+// counts an area that has been enabled or disabled since the table was
+// created, area caches of the clusters the area is in and all portal
+// caches can't be taken from the table while the count isn't zero
+// Parameter:			areanum			: area that changed
+//						change			: 1 if the area now differs from the table, -1 if not
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_RouteTableCountChange (int areanum, int change)
+{
+	int clusternum;
+	aas_portal_t *portal;
+	aas_routetable_t *table = &aasworld.routetable;
+
+	clusternum = aasworld.areasettings[areanum].cluster;
+	if (clusternum > 0)
+	{
+		table->clusterchanges[clusternum] += change;
+	} //end if
+	else
+	{
+		portal = &aasworld.portals[-clusternum];
+		table->clusterchanges[portal->frontcluster] += change;
+		if (portal->backcluster != portal->frontcluster)
+		{
+			table->clusterchanges[portal->backcluster] += change;
+		} //end if
+	} //end else
+	table->numchanges += change;
+} //end of the function AAS_RouteTableCountChange
+//===========================================================================
+// called when an area has been enabled or disabled
+// Parameter:			areanum			: area that changed
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_RouteTableAreaChanged (int areanum)
+{
+	int disabled;
+	aas_routetable_t *table = &aasworld.routetable;
+
+	if (!table->data) return;
+	disabled = (aasworld.areasettings[areanum].areaflags & AREA_DISABLED) != 0;
+	if (disabled != table->disabled[areanum]) AAS_RouteTableCountChange (areanum, 1);
+	else AAS_RouteTableCountChange (areanum, -1);
+} //end of the function AAS_RouteTableAreaChanged
+//===========================================================================
+// remembers the travel flags used for routing so they can be put in
+// the route table
+// Parameter:			travelflags		: travel flags used for routing
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_RouteTableUseTravelFlags (int travelflags)
+{
+	int i;
+
+	for (i = 0; i < aasworld.numusedtravelflags; i++)
+	{
+		if (aasworld.usedtravelflags[i] == travelflags) return;
+	} //end for
+	if (aasworld.numusedtravelflags >= MAX_ROUTETABLE_TRAVELFLAGS) return;
+	aasworld.usedtravelflags[aasworld.numusedtravelflags++] = travelflags;
+} //end of the function AAS_RouteTableUseTravelFlags
+//===========================================================================
+// returns a routing cache with the travel times from the route table
+// the cache still has to be set up and linked by the caller
+// Parameter:			clusternum		: cluster of the cache
+//						areanum			: goal area of the cache
+//						travelflags		: travel flags of the cache
+//						portal			: true for a portal routing cache
+// Returns:				the routing cache or NULL if it's not in the table
+// Changes Globals:		-
+//===========================================================================
+aas_routingcache_t *AAS_RouteTableCache (int clusternum, int areanum, int travelflags, int portal)
+{
+	int i, clusterareanum, numtraveltimes;
+	byte *record;
+	unsigned short int *traveltimes;
+	unsigned char *reachabilities;
+	aas_routingcache_t *cache;
+	aas_routetable_t *table = &aasworld.routetable;
+
+	if (!table->data) return NULL;
+	//find the travel flags in the table
+	for (i = 0; i < table->numtravelflags; i++)
+	{
+		if (table->travelflags[i] == travelflags) break;
+	} //end for
+	if (i >= table->numtravelflags) return NULL;
+
+	if (portal)
+	{
+		//every enabled or disabled area can change the portal routing
+		if (table->numchanges) return NULL;
+		if (clusternum != AAS_RouteTablePortalCluster (areanum)) return NULL;
+		traveltimes = (unsigned short int *) (table->data + table->portaloffsets[i]) +
+			areanum * aasworld.numportals;
+		reachabilities = table->portalreachabilities;
+	} //end if
+	else
+	{
+		if (table->clusterchanges[clusternum]) return NULL;
+		numtraveltimes = aasworld.clusters[clusternum].numreachabilityareas;
+		clusterareanum = AAS_ClusterAreaNum (clusternum, areanum);
+		if (clusterareanum >= numtraveltimes) return NULL;
+		record = table->data + table->clusteroffsets[i * aasworld.numclusters + clusternum] +
+			clusterareanum * AAS_RouteTableRecordSize (numtraveltimes);
+		traveltimes = (unsigned short int *) record;
+		reachabilities = record + numtraveltimes * sizeof (unsigned short int);
+	} //end else
+	cache = (aas_routingcache_t *) GetClearedMemory (sizeof (aas_routingcache_t));
+	cache->traveltimes = traveltimes;
+	cache->reachabilities = reachabilities;
+	cache->intable = qtrue;
+	cache->size = sizeof (aas_routingcache_t);
+	routingcachesize += cache->size;
+	return cache;
+} //end of the function AAS_RouteTableCache
+//===========================================================================
+// Parameter:			-
+// Returns:				qtrue if the route table was loaded
+// Changes Globals:		-
+//===========================================================================
+int AAS_LoadRouteTable (void)
+{
+	int i, length, datasize;
+	fileHandle_t fp;
+	char filename[MAX_QPATH];
+	routetableheader_t header;
+	aas_routetable_t *table = &aasworld.routetable;
+
+	AAS_FreeRouteTable ();
+
+	Com_sprintf (filename, MAX_QPATH, "maps/%s.rtb", aasworld.mapname);
+	length = botimport.FS_FOpenFile (filename, &fp, FS_READ);
+	if (!fp)
+	{
+		return qfalse;
+	} //end if
+	botimport.FS_Read (&header, sizeof (routetableheader_t), fp);
+	if (header.ident != RTID || header.version != RTVERSION ||
+		header.numareas != aasworld.numareas ||
+		header.numclusters != aasworld.numclusters ||
+		header.numportals != aasworld.numportals ||
+		header.numtravelflags < 1 || header.numtravelflags > MAX_ROUTETABLE_TRAVELFLAGS ||
+		header.areacrc != CRC_ProcessString ((unsigned char *) aasworld.areas, sizeof (aas_area_t) * aasworld.numareas) ||
+		header.clustercrc != CRC_ProcessString ((unsigned char *) aasworld.clusters, sizeof (aas_cluster_t) * aasworld.numclusters))
+	{
+		botimport.Print (PRT_MESSAGE, "%s is out of date\n", filename);
+		botimport.FS_FCloseFile (fp);
+		return qfalse;
+	} //end if
+	table->numtravelflags = header.numtravelflags;
+	Com_Memcpy (table->travelflags, header.travelflags, sizeof (table->travelflags));
+	datasize = AAS_RouteTableLayout (table);
+	if (datasize != header.datasize || length != sizeof (routetableheader_t) + datasize)
+	{
+		botimport.Print (PRT_MESSAGE, "%s is out of date\n", filename);
+		botimport.FS_FCloseFile (fp);
+		AAS_FreeRouteTable ();
+		return qfalse;
+	} //end if
+	//leave some room for the routing caches that aren't in the table
+	if (AvailableMemory () < datasize + 2 * 1024 * 1024)
+	{
+		botimport.Print (PRT_WARNING, "not enough memory for %s, %d bytes\n", filename, datasize);
+		botimport.FS_FCloseFile (fp);
+		AAS_FreeRouteTable ();
+		return qfalse;
+	} //end if
+	//read the whole table in one go, the routing caches use it in place
+	table->data = (byte *) GetMemory (datasize);
+	botimport.FS_Read (table->data, datasize, fp);
+	botimport.FS_FCloseFile (fp);
+
+	table->disabled = table->data;
+	table->clusterchanges = (int *) GetClearedMemory (aasworld.numclusters * sizeof (int));
+	table->portalreachabilities = (unsigned char *) GetClearedMemory (aasworld.numportals * sizeof (unsigned char));
+	//count the areas that are enabled or disabled differently than in the table
+	for (i = 1; i < aasworld.numareas; i++)
+	{
+		if (((aasworld.areasettings[i].areaflags & AREA_DISABLED) != 0) != table->disabled[i])
+		{
+			AAS_RouteTableCountChange (i, 1);
+		} //end if
+	} //end for
+	botimport.Print (PRT_MESSAGE, "loaded %s, %d travel flag combinations, %d bytes\n",
+		filename, table->numtravelflags, datasize);
+	return qtrue;
+} //end of the function AAS_LoadRouteTable
+//===========================================================================
+// removes all area and portal routing caches
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_RemoveAllRoutingCache (void)
+{
+	int i;
+	aas_routingcache_t *cache, *nextcache;
+
+	for (i = 0; i < aasworld.numclusters; i++)
+	{
+		AAS_RemoveRoutingCacheInCluster (i);
+	} //end for
+	for (i = 0; i < aasworld.numareas; i++)
+	{
+		for (cache = aasworld.portalcache[i]; cache; cache = nextcache)
+		{
+			nextcache = cache->next;
+			AAS_FreeRoutingCache (cache);
+		} //end for
+		aasworld.portalcache[i] = NULL;
+	} //end for
+} //end of the function AAS_RemoveAllRoutingCache
+//===========================================================================
+// adds travel flags to the list for a new route table
+// Parameter:			table			: route table being created
+//						travelflags		: travel flags to add
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_RouteTableAddTravelFlags (aas_routetable_t *table, int travelflags)
+{
+	int i;
+
+	for (i = 0; i < table->numtravelflags; i++)
+	{
+		if (table->travelflags[i] == travelflags) return;
+	} //end for
+	if (table->numtravelflags >= MAX_ROUTETABLE_TRAVELFLAGS) return;
+	table->travelflags[table->numtravelflags++] = travelflags;
+} //end of the function AAS_RouteTableAddTravelFlags
+//===========================================================================
+// computes all the routing caches for the map and writes them to the
+// route table file, then loads the new table
+// Parameter:			-
+// Returns:				qtrue if the route table was written and loaded
+// Changes Globals:		-
+//===========================================================================
+int AAS_WriteRouteTable (void)
+{
+	int i, j, k, n, clusternum, numtraveltimes, maxtraveltimes, starttime, pad;
+	int *goalareas;
+	byte disabled, zeros[4];
+	fileHandle_t fp;
+	char filename[MAX_QPATH];
+	routetableheader_t header;
+	aas_routetable_t newtable;
+	aas_routingcache_t *cache;
+	aas_portal_t *portal;
+
+	starttime = Sys_MilliSeconds ();
+	//the default travel flags, whatever was in the old table and the
+	//travel flags used since the map was loaded
+	Com_Memset (&newtable, 0, sizeof (aas_routetable_t));
+	for (i = 0; i < sizeof (routetabledefaulttravelflags) / sizeof (routetabledefaulttravelflags[0]); i++)
+	{
+		AAS_RouteTableAddTravelFlags (&newtable, routetabledefaulttravelflags[i]);
+	} //end for
+	for (i = 0; i < aasworld.routetable.numtravelflags; i++)
+	{
+		AAS_RouteTableAddTravelFlags (&newtable, aasworld.routetable.travelflags[i]);
+	} //end for
+	for (i = 0; i < aasworld.numusedtravelflags; i++)
+	{
+		AAS_RouteTableAddTravelFlags (&newtable, aasworld.usedtravelflags[i]);
+	} //end for
+	//the caches using the old table have to go before the table itself
+	AAS_RemoveAllRoutingCache ();
+	AAS_FreeRouteTable ();
+
+	Com_sprintf (filename, MAX_QPATH, "maps/%s.rtb", aasworld.mapname);
+	botimport.FS_FOpenFile (filename, &fp, FS_WRITE);
+	if (!fp)
+	{
+		AAS_Error ("Unable to open file: %s\n", filename);
+		return qfalse;
+	} //end if
+	Com_Memset (&header, 0, sizeof (routetableheader_t));
+	header.ident = RTID;
+	header.version = RTVERSION;
+	header.numareas = aasworld.numareas;
+	header.numclusters = aasworld.numclusters;
+	header.numportals = aasworld.numportals;
+	header.areacrc = CRC_ProcessString ((unsigned char *) aasworld.areas, sizeof (aas_area_t) * aasworld.numareas);
+	header.clustercrc = CRC_ProcessString ((unsigned char *) aasworld.clusters, sizeof (aas_cluster_t) * aasworld.numclusters);
+	header.numtravelflags = newtable.numtravelflags;
+	Com_Memcpy (header.travelflags, newtable.travelflags, sizeof (header.travelflags));
+	header.datasize = AAS_RouteTableLayout (&newtable);
+	FreeMemory (newtable.clusteroffsets);
+	FreeMemory (newtable.portaloffsets);
+	botimport.FS_Write (&header, sizeof (routetableheader_t), fp);
+
+	Com_Memset (zeros, 0, sizeof (zeros));
+	//write the disabled state of all the areas
+	for (i = 0; i < aasworld.numareas; i++)
+	{
+		disabled = (aasworld.areasettings[i].areaflags & AREA_DISABLED) != 0;
+		botimport.FS_Write (&disabled, sizeof (disabled), fp);
+	} //end for
+	botimport.FS_Write (zeros, ((aasworld.numareas + 3) & ~3) - aasworld.numareas, fp);
+
+	//scratch cache large enough for any cluster or the portals
+	maxtraveltimes = aasworld.numportals;
+	for (i = 0; i < aasworld.numclusters; i++)
+	{
+		if (aasworld.clusters[i].numreachabilityareas > maxtraveltimes)
+		{
+			maxtraveltimes = aasworld.clusters[i].numreachabilityareas;
+		} //end if
+	} //end for
+	cache = AAS_AllocRoutingCache (maxtraveltimes);
+	goalareas = (int *) GetMemory (maxtraveltimes * sizeof (int));
+
+	for (i = 0; i < newtable.numtravelflags; i++)
+	{
+		//the area caches of all the clusters
+		for (j = 0; j < aasworld.numclusters; j++)
+		{
+			numtraveltimes = aasworld.clusters[j].numreachabilityareas;
+			//find the area for every cluster area number
+			Com_Memset (goalareas, 0, maxtraveltimes * sizeof (int));
+			for (k = 1; k < aasworld.numareas; k++)
+			{
+				clusternum = aasworld.areasettings[k].cluster;
+				if (clusternum < 0)
+				{
+					portal = &aasworld.portals[-clusternum];
+					if (portal->frontcluster != j && portal->backcluster != j) continue;
+				} //end if
+				else if (clusternum != j) continue;
+				n = AAS_ClusterAreaNum (j, k);
+				if (n < numtraveltimes) goalareas[n] = k;
+			} //end for
+			pad = AAS_RouteTableRecordSize (numtraveltimes) - numtraveltimes * 3;
+			for (k = 0; k < numtraveltimes; k++)
+			{
+				Com_Memset (cache->traveltimes, 0, numtraveltimes * sizeof (unsigned short int));
+				Com_Memset (cache->reachabilities, 0, numtraveltimes * sizeof (unsigned char));
+				if (goalareas[k])
+				{
+					cache->cluster = j;
+					cache->areanum = goalareas[k];
+					VectorCopy (aasworld.areas[goalareas[k]].center, cache->origin);
+					cache->starttraveltime = 1;
+					cache->travelflags = newtable.travelflags[i];
+					AAS_UpdateAreaRoutingCache (cache);
+				} //end if
+				botimport.FS_Write (cache->traveltimes, numtraveltimes * sizeof (unsigned short int), fp);
+				botimport.FS_Write (cache->reachabilities, numtraveltimes * sizeof (unsigned char), fp);
+				botimport.FS_Write (zeros, pad, fp);
+			} //end for
+		} //end for
+		//the portal caches of all the areas
+		for (k = 0; k < aasworld.numareas; k++)
+		{
+			Com_Memset (cache->traveltimes, 0, aasworld.numportals * sizeof (unsigned short int));
+			if (k)
+			{
+				cache->cluster = AAS_RouteTablePortalCluster (k);
+				cache->areanum = k;
+				VectorCopy (aasworld.areas[k].center, cache->origin);
+				cache->starttraveltime = 1;
+				cache->travelflags = newtable.travelflags[i];
+				AAS_UpdatePortalRoutingCache (cache);
+			} //end if
+			botimport.FS_Write (cache->traveltimes, aasworld.numportals * sizeof (unsigned short int), fp);
+		} //end for
+		n = aasworld.numareas * aasworld.numportals * sizeof (unsigned short int);
+		botimport.FS_Write (zeros, ((n + 3) & ~3) - n, fp);
+		//get rid of the area caches the portal routing created on the way
+		AAS_RemoveAllRoutingCache ();
+	} //end for
+
+	routingcachesize -= cache->size;
+	FreeMemory (cache);
+	FreeMemory (goalareas);
+	botimport.FS_FCloseFile (fp);
+
+	botimport.Print (PRT_MESSAGE, "route table written to %s in %d msec\n", filename, Sys_MilliSeconds () - starttime);
+	return AAS_LoadRouteTable ();
+} //end of the function AAS_WriteRouteTable
+//===========================================================================
+// loads the route table for the map or creates it when it's missing
+// and routetable is set to 2
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_InitRouteTable (void)
+{
+	int mode;
+
+	mode = (int) LibVarValue ("routetable", "1");
+	if (mode <= 0) return;
+	if (AAS_LoadRouteTable ()) return;
+	if (mode > 1) AAS_WriteRouteTable ();
+} //end of the function AAS_InitRouteTable
+//===========================================================================
 // Parameter:			-
 // Returns:				-
 // Changes Globals:		-
@@ -1200,6 +1735,8 @@ void AAS_InitRouting (void)
 	max_routingcachesize = 1024 * (int) LibVarValue ("max_routingcache", "4096");
 	// read any routing cache if available
 	AAS_ReadRouteCache ();
+	// load or create the precomputed route table
+	AAS_InitRouteTable ();
 } //end of the function AAS_InitRouting
 //===========================================================================
 // Parameter:			-
@@ -1212,6 +1749,9 @@ void AAS_FreeRoutingCaches (void)
 	AAS_FreeAllClusterAreaCache ();
 	// free all the existing portal cache
 	AAS_FreeAllPortalCache ();
+	// free the route table, the caches using it are gone
+	AAS_FreeRouteTable ();
+	aasworld.numusedtravelflags = 0;
 	// free cached travel times within areas
 	if (aasworld.areatraveltimes) FreeMemory (aasworld.areatraveltimes);
 	aasworld.areatraveltimes = NULL;
@@ -1226,6 +1766,10 @@ void AAS_FreeRoutingCaches (void)
 	aasworld.areaupdate = NULL;
 	if (aasworld.portalupdate) FreeMemory (aasworld.portalupdate);
 	aasworld.portalupdate = NULL;
+	if (aasworld.areaupdateheap) FreeMemory (aasworld.areaupdateheap);
+	aasworld.areaupdateheap = NULL;
+	if (aasworld.portalupdateheap) FreeMemory (aasworld.portalupdateheap);
+	aasworld.portalupdateheap = NULL;
 	// free lists with areas the reachabilities go through
 	if (aasworld.reachabilityareas) FreeMemory (aasworld.reachabilityareas);
 	aasworld.reachabilityareas = NULL;
@@ -1237,7 +1781,76 @@ void AAS_FreeRoutingCaches (void)
 	aasworld.areacontentstravelflags = NULL;
 } //end of the function AAS_FreeRoutingCaches
 //===========================================================================
+// adds the update to the heap or, if it's already in the heap, moves it
+// up after its travel time went down
+// Parameter:			heap			: update heap
+//						numnodes		: number of nodes in the heap
+//						updates			: the updates the heap nodes refer to
+//						updatenum		: number of the update to add or move
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_RoutingHeapUpdate (aas_routingheapnode_t *heap, int *numnodes, aas_routingupdate_t *updates, int updatenum)
+{
+	int i, parent;
+	aas_routingheapnode_t node;
+
+	node.tmptraveltime = updates[updatenum].tmptraveltime;
+	node.updatenum = updatenum;
+	//start at the current position or at the end of the heap
+	if (updates[updatenum].heapindex) i = updates[updatenum].heapindex - 1;
+	else i = (*numnodes)++;
+	//move the node up as long as the parent has a larger travel time
+	while (i > 0)
+	{
+		parent = (i - 1) >> 1;
+		if (heap[parent].tmptraveltime <= node.tmptraveltime) break;
+		heap[i] = heap[parent];
+		updates[heap[i].updatenum].heapindex = i + 1;
+		i = parent;
+	} //end while
+	heap[i] = node;
+	updates[updatenum].heapindex = i + 1;
+} //end of the function AAS_RoutingHeapUpdate
+//===========================================================================
+// removes the update with the smallest travel time from the heap
+// Parameter:			heap			: update heap
+//						numnodes		: number of nodes in the heap
+//						updates			: the updates the heap nodes refer to
+// Returns:				number of the removed update
+// Changes Globals:		-
+//===========================================================================
+int AAS_RoutingHeapPop (aas_routingheapnode_t *heap, int *numnodes, aas_routingupdate_t *updates)
+{
+	int i, child, updatenum;
+	aas_routingheapnode_t node;
+
+	updatenum = heap[0].updatenum;
+	updates[updatenum].heapindex = 0;
+	(*numnodes)--;
+	if (!*numnodes) return updatenum;
+	//move the last node down from the top
+	node = heap[*numnodes];
+	i = 0;
+	while (1)
+	{
+		child = (i << 1) + 1;
+		if (child >= *numnodes) break;
+		if (child + 1 < *numnodes &&
+			heap[child + 1].tmptraveltime < heap[child].tmptraveltime) child++;
+		if (node.tmptraveltime <= heap[child].tmptraveltime) break;
+		heap[i] = heap[child];
+		updates[heap[i].updatenum].heapindex = i + 1;
+		i = child;
+	} //end while
+	heap[i] = node;
+	updates[node.updatenum].heapindex = i + 1;
+	return updatenum;
+} //end of the function AAS_RoutingHeapPop
+//===========================================================================
 // update the given routing cache
+// the updates are kept in a heap sorted on travel time, the update with the
+// smallest travel time is always expanded first so no area is expanded twice
 // Parameter:			areacache		: routing cache to update
 // Returns:				-
 // Changes Globals:		-
@@ -1245,9 +1858,9 @@ void AAS_FreeRoutingCaches (void)
 void AAS_UpdateAreaRoutingCache (aas_routingcache_t *areacache)
 {
 	int i, nextareanum, cluster, badtravelflags, clusterareanum, linknum;
-	int numreachabilityareas;
+	int numreachabilityareas, numheapnodes;
 	unsigned short int t, startareatraveltimes[128]; //NOTE: not more than 128 reachabilities per area allowed
-	aas_routingupdate_t *updateliststart, *updatelistend, *curupdate, *nextupdate;
+	aas_routingupdate_t *curupdate, *nextupdate;
 	aas_reachability_t *reach;
 	aas_reversedreachability_t *revreach;
 	aas_reversedlink_t *revlink;
@@ -1260,8 +1873,6 @@ void AAS_UpdateAreaRoutingCache (aas_routingcache_t *areacache)
 
 	aasworld.frameroutingupdates++;
 
-	//clear the routing update fields
-	//	Com_Memset(aasworld.areaupdate, 0, aasworld.numareas * sizeof(aas_routingupdate_t));
 	badtravelflags = ~areacache->travelflags;
 	clusterareanum = AAS_ClusterAreaNum (areacache->cluster, areacache->areanum);
 	if (clusterareanum >= numreachabilityareas) return;
@@ -1270,26 +1881,20 @@ void AAS_UpdateAreaRoutingCache (aas_routingcache_t *areacache)
 
 	curupdate = &aasworld.areaupdate[clusterareanum];
 	curupdate->areanum = areacache->areanum;
-	//VectorCopy(areacache->origin, curupdate->start);
 	curupdate->areatraveltimes = startareatraveltimes;
 	curupdate->tmptraveltime = areacache->starttraveltime;
 
 	areacache->traveltimes[clusterareanum] = areacache->starttraveltime;
-	//put the area to start with in the current read list
-	curupdate->next = NULL;
-	curupdate->prev = NULL;
-	updateliststart = curupdate;
-	updatelistend = curupdate;
-	//while there are updates in the current list
-	while (updateliststart)
-	{
-		curupdate = updateliststart;
-
-		if (curupdate->next) curupdate->next->prev = NULL;
-		else updatelistend = NULL;
-		updateliststart = curupdate->next;
-
-		curupdate->inlist = qfalse;
+	//put the area to start with in the heap
+	numheapnodes = 0;
+	AAS_RoutingHeapUpdate (aasworld.areaupdateheap, &numheapnodes, aasworld.areaupdate, clusterareanum);
+	//while there are updates in the heap
+	while (numheapnodes)
+	{
+		//take the update with the smallest travel time, the travel time
+		//of this area can't go down anymore
+		curupdate = &aasworld.areaupdate[AAS_RoutingHeapPop (aasworld.areaupdateheap,
+			&numheapnodes, aasworld.areaupdate)];
 		//check all reversed reachability links
 		revreach = &aasworld.reversedreachability[curupdate->areanum];
 
@@ -1315,7 +1920,6 @@ void AAS_UpdateAreaRoutingCache (aas_routingcache_t *areacache)
 			//time already travelled plus the traveltime through
 			//the current area plus the travel time from the reachability
 			t = curupdate->tmptraveltime +
-				//AAS_AreaTravelTime(curupdate->areanum, curupdate->start, reach->end) +
 				curupdate->areatraveltimes[i] +
 				reach->traveltime;
 
@@ -1327,21 +1931,10 @@ void AAS_UpdateAreaRoutingCache (aas_routingcache_t *areacache)
 				nextupdate = &aasworld.areaupdate[clusterareanum];
 				nextupdate->areanum = nextareanum;
 				nextupdate->tmptraveltime = t;
-				//VectorCopy(reach->start, nextupdate->start);
 				nextupdate->areatraveltimes = aasworld.areatraveltimes[nextareanum][linknum -
 					aasworld.areasettings[nextareanum].firstreachablearea];
-				if (!nextupdate->inlist)
-				{
-					// we add the update to the end of the list
-					// we could also use a B+ tree to have a real sorted list
-					// on travel time which makes for faster routing updates
-					nextupdate->next = NULL;
-					nextupdate->prev = updatelistend;
-					if (updatelistend) updatelistend->next = nextupdate;
-					else updateliststart = nextupdate;
-					updatelistend = nextupdate;
-					nextupdate->inlist = qtrue;
-				} //end if
+				//add the update to the heap or move it up
+				AAS_RoutingHeapUpdate (aasworld.areaupdateheap, &numheapnodes, aasworld.areaupdate, clusterareanum);
 			} //end if
 		} //end for
 	} //end while
@@ -1369,7 +1962,9 @@ aas_routingcache_t *AAS_GetAreaRoutingCache (int clusternum, int areanum, int tr
 	//if there was no cache
 	if (!cache)
 	{
-		cache = AAS_AllocRoutingCache (aasworld.clusters[clusternum].numreachabilityareas);
+		//take the travel times from the route table if they're in there
+		cache = AAS_RouteTableCache (clusternum, areanum, travelflags, qfalse);
+		if (!cache) cache = AAS_AllocRoutingCache (aasworld.clusters[clusternum].numreachabilityareas);
 		cache->cluster = clusternum;
 		cache->areanum = areanum;
 		VectorCopy (aasworld.areas[areanum].center, cache->origin);
@@ -1379,7 +1974,7 @@ aas_routingcache_t *AAS_GetAreaRoutingCache (int clusternum, int areanum, int tr
 		cache->next = clustercache;
 		if (clustercache) clustercache->prev = cache;
 		aasworld.clusterareacache[clusternum][clusterareanum] = cache;
-		AAS_UpdateAreaRoutingCache (cache);
+		if (!cache->intable) AAS_UpdateAreaRoutingCache (cache);
 	} //end if
 	else
 	{
@@ -1392,25 +1987,25 @@ aas_routingcache_t *AAS_GetAreaRoutingCache (int clusternum, int areanum, int tr
 	return cache;
 } //end of the function AAS_GetAreaRoutingCache
 //===========================================================================
-// Parameter:			-
+// update the given portal routing cache
+// just like the area routing the portal updates are kept in a heap sorted
+// on travel time
+// Parameter:			portalcache		: routing cache to update
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
 void AAS_UpdatePortalRoutingCache (aas_routingcache_t *portalcache)
 {
-	int i, portalnum, clusterareanum, clusternum;
+	int i, portalnum, clusterareanum, clusternum, numheapnodes;
 	unsigned short int t;
 	aas_portal_t *portal;
 	aas_cluster_t *cluster;
 	aas_routingcache_t *cache;
-	aas_routingupdate_t *updateliststart, *updatelistend, *curupdate, *nextupdate;
+	aas_routingupdate_t *curupdate, *nextupdate;
 
 #ifdef ROUTING_DEBUG
 	numportalcacheupdates++;
 #endif //ROUTING_DEBUG
-	//clear the routing update fields
-	//	Com_Memset(aasworld.portalupdate, 0, (aasworld.numportals+1) * sizeof(aas_routingupdate_t));
-
 	curupdate = &aasworld.portalupdate[aasworld.numportals];
 	curupdate->cluster = portalcache->cluster;
 	curupdate->areanum = portalcache->areanum;
@@ -1421,21 +2016,15 @@ void AAS_UpdatePortalRoutingCache (aas_routingcache_t *portalcache)
 	{
 		portalcache->traveltimes[-clusternum] = portalcache->starttraveltime;
 	} //end if
-	//put the area to start with in the current read list
-	curupdate->next = NULL;
-	curupdate->prev = NULL;
-	updateliststart = curupdate;
-	updatelistend = curupdate;
-	//while there are updates in the current list
-	while (updateliststart)
+	//put the area to start with in the heap
+	numheapnodes = 0;
+	AAS_RoutingHeapUpdate (aasworld.portalupdateheap, &numheapnodes, aasworld.portalupdate, aasworld.numportals);
+	//while there are updates in the heap
+	while (numheapnodes)
 	{
-		curupdate = updateliststart;
-		//remove the current update from the list
-		if (curupdate->next) curupdate->next->prev = NULL;
-		else updatelistend = NULL;
-		updateliststart = curupdate->next;
-		//current update is removed from the list
-		curupdate->inlist = qfalse;
+		//take the update with the smallest travel time
+		curupdate = &aasworld.portalupdate[AAS_RoutingHeapPop (aasworld.portalupdateheap,
+			&numheapnodes, aasworld.portalupdate)];
 
 		cluster = &aasworld.clusters[curupdate->cluster];
 
@@ -1472,18 +2061,8 @@ void AAS_UpdatePortalRoutingCache (aas_routingcache_t *portalcache)
 				nextupdate->areanum = portal->areanum;
 				//add travel time through the actual portal area for the next update
 				nextupdate->tmptraveltime = t + aasworld.portalmaxtraveltimes[portalnum];
-				if (!nextupdate->inlist)
-				{
-					// we add the update to the end of the list
-					// we could also use a B+ tree to have a real sorted list
-					// on travel time which makes for faster routing updates
-					nextupdate->next = NULL;
-					nextupdate->prev = updatelistend;
-					if (updatelistend) updatelistend->next = nextupdate;
-					else updateliststart = nextupdate;
-					updatelistend = nextupdate;
-					nextupdate->inlist = qtrue;
-				} //end if
+				//add the update to the heap or move it up
+				AAS_RoutingHeapUpdate (aasworld.portalupdateheap, &numheapnodes, aasworld.portalupdate, portalnum);
 			} //end if
 		} //end for
 	} //end while
@@ -1505,7 +2084,9 @@ aas_routingcache_t *AAS_GetPortalRoutingCache (int clusternum, int areanum, int
 	//if the portal routing isn't cached
 	if (!cache)
 	{
-		cache = AAS_AllocRoutingCache (aasworld.numportals);
+		//take the travel times from the route table if they're in there
+		cache = AAS_RouteTableCache (clusternum, areanum, travelflags, qtrue);
+		if (!cache) cache = AAS_AllocRoutingCache (aasworld.numportals);
 		cache->cluster = clusternum;
 		cache->areanum = areanum;
 		VectorCopy (aasworld.areas[areanum].center, cache->origin);
@@ -1517,7 +2098,7 @@ aas_routingcache_t *AAS_GetPortalRoutingCache (int clusternum, int areanum, int
 		if (aasworld.portalcache[areanum]) aasworld.portalcache[areanum]->prev = cache;
 		aasworld.portalcache[areanum] = cache;
 		//update the cache
-		AAS_UpdatePortalRoutingCache (cache);
+		if (!cache->intable) AAS_UpdatePortalRoutingCache (cache);
 	} //end if
 	else
 	{
@@ -1530,6 +2111,361 @@ aas_routingcache_t *AAS_GetPortalRoutingCache (int clusternum, int areanum, int
 	return cache;
 } //end of the function AAS_GetPortalRoutingCache
 //===========================================================================
+// update the given routing cache with a FIFO list of updates
+// this is how the routing caches were updated before the update heap,
+// it's only kept around to compare against in the routing benchmark
+// Parameter:			areacache		: routing cache to update
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_UpdateAreaRoutingCacheFIFO (aas_routingcache_t *areacache)
+{
+	int i, nextareanum, cluster, badtravelflags, clusterareanum, linknum;
+	int numreachabilityareas;
+	unsigned short int t, startareatraveltimes[128]; //NOTE: not more than 128 reachabilities per area allowed
+	aas_routingupdate_t *updateliststart, *updatelistend, *curupdate, *nextupdate;
+	aas_reachability_t *reach;
+	aas_reversedreachability_t *revreach;
+	aas_reversedlink_t *revlink;
+
+	//number of reachability areas within this cluster
+	numreachabilityareas = aasworld.clusters[areacache->cluster].numreachabilityareas;
+
+	aasworld.frameroutingupdates++;
+
+	//clear the routing update fields
+	//	Com_Memset(aasworld.areaupdate, 0, aasworld.numareas * sizeof(aas_routingupdate_t));
+	badtravelflags = ~areacache->travelflags;
+	clusterareanum = AAS_ClusterAreaNum (areacache->cluster, areacache->areanum);
+	if (clusterareanum >= numreachabilityareas) return;
+
+	Com_Memset (startareatraveltimes, 0, sizeof (startareatraveltimes));
+
+	curupdate = &aasworld.areaupdate[clusterareanum];
+	curupdate->areanum = areacache->areanum;
+	//VectorCopy(areacache->origin, curupdate->start);
+	curupdate->areatraveltimes = startareatraveltimes;
+	curupdate->tmptraveltime = areacache->starttraveltime;
+
+	areacache->traveltimes[clusterareanum] = areacache->starttraveltime;
+	//put the area to start with in the current read list
+	curupdate->next = NULL;
+	curupdate->prev = NULL;
+	updateliststart = curupdate;
+	updatelistend = curupdate;
+	//while there are updates in the current list
+	while (updateliststart)
+	{
+		curupdate = updateliststart;
+
+		if (curupdate->next) curupdate->next->prev = NULL;
+		else updatelistend = NULL;
+		updateliststart = curupdate->next;
+
+		curupdate->inlist = qfalse;
+		//check all reversed reachability links
+		revreach = &aasworld.reversedreachability[curupdate->areanum];
+
+		for (i = 0, revlink = revreach->first; revlink; revlink = revlink->next, i++)
+		{
+			linknum = revlink->linknum;
+			reach = &aasworld.reachability[linknum];
+			//if there is used an undesired travel type
+			if (AAS_TravelFlagForType_inline (reach->traveltype) & badtravelflags) continue;
+			//if not allowed to enter the next area
+			if (aasworld.areasettings[reach->areanum].areaflags & AREA_DISABLED) continue;
+			//if the next area has a not allowed travel flag
+			if (AAS_AreaContentsTravelFlags_inline (reach->areanum) & badtravelflags) continue;
+			//number of the area the reversed reachability leads to
+			nextareanum = revlink->areanum;
+			//get the cluster number of the area
+			cluster = aasworld.areasettings[nextareanum].cluster;
+			//don't leave the cluster
+			if (cluster > 0 && cluster != areacache->cluster) continue;
+			//get the number of the area in the cluster
+			clusterareanum = AAS_ClusterAreaNum (areacache->cluster, nextareanum);
+			if (clusterareanum >= numreachabilityareas) continue;
+			//time already travelled plus the traveltime through
+			//the current area plus the travel time from the reachability
+			t = curupdate->tmptraveltime +
+				//AAS_AreaTravelTime(curupdate->areanum, curupdate->start, reach->end) +
+				curupdate->areatraveltimes[i] +
+				reach->traveltime;
+
+			if (!areacache->traveltimes[clusterareanum] ||
+				areacache->traveltimes[clusterareanum] > t)
+			{
+				areacache->traveltimes[clusterareanum] = t;
+				areacache->reachabilities[clusterareanum] = linknum - aasworld.areasettings[nextareanum].firstreachablearea;
+				nextupdate = &aasworld.areaupdate[clusterareanum];
+				nextupdate->areanum = nextareanum;
+				nextupdate->tmptraveltime = t;
+				//VectorCopy(reach->start, nextupdate->start);
+				nextupdate->areatraveltimes = aasworld.areatraveltimes[nextareanum][linknum -
+					aasworld.areasettings[nextareanum].firstreachablearea];
+				if (!nextupdate->inlist)
+				{
+					// we add the update to the end of the list
+					// we could also use a B+ tree to have a real sorted list
+					// on travel time which makes for faster routing updates
+					nextupdate->next = NULL;
+					nextupdate->prev = updatelistend;
+					if (updatelistend) updatelistend->next = nextupdate;
+					else updateliststart = nextupdate;
+					updatelistend = nextupdate;
+					nextupdate->inlist = qtrue;
+				} //end if
+			} //end if
+		} //end for
+	} //end while
+} //end of the function AAS_UpdateAreaRoutingCacheFIFO
+//===========================================================================
+// update the given portal routing cache with a FIFO list of updates
+// only used in the routing benchmark
+// Parameter:			portalcache		: routing cache to update
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_UpdatePortalRoutingCacheFIFO (aas_routingcache_t *portalcache)
+{
+	int i, portalnum, clusterareanum, clusternum;
+	unsigned short int t;
+	aas_portal_t *portal;
+	aas_cluster_t *cluster;
+	aas_routingcache_t *cache;
+	aas_routingupdate_t *updateliststart, *updatelistend, *curupdate, *nextupdate;
+
+	//clear the routing update fields
+	//	Com_Memset(aasworld.portalupdate, 0, (aasworld.numportals+1) * sizeof(aas_routingupdate_t));
+
+	curupdate = &aasworld.portalupdate[aasworld.numportals];
+	curupdate->cluster = portalcache->cluster;
+	curupdate->areanum = portalcache->areanum;
+	curupdate->tmptraveltime = portalcache->starttraveltime;
+	//if the start area is a cluster portal, store the travel time for that portal
+	clusternum = aasworld.areasettings[portalcache->areanum].cluster;
+	if (clusternum < 0)
+	{
+		portalcache->traveltimes[-clusternum] = portalcache->starttraveltime;
+	} //end if
+	//put the area to start with in the current read list
+	curupdate->next = NULL;
+	curupdate->prev = NULL;
+	updateliststart = curupdate;
+	updatelistend = curupdate;
+	//while there are updates in the current list
+	while (updateliststart)
+	{
+		curupdate = updateliststart;
+		//remove the current update from the list
+		if (curupdate->next) curupdate->next->prev = NULL;
+		else updatelistend = NULL;
+		updateliststart = curupdate->next;
+		//current update is removed from the list
+		curupdate->inlist = qfalse;
+
+		cluster = &aasworld.clusters[curupdate->cluster];
+
+		cache = AAS_GetAreaRoutingCache (curupdate->cluster,
+			curupdate->areanum, portalcache->travelflags);
+		//take all portals of the cluster
+		for (i = 0; i < cluster->numportals; i++)
+		{
+			portalnum = aasworld.portalindex[cluster->firstportal + i];
+			portal = &aasworld.portals[portalnum];
+			//if this is the portal of the current update continue
+			if (portal->areanum == curupdate->areanum) continue;
+
+			clusterareanum = AAS_ClusterAreaNum (curupdate->cluster, portal->areanum);
+			if (clusterareanum >= cluster->numreachabilityareas) continue;
+
+			t = cache->traveltimes[clusterareanum];
+			if (!t) continue;
+			t += curupdate->tmptraveltime;
+
+			if (!portalcache->traveltimes[portalnum] ||
+				portalcache->traveltimes[portalnum] > t)
+			{
+				portalcache->traveltimes[portalnum] = t;
+				nextupdate = &aasworld.portalupdate[portalnum];
+				if (portal->frontcluster == curupdate->cluster)
+				{
+					nextupdate->cluster = portal->backcluster;
+				} //end if
+				else
+				{
+					nextupdate->cluster = portal->frontcluster;
+				} //end else
+				nextupdate->areanum = portal->areanum;
+				//add travel time through the actual portal area for the next update
+				nextupdate->tmptraveltime = t + aasworld.portalmaxtraveltimes[portalnum];
+				if (!nextupdate->inlist)
+				{
+					// we add the update to the end of the list
+					// we could also use a B+ tree to have a real sorted list
+					// on travel time which makes for faster routing updates
+					nextupdate->next = NULL;
+					nextupdate->prev = updatelistend;
+					if (updatelistend) updatelistend->next = nextupdate;
+					else updateliststart = nextupdate;
+					updatelistend = nextupdate;
+					nextupdate->inlist = qtrue;
+				} //end if
+			} //end if
+		} //end for
+	} //end while
+} //end of the function AAS_UpdatePortalRoutingCacheFIFO
+//===========================================================================
+// returns the cluster to create a routing cache for in the benchmark
+// portal areas have an area routing cache in both the front and back cluster
+// Parameter:			areanum			: goal area
+//						side			: 0 or 1 for the front or back cluster of a portal
+//						portals			: true for the portal routing cache
+// Returns:				cluster number or 0 if there's no cache for this side
+// Changes Globals:		-
+//===========================================================================
+int AAS_RoutingBenchmarkCluster (int areanum, int side, int portals)
+{
+	int clusternum;
+	aas_portal_t *portal;
+
+	clusternum = aasworld.areasettings[areanum].cluster;
+	if (clusternum > 0)
+	{
+		if (side) return 0;
+		return clusternum;
+	} //end if
+	portal = &aasworld.portals[-clusternum];
+	//the portal routing cache of a portal uses the front cluster
+	if (!side) return portal->frontcluster;
+	if (portals || portal->backcluster == portal->frontcluster) return 0;
+	return portal->backcluster;
+} //end of the function AAS_RoutingBenchmarkCluster
+//===========================================================================
+// computes the area routing cache of every area in every cluster or the
+// portal routing cache of every area, together they hold the travel times
+// between all pairs of areas
+// the updates are first done with both methods to compare the results
+// and then timed one method at a time
+// Parameter:			portals			: true for the portal routing caches
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_RoutingBenchmarkCaches (int portals)
+{
+	int i, j, side, pass, clusternum, numtraveltimes, maxtraveltimes, starttime;
+	int numcaches, numdiff, numshorter[2], maxdiff, numreachdiff, msec[2];
+	unsigned short int t[2];
+	aas_routingcache_t *cache[2];
+
+	//scratch caches large enough for any cluster or the portals
+	maxtraveltimes = aasworld.numportals;
+	for (i = 0; i < aasworld.numclusters; i++)
+	{
+		if (aasworld.clusters[i].numreachabilityareas > maxtraveltimes)
+		{
+			maxtraveltimes = aasworld.clusters[i].numreachabilityareas;
+		} //end if
+	} //end for
+	cache[0] = AAS_AllocRoutingCache (maxtraveltimes);
+	cache[1] = AAS_AllocRoutingCache (maxtraveltimes);
+
+	numcaches = 0;
+	numtraveltimes = 0;
+	numdiff = 0;
+	numshorter[0] = numshorter[1] = 0;
+	maxdiff = 0;
+	numreachdiff = 0;
+	msec[0] = msec[1] = 0;
+	//pass 0 compares, pass 1 times the FIFO list, pass 2 times the heap
+	for (pass = 0; pass < 3; pass++)
+	{
+		starttime = Sys_MilliSeconds ();
+		for (i = 1; i < aasworld.numareas; i++)
+		{
+			for (side = 0; side < 2; side++)
+			{
+				clusternum = AAS_RoutingBenchmarkCluster (i, side, portals);
+				if (!clusternum) continue;
+
+				if (portals) numtraveltimes = aasworld.numportals;
+				else numtraveltimes = aasworld.clusters[clusternum].numreachabilityareas;
+
+				for (j = 0; j < 2; j++)
+				{
+					if (pass && pass != j + 1) continue;
+					Com_Memset (cache[j]->traveltimes, 0, numtraveltimes * sizeof (unsigned short int));
+					Com_Memset (cache[j]->reachabilities, 0, numtraveltimes * sizeof (unsigned char));
+					cache[j]->cluster = clusternum;
+					cache[j]->areanum = i;
+					VectorCopy (aasworld.areas[i].center, cache[j]->origin);
+					cache[j]->starttraveltime = 1;
+					cache[j]->travelflags = TFL_DEFAULT;
+					if (portals)
+					{
+						if (j) AAS_UpdatePortalRoutingCache (cache[j]);
+						else AAS_UpdatePortalRoutingCacheFIFO (cache[j]);
+					} //end if
+					else
+					{
+						if (j) AAS_UpdateAreaRoutingCache (cache[j]);
+						else AAS_UpdateAreaRoutingCacheFIFO (cache[j]);
+					} //end else
+				} //end for
+				if (pass) continue;
+
+				numcaches++;
+				for (j = 0; j < numtraveltimes; j++)
+				{
+					t[0] = cache[0]->traveltimes[j];
+					t[1] = cache[1]->traveltimes[j];
+					if (t[0] == t[1])
+					{
+						if (t[0] && cache[0]->reachabilities[j] != cache[1]->reachabilities[j]) numreachdiff++;
+						continue;
+					} //end if
+					numdiff++;
+					//zero means the goal can't be reached at all
+					if (!t[0] || (t[1] && t[1] < t[0])) numshorter[1]++;
+					else numshorter[0]++;
+					if (t[0] && t[1] && abs (t[0] - t[1]) > maxdiff) maxdiff = abs (t[0] - t[1]);
+				} //end for
+			} //end for
+		} //end for
+		if (pass) msec[pass - 1] = Sys_MilliSeconds () - starttime;
+	} //end for
+
+	routingcachesize -= cache[0]->size + cache[1]->size;
+	FreeMemory (cache[0]);
+	FreeMemory (cache[1]);
+
+	botimport.Print (PRT_MESSAGE, "%d %s routing caches\n", numcaches, portals ? "portal" : "area");
+	botimport.Print (PRT_MESSAGE, "  FIFO list %d msec, heap %d msec\n", msec[0], msec[1]);
+	botimport.Print (PRT_MESSAGE, "  %d travel times differ, %d shorter with the heap, %d shorter with the FIFO list\n",
+		numdiff, numshorter[1], numshorter[0]);
+	botimport.Print (PRT_MESSAGE, "  max travel time difference %d\n", maxdiff);
+	botimport.Print (PRT_MESSAGE, "  %d equal travel times with a different reachability\n", numreachdiff);
+} //end of the function AAS_RoutingBenchmarkCaches
+//===========================================================================
+// compares the heap and FIFO list routing updates on the loaded map
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_RoutingBenchmark (void)
+{
+	if (!aasworld.initialized)
+	{
+		botimport.Print (PRT_ERROR, "AAS_RoutingBenchmark: AAS not initialized\n");
+		return;
+	} //end if
+	botimport.Print (PRT_MESSAGE, "routing benchmark on %d areas, %d clusters, %d portals\n",
+		aasworld.numareas, aasworld.numclusters, aasworld.numportals);
+	AAS_RoutingBenchmarkCaches (qfalse);
+	//the portal routing uses the area routing caches that are created on the way
+	AAS_RoutingBenchmarkCaches (qtrue);
+} //end of the function AAS_RoutingBenchmark
+//===========================================================================
 // Parameter:			-
 // Returns:				-
 // Changes Globals:		-
@@ -1578,6 +2514,8 @@ int AAS_AreaRouteToGoalArea (int areanum, vec3_t origin, int goalareanum, int tr
 	{
 		travelflags |= TFL_DONOTENTER;
 	} //end if
+	//remember the travel flags for the route table
+	AAS_RouteTableUseTravelFlags (travelflags);
 	//NOTE: the number of routing updates is limited per frame
 	/*
 	if (aasworld.frameroutingupdates > MAX_FRAMEROUTINGUPDATES)
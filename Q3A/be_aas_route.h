@@ -39,6 +39,10 @@ unsigned short int AAS_AreaTravelTime (int areanum, vec3_t start, vec3_t end);
 void AAS_CreateAllRoutingCache (void);
 void AAS_WriteRouteCache (void);
 void AAS_RoutingInfo (void);
+//compares the heap and FIFO list routing updates on the loaded map
+void AAS_RoutingBenchmark (void);
+//computes all the routing caches and writes them to the route table file
+int AAS_WriteRouteTable (void);
 #endif //AASINTERN
 
 //returns the travel flag for the given travel type
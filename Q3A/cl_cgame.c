@@ -526,7 +526,9 @@ int CL_CgameSystemCalls (int *args)
 		SCR_UpdateScreen ();
 		return 0;
 	case CG_CM_LOADMAP:
+		Com_BeginLoadStage ("collision map");
 		CL_CM_LoadMap (VMA (1));
+		Com_EndLoadStage ();
 		return 0;
 	case CG_CM_NUMINLINEMODELS:
 		return CM_NumInlineModels ();
@@ -579,21 +581,57 @@ int CL_CgameSystemCalls (int *args)
 		S_Respatialize (args[1], VMA (2), VMA (3), args[4]);
 		return 0;
 	case CG_S_REGISTERSOUND:
-		return S_RegisterSound (VMA (1), args[2]);
+	{
+		int		start, h;
+
+		start = Sys_Microseconds ();
+		h = S_RegisterSound (VMA (1), args[2]);
+		Com_AddLoadTime ("sound registration", Sys_Microseconds () - start);
+		return h;
+	}
 	case CG_S_STARTBACKGROUNDTRACK:
 		S_StartBackgroundTrack (VMA (1), VMA (2));
 		return 0;
 	case CG_R_LOADWORLDMAP:
+		Com_BeginLoadStage ("renderer world");
 		re.LoadWorld (VMA (1));
+		Com_EndLoadStage ();
 		return 0;
 	case CG_R_REGISTERMODEL:
-		return re.RegisterModel (VMA (1));
+	{
+		int		start, h;
+
+		start = Sys_Microseconds ();
+		h = re.RegisterModel (VMA (1));
+		Com_AddLoadTime ("model registration", Sys_Microseconds () - start);
+		return h;
+	}
 	case CG_R_REGISTERSKIN:
-		return re.RegisterSkin (VMA (1));
+	{
+		int		start, h;
+
+		start = Sys_Microseconds ();
+		h = re.RegisterSkin (VMA (1));
+		Com_AddLoadTime ("skin registration", Sys_Microseconds () - start);
+		return h;
+	}
 	case CG_R_REGISTERSHADER:
-		return re.RegisterShader (VMA (1));
 	case CG_R_REGISTERSHADERNOMIP:
-		return re.RegisterShaderNoMip (VMA (1));
+	{
+		int		start, h;
+
+		start = Sys_Microseconds ();
+		if (args[0] == CG_R_REGISTERSHADER)
+		{
+			h = re.RegisterShader (VMA (1));
+		}
+		else
+		{
+			h = re.RegisterShaderNoMip (VMA (1));
+		}
+		Com_AddLoadTime ("shader registration", Sys_Microseconds () - start);
+		return h;
+	}
 	case CG_R_REGISTERFONT:
 		re.RegisterFont (VMA (1), args[2], VMA (3));
 	case CG_R_CLEARSCENE:
@@ -768,6 +806,13 @@ void CL_InitCGame (void)
 
 	t1 = Sys_Milliseconds ();
 
+	// a local server already started the stages for this map
+	if (!com_sv_running->integer)
+	{
+		Com_ClearLoadStages ();
+	}
+	Com_BeginLoadStage ("cgame init");
+
 	// put away the console
 	Con_Close ();
 
@@ -796,6 +841,8 @@ void CL_InitCGame (void)
 
 	t2 = Sys_Milliseconds ();
 
+	Com_EndLoadStage ();
+
 	Com_Printf ("CL_InitCGame: %5.2f seconds\n", (t2 - t1) / 1000.0);
 
 	// have the renderer touch all its images, so they are present
@@ -1098,6 +1145,10 @@ void CL_SetCGameTime (void)
 		if (!clc.timeDemoStart)
 		{
 			clc.timeDemoStart = Sys_Milliseconds ();
+
+			// start the renderer's frame times with the first timed frame
+			if (Cvar_VariableValue ("r_frameTimes"))
+				Cmd_ExecuteString ("frametimes reset");
 		}
 		clc.timeDemoFrames++;
 		cl.serverTime = clc.timeDemoBaseTime + clc.timeDemoFrames * 50;
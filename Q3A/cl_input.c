@@ -794,13 +794,14 @@ During normal gameplay, a client packet will contain something like:
 void CL_WritePacket (void)
 {
 	msg_t		buf;
-	byte		data[MAX_MSGLEN];
+	byte		*data;
 	int			i, j;
 	usercmd_t	*cmd, *oldcmd;
 	usercmd_t	nullcmd;
 	int			packetNum;
 	int			oldPacketNum;
 	int			count, key;
+	frameMark_t	mark;
 
 	// don't send anything if playing back a demo
 	if (clc.demoplaying || cls.state == CA_CINEMATIC)
@@ -811,7 +812,10 @@ void CL_WritePacket (void)
 	Com_Memset (&nullcmd, 0, sizeof (nullcmd));
 	oldcmd = &nullcmd;
 
-	MSG_Init (&buf, data, sizeof (data));
+	mark = Frame_Mark ();
+	data = Frame_Alloc (MAX_MSGLEN);
+
+	MSG_Init (&buf, data, MAX_MSGLEN);
 
 	MSG_Bitstream (&buf);
 	// write the current serverId so the server
@@ -913,6 +917,8 @@ void CL_WritePacket (void)
 		Com_DPrintf ("WARNING: #462 unsent fragments (not supposed to happen!)\n");
 		CL_Netchan_TransmitNextFragment (&clc.netchan);
 	}
+
+	Frame_Release (mark);
 }
 
 /*
@@ -433,6 +433,9 @@ void CL_DemoCompleted (void)
 			Com_Printf ("%i frames, %3.1f seconds: %3.1f fps\n", clc.timeDemoFrames,
 				time / 1000.0, clc.timeDemoFrames*1000.0 / time);
 		}
+
+		if (Cvar_VariableValue ("r_frameTimes"))
+			Cmd_ExecuteString ("frametimes");
 	}
 
 	CL_Disconnect (qtrue);
@@ -1445,6 +1448,58 @@ void CL_Clientinfo_f (void)
 }
 
 
+/*
+==============
+CL_DeltaBench_f
+
+Runs the delta encoding conformance check and benchmark on the entity and
+player states received most recently, typically from a demo
+==============
+*/
+void CL_DeltaBench_f (void)
+{
+	static playerState_t	players[PACKET_BACKUP];
+	entityState_t			*states;
+	clSnapshot_t			*snap;
+	int						numStates, numPlayers;
+	int						first, i;
+
+	if (cls.state < CA_PRIMED)
+	{
+		Com_Printf ("Not connected or playing a demo.\n");
+		return;
+	}
+
+	// the parse buffer is a ring, so copy it out oldest first
+	first = cl.parseEntitiesNum - MAX_PARSE_ENTITIES;
+	if (first < 0)
+	{
+		first = 0;
+	}
+	numStates = cl.parseEntitiesNum - first;
+
+	states = Z_Malloc (numStates * sizeof (*states) + 1);
+	for (i = 0; i < numStates; i++)
+	{
+		states[i] = cl.parseEntities[(first + i) & (MAX_PARSE_ENTITIES - 1)];
+	}
+
+	numPlayers = 0;
+	for (i = cl.snap.messageNum - PACKET_BACKUP + 1; i <= cl.snap.messageNum; i++)
+	{
+		snap = &cl.snapshots[i & PACKET_MASK];
+		if (snap->valid && snap->messageNum == i)
+		{
+			players[numPlayers++] = snap->ps;
+		}
+	}
+
+	MSG_DeltaBench (states, numStates, players, numPlayers);
+
+	Z_Free (states);
+}
+
+
 //====================================================================
 
 /*
@@ -2430,6 +2485,7 @@ void CL_InitRef (void)
 	ri.Printf = CL_RefPrintf;
 	ri.Error = Com_Error;
 	ri.Milliseconds = CL_ScaledMilliseconds;
+	ri.Microseconds = Sys_Microseconds;
 	ri.Malloc = CL_RefMalloc;
 	ri.Free = Z_Free;
 	ri.Hunk_Alloc = Hunk_Alloc;
@@ -2455,6 +2511,14 @@ void CL_InitRef (void)
 	ri.CIN_PlayCinematic = CIN_PlayCinematic;
 	ri.CIN_RunCinematic = CIN_RunCinematic;
 
+	ri.BeginLoadStage = Com_BeginLoadStage;
+	ri.EndLoadStage = Com_EndLoadStage;
+	ri.ThreadCount = Sys_ThreadCount;
+	ri.RunJobs = Sys_RunJobs;
+	ri.FrameAlloc = Frame_Alloc;
+	ri.FrameMark = Frame_Mark;
+	ri.FrameRelease = Frame_Release;
+
 	ret = GetRefAPI (REF_API_VERSION, &ri);
 
 #if defined __USEA3D && defined __A3D_GEOM
@@ -2609,6 +2673,7 @@ void CL_Init (void)
 	Cmd_AddCommand ("cmd", CL_ForwardToServer_f);
 	Cmd_AddCommand ("configstrings", CL_Configstrings_f);
 	Cmd_AddCommand ("clientinfo", CL_Clientinfo_f);
+	Cmd_AddCommand ("deltabench", CL_DeltaBench_f);
 	Cmd_AddCommand ("snd_restart", CL_Snd_Restart_f);
 	Cmd_AddCommand ("vid_restart", CL_Vid_Restart_f);
 	Cmd_AddCommand ("disconnect", CL_Disconnect_f);
@@ -2685,6 +2750,7 @@ void CL_Shutdown (void)
 	Cmd_RemoveCommand ("serverstatus");
 	Cmd_RemoveCommand ("showip");
 	Cmd_RemoveCommand ("model");
+	Cmd_RemoveCommand ("deltabench");
 
 	Cvar_Set ("cl_running", "0");
 
@@ -42,7 +42,8 @@ void SetPlaneSignbits (cplane_t *out) {
 #endif //BSPC
 
 // to allow boxes to be treated as brush models, we allocate
-// some extra indexes along with those needed by the map
+// some extra indexes along with those needed by the map, one
+// box for each thread that can trace
 #define	BOX_BRUSHES		1
 #define	BOX_SIDES		6
 #define	BOX_LEAFS		2
@@ -52,8 +53,6 @@ void SetPlaneSignbits (cplane_t *out) {
 
 
 clipMap_t	cm;
-int			c_pointcontents;
-int			c_traces, c_brush_traces, c_patch_traces;
 
 
 byte		*cmod_base;
@@ -62,15 +61,11 @@ byte		*cmod_base;
 cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
+cvar_t		*cm_flatLeafs;
 #endif
 
-cmodel_t	box_model;
-cplane_t	*box_planes;
-cbrush_t	*box_brush;
-
-
-
 void	CM_InitBoxHull (void);
+void	CM_InitThreads (void);
 void	CM_FloodAreaConnections (void);
 
 
@@ -254,7 +249,7 @@ void CMod_LoadBrushes (lump_t *l)
 	}
 	count = l->filelen / sizeof (*in);
 
-	cm.brushes = Hunk_Alloc ((BOX_BRUSHES + count) * sizeof (*cm.brushes), h_high);
+	cm.brushes = Hunk_Alloc ((BOX_BRUSHES * cm.numThreads + count) * sizeof (*cm.brushes), h_high);
 	cm.numBrushes = count;
 
 	out = cm.brushes;
@@ -339,7 +334,7 @@ void CMod_LoadPlanes (lump_t *l)
 
 	if (count < 1)
 		Com_Error (ERR_DROP, "Map with no planes");
-	cm.planes = Hunk_Alloc ((BOX_PLANES + count) * sizeof (*cm.planes), h_high);
+	cm.planes = Hunk_Alloc ((BOX_PLANES * cm.numThreads + count) * sizeof (*cm.planes), h_high);
 	cm.numPlanes = count;
 
 	out = cm.planes;
@@ -377,7 +372,7 @@ void CMod_LoadLeafBrushes (lump_t *l)
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 	count = l->filelen / sizeof (*in);
 
-	cm.leafbrushes = Hunk_Alloc ((count + BOX_BRUSHES) * sizeof (*cm.leafbrushes), h_high);
+	cm.leafbrushes = Hunk_Alloc ((count + BOX_BRUSHES * cm.numThreads) * sizeof (*cm.leafbrushes), h_high);
 	cm.numLeafBrushes = count;
 
 	out = cm.leafbrushes;
@@ -436,7 +431,7 @@ void CMod_LoadBrushSides (lump_t *l)
 	}
 	count = l->filelen / sizeof (*in);
 
-	cm.brushsides = Hunk_Alloc ((BOX_SIDES + count) * sizeof (*cm.brushsides), h_high);
+	cm.brushsides = Hunk_Alloc ((BOX_SIDES * cm.numThreads + count) * sizeof (*cm.brushsides), h_high);
 	cm.numBrushSides = count;
 
 	out = cm.brushsides;
@@ -501,20 +496,27 @@ void CMod_LoadVisibility (lump_t *l)
 /*
 =================
 CMod_LoadPatches
+
+The patch collision comes from the cache keyed on checksum when it can,
+otherwise it is generated on the job threads
 =================
 */
 #define	MAX_PATCH_VERTS		1024
-void CMod_LoadPatches (lump_t *surfs, lump_t *verts)
+void CMod_LoadPatches (lump_t *surfs, lump_t *verts, int checksum)
 {
-	drawVert_t	*dv, *dv_p;
-	dsurface_t	*in;
-	int			count;
-	int			i, j;
-	int			c;
-	cPatch_t	*patch;
-	vec3_t		points[MAX_PATCH_VERTS];
-	int			width, height;
-	int			shaderNum;
+	drawVert_t		*dv, *dv_p;
+	dsurface_t		*in, *surf;
+	int				count;
+	int				i, j;
+	int				c;
+	cPatch_t		*patch;
+	patchSource_t	*sources, *src;
+	vec3_t			*points;
+	int				numPatches, numPoints;
+	int				width, height;
+	int				shaderNum;
+	int				start, generateMsec;
+	qboolean		cached;
 
 	in = (void *) (cmod_base + surfs->fileofs);
 	if (surfs->filelen % sizeof (*in))
@@ -526,11 +528,15 @@ void CMod_LoadPatches (lump_t *surfs, lump_t *verts)
 	if (verts->filelen % sizeof (*dv))
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 
+	start = Sys_Milliseconds ();
+
 	// scan through all the surfaces, but only load patches,
 	// not planar faces
-	for (i = 0; i < count; i++, in++)
+	numPatches = 0;
+	numPoints = 0;
+	for (i = 0, surf = in; i < count; i++, surf++)
 	{
-		if (LittleLong (in->surfaceType) != MST_PATCH)
+		if (LittleLong (surf->surfaceType) != MST_PATCH)
 		{
 			continue;		// ignore other surfaces
 		}
@@ -538,29 +544,82 @@ void CMod_LoadPatches (lump_t *surfs, lump_t *verts)
 
 		cm.surfaces[i] = patch = Hunk_Alloc (sizeof (*patch), h_high);
 
-		// load the full drawverts onto the stack
-		width = LittleLong (in->patchWidth);
-		height = LittleLong (in->patchHeight);
-		c = width * height;
+		shaderNum = LittleLong (surf->shaderNum);
+		patch->contents = cm.shaders[shaderNum].contentFlags;
+		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
+
+		c = LittleLong (surf->patchWidth) * LittleLong (surf->patchHeight);
 		if (c > MAX_PATCH_VERTS)
 		{
 			Com_Error (ERR_DROP, "ParseMesh: MAX_PATCH_VERTS");
 		}
+		numPatches++;
+		numPoints += c;
+	}
+
+	cached = CM_LoadPatchCache (checksum, &generateMsec);
+
+	if (!cached && numPatches)
+	{
+		// load the full drawverts of all the patches
+		sources = Hunk_AllocateTempMemory (numPatches * sizeof (*sources));
+		points = Hunk_AllocateTempMemory (numPoints * sizeof (*points));
 
-		dv_p = dv + LittleLong (in->firstVert);
-		for (j = 0; j < c; j++, dv_p++)
+		src = sources;
+		for (i = 0, surf = in; i < count; i++, surf++)
 		{
-			points[j][0] = LittleFloat (dv_p->xyz[0]);
-			points[j][1] = LittleFloat (dv_p->xyz[1]);
-			points[j][2] = LittleFloat (dv_p->xyz[2]);
+			if (!cm.surfaces[i])
+			{
+				continue;
+			}
+
+			width = LittleLong (surf->patchWidth);
+			height = LittleLong (surf->patchHeight);
+			c = width * height;
+
+			src->width = width;
+			src->height = height;
+			src->points = points;
+
+			dv_p = dv + LittleLong (surf->firstVert);
+			for (j = 0; j < c; j++, dv_p++)
+			{
+				points[j][0] = LittleFloat (dv_p->xyz[0]);
+				points[j][1] = LittleFloat (dv_p->xyz[1]);
+				points[j][2] = LittleFloat (dv_p->xyz[2]);
+			}
+			points += c;
+			src++;
 		}
 
-		shaderNum = LittleLong (in->shaderNum);
-		patch->contents = cm.shaders[shaderNum].contentFlags;
-		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
+		// create the internal facet structures
+		CM_GeneratePatchCollides (sources, numPatches);
+
+		src = sources;
+		for (i = 0; i < count; i++)
+		{
+			if (cm.surfaces[i])
+			{
+				cm.surfaces[i]->pc = src->pc;
+				src++;
+			}
+		}
 
-		// create the internal facet structure
-		patch->pc = CM_GeneratePatchCollide (width, height, points);
+		Hunk_FreeTempMemory (sources[0].points);
+		Hunk_FreeTempMemory (sources);
+	}
+
+	if (cached)
+	{
+		// the first load of the map is the one to compare with
+		Com_DPrintf ("patch collision loaded from the cache in %i msec, generating took %i msec\n",
+			Sys_Milliseconds () - start, generateMsec);
+	}
+	else
+	{
+		generateMsec = Sys_Milliseconds () - start;
+		CM_WritePatchCache (checksum, generateMsec);
+		Com_DPrintf ("patch collision generated in %i msec\n", generateMsec);
 	}
 }
 
@@ -613,6 +672,7 @@ void CM_LoadMap (const char *name, qboolean clientload, int *checksum)
 	cm_noAreas = Cvar_Get ("cm_noAreas", "0", CVAR_CHEAT);
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE | CVAR_CHEAT);
+	cm_flatLeafs = Cvar_Get ("cm_flatLeafs", "1", CVAR_LATCH);
 #endif
 	Com_DPrintf ("CM_LoadMap( %s, %i )\n", name, clientload);
 
@@ -626,6 +686,8 @@ void CM_LoadMap (const char *name, qboolean clientload, int *checksum)
 	Com_Memset (&cm, 0, sizeof (cm));
 	CM_ClearLevelPatches ();
 
+	cm.numThreads = Sys_ThreadCount ();
+
 	if (!name[0])
 	{
 		cm.numLeafs = 1;
@@ -637,11 +699,13 @@ void CM_LoadMap (const char *name, qboolean clientload, int *checksum)
 	}
 
 	// load the file
+	Com_BeginLoadStage ("read bsp");
 #ifndef BSPC
 	length = FS_ReadFile (name, (void **) &buf);
 #else
 	length = LoadQuakeFile((quakefile_t *) name, (void **)&buf);
 #endif
+	Com_EndLoadStage ();
 
 	if (!buf)
 	{
@@ -665,6 +729,7 @@ void CM_LoadMap (const char *name, qboolean clientload, int *checksum)
 	cmod_base = (byte *) buf;
 
 	// load into heap
+	Com_BeginLoadStage ("collision lumps");
 	CMod_LoadShaders (&header.lumps[LUMP_SHADERS]);
 	CMod_LoadLeafs (&header.lumps[LUMP_LEAFS]);
 	CMod_LoadLeafBrushes (&header.lumps[LUMP_LEAFBRUSHES]);
@@ -676,15 +741,27 @@ void CM_LoadMap (const char *name, qboolean clientload, int *checksum)
 	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
 	CMod_LoadVisibility (&header.lumps[LUMP_VISIBILITY]);
-	CMod_LoadPatches (&header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS]);
+	Com_EndLoadStage ();
+
+	Com_BeginLoadStage ("patch collision");
+	CMod_LoadPatches (&header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], CM_Checksum (&header));
+	Com_EndLoadStage ();
 
 	// we are NOT freeing the file, because it is cached for the ref
 	FS_FreeFile (buf);
 
+	Com_BeginLoadStage ("collision setup");
+
 	CM_InitBoxHull ();
 
+	CM_InitThreads ();
+
+	CM_FlattenWorld ();
+
 	CM_FloodAreaConnections ();
 
+	Com_EndLoadStage ();
+
 	// allow this to be cached if it is loaded by the server
 	if (!clientload)
 	{
@@ -720,7 +797,7 @@ cmodel_t	*CM_ClipHandleToModel (clipHandle_t handle)
 	}
 	if (handle == BOX_MODEL_HANDLE)
 	{
-		return &box_model;
+		return &CM_Thread ()->boxModel;
 	}
 	if (handle < MAX_SUBMODELS)
 	{
@@ -789,53 +866,328 @@ CM_InitBoxHull
 
 Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
+Every thread gets its own box, so a box set up by CM_TempBoxModel is
+only seen by traces from the same thread.
 ===================
 */
 void CM_InitBoxHull (void)
 {
-	int			i;
+	int			i, t;
 	int			side;
 	cplane_t	*p;
 	cbrushside_t	*s;
+	cmThread_t	*thread;
+
+	for (t = 0; t < cm.numThreads; t++)
+	{
+		thread = &cm.threads[t];
+
+		thread->boxPlanes = &cm.planes[cm.numPlanes + t * BOX_PLANES];
+
+		thread->boxBrush = &cm.brushes[cm.numBrushes + t * BOX_BRUSHES];
+		thread->boxBrush->numsides = 6;
+		thread->boxBrush->sides = cm.brushsides + cm.numBrushSides + t * BOX_SIDES;
+		thread->boxBrush->contents = CONTENTS_BODY;
+
+		thread->boxModel.leaf.numLeafBrushes = 1;
+		thread->boxModel.leaf.firstLeafBrush = cm.numLeafBrushes + t * BOX_BRUSHES;
+		cm.leafbrushes[cm.numLeafBrushes + t * BOX_BRUSHES] = cm.numBrushes + t * BOX_BRUSHES;
+
+		for (i = 0; i < 6; i++)
+		{
+			side = i & 1;
+
+			// brush sides
+			s = &thread->boxBrush->sides[i];
+			s->plane = thread->boxPlanes + (i * 2 + side);
+			s->surfaceFlags = 0;
+
+			// planes
+			p = &thread->boxPlanes[i * 2];
+			p->type = i >> 1;
+			p->signbits = 0;
+			VectorClear (p->normal);
+			p->normal[i >> 1] = 1;
+
+			p = &thread->boxPlanes[i * 2 + 1];
+			p->type = 3 + (i >> 1);
+			p->signbits = 0;
+			VectorClear (p->normal);
+			p->normal[i >> 1] = -1;
+
+			SetPlaneSignbits (p);
+		}
+	}
+}
+
+/*
+===================
+CM_InitThreads
+
+Allocates the per-thread visited marks for the brushes and patches, so
+traces from different threads never write to shared memory
+===================
+*/
+void CM_InitThreads (void)
+{
+	int			t;
+	cmThread_t	*thread;
 
-	box_planes = &cm.planes[cm.numPlanes];
+	for (t = 0; t < cm.numThreads; t++)
+	{
+		thread = &cm.threads[t];
 
-	box_brush = &cm.brushes[cm.numBrushes];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
-	box_brush->contents = CONTENTS_BODY;
+		thread->brushChecks = Hunk_Alloc ((cm.numBrushes + BOX_BRUSHES * cm.numThreads) * sizeof (int), h_high);
+		thread->patchChecks = Hunk_Alloc ((cm.numSurfaces + 1) * sizeof (int), h_high);
+	}
+}
+
+/*
+===================
+CM_FlattenNode_r
 
-	box_model.leaf.numLeafBrushes = 1;
-	//	box_model.leaf.firstLeafBrush = cm.numBrushes;
-	box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
+Copies the subtree under num into cm.flatNodes depth first, returning its
+new number
+===================
+*/
+static int CM_FlattenNode_r (int num, int *numFlat)
+{
+	cNode_t		*node;
+	cFlatNode_t	*out;
+	int			index;
+
+	if (num < 0)
+	{
+		return num;		// leafs keep their numbers
+	}
+
+	node = &cm.nodes[num];
+	index = (*numFlat)++;
+	out = &cm.flatNodes[index];
+
+	out->plane = *node->plane;
+	out->children[0] = CM_FlattenNode_r (node->children[0], numFlat);
+	out->children[1] = CM_FlattenNode_r (node->children[1], numFlat);
+
+	return index;
+}
+
+/*
+===================
+CM_BrushIsAxial
+
+True if the first six sides are the axial planes CM_BoundBrush takes the
+bounds from.  A sweep that stays a unit clear of the bounds is then always
+in front of one of those sides by more than SURFACE_CLIP_EPSILON, and
+CM_TraceThroughBrush would leave it alone.
+===================
+*/
+static qboolean CM_BrushIsAxial (const cbrush_t *b)
+{
+	int			i, j;
+	cplane_t	*plane;
+
+	if (b->numsides < 6)
+	{
+		return qfalse;
+	}
 
 	for (i = 0; i < 6; i++)
 	{
-		side = i & 1;
+		plane = b->sides[i].plane;
+		for (j = 0; j < 3; j++)
+		{
+			if (plane->normal[j] != (j != i >> 1 ? 0 : (i & 1) ? 1 : -1))
+			{
+				return qfalse;
+			}
+		}
+	}
+
+	return qtrue;
+}
 
-		// brush sides
-		s = &cm.brushsides[cm.numBrushSides + i];
-		s->plane = cm.planes + (cm.numPlanes + i * 2 + side);
-		s->surfaceFlags = 0;
+/*
+===================
+CM_FlattenLeafs
+
+Packs each leaf's brushes, their bounds and their side planes into
+contiguous blocks, in the leaf's own order so the traces keep visiting the
+brushes in the order that decides ties
+===================
+*/
+static void CM_FlattenLeafs (void)
+{
+	int				i, j, k, n;
+	int				numBrushes, numBounds, numSides, numGroups;
+	cLeaf_t			*leaf;
+	cFlatLeaf_t		*fl;
+	cFlatBrush_t	*fb;
+	cFlatGroup_t	*fg;
+	cbrush_t		*b;
+	float			*bounds, *sides;
+
+	// size everything first so it is allocated in one go
+	numBrushes = numBounds = numSides = numGroups = 0;
+	for (i = 0; i < cm.numLeafs; i++)
+	{
+		leaf = &cm.leafs[i];
+		n = 0;
+		for (k = 0; k < leaf->numLeafBrushes; k++)
+		{
+			b = &cm.brushes[cm.leafbrushes[leaf->firstLeafBrush + k]];
+			if (!b->numsides)
+			{
+				continue;	// never does anything
+			}
+			n++;
+			numSides += 4 * ((b->numsides + 3) & ~3);
+		}
+		numBrushes += n;
+		numBounds += 6 * ((n + 3) & ~3);
+		if (n > FLAT_GROUP_BRUSHES)
+		{
+			numGroups += (n + FLAT_GROUP_BRUSHES - 1) / FLAT_GROUP_BRUSHES;
+		}
+	}
 
-		// planes
-		p = &box_planes[i * 2];
-		p->type = i >> 1;
-		p->signbits = 0;
-		VectorClear (p->normal);
-		p->normal[i >> 1] = 1;
+	cm.flatLeafs = Hunk_Alloc (cm.numLeafs * sizeof (*cm.flatLeafs), h_high);
+	cm.flatBrushes = Hunk_Alloc ((numBrushes + 1) * sizeof (*cm.flatBrushes), h_high);
+	cm.flatBounds = Hunk_Alloc ((numBounds + 1) * sizeof (*cm.flatBounds), h_high);
+	cm.flatSides = Hunk_Alloc ((numSides + 1) * sizeof (*cm.flatSides), h_high);
+	cm.flatGroups = Hunk_Alloc ((numGroups + 1) * sizeof (*cm.flatGroups), h_high);
 
-		p = &box_planes[i * 2 + 1];
-		p->type = 3 + (i >> 1);
-		p->signbits = 0;
-		VectorClear (p->normal);
-		p->normal[i >> 1] = -1;
+	numBrushes = numBounds = numSides = numGroups = 0;
+	for (i = 0; i < cm.numLeafs; i++)
+	{
+		leaf = &cm.leafs[i];
+		fl = &cm.flatLeafs[i];
 
-		SetPlaneSignbits (p);
+		fl->firstBrush = numBrushes;
+		for (k = 0; k < leaf->numLeafBrushes; k++)
+		{
+			b = &cm.brushes[cm.leafbrushes[leaf->firstLeafBrush + k]];
+			if (!b->numsides)
+			{
+				continue;
+			}
+
+			fb = &cm.flatBrushes[numBrushes++];
+			fb->brushnum = b - cm.brushes;
+			fb->contents = b->contents;
+			fb->numsides = b->numsides;
+			fb->firstSide = numSides;
+			fb->axial = CM_BrushIsAxial (b);
+
+			n = (b->numsides + 3) & ~3;
+			sides = cm.flatSides + numSides;
+			for (j = 0; j < b->numsides; j++)
+			{
+				sides[j] = b->sides[j].plane->normal[0];
+				sides[n + j] = b->sides[j].plane->normal[1];
+				sides[2 * n + j] = b->sides[j].plane->normal[2];
+				sides[3 * n + j] = b->sides[j].plane->dist;
+			}
+			numSides += 4 * n;
+		}
+		fl->numBrushes = numBrushes - fl->firstBrush;
+
+		// the bounds four brushes at a time, mins x, y, z then maxs x, y, z
+		n = (fl->numBrushes + 3) & ~3;
+		fl->firstBounds = numBounds;
+		bounds = cm.flatBounds + numBounds;
+		for (k = 0; k < fl->numBrushes; k++)
+		{
+			b = &cm.brushes[cm.flatBrushes[fl->firstBrush + k].brushnum];
+			for (j = 0; j < 3; j++)
+			{
+				bounds[j * n + k] = b->bounds[0][j];
+				bounds[(3 + j) * n + k] = b->bounds[1][j];
+			}
+		}
+		numBounds += 6 * n;
+
+		// big leafs also get a box around each run of brushes
+		fl->firstGroup = numGroups;
+		fl->numGroups = 0;
+		if (fl->numBrushes <= FLAT_GROUP_BRUSHES)
+		{
+			continue;
+		}
+
+		fg = NULL;		// set by the first brush
+		for (k = 0; k < fl->numBrushes; k++)
+		{
+			fb = &cm.flatBrushes[fl->firstBrush + k];
+			b = &cm.brushes[fb->brushnum];
+
+			if (!(k % FLAT_GROUP_BRUSHES))
+			{
+				fg = &cm.flatGroups[numGroups++];
+				fl->numGroups++;
+				VectorCopy (b->bounds[0], fg->bounds[0]);
+				VectorCopy (b->bounds[1], fg->bounds[1]);
+				fg->axial = qtrue;
+			}
+			AddPointToBounds (b->bounds[0], fg->bounds[0], fg->bounds[1]);
+			AddPointToBounds (b->bounds[1], fg->bounds[0], fg->bounds[1]);
+			if (!fb->axial)
+			{
+				fg->axial = qfalse;
+			}
+		}
 	}
 }
 
+/*
+===================
+CM_FlattenWorld
+
+Builds the trace friendly copies of the world tree once the map is loaded
+===================
+*/
+void CM_FlattenWorld (void)
+{
+	int		numFlat;
+
+	cm.flatNodes = Hunk_Alloc (cm.numNodes * sizeof (*cm.flatNodes), h_high);
+
+	numFlat = 0;
+	CM_FlattenNode_r (0, &numFlat);
+
+#ifndef BSPC
+	if (!cm_flatLeafs->integer)
+	{
+		return;
+	}
+#endif
+
+	CM_FlattenLeafs ();
+}
+
+/*
+===================
+CM_Thread
+
+The trace state for the calling thread
+===================
+*/
+cmThread_t *CM_Thread (void)
+{
+	int		index;
+
+	index = Sys_ThreadIndex ();
+
+	// the job pool is created before any map is loaded and never grows,
+	// so this can only trip if some other thread starts tracing
+	if (index >= cm.numThreads && cm.numNodes)
+	{
+		Com_Error (ERR_FATAL, "CM_Thread: thread %i of %i", index, cm.numThreads);
+	}
+
+	return &cm.threads[index];
+}
+
 /*
 ===================
 CM_TempBoxModel
@@ -847,15 +1199,21 @@ Capsules are handled differently though.
 */
 clipHandle_t CM_TempBoxModel (const vec3_t mins, const vec3_t maxs, int capsule)
 {
+	cmThread_t	*thread;
+	cplane_t	*box_planes;
+
+	thread = CM_Thread ();
 
-	VectorCopy (mins, box_model.mins);
-	VectorCopy (maxs, box_model.maxs);
+	VectorCopy (mins, thread->boxModel.mins);
+	VectorCopy (maxs, thread->boxModel.maxs);
 
 	if (capsule)
 	{
 		return CAPSULE_MODEL_HANDLE;
 	}
 
+	box_planes = thread->boxPlanes;
+
 	box_planes[0].dist = maxs[0];
 	box_planes[1].dist = -maxs[0];
 	box_planes[2].dist = mins[0];
@@ -869,12 +1227,45 @@ clipHandle_t CM_TempBoxModel (const vec3_t mins, const vec3_t maxs, int capsule)
 	box_planes[10].dist = mins[2];
 	box_planes[11].dist = -mins[2];
 
-	VectorCopy (mins, box_brush->bounds[0]);
-	VectorCopy (maxs, box_brush->bounds[1]);
+	VectorCopy (mins, thread->boxBrush->bounds[0]);
+	VectorCopy (maxs, thread->boxBrush->bounds[1]);
 
 	return BOX_MODEL_HANDLE;
 }
 
+/*
+===================
+CM_TraceCounts
+
+Sums the trace statistics of all threads, optionally clearing them
+===================
+*/
+void CM_TraceCounts (int *traces, int *brushTraces, int *patchTraces, int *points, qboolean clear)
+{
+	int			t;
+	cmThread_t	*thread;
+
+	*traces = *brushTraces = *patchTraces = *points = 0;
+
+	for (t = 0; t < cm.numThreads; t++)
+	{
+		thread = &cm.threads[t];
+
+		*traces += thread->c_traces;
+		*brushTraces += thread->c_brush_traces;
+		*patchTraces += thread->c_patch_traces;
+		*points += thread->c_pointcontents;
+
+		if (clear)
+		{
+			thread->c_traces = 0;
+			thread->c_brush_traces = 0;
+			thread->c_patch_traces = 0;
+			thread->c_pointcontents = 0;
+		}
+	}
+}
+
 /*
 ===================
 CM_ModelBounds
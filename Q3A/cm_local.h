@@ -67,13 +67,11 @@ typedef struct
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
-	int			checkcount;		// to avoid repeated testings
 } cbrush_t;
 
 
 typedef struct
 {
-	int			checkcount;				// to avoid repeated testings
 	int			surfaceFlags;
 	int			contents;
 	struct patchCollide_s	*pc;
@@ -86,6 +84,60 @@ typedef struct
 	int			floodvalid;
 } cArea_t;
 
+// the world tree copied after loading into the order the traces walk it:
+// nodes depth first with their planes inline, and each leaf's brushes with
+// their bounds and side planes packed together, so a trace touches a few
+// contiguous blocks instead of chasing planes, brushes and sides around
+#define	FLAT_GROUP_BRUSHES		16		// brushes under each box of a large leaf, a multiple of 4
+
+typedef struct
+{
+	cplane_t	plane;
+	int			children[2];		// negative numbers are leafs
+	int			pad;
+} cFlatNode_t;
+
+typedef struct
+{
+	int			brushnum;			// for the visited marks and the side that was hit
+	int			contents;
+	int			numsides;
+	int			firstSide;			// into cm.flatSides: x, y, z and dist arrays of numsides rounded up to 4
+	qboolean	axial;				// the first six sides are its bounds, so sweeps clear of them can skip it
+} cFlatBrush_t;
+
+typedef struct
+{
+	vec3_t		bounds[2];			// of FLAT_GROUP_BRUSHES consecutive brushes
+	qboolean	axial;				// all of them can be skipped by sweeps that miss the box
+} cFlatGroup_t;
+
+typedef struct
+{
+	int			firstBrush;			// into cm.flatBrushes, in leafbrushes order
+	int			numBrushes;
+	int			firstBounds;		// into cm.flatBounds: mins and maxs arrays of numBrushes rounded up to 4
+	int			firstGroup;			// into cm.flatGroups, only for leafs over FLAT_GROUP_BRUSHES
+	int			numGroups;
+} cFlatLeaf_t;
+
+// everything a trace writes lives here, one per thread that can trace,
+// so the job threads can run traces alongside the main thread
+typedef struct
+{
+	int			checkcount;				// incremented on each trace
+	int			packetcount;			// incremented on each CM_TraceBatch packet
+	int			*brushChecks;			// [numBrushes + box brushes], to avoid repeated testings
+	int			*patchChecks;			// [numSurfaces]
+
+	cmodel_t	boxModel;				// CM_TempBoxModel
+	cplane_t	*boxPlanes;
+	cbrush_t	*boxBrush;
+
+	int			c_pointcontents;
+	int			c_traces, c_brush_traces, c_patch_traces;
+} cmThread_t;
+
 typedef struct
 {
 	char		name[MAX_QPATH];
@@ -133,7 +185,16 @@ typedef struct
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
 	int			floodvalid;
-	int			checkcount;					// incremented on each trace
+
+	cFlatNode_t	*flatNodes;			// [numNodes]
+	cFlatLeaf_t	*flatLeafs;			// [numLeafs], NULL with cm_flatLeafs 0
+	cFlatBrush_t	*flatBrushes;
+	float		*flatBounds;
+	float		*flatSides;
+	cFlatGroup_t	*flatGroups;
+
+	int			numThreads;
+	cmThread_t	threads[MAX_JOB_THREADS + 1];
 } clipMap_t;
 
 
@@ -142,11 +203,10 @@ typedef struct
 #define	SURFACE_CLIP_EPSILON	(0.125)
 
 extern	clipMap_t	cm;
-extern	int			c_pointcontents;
-extern	int			c_traces, c_brush_traces, c_patch_traces;
 extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
+extern	cvar_t		*cm_flatLeafs;
 
 // cm_test.c
 
@@ -173,6 +233,8 @@ typedef struct
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	cmThread_t	*thread;	// visited marks and counters of the tracing thread
+	int			checkcount;	// what this trace stamps into thread->brushChecks/patchChecks
 } traceWork_t;
 
 typedef struct leafList_s
@@ -183,6 +245,7 @@ typedef struct leafList_s
 	int		*list;
 	vec3_t	bounds[2];
 	int		lastLeaf;		// for overflows where each leaf can't be stored individually
+	cmThread_t	*thread;
 	void (*storeLeafs)(struct leafList_s *ll, int nodenum);
 } leafList_t;
 
@@ -196,9 +259,30 @@ void CM_BoxLeafnums_r (leafList_t *ll, int nodenum);
 
 cmodel_t	*CM_ClipHandleToModel (clipHandle_t handle);
 
+cmThread_t	*CM_Thread (void);
+void		CM_FlattenWorld (void);
+
+void CM_TraceThroughTree (traceWork_t *tw, int num, float p1f, float p2f, vec3_t p1, vec3_t p2);
+void CM_TraceThroughLeafPatches (traceWork_t *tw, cLeaf_t *leaf);
+void CM_TestInLeafPatches (traceWork_t *tw, cLeaf_t *leaf);
+void CM_TestInFlatLeaf (traceWork_t *tw, int leafnum);
+void CM_TraceThroughFlatLeaf (traceWork_t *tw, int leafnum);
+
 // cm_patch.c
 
+// a patch for CM_GeneratePatchCollides to generate the collision of
+typedef struct
+{
+	int						width;
+	int						height;
+	vec3_t					*points;
+	struct patchCollide_s	*pc;		// filled in
+} patchSource_t;
+
 struct patchCollide_s	*CM_GeneratePatchCollide (int width, int height, vec3_t *points);
+void CM_GeneratePatchCollides (patchSource_t *patches, int count);
 void CM_TraceThroughPatchCollide (traceWork_t *tw, const struct patchCollide_s *pc);
 qboolean CM_PositionTestInPatchCollide (traceWork_t *tw, const struct patchCollide_s *pc);
 void CM_ClearLevelPatches (void);
+qboolean CM_LoadPatchCache (int checksum, int *generateMsec);
+void CM_WritePatchCache (int checksum, int generateMsec);
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "cm_local.h"
 #include "cm_patch.h"
+#include <setjmp.h>
 
 /*
 
@@ -89,6 +90,10 @@ static const facet_t		*debugFacet;
 static qboolean		debugBlock;
 static vec3_t		debugBlockPoints[4];
 
+#ifndef BSPC
+static cvar_t		*cm_debugSurfaceUpdate;
+#endif //BSPC
+
 /*
 =================
 CM_ClearLevelPatches
@@ -98,6 +103,30 @@ void CM_ClearLevelPatches (void)
 {
 	debugPatchCollide = NULL;
 	debugFacet = NULL;
+
+#ifndef BSPC
+	// fetched here rather than on the first hit, because traces can run on the job threads
+	cm_debugSurfaceUpdate = Cvar_Get ("r_debugSurfaceUpdate", "1", 0);
+#endif //BSPC
+}
+
+/*
+=================
+CM_SetDebugFacet
+
+Only the main thread's traces are shown, the debug surface is a single
+global that the job threads must not write
+=================
+*/
+static void CM_SetDebugFacet (const traceWork_t *tw, const patchCollide_t *pc, const facet_t *facet)
+{
+#ifndef BSPC
+	if (cm_debugSurfaceUpdate && cm_debugSurfaceUpdate->integer && tw->thread == &cm.threads[0])
+	{
+		debugPatchCollide = pc;
+		debugFacet = facet;
+	}
+#endif //BSPC
 }
 
 /*
@@ -463,15 +492,86 @@ PATCH COLLIDE GENERATION
 ================================================================================
 */
 
-static	int				numPlanes;
-static	patchPlane_t	planes[MAX_PATCH_PLANES];
+// planes are hashed on their integer distance, so CM_FindPlane2 only has
+// to look at the few planes that can be within DIST_EPSILON
+#define	PLANE_HASH_SIZE		1024
+
+#define	MAX_PATCH_WARNINGS	8
+
+// everything generating one patch's collision works on, so that several
+// patches can be generated at once on the job threads
+typedef struct
+{
+	cGrid_t			grid;
+	int				gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2];
+
+	int				numPlanes;
+	patchPlane_t	planes[MAX_PATCH_PLANES];
+	int				planeHashTable[PLANE_HASH_SIZE];
+	int				planeHashChain[MAX_PATCH_PLANES];
+
+	int				numFacets;
+	facet_t			facets[MAX_FACETS];
+
+	vec3_t			bounds[2];
+
+	// job threads can't print or drop, so the messages wait here
+	// until the main thread commits the patch
+	int				numWarnings;
+	const char		*warnings[MAX_PATCH_WARNINGS];
+	qboolean		developerWarnings[MAX_PATCH_WARNINGS];
+	const char		*error;
+	jmp_buf			abort;
 
-static	int				numFacets;
-static	facet_t			facets[MAX_PATCH_PLANES]; //maybe MAX_FACETS ??
+	// polylib errors come back through CM_PatchError too
+	windingOwner_t	windings;
+} patchWork_t;
+
+static patchWork_t	cm_patchWork;		// for CM_GeneratePatchCollide
 
 #define	NORMAL_EPSILON	0.0001
 #define	DIST_EPSILON	0.02
 
+/*
+==================
+CM_PatchWarning
+
+The messages are printed when the patch is committed, in patch order
+==================
+*/
+static void CM_PatchWarning (patchWork_t *pw, qboolean developer, const char *msg)
+{
+	if (pw->numWarnings < MAX_PATCH_WARNINGS)
+	{
+		pw->warnings[pw->numWarnings] = msg;
+		pw->developerWarnings[pw->numWarnings] = developer;
+	}
+	pw->numWarnings++;
+}
+
+/*
+==================
+CM_PatchError
+
+Abandons the patch, the error is raised when it is committed
+==================
+*/
+static void CM_PatchError (patchWork_t *pw, const char *msg)
+{
+	pw->error = msg;
+	longjmp (pw->abort, 1);
+}
+
+/*
+==================
+CM_PatchWindingError
+==================
+*/
+static void CM_PatchWindingError (windingOwner_t *owner, const char *msg)
+{
+	CM_PatchError ((patchWork_t *) owner->data, msg);
+}
+
 /*
 ==================
 CM_PlaneEqual
@@ -535,33 +635,98 @@ void CM_SnapVector (vec3_t normal)
 
 /*
 ==================
-CM_FindPlane2
+CM_ClearPatchPlanes
 ==================
 */
-int CM_FindPlane2 (float plane[4], int *flipped)
+static void CM_ClearPatchPlanes (patchWork_t *pw)
 {
-	int i;
+	pw->numPlanes = 0;
+	Com_Memset (pw->planeHashTable, -1, sizeof (pw->planeHashTable));
+}
 
-	// see if the points are close enough to an existing plane
-	for (i = 0; i < numPlanes; i++)
+/*
+==================
+CM_PlaneHash
+==================
+*/
+static int CM_PlaneHash (float dist)
+{
+	return (int) floor (dist) & (PLANE_HASH_SIZE - 1);
+}
+
+/*
+==================
+CM_AddPatchPlane
+==================
+*/
+static int CM_AddPatchPlane (patchWork_t *pw, float plane[4])
+{
+	int		hash;
+
+	if (pw->numPlanes == MAX_PATCH_PLANES)
 	{
-		if (CM_PlaneEqual (&planes[i], plane, flipped)) return i;
+		CM_PatchError (pw, "MAX_PATCH_PLANES");
 	}
 
-	// add a new plane
-	if (numPlanes == MAX_PATCH_PLANES)
+	Vector4Copy (plane, pw->planes[pw->numPlanes].plane);
+	pw->planes[pw->numPlanes].signbits = CM_SignbitsForNormal (plane);
+
+	hash = CM_PlaneHash (plane[3]);
+	pw->planeHashChain[pw->numPlanes] = pw->planeHashTable[hash];
+	pw->planeHashTable[hash] = pw->numPlanes;
+
+	pw->numPlanes++;
+
+	return pw->numPlanes - 1;
+}
+
+/*
+==================
+CM_FindPlane2
+
+Returns the first plane CM_PlaneEqual accepts, like a search through
+all of them would.  A match is within DIST_EPSILON of the distance, or
+of its negation for a flipped plane, so it is hashed into the same
+bucket as one of them or the one on either side.
+==================
+*/
+int CM_FindPlane2 (patchWork_t *pw, float plane[4], int *flipped)
+{
+	int		i, side, hash, h;
+	int		best, bestFlipped, f;
+	float	dist;
+
+	best = -1;
+	bestFlipped = qfalse;
+
+	for (side = 0; side < 2; side++)
 	{
-		Com_Error (ERR_DROP, "MAX_PATCH_PLANES");
-	}
+		dist = side ? -plane[3] : plane[3];
+		hash = (int) floor (dist);
 
-	Vector4Copy (plane, planes[numPlanes].plane);
-	planes[numPlanes].signbits = CM_SignbitsForNormal (plane);
+		for (h = hash - 1; h <= hash + 1; h++)
+		{
+			for (i = pw->planeHashTable[h & (PLANE_HASH_SIZE - 1)]; i != -1; i = pw->planeHashChain[i])
+			{
+				if ((best == -1 || i < best) && CM_PlaneEqual (&pw->planes[i], plane, &f))
+				{
+					best = i;
+					bestFlipped = f;
+				}
+			}
+		}
+	}
 
-	numPlanes++;
+	if (best != -1)
+	{
+		*flipped = bestFlipped;
+		return best;
+	}
 
+	// add a new plane
 	*flipped = qfalse;
 
-	return numPlanes - 1;
+	return CM_AddPatchPlane (pw, plane);
 }
 
 /*
@@ -569,7 +734,7 @@ int CM_FindPlane2 (float plane[4], int *flipped)
 CM_FindPlane
 ==================
 */
-static int CM_FindPlane (float *p1, float *p2, float *p3)
+static int CM_FindPlane (patchWork_t *pw, float *p1, float *p2, float *p3)
 {
 	float	plane[4];
 	int		i;
@@ -581,26 +746,26 @@ static int CM_FindPlane (float *p1, float *p2, float *p3)
 	}
 
 	// see if the points are close enough to an existing plane
-	for (i = 0; i < numPlanes; i++)
+	for (i = 0; i < pw->numPlanes; i++)
 	{
-		if (DotProduct (plane, planes[i].plane) < 0)
+		if (DotProduct (plane, pw->planes[i].plane) < 0)
 		{
 			continue;	// allow backwards planes?
 		}
 
-		d = DotProduct (p1, planes[i].plane) - planes[i].plane[3];
+		d = DotProduct (p1, pw->planes[i].plane) - pw->planes[i].plane[3];
 		if (d < -PLANE_TRI_EPSILON || d > PLANE_TRI_EPSILON)
 		{
 			continue;
 		}
 
-		d = DotProduct (p2, planes[i].plane) - planes[i].plane[3];
+		d = DotProduct (p2, pw->planes[i].plane) - pw->planes[i].plane[3];
 		if (d < -PLANE_TRI_EPSILON || d > PLANE_TRI_EPSILON)
 		{
 			continue;
 		}
 
-		d = DotProduct (p3, planes[i].plane) - planes[i].plane[3];
+		d = DotProduct (p3, pw->planes[i].plane) - pw->planes[i].plane[3];
 		if (d < -PLANE_TRI_EPSILON || d > PLANE_TRI_EPSILON)
 		{
 			continue;
@@ -611,17 +776,7 @@ static int CM_FindPlane (float *p1, float *p2, float *p3)
 	}
 
 	// add a new plane
-	if (numPlanes == MAX_PATCH_PLANES)
-	{
-		Com_Error (ERR_DROP, "MAX_PATCH_PLANES");
-	}
-
-	Vector4Copy (plane, planes[numPlanes].plane);
-	planes[numPlanes].signbits = CM_SignbitsForNormal (plane);
-
-	numPlanes++;
-
-	return numPlanes - 1;
+	return CM_AddPatchPlane (pw, plane);
 }
 
 /*
@@ -629,7 +784,7 @@ static int CM_FindPlane (float *p1, float *p2, float *p3)
 CM_PointOnPlaneSide
 ==================
 */
-static int CM_PointOnPlaneSide (float *p, int planeNum)
+static int CM_PointOnPlaneSide (patchWork_t *pw, float *p, int planeNum)
 {
 	float	*plane;
 	float	d;
@@ -638,7 +793,7 @@ static int CM_PointOnPlaneSide (float *p, int planeNum)
 	{
 		return SIDE_ON;
 	}
-	plane = planes[planeNum].plane;
+	plane = pw->planes[planeNum].plane;
 
 	d = DotProduct (p, plane) - plane[3];
 
@@ -660,23 +815,23 @@ static int CM_PointOnPlaneSide (float *p, int planeNum)
 CM_GridPlane
 ==================
 */
-static int	CM_GridPlane (int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i, int j, int tri)
+static int	CM_GridPlane (patchWork_t *pw, int i, int j, int tri)
 {
 	int		p;
 
-	p = gridPlanes[i][j][tri];
+	p = pw->gridPlanes[i][j][tri];
 	if (p != -1)
 	{
 		return p;
 	}
-	p = gridPlanes[i][j][!tri];
+	p = pw->gridPlanes[i][j][!tri];
 	if (p != -1)
 	{
 		return p;
 	}
 
 	// should never happen
-	Com_Printf ("WARNING: CM_GridPlane unresolvable\n");
+	CM_PatchWarning (pw, qfalse, "WARNING: CM_GridPlane unresolvable\n");
 	return -1;
 }
 
@@ -685,59 +840,62 @@ static int	CM_GridPlane (int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i,
 CM_EdgePlaneNum
 ==================
 */
-static int CM_EdgePlaneNum (cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i, int j, int k)
+static int CM_EdgePlaneNum (patchWork_t *pw, int i, int j, int k)
 {
+	cGrid_t		*grid;
 	float	*p1, *p2;
 	vec3_t		up;
 	int			p;
 
+	grid = &pw->grid;
+
 	switch (k)
 	{
 	case 0:	// top border
 		p1 = grid->points[i][j];
 		p2 = grid->points[i + 1][j];
-		p = CM_GridPlane (gridPlanes, i, j, 0);
-		VectorMA (p1, 4, planes[p].plane, up);
-		return CM_FindPlane (p1, p2, up);
+		p = CM_GridPlane (pw, i, j, 0);
+		VectorMA (p1, 4, pw->planes[p].plane, up);
+		return CM_FindPlane (pw, p1, p2, up);
 
 	case 2:	// bottom border
 		p1 = grid->points[i][j + 1];
 		p2 = grid->points[i + 1][j + 1];
-		p = CM_GridPlane (gridPlanes, i, j, 1);
-		VectorMA (p1, 4, planes[p].plane, up);
-		return CM_FindPlane (p2, p1, up);
+		p = CM_GridPlane (pw, i, j, 1);
+		VectorMA (p1, 4, pw->planes[p].plane, up);
+		return CM_FindPlane (pw, p2, p1, up);
 
 	case 3: // left border
 		p1 = grid->points[i][j];
 		p2 = grid->points[i][j + 1];
-		p = CM_GridPlane (gridPlanes, i, j, 1);
-		VectorMA (p1, 4, planes[p].plane, up);
-		return CM_FindPlane (p2, p1, up);
+		p = CM_GridPlane (pw, i, j, 1);
+		VectorMA (p1, 4, pw->planes[p].plane, up);
+		return CM_FindPlane (pw, p2, p1, up);
 
 	case 1:	// right border
 		p1 = grid->points[i + 1][j];
 		p2 = grid->points[i + 1][j + 1];
-		p = CM_GridPlane (gridPlanes, i, j, 0);
-		VectorMA (p1, 4, planes[p].plane, up);
-		return CM_FindPlane (p1, p2, up);
+		p = CM_GridPlane (pw, i, j, 0);
+		VectorMA (p1, 4, pw->planes[p].plane, up);
+		return CM_FindPlane (pw, p1, p2, up);
 
 	case 4:	// diagonal out of triangle 0
 		p1 = grid->points[i + 1][j + 1];
 		p2 = grid->points[i][j];
-		p = CM_GridPlane (gridPlanes, i, j, 0);
-		VectorMA (p1, 4, planes[p].plane, up);
-		return CM_FindPlane (p1, p2, up);
+		p = CM_GridPlane (pw, i, j, 0);
+		VectorMA (p1, 4, pw->planes[p].plane, up);
+		return CM_FindPlane (pw, p1, p2, up);
 
 	case 5:	// diagonal out of triangle 1
 		p1 = grid->points[i][j];
 		p2 = grid->points[i + 1][j + 1];
-		p = CM_GridPlane (gridPlanes, i, j, 1);
-		VectorMA (p1, 4, planes[p].plane, up);
-		return CM_FindPlane (p1, p2, up);
+		p = CM_GridPlane (pw, i, j, 1);
+		VectorMA (p1, 4, pw->planes[p].plane, up);
+		return CM_FindPlane (pw, p1, p2, up);
 
 	}
 
-	Com_Error (ERR_DROP, "CM_EdgePlaneNum: bad k");
+	CM_PatchError (pw, "CM_EdgePlaneNum: bad k");
 	return -1;
 }
 
@@ -746,13 +904,15 @@ static int CM_EdgePlaneNum (cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRI
 CM_SetBorderInward
 ===================
 */
-static void CM_SetBorderInward (facet_t *facet, cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2],
-	int i, int j, int which)
+static void CM_SetBorderInward (patchWork_t *pw, facet_t *facet, int i, int j, int which)
 {
+	cGrid_t	*grid;
 	int		k, l;
 	float	*points[4];
 	int		numPoints;
 
+	grid = &pw->grid;
+
 	switch (which)
 	{
 	case -1:
@@ -775,7 +935,7 @@ static void CM_SetBorderInward (facet_t *facet, cGrid_t *grid, int gridPlanes[MA
 		numPoints = 3;
 		break;
 	default:
-		Com_Error (ERR_FATAL, "CM_SetBorderInward: bad parameter");
+		CM_PatchError (pw, "CM_SetBorderInward: bad parameter");
 		numPoints = 0;
 		break;
 	}
@@ -791,7 +951,7 @@ static void CM_SetBorderInward (facet_t *facet, cGrid_t *grid, int gridPlanes[MA
 		{
 			int		side;
 
-			side = CM_PointOnPlaneSide (points[l], facet->borderPlanes[k]);
+			side = CM_PointOnPlaneSide (pw, points[l], facet->borderPlanes[k]);
 			if (side == SIDE_FRONT)
 			{
 				front++;
@@ -817,9 +977,9 @@ static void CM_SetBorderInward (facet_t *facet, cGrid_t *grid, int gridPlanes[MA
 		else
 		{
 			// bisecting side border
-			Com_DPrintf ("WARNING: CM_SetBorderInward: mixed plane sides\n");
+			CM_PatchWarning (pw, qtrue, "WARNING: CM_SetBorderInward: mixed plane sides\n");
 			facet->borderInward[k] = qfalse;
-			if (!debugBlock)
+			if (!debugBlock && !Sys_ThreadIndex ())
 			{
 				debugBlock = qtrue;
 				VectorCopy (grid->points[i][j], debugBlockPoints[0]);
@@ -838,7 +998,7 @@ CM_ValidateFacet
 If the facet isn't bounded by its borders, we screwed up.
 ==================
 */
-static qboolean CM_ValidateFacet (facet_t *facet)
+static qboolean CM_ValidateFacet (patchWork_t *pw, facet_t *facet)
 {
 	float		plane[4];
 	int			j;
@@ -850,15 +1010,16 @@ static qboolean CM_ValidateFacet (facet_t *facet)
 		return qfalse;
 	}
 
-	Vector4Copy (planes[facet->surfacePlane].plane, plane);
+	Vector4Copy (pw->planes[facet->surfacePlane].plane, plane);
 	w = BaseWindingForPlane (plane, plane[3]);
 	for (j = 0; j < facet->numBorders && w; j++)
 	{
 		if (facet->borderPlanes[j] == -1)
 		{
+			FreeWinding (w);
 			return qfalse;
 		}
-		Vector4Copy (planes[facet->borderPlanes[j]].plane, plane);
+		Vector4Copy (pw->planes[facet->borderPlanes[j]].plane, plane);
 		if (!facet->borderInward[j])
 		{
 			VectorSubtract (vec3_origin, plane, plane);
@@ -899,7 +1060,7 @@ static qboolean CM_ValidateFacet (facet_t *facet)
 CM_AddFacetBevels
 ==================
 */
-void CM_AddFacetBevels (facet_t *facet)
+void CM_AddFacetBevels (patchWork_t *pw, facet_t *facet)
 {
 
 	int i, j, k, l;
@@ -908,13 +1069,13 @@ void CM_AddFacetBevels (facet_t *facet)
 	winding_t *w, *w2;
 	vec3_t mins, maxs, vec, vec2;
 
-	Vector4Copy (planes[facet->surfacePlane].plane, plane);
+	Vector4Copy (pw->planes[facet->surfacePlane].plane, plane);
 
 	w = BaseWindingForPlane (plane, plane[3]);
 	for (j = 0; j < facet->numBorders && w; j++)
 	{
 		if (facet->borderPlanes[j] == facet->surfacePlane) continue;
-		Vector4Copy (planes[facet->borderPlanes[j]].plane, plane);
+		Vector4Copy (pw->planes[facet->borderPlanes[j]].plane, plane);
 
 		if (!facet->borderInward[j])
 		{
@@ -948,21 +1109,21 @@ void CM_AddFacetBevels (facet_t *facet)
 				plane[3] = -mins[axis];
 			}
 			//if it's the surface plane
-			if (CM_PlaneEqual (&planes[facet->surfacePlane], plane, &flipped))
+			if (CM_PlaneEqual (&pw->planes[facet->surfacePlane], plane, &flipped))
 			{
 				continue;
 			}
 			// see if the plane is allready present
 			for (i = 0; i < facet->numBorders; i++)
 			{
-				if (CM_PlaneEqual (&planes[facet->borderPlanes[i]], plane, &flipped))
+				if (CM_PlaneEqual (&pw->planes[facet->borderPlanes[i]], plane, &flipped))
 					break;
 			}
 
 			if (i == facet->numBorders)
 			{
-				if (facet->numBorders > 4 + 6 + 16) Com_Printf ("ERROR: too many bevels\n");
-				facet->borderPlanes[facet->numBorders] = CM_FindPlane2 (plane, &flipped);
+				if (facet->numBorders > 4 + 6 + 16) CM_PatchWarning (pw, qfalse, "ERROR: too many bevels\n");
+				facet->borderPlanes[facet->numBorders] = CM_FindPlane2 (pw, plane, &flipped);
 				facet->borderNoAdjust[facet->numBorders] = 0;
 				facet->borderInward[facet->numBorders] = flipped;
 				facet->numBorders++;
@@ -1011,14 +1172,14 @@ void CM_AddFacetBevels (facet_t *facet)
 					continue;
 
 				//if it's the surface plane
-				if (CM_PlaneEqual (&planes[facet->surfacePlane], plane, &flipped))
+				if (CM_PlaneEqual (&pw->planes[facet->surfacePlane], plane, &flipped))
 				{
 					continue;
 				}
 				// see if the plane is allready present
 				for (i = 0; i < facet->numBorders; i++)
 				{
-					if (CM_PlaneEqual (&planes[facet->borderPlanes[i]], plane, &flipped))
+					if (CM_PlaneEqual (&pw->planes[facet->borderPlanes[i]], plane, &flipped))
 					{
 						break;
 					}
@@ -1026,20 +1187,20 @@ void CM_AddFacetBevels (facet_t *facet)
 
 				if (i == facet->numBorders)
 				{
-					if (facet->numBorders > 4 + 6 + 16) Com_Printf ("ERROR: too many bevels\n");
-					facet->borderPlanes[facet->numBorders] = CM_FindPlane2 (plane, &flipped);
+					if (facet->numBorders > 4 + 6 + 16) CM_PatchWarning (pw, qfalse, "ERROR: too many bevels\n");
+					facet->borderPlanes[facet->numBorders] = CM_FindPlane2 (pw, plane, &flipped);
 
 					for (k = 0; k < facet->numBorders; k++)
 					{
 						if (facet->borderPlanes[facet->numBorders] ==
-							facet->borderPlanes[k]) Com_Printf ("WARNING: bevel plane already used\n");
+							facet->borderPlanes[k]) CM_PatchWarning (pw, qfalse, "WARNING: bevel plane already used\n");
 					}
 
 					facet->borderNoAdjust[facet->numBorders] = 0;
 					facet->borderInward[facet->numBorders] = flipped;
 
 					w2 = CopyWinding (w);
-					Vector4Copy (planes[facet->borderPlanes[facet->numBorders]].plane, newplane);
+					Vector4Copy (pw->planes[facet->borderPlanes[facet->numBorders]].plane, newplane);
 					if (!facet->borderInward[facet->numBorders])
 					{
 						VectorNegate (newplane, newplane);
@@ -1048,7 +1209,7 @@ void CM_AddFacetBevels (facet_t *facet)
 					ChopWindingInPlace (&w2, newplane, newplane[3], 0.1f);
 					if (!w2)
 					{
-						Com_DPrintf ("WARNING: CM_AddFacetBevels... invalid bevel\n");
+						CM_PatchWarning (pw, qtrue, "WARNING: CM_AddFacetBevels... invalid bevel\n");
 						continue;
 					}
 					else
@@ -1088,17 +1249,18 @@ typedef enum
 CM_PatchCollideFromGrid
 ==================
 */
-static void CM_PatchCollideFromGrid (cGrid_t *grid, patchCollide_t *pf)
+static void CM_PatchCollideFromGrid (patchWork_t *pw)
 {
 	int				i, j;
 	float			*p1, *p2, *p3;
-	MAC_STATIC int				gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2];
+	cGrid_t			*grid;
 	facet_t			*facet;
 	int				borders[4];
 	int				noAdjust[4];
 
-	numPlanes = 0;
-	numFacets = 0;
+	grid = &pw->grid;
+	CM_ClearPatchPlanes (pw);
+	pw->numFacets = 0;
 
 	// find the planes for each triangle of the grid
 	for (i = 0; i < grid->width - 1; i++)
@@ -1108,12 +1270,12 @@ static void CM_PatchCollideFromGrid (cGrid_t *grid, patchCollide_t *pf)
 			p1 = grid->points[i][j];
 			p2 = grid->points[i + 1][j];
 			p3 = grid->points[i + 1][j + 1];
-			gridPlanes[i][j][0] = CM_FindPlane (p1, p2, p3);
+			pw->gridPlanes[i][j][0] = CM_FindPlane (pw, p1, p2, p3);
 
 			p1 = grid->points[i + 1][j + 1];
 			p2 = grid->points[i][j + 1];
 			p3 = grid->points[i][j];
-			gridPlanes[i][j][1] = CM_FindPlane (p1, p2, p3);
+			pw->gridPlanes[i][j][1] = CM_FindPlane (pw, p1, p2, p3);
 		}
 	}
 
@@ -1126,77 +1288,77 @@ static void CM_PatchCollideFromGrid (cGrid_t *grid, patchCollide_t *pf)
 			borders[EN_TOP] = -1;
 			if (j > 0)
 			{
-				borders[EN_TOP] = gridPlanes[i][j - 1][1];
+				borders[EN_TOP] = pw->gridPlanes[i][j - 1][1];
 			}
 			else if (grid->wrapHeight)
 			{
-				borders[EN_TOP] = gridPlanes[i][grid->height - 2][1];
+				borders[EN_TOP] = pw->gridPlanes[i][grid->height - 2][1];
 			}
-			noAdjust[EN_TOP] = (borders[EN_TOP] == gridPlanes[i][j][0]);
+			noAdjust[EN_TOP] = (borders[EN_TOP] == pw->gridPlanes[i][j][0]);
 			if (borders[EN_TOP] == -1 || noAdjust[EN_TOP])
 			{
-				borders[EN_TOP] = CM_EdgePlaneNum (grid, gridPlanes, i, j, 0);
+				borders[EN_TOP] = CM_EdgePlaneNum (pw, i, j, 0);
 			}
 
 			borders[EN_BOTTOM] = -1;
 			if (j < grid->height - 2)
 			{
-				borders[EN_BOTTOM] = gridPlanes[i][j + 1][0];
+				borders[EN_BOTTOM] = pw->gridPlanes[i][j + 1][0];
 			}
 			else if (grid->wrapHeight)
 			{
-				borders[EN_BOTTOM] = gridPlanes[i][0][0];
+				borders[EN_BOTTOM] = pw->gridPlanes[i][0][0];
 			}
-			noAdjust[EN_BOTTOM] = (borders[EN_BOTTOM] == gridPlanes[i][j][1]);
+			noAdjust[EN_BOTTOM] = (borders[EN_BOTTOM] == pw->gridPlanes[i][j][1]);
 			if (borders[EN_BOTTOM] == -1 || noAdjust[EN_BOTTOM])
 			{
-				borders[EN_BOTTOM] = CM_EdgePlaneNum (grid, gridPlanes, i, j, 2);
+				borders[EN_BOTTOM] = CM_EdgePlaneNum (pw, i, j, 2);
 			}
 
 			borders[EN_LEFT] = -1;
 			if (i > 0)
 			{
-				borders[EN_LEFT] = gridPlanes[i - 1][j][0];
+				borders[EN_LEFT] = pw->gridPlanes[i - 1][j][0];
 			}
 			else if (grid->wrapWidth)
 			{
-				borders[EN_LEFT] = gridPlanes[grid->width - 2][j][0];
+				borders[EN_LEFT] = pw->gridPlanes[grid->width - 2][j][0];
 			}
-			noAdjust[EN_LEFT] = (borders[EN_LEFT] == gridPlanes[i][j][1]);
+			noAdjust[EN_LEFT] = (borders[EN_LEFT] == pw->gridPlanes[i][j][1]);
 			if (borders[EN_LEFT] == -1 || noAdjust[EN_LEFT])
 			{
-				borders[EN_LEFT] = CM_EdgePlaneNum (grid, gridPlanes, i, j, 3);
+				borders[EN_LEFT] = CM_EdgePlaneNum (pw, i, j, 3);
 			}
 
 			borders[EN_RIGHT] = -1;
 			if (i < grid->width - 2)
 			{
-				borders[EN_RIGHT] = gridPlanes[i + 1][j][1];
+				borders[EN_RIGHT] = pw->gridPlanes[i + 1][j][1];
 			}
 			else if (grid->wrapWidth)
 			{
-				borders[EN_RIGHT] = gridPlanes[0][j][1];
+				borders[EN_RIGHT] = pw->gridPlanes[0][j][1];
 			}
-			noAdjust[EN_RIGHT] = (borders[EN_RIGHT] == gridPlanes[i][j][0]);
+			noAdjust[EN_RIGHT] = (borders[EN_RIGHT] == pw->gridPlanes[i][j][0]);
 			if (borders[EN_RIGHT] == -1 || noAdjust[EN_RIGHT])
 			{
-				borders[EN_RIGHT] = CM_EdgePlaneNum (grid, gridPlanes, i, j, 1);
+				borders[EN_RIGHT] = CM_EdgePlaneNum (pw, i, j, 1);
 			}
 
-			if (numFacets == MAX_FACETS)
+			if (pw->numFacets == MAX_FACETS)
 			{
-				Com_Error (ERR_DROP, "MAX_FACETS");
+				CM_PatchError (pw, "MAX_FACETS");
 			}
-			facet = &facets[numFacets];
+			facet = &pw->facets[pw->numFacets];
 			Com_Memset (facet, 0, sizeof (*facet));
 
-			if (gridPlanes[i][j][0] == gridPlanes[i][j][1])
+			if (pw->gridPlanes[i][j][0] == pw->gridPlanes[i][j][1])
 			{
-				if (gridPlanes[i][j][0] == -1)
+				if (pw->gridPlanes[i][j][0] == -1)
 				{
 					continue;		// degenrate
 				}
-				facet->surfacePlane = gridPlanes[i][j][0];
+				facet->surfacePlane = pw->gridPlanes[i][j][0];
 				facet->numBorders = 4;
 				facet->borderPlanes[0] = borders[EN_TOP];
 				facet->borderNoAdjust[0] = noAdjust[EN_TOP];
@@ -1206,96 +1368,79 @@ static void CM_PatchCollideFromGrid (cGrid_t *grid, patchCollide_t *pf)
 				facet->borderNoAdjust[2] = noAdjust[EN_BOTTOM];
 				facet->borderPlanes[3] = borders[EN_LEFT];
 				facet->borderNoAdjust[3] = noAdjust[EN_LEFT];
-				CM_SetBorderInward (facet, grid, gridPlanes, i, j, -1);
-				if (CM_ValidateFacet (facet))
+				CM_SetBorderInward (pw, facet, i, j, -1);
+				if (CM_ValidateFacet (pw, facet))
 				{
-					CM_AddFacetBevels (facet);
-					numFacets++;
+					CM_AddFacetBevels (pw, facet);
+					pw->numFacets++;
 				}
 			}
 			else
 			{
 				// two seperate triangles
-				facet->surfacePlane = gridPlanes[i][j][0];
+				facet->surfacePlane = pw->gridPlanes[i][j][0];
 				facet->numBorders = 3;
 				facet->borderPlanes[0] = borders[EN_TOP];
 				facet->borderNoAdjust[0] = noAdjust[EN_TOP];
 				facet->borderPlanes[1] = borders[EN_RIGHT];
 				facet->borderNoAdjust[1] = noAdjust[EN_RIGHT];
-				facet->borderPlanes[2] = gridPlanes[i][j][1];
+				facet->borderPlanes[2] = pw->gridPlanes[i][j][1];
 				if (facet->borderPlanes[2] == -1)
 				{
 					facet->borderPlanes[2] = borders[EN_BOTTOM];
 					if (facet->borderPlanes[2] == -1)
 					{
-						facet->borderPlanes[2] = CM_EdgePlaneNum (grid, gridPlanes, i, j, 4);
+						facet->borderPlanes[2] = CM_EdgePlaneNum (pw, i, j, 4);
 					}
 				}
-				CM_SetBorderInward (facet, grid, gridPlanes, i, j, 0);
-				if (CM_ValidateFacet (facet))
+				CM_SetBorderInward (pw, facet, i, j, 0);
+				if (CM_ValidateFacet (pw, facet))
 				{
-					CM_AddFacetBevels (facet);
-					numFacets++;
+					CM_AddFacetBevels (pw, facet);
+					pw->numFacets++;
 				}
 
-				if (numFacets == MAX_FACETS)
+				if (pw->numFacets == MAX_FACETS)
 				{
-					Com_Error (ERR_DROP, "MAX_FACETS");
+					CM_PatchError (pw, "MAX_FACETS");
 				}
-				facet = &facets[numFacets];
+				facet = &pw->facets[pw->numFacets];
 				Com_Memset (facet, 0, sizeof (*facet));
 
-				facet->surfacePlane = gridPlanes[i][j][1];
+				facet->surfacePlane = pw->gridPlanes[i][j][1];
 				facet->numBorders = 3;
 				facet->borderPlanes[0] = borders[EN_BOTTOM];
 				facet->borderNoAdjust[0] = noAdjust[EN_BOTTOM];
 				facet->borderPlanes[1] = borders[EN_LEFT];
 				facet->borderNoAdjust[1] = noAdjust[EN_LEFT];
-				facet->borderPlanes[2] = gridPlanes[i][j][0];
+				facet->borderPlanes[2] = pw->gridPlanes[i][j][0];
 				if (facet->borderPlanes[2] == -1)
 				{
 					facet->borderPlanes[2] = borders[EN_TOP];
 					if (facet->borderPlanes[2] == -1)
 					{
-						facet->borderPlanes[2] = CM_EdgePlaneNum (grid, gridPlanes, i, j, 5);
+						facet->borderPlanes[2] = CM_EdgePlaneNum (pw, i, j, 5);
 					}
 				}
-				CM_SetBorderInward (facet, grid, gridPlanes, i, j, 1);
-				if (CM_ValidateFacet (facet))
+				CM_SetBorderInward (pw, facet, i, j, 1);
+				if (CM_ValidateFacet (pw, facet))
 				{
-					CM_AddFacetBevels (facet);
-					numFacets++;
+					CM_AddFacetBevels (pw, facet);
+					pw->numFacets++;
 				}
 			}
 		}
 	}
 
-	// copy the results out
-	pf->numPlanes = numPlanes;
-	pf->numFacets = numFacets;
-	pf->facets = Hunk_Alloc (numFacets * sizeof (*pf->facets), h_high);
-	Com_Memcpy (pf->facets, facets, numFacets * sizeof (*pf->facets));
-	pf->planes = Hunk_Alloc (numPlanes * sizeof (*pf->planes), h_high);
-	Com_Memcpy (pf->planes, planes, numPlanes * sizeof (*pf->planes));
 }
 
-
 /*
 ===================
-CM_GeneratePatchCollide
-
-Creates an internal structure that will be used to perform
-collision detection with a patch mesh.
-
-Points is packed as concatenated rows.
+CM_CheckPatchSize
 ===================
 */
-struct patchCollide_s	*CM_GeneratePatchCollide (int width, int height, vec3_t *points)
+static void CM_CheckPatchSize (int width, int height, const vec3_t *points)
 {
-	patchCollide_t	*pf;
-	MAC_STATIC cGrid_t			grid;
-	int				i, j;
-
 	if (width <= 2 || height <= 2 || !points)
 	{
 		Com_Error (ERR_DROP, "CM_GeneratePatchFacets: bad parameters: (%i, %i, %p)",
@@ -1311,61 +1456,544 @@ struct patchCollide_s	*CM_GeneratePatchCollide (int width, int height, vec3_t *p
 	{
 		Com_Error (ERR_DROP, "CM_GeneratePatchFacets: source is > MAX_GRID_SIZE");
 	}
+}
+
+/*
+===================
+CM_GeneratePatchWork
+
+Does all the work of generating a patch's collision without touching
+anything outside pw, so it can run on any thread.  CM_CommitPatchWork
+then copies the result out to the hunk.
+===================
+*/
+static void CM_GeneratePatchWork (patchWork_t *pw, int width, int height, const vec3_t *points)
+{
+	cGrid_t			*grid;
+	int				i, j;
+
+	pw->numWarnings = 0;
+	pw->error = NULL;
+	pw->windings.error = CM_PatchWindingError;
+	pw->windings.data = pw;
+	SetWindingOwner (&pw->windings);
+
+	if (setjmp (pw->abort))
+	{
+		// pw->error says why
+		FreeOwnedWindings (&pw->windings);
+		SetWindingOwner (NULL);
+		return;
+	}
 
 	// build a grid
-	grid.width = width;
-	grid.height = height;
-	grid.wrapWidth = qfalse;
-	grid.wrapHeight = qfalse;
+	grid = &pw->grid;
+	grid->width = width;
+	grid->height = height;
+	grid->wrapWidth = qfalse;
+	grid->wrapHeight = qfalse;
 	for (i = 0; i < width; i++)
 	{
 		for (j = 0; j < height; j++)
 		{
-			VectorCopy (points[j*width + i], grid.points[i][j]);
+			VectorCopy (points[j*width + i], grid->points[i][j]);
 		}
 	}
 
 	// subdivide the grid
-	CM_SetGridWrapWidth (&grid);
-	CM_SubdivideGridColumns (&grid);
-	CM_RemoveDegenerateColumns (&grid);
+	CM_SetGridWrapWidth (grid);
+	CM_SubdivideGridColumns (grid);
+	CM_RemoveDegenerateColumns (grid);
 
-	CM_TransposeGrid (&grid);
+	CM_TransposeGrid (grid);
 
-	CM_SetGridWrapWidth (&grid);
-	CM_SubdivideGridColumns (&grid);
-	CM_RemoveDegenerateColumns (&grid);
+	CM_SetGridWrapWidth (grid);
+	CM_SubdivideGridColumns (grid);
+	CM_RemoveDegenerateColumns (grid);
 
 	// we now have a grid of points exactly on the curve
 	// the aproximate surface defined by these points will be
 	// collided against
-	pf = Hunk_Alloc (sizeof (*pf), h_high);
-	ClearBounds (pf->bounds[0], pf->bounds[1]);
-	for (i = 0; i < grid.width; i++)
+	ClearBounds (pw->bounds[0], pw->bounds[1]);
+	for (i = 0; i < grid->width; i++)
 	{
-		for (j = 0; j < grid.height; j++)
+		for (j = 0; j < grid->height; j++)
 		{
-			AddPointToBounds (grid.points[i][j], pf->bounds[0], pf->bounds[1]);
+			AddPointToBounds (grid->points[i][j], pw->bounds[0], pw->bounds[1]);
 		}
 	}
 
-	c_totalPatchBlocks += (grid.width - 1) * (grid.height - 1);
-
 	// generate a bsp tree for the surface
-	CM_PatchCollideFromGrid (&grid, pf);
+	CM_PatchCollideFromGrid (pw);
 
 	// expand by one unit for epsilon purposes
-	pf->bounds[0][0] -= 1;
-	pf->bounds[0][1] -= 1;
-	pf->bounds[0][2] -= 1;
+	pw->bounds[0][0] -= 1;
+	pw->bounds[0][1] -= 1;
+	pw->bounds[0][2] -= 1;
+
+	pw->bounds[1][0] += 1;
+	pw->bounds[1][1] += 1;
+	pw->bounds[1][2] += 1;
+
+	SetWindingOwner (NULL);
+}
+
+/*
+===================
+CM_CommitPatchWork
 
-	pf->bounds[1][0] += 1;
-	pf->bounds[1][1] += 1;
-	pf->bounds[1][2] += 1;
+Reports what came up while generating and copies the result out
+===================
+*/
+static patchCollide_t *CM_CommitPatchWork (patchWork_t *pw)
+{
+	patchCollide_t	*pf;
+	int				i;
+
+	for (i = 0; i < pw->numWarnings && i < MAX_PATCH_WARNINGS; i++)
+	{
+		if (pw->developerWarnings[i])
+		{
+			Com_DPrintf ("%s", pw->warnings[i]);
+		}
+		else
+		{
+			Com_Printf ("%s", pw->warnings[i]);
+		}
+	}
+	if (pw->numWarnings > MAX_PATCH_WARNINGS)
+	{
+		Com_DPrintf ("...%i more patch warnings\n", pw->numWarnings - MAX_PATCH_WARNINGS);
+	}
+
+	if (pw->error)
+	{
+		Com_Error (ERR_DROP, "%s", pw->error);
+	}
+
+	pf = Hunk_Alloc (sizeof (*pf), h_high);
+	VectorCopy (pw->bounds[0], pf->bounds[0]);
+	VectorCopy (pw->bounds[1], pf->bounds[1]);
+
+	c_totalPatchBlocks += (pw->grid.width - 1) * (pw->grid.height - 1);
+
+	// copy the results out
+	pf->numPlanes = pw->numPlanes;
+	pf->numFacets = pw->numFacets;
+	pf->facets = Hunk_Alloc (pw->numFacets * sizeof (*pf->facets), h_high);
+	Com_Memcpy (pf->facets, pw->facets, pw->numFacets * sizeof (*pf->facets));
+	pf->planes = Hunk_Alloc (pw->numPlanes * sizeof (*pf->planes), h_high);
+	Com_Memcpy (pf->planes, pw->planes, pw->numPlanes * sizeof (*pf->planes));
 
 	return pf;
 }
 
+/*
+===================
+CM_GeneratePatchCollide
+
+Creates an internal structure that will be used to perform
+collision detection with a patch mesh.
+
+Points is packed as concatenated rows.
+===================
+*/
+struct patchCollide_s	*CM_GeneratePatchCollide (int width, int height, vec3_t *points)
+{
+	CM_CheckPatchSize (width, height, points);
+
+	CM_GeneratePatchWork (&cm_patchWork, width, height, points);
+
+	return CM_CommitPatchWork (&cm_patchWork);
+}
+
+typedef struct
+{
+	patchSource_t	*patches;
+	patchWork_t		*work;
+} patchBatch_t;
+
+/*
+===================
+CM_GeneratePatchJob
+===================
+*/
+static void CM_GeneratePatchJob (void *data, int index)
+{
+	patchBatch_t	*batch;
+	patchSource_t	*patch;
+
+	batch = (patchBatch_t *) data;
+	patch = &batch->patches[index];
+
+	CM_GeneratePatchWork (&batch->work[index], patch->width, patch->height, patch->points);
+}
+
+/*
+===================
+CM_GeneratePatchCollides
+
+Generates a batch of patches on the job threads at a time, each in its own
+work area, then commits them in order on this thread so the hunk ends up
+exactly as if they had been generated one by one
+===================
+*/
+void CM_GeneratePatchCollides (patchSource_t *patches, int count)
+{
+	patchBatch_t	batch;
+	patchWork_t		*work;
+	int				numSlots;
+	int				first, n, i;
+
+	if (!count)
+	{
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		CM_CheckPatchSize (patches[i].width, patches[i].height, patches[i].points);
+	}
+
+	numSlots = Sys_ThreadCount ();
+	if (numSlots > count)
+	{
+		numSlots = count;
+	}
+	work = Hunk_AllocateTempMemory (numSlots * sizeof (*work));
+
+	batch.work = work;
+	for (first = 0; first < count; first += n)
+	{
+		n = count - first;
+		if (n > numSlots)
+		{
+			n = numSlots;
+		}
+
+		batch.patches = patches + first;
+		Sys_RunJobs (CM_GeneratePatchJob, &batch, n);
+
+		for (i = 0; i < n; i++)
+		{
+			patches[first + i].pc = CM_CommitPatchWork (&work[i]);
+		}
+	}
+
+	Hunk_FreeTempMemory (work);
+}
+
+/*
+================================================================================
+
+PATCH COLLIDE CACHE
+
+Generating the patch collision is a good part of loading a curvy map, and
+the result only depends on the map, so it is written out after the first
+load and read back on the next ones.  The file is named after the map's
+collision checksum and lives under the home path outside the search path,
+so it plays no part in pure checks.
+
+================================================================================
+*/
+
+#define	PATCH_CACHE_IDENT		(('C'<<24)+('P'<<16)+('C'<<8)+'P')	// "PCPC"
+#define	PATCH_CACHE_VERSION		2
+
+typedef struct
+{
+	int			ident;
+	int			version;
+	int			checksum;
+	int			numSurfaces;
+	int			numPatches;
+	int			planeSize;		// catches builds with different structures
+	int			facetSize;
+	int			generateMsec;	// what generating took, to compare with loading
+} patchCacheHeader_t;
+
+typedef struct
+{
+	int			surfaceNum;
+	vec3_t		bounds[2];
+	int			numPlanes;
+	int			numFacets;
+	// followed by the planes and facets
+} patchCacheEntry_t;
+
+#ifndef BSPC
+
+static cvar_t		*cm_patchCache;
+
+/*
+===================
+CM_PatchCacheName
+===================
+*/
+static const char *CM_PatchCacheName (int checksum)
+{
+	return va ("patchcache/%08x.dat", checksum);
+}
+
+/*
+===================
+CM_CheckPatchFacets
+
+Every plane a facet refers to has to be one of the entry's planes
+===================
+*/
+static qboolean CM_CheckPatchFacets (const facet_t *facets, int numFacets, int numPlanes)
+{
+	const facet_t	*facet;
+	int				i, j;
+
+	for (i = 0, facet = facets; i < numFacets; i++, facet++)
+	{
+		if (facet->surfacePlane < 0 || facet->surfacePlane >= numPlanes
+			|| facet->numBorders < 0 || facet->numBorders > (int) (sizeof (facet->borderPlanes) / sizeof (facet->borderPlanes[0])))
+		{
+			return qfalse;
+		}
+
+		for (j = 0; j < facet->numBorders; j++)
+		{
+			if (facet->borderPlanes[j] < 0 || facet->borderPlanes[j] >= numPlanes)
+			{
+				return qfalse;
+			}
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+===================
+CM_CheckPatchCache
+
+Walks the entries to make sure they match the patches in cm.surfaces,
+and that nothing in them indexes outside their own planes
+===================
+*/
+static qboolean CM_CheckPatchCache (const byte *buf, int length)
+{
+	const patchCacheHeader_t	*header;
+	const patchCacheEntry_t		*entry;
+	const byte					*p, *end;
+	int							i, count;
+
+	header = (const patchCacheHeader_t *) buf;
+	p = buf + sizeof (*header);
+	end = buf + length;
+	count = 0;
+
+	for (i = 0; i < cm.numSurfaces; i++)
+	{
+		if (!cm.surfaces[i])
+		{
+			continue;
+		}
+
+		entry = (const patchCacheEntry_t *) p;
+		if (end - p < sizeof (*entry) || entry->surfaceNum != i
+			|| entry->numPlanes < 0 || entry->numPlanes > MAX_PATCH_PLANES
+			|| entry->numFacets < 0 || entry->numFacets > MAX_FACETS)
+		{
+			return qfalse;
+		}
+
+		p += sizeof (*entry);
+		if (end - p < entry->numPlanes * sizeof (patchPlane_t) + entry->numFacets * sizeof (facet_t))
+		{
+			return qfalse;
+		}
+		p += entry->numPlanes * sizeof (patchPlane_t);
+
+		if (!CM_CheckPatchFacets ((const facet_t *) p, entry->numFacets, entry->numPlanes))
+		{
+			return qfalse;
+		}
+		p += entry->numFacets * sizeof (facet_t);
+		count++;
+	}
+
+	return count == header->numPatches && p == end;
+}
+
+/*
+===================
+CM_LoadPatchCache
+
+Fills in the patch collision of every patch in cm.surfaces from the cache,
+or returns qfalse without touching them if there is no usable cache.
+generateMsec is set to how long generating them took when the cache was
+written.
+===================
+*/
+qboolean CM_LoadPatchCache (int checksum, int *generateMsec)
+{
+	fileHandle_t		f;
+	int					length;
+	int					i;
+	byte				*buf, *p;
+	patchCacheHeader_t	*header;
+	patchCacheEntry_t	*entry;
+	patchCollide_t		*pc;
+	qboolean			ok;
+
+	cm_patchCache = Cvar_Get ("cm_patchCache", "1", 0);
+	if (!cm_patchCache->integer)
+	{
+		return qfalse;
+	}
+
+	length = FS_SV_FOpenFileRead (CM_PatchCacheName (checksum), &f);
+	if (!f)
+	{
+		return qfalse;
+	}
+	if (length < sizeof (*header))
+	{
+		FS_FCloseFile (f);
+		return qfalse;
+	}
+
+	buf = Hunk_AllocateTempMemory (length);
+	ok = (FS_Read (buf, length, f) == length);
+	FS_FCloseFile (f);
+
+	header = (patchCacheHeader_t *) buf;
+	if (!ok || header->ident != PATCH_CACHE_IDENT || header->version != PATCH_CACHE_VERSION
+		|| header->checksum != checksum || header->numSurfaces != cm.numSurfaces
+		|| header->planeSize != sizeof (patchPlane_t) || header->facetSize != sizeof (facet_t)
+		|| !CM_CheckPatchCache (buf, length))
+	{
+		Com_DPrintf ("%s is out of date, regenerating\n", CM_PatchCacheName (checksum));
+		Hunk_FreeTempMemory (buf);
+		return qfalse;
+	}
+
+	*generateMsec = header->generateMsec;
+
+	p = buf + sizeof (*header);
+	for (i = 0; i < cm.numSurfaces; i++)
+	{
+		if (!cm.surfaces[i])
+		{
+			continue;
+		}
+
+		entry = (patchCacheEntry_t *) p;
+		p += sizeof (*entry);
+
+		pc = Hunk_Alloc (sizeof (*pc), h_high);
+		VectorCopy (entry->bounds[0], pc->bounds[0]);
+		VectorCopy (entry->bounds[1], pc->bounds[1]);
+
+		pc->numPlanes = entry->numPlanes;
+		pc->planes = Hunk_Alloc (pc->numPlanes * sizeof (*pc->planes), h_high);
+		Com_Memcpy (pc->planes, p, pc->numPlanes * sizeof (*pc->planes));
+		p += pc->numPlanes * sizeof (*pc->planes);
+
+		pc->numFacets = entry->numFacets;
+		pc->facets = Hunk_Alloc (pc->numFacets * sizeof (*pc->facets), h_high);
+		Com_Memcpy (pc->facets, p, pc->numFacets * sizeof (*pc->facets));
+		p += pc->numFacets * sizeof (*pc->facets);
+
+		cm.surfaces[i]->pc = pc;
+	}
+
+	Hunk_FreeTempMemory (buf);
+
+	return qtrue;
+}
+
+/*
+===================
+CM_WritePatchCache
+
+Saves the patch collision CMod_LoadPatches just generated in generateMsec
+===================
+*/
+void CM_WritePatchCache (int checksum, int generateMsec)
+{
+	fileHandle_t		f;
+	int					i;
+	patchCacheHeader_t	header;
+	patchCacheEntry_t	entry;
+	patchCollide_t		*pc;
+
+	if (!cm_patchCache->integer)
+	{
+		return;
+	}
+
+	header.ident = PATCH_CACHE_IDENT;
+	header.version = PATCH_CACHE_VERSION;
+	header.checksum = checksum;
+	header.numSurfaces = cm.numSurfaces;
+	header.numPatches = 0;
+	header.planeSize = sizeof (patchPlane_t);
+	header.facetSize = sizeof (facet_t);
+	header.generateMsec = generateMsec;
+
+	for (i = 0; i < cm.numSurfaces; i++)
+	{
+		if (cm.surfaces[i])
+		{
+			header.numPatches++;
+		}
+	}
+
+	if (!header.numPatches)
+	{
+		return;
+	}
+
+	f = FS_SV_FOpenFileWrite (CM_PatchCacheName (checksum));
+	if (!f)
+	{
+		Com_DPrintf ("Couldn't write %s\n", CM_PatchCacheName (checksum));
+		return;
+	}
+
+	FS_Write (&header, sizeof (header), f);
+
+	for (i = 0; i < cm.numSurfaces; i++)
+	{
+		if (!cm.surfaces[i])
+		{
+			continue;
+		}
+
+		pc = cm.surfaces[i]->pc;
+		entry.surfaceNum = i;
+		VectorCopy (pc->bounds[0], entry.bounds[0]);
+		VectorCopy (pc->bounds[1], entry.bounds[1]);
+		entry.numPlanes = pc->numPlanes;
+		entry.numFacets = pc->numFacets;
+
+		FS_Write (&entry, sizeof (entry), f);
+		FS_Write (pc->planes, pc->numPlanes * sizeof (*pc->planes), f);
+		FS_Write (pc->facets, pc->numFacets * sizeof (*pc->facets), f);
+	}
+
+	FS_FCloseFile (f);
+}
+
+#else
+
+qboolean CM_LoadPatchCache (int checksum, int *generateMsec)
+{
+	return qfalse;
+}
+
+void CM_WritePatchCache (int checksum, int generateMsec)
+{
+}
+
+#endif //BSPC
+
 /*
 ================================================================================
 
@@ -1391,9 +2019,6 @@ void CM_TracePointThroughPatchCollide (traceWork_t *tw, const struct patchCollid
 	int			i, j, k;
 	float		offset;
 	float		d1, d2;
-#ifndef BSPC
-	static cvar_t *cv;
-#endif //BSPC
 
 #ifndef BSPC
 	if (!cm_playerCurveClip->integer || !tw->isPoint)
@@ -1470,17 +2095,7 @@ void CM_TracePointThroughPatchCollide (traceWork_t *tw, const struct patchCollid
 		if (j == facet->numBorders)
 		{
 			// we hit this facet
-#ifndef BSPC
-			if (!cv)
-			{
-				cv = Cvar_Get ("r_debugSurfaceUpdate", "1", 0);
-			}
-			if (cv->integer)
-			{
-				debugPatchCollide = pc;
-				debugFacet = facet;
-			}
-#endif //BSPC
+			CM_SetDebugFacet (tw, pc, facet);
 			planes = &pc->planes[facet->surfacePlane];
 
 			// calculate intersection with a slight pushoff
@@ -1569,9 +2184,6 @@ void CM_TraceThroughPatchCollide (traceWork_t *tw, const struct patchCollide_s *
 	facet_t	*facet;
 	float plane[4], bestplane[4];
 	vec3_t startp, endp;
-#ifndef BSPC
-	static cvar_t *cv;
-#endif //BSPC
 
 	if (tw->isPoint)
 	{
@@ -1686,17 +2298,7 @@ void CM_TraceThroughPatchCollide (traceWork_t *tw, const struct patchCollide_s *
 				{
 					enterFrac = 0;
 				}
-#ifndef BSPC
-				if (!cv)
-				{
-					cv = Cvar_Get ("r_debugSurfaceUpdate", "1", 0);
-				}
-				if (cv && cv->integer)
-				{
-					debugPatchCollide = pc;
-					debugFacet = facet;
-				}
-#endif //BSPC
+				CM_SetDebugFacet (tw, pc, facet);
 
 				tw->trace.fraction = enterFrac;
 				VectorCopy (bestplane, tw->trace.plane.normal);
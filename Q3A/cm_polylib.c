@@ -33,6 +33,8 @@ int	c_peak_windings;
 int	c_winding_allocs;
 int	c_winding_points;
 
+static windingOwner_t	*windingOwners[MAX_JOB_THREADS + 1];
+
 void pw (winding_t *w)
 {
 	int		i;
@@ -41,6 +43,63 @@ void pw (winding_t *w)
 }
 
 
+/*
+=============
+SetWindingOwner
+
+NULL goes back to Com_Error and untracked windings
+=============
+*/
+void SetWindingOwner (windingOwner_t *owner)
+{
+	if (owner)
+	{
+		owner->numWindings = 0;
+	}
+	windingOwners[Sys_ThreadIndex ()] = owner;
+}
+
+/*
+=============
+WindingError
+
+Goes to the thread's winding owner if it has one, which doesn't return
+=============
+*/
+static void WindingError (int code, const char *msg)
+{
+	windingOwner_t	*owner;
+
+	owner = windingOwners[Sys_ThreadIndex ()];
+	if (owner)
+	{
+		owner->error (owner, msg);
+	}
+
+	Com_Error (code, "%s", msg);
+}
+
+/*
+=============
+ReleaseWinding
+=============
+*/
+static void ReleaseWinding (winding_t *w)
+{
+	*(unsigned *) w = 0xdeaddead;
+
+	// the zone belongs to the main thread, job threads generating
+	// patch collision get their windings from the C heap
+	if (Sys_ThreadIndex ())
+	{
+		free (w);
+		return;
+	}
+
+	c_active_windings--;
+	Z_Free (w);
+}
+
 /*
 =============
 AllocWinding
@@ -49,28 +108,81 @@ AllocWinding
 winding_t	*AllocWinding (int points)
 {
 	winding_t	*w;
+	windingOwner_t	*owner;
 	int			s;
 
-	c_winding_allocs++;
-	c_winding_points += points;
-	c_active_windings++;
-	if (c_active_windings > c_peak_windings)
-		c_peak_windings = c_active_windings;
-
 	s = sizeof (vec_t) * 3 * points + sizeof (int);
-	w = Z_Malloc (s);
+
+	if (Sys_ThreadIndex ())
+	{
+		w = malloc (s);
+	}
+	else
+	{
+		c_winding_allocs++;
+		c_winding_points += points;
+		c_active_windings++;
+		if (c_active_windings > c_peak_windings)
+			c_peak_windings = c_active_windings;
+
+		w = Z_Malloc (s);
+	}
 	Com_Memset (w, 0, s);
+
+	owner = windingOwners[Sys_ThreadIndex ()];
+	if (owner)
+	{
+		if (owner->numWindings == MAX_OWNED_WINDINGS)
+		{
+			ReleaseWinding (w);
+			WindingError (ERR_DROP, "AllocWinding: MAX_OWNED_WINDINGS");
+		}
+		owner->windings[owner->numWindings++] = w;
+	}
+
 	return w;
 }
 
 void FreeWinding (winding_t *w)
 {
+	windingOwner_t	*owner;
+	int				i;
+
 	if (*(unsigned *) w == 0xdeaddead)
-		Com_Error (ERR_FATAL, "FreeWinding: freed a freed winding");
-	*(unsigned *) w = 0xdeaddead;
+		WindingError (ERR_FATAL, "FreeWinding: freed a freed winding");
 
-	c_active_windings--;
-	Z_Free (w);
+	owner = windingOwners[Sys_ThreadIndex ()];
+	if (owner)
+	{
+		for (i = 0; i < owner->numWindings; i++)
+		{
+			if (owner->windings[i] == w)
+			{
+				owner->windings[i] = owner->windings[--owner->numWindings];
+				break;
+			}
+		}
+	}
+
+	ReleaseWinding (w);
+}
+
+/*
+=============
+FreeOwnedWindings
+
+Frees whatever was left live when the owner's work was abandoned
+=============
+*/
+void FreeOwnedWindings (windingOwner_t *owner)
+{
+	int		i;
+
+	for (i = 0; i < owner->numWindings; i++)
+	{
+		ReleaseWinding (owner->windings[i]);
+	}
+	owner->numWindings = 0;
 }
 
 /*
@@ -220,7 +332,7 @@ winding_t *BaseWindingForPlane (vec3_t normal, vec_t dist)
 		}
 	}
 	if (x == -1)
-		Com_Error (ERR_DROP, "BaseWindingForPlane: no axis found");
+		WindingError (ERR_DROP, "BaseWindingForPlane: no axis found");
 
 	VectorCopy (vec3_origin, vup);
 	switch (x)
@@ -312,7 +424,7 @@ void	ClipWindingEpsilon (winding_t *in, vec3_t normal, vec_t dist,
 	vec_t	dists[MAX_POINTS_ON_WINDING + 4];
 	int		sides[MAX_POINTS_ON_WINDING + 4];
 	int		counts[3];
-	static	vec_t	dot;		// VC 4.2 optimizer bug if not static
+	vec_t	dot;
 	int		i, j;
 	vec_t	*p1, *p2;
 	vec3_t	mid;
@@ -407,9 +519,9 @@ void	ClipWindingEpsilon (winding_t *in, vec3_t normal, vec_t dist,
 	}
 
 	if (f->numpoints > maxpts || b->numpoints > maxpts)
-		Com_Error (ERR_DROP, "ClipWinding: points exceeded estimate");
+		WindingError (ERR_DROP, "ClipWinding: points exceeded estimate");
 	if (f->numpoints > MAX_POINTS_ON_WINDING || b->numpoints > MAX_POINTS_ON_WINDING)
-		Com_Error (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
+		WindingError (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
 }
 
 
@@ -424,7 +536,7 @@ void ChopWindingInPlace (winding_t **inout, vec3_t normal, vec_t dist, vec_t eps
 	vec_t	dists[MAX_POINTS_ON_WINDING + 4];
 	int		sides[MAX_POINTS_ON_WINDING + 4];
 	int		counts[3];
-	static	vec_t	dot;		// VC 4.2 optimizer bug if not static
+	vec_t	dot;
 	int		i, j;
 	vec_t	*p1, *p2;
 	vec3_t	mid;
@@ -506,9 +618,9 @@ void ChopWindingInPlace (winding_t **inout, vec3_t normal, vec_t dist, vec_t eps
 	}
 
 	if (f->numpoints > maxpts)
-		Com_Error (ERR_DROP, "ClipWinding: points exceeded estimate");
+		WindingError (ERR_DROP, "ClipWinding: points exceeded estimate");
 	if (f->numpoints > MAX_POINTS_ON_WINDING)
-		Com_Error (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
+		WindingError (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
 
 	FreeWinding (in);
 	*inout = f;
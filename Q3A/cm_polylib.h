@@ -65,4 +65,21 @@ void	AddWindingToConvexHull (winding_t *w, winding_t **hull, vec3_t normal);
 void	ChopWindingInPlace (winding_t **w, vec3_t normal, vec_t dist, vec_t epsilon);
 // frees the original if clipped
 
+// patch collision is generated on the job threads, which may not call
+// Com_Error or leave memory behind.  While a thread has an owner set, the
+// windings it allocates are tracked on the owner, and errors go to
+// owner->error instead of Com_Error.  error must not return.
+#define	MAX_OWNED_WINDINGS	8
+
+typedef struct windingOwner_s
+{
+	void		(*error) (struct windingOwner_s *owner, const char *msg);
+	void		*data;
+	int			numWindings;
+	winding_t	*windings[MAX_OWNED_WINDINGS];
+} windingOwner_t;
+
+void	SetWindingOwner (windingOwner_t *owner);
+void	FreeOwnedWindings (windingOwner_t *owner);
+
 void pw (winding_t *w);
@@ -45,6 +45,13 @@ void		CM_TransformedBoxTrace (trace_t *results, const vec3_t start, const vec3_t
 	vec3_t mins, vec3_t maxs,
 	clipHandle_t model, int brushmask,
 	const vec3_t origin, const vec3_t angles, int capsule);
+// world only, results[i] is what CM_BoxTrace would give for requests[i]
+void		CM_TraceBatch (trace_t *results, const traceRequest_t *requests, int count, int capsule);
+
+// sums the trace statistics of all threads
+void		CM_TraceCounts (int *traces, int *brushTraces, int *patchTraces, int *points, qboolean clear);
+void		CM_TraceStress_f (void);
+void		CM_TraceBench_f (void);
 
 byte		*CM_ClusterPVS (int cluster);
 
@@ -31,13 +31,13 @@ CM_PointLeafnum_r
 int CM_PointLeafnum_r (const vec3_t p, int num)
 {
 	float		d;
-	cNode_t		*node;
+	cFlatNode_t	*node;
 	cplane_t	*plane;
 
 	while (num >= 0)
 	{
-		node = cm.nodes + num;
-		plane = node->plane;
+		node = cm.flatNodes + num;
+		plane = &node->plane;
 
 		if (plane->type < 3)
 			d = p[plane->type] - plane->dist;
@@ -49,7 +49,7 @@ int CM_PointLeafnum_r (const vec3_t p, int num)
 			num = node->children[0];
 	}
 
-	c_pointcontents++;		// optimize counter
+	CM_Thread ()->c_pointcontents++;		// optimize counter
 
 	return -1 - num;
 }
@@ -108,12 +108,12 @@ void CM_StoreBrushes (leafList_t *ll, int nodenum)
 	for (k = 0; k < leaf->numLeafBrushes; k++)
 	{
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush + k];
-		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount)
+		if (ll->thread->brushChecks[brushnum] == ll->thread->checkcount)
 		{
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		ll->thread->brushChecks[brushnum] = ll->thread->checkcount;
+		b = &cm.brushes[brushnum];
 		for (i = 0; i < 3; i++)
 		{
 			if (b->bounds[0][i] >= ll->bounds[1][i] || b->bounds[1][i] <= ll->bounds[0][i])
@@ -153,7 +153,7 @@ Fills in a list of all the leafs touched
 void CM_BoxLeafnums_r (leafList_t *ll, int nodenum)
 {
 	cplane_t	*plane;
-	cNode_t		*node;
+	cFlatNode_t	*node;
 	int			s;
 
 	while (1)
@@ -164,8 +164,8 @@ void CM_BoxLeafnums_r (leafList_t *ll, int nodenum)
 			return;
 		}
 
-		node = &cm.nodes[nodenum];
-		plane = node->plane;
+		node = &cm.flatNodes[nodenum];
+		plane = &node->plane;
 		s = BoxOnPlaneSide (ll->bounds[0], ll->bounds[1], plane);
 		if (s == 1)
 		{
@@ -194,7 +194,8 @@ int	CM_BoxLeafnums (const vec3_t mins, const vec3_t maxs, int *list, int listsiz
 {
 	leafList_t	ll;
 
-	cm.checkcount++;
+	ll.thread = CM_Thread ();
+	ll.thread->checkcount++;
 
 	VectorCopy (mins, ll.bounds[0]);
 	VectorCopy (maxs, ll.bounds[1]);
@@ -220,7 +221,8 @@ int CM_BoxBrushes (const vec3_t mins, const vec3_t maxs, cbrush_t **list, int li
 {
 	leafList_t	ll;
 
-	cm.checkcount++;
+	ll.thread = CM_Thread ();
+	ll.thread->checkcount++;
 
 	VectorCopy (mins, ll.bounds[0]);
 	VectorCopy (maxs, ll.bounds[1]);
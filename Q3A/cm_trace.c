@@ -20,6 +20,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 #include "cm_local.h"
+#include <emmintrin.h>
 
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
@@ -264,18 +265,17 @@ void CM_TestInLeaf (traceWork_t *tw, cLeaf_t *leaf)
 	int			k;
 	int			brushnum;
 	cbrush_t	*b;
-	cPatch_t	*patch;
 
 	// test box position against all brushes in the leaf
 	for (k = 0; k < leaf->numLeafBrushes; k++)
 	{
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush + k];
-		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount)
+		if (tw->thread->brushChecks[brushnum] == tw->checkcount)
 		{
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->thread->brushChecks[brushnum] = tw->checkcount;
+		b = &cm.brushes[brushnum];
 
 		if (!(b->contents & tw->contents))
 		{
@@ -289,6 +289,20 @@ void CM_TestInLeaf (traceWork_t *tw, cLeaf_t *leaf)
 		}
 	}
 
+	CM_TestInLeafPatches (tw, leaf);
+}
+
+/*
+================
+CM_TestInLeafPatches
+================
+*/
+void CM_TestInLeafPatches (traceWork_t *tw, cLeaf_t *leaf)
+{
+	int			k;
+	int			surfnum;
+	cPatch_t	*patch;
+
 	// test against all patches
 #ifdef BSPC
 	if (1) {
@@ -298,16 +312,17 @@ void CM_TestInLeaf (traceWork_t *tw, cLeaf_t *leaf)
 #endif //BSPC
 		for (k = 0; k < leaf->numLeafSurfaces; k++)
 		{
-			patch = cm.surfaces[cm.leafsurfaces[leaf->firstLeafSurface + k]];
+			surfnum = cm.leafsurfaces[leaf->firstLeafSurface + k];
+			patch = cm.surfaces[surfnum];
 			if (!patch)
 			{
 				continue;
 			}
-			if (patch->checkcount == cm.checkcount)
+			if (tw->thread->patchChecks[surfnum] == tw->checkcount)
 			{
 				continue;	// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->thread->patchChecks[surfnum] = tw->checkcount;
 
 			if (!(patch->contents & tw->contents))
 			{
@@ -470,18 +485,26 @@ void CM_PositionTest (traceWork_t *tw)
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
+	ll.thread = tw->thread;
 
-	cm.checkcount++;
+	tw->thread->checkcount++;
 
 	CM_BoxLeafnums_r (&ll, 0);
 
 
-	cm.checkcount++;
+	tw->checkcount = ++tw->thread->checkcount;
 
 	// test the contents of the leafs
 	for (i = 0; i < ll.count; i++)
 	{
-		CM_TestInLeaf (tw, &cm.leafs[leafs[i]]);
+		if (cm.flatLeafs)
+		{
+			CM_TestInFlatLeaf (tw, leafs[i]);
+		}
+		else
+		{
+			CM_TestInLeaf (tw, &cm.leafs[leafs[i]]);
+		}
 		if (tw->trace.allsolid)
 		{
 			break;
@@ -508,7 +531,7 @@ void CM_TraceThroughPatch (traceWork_t *tw, cPatch_t *patch)
 {
 	float		oldFrac;
 
-	c_patch_traces++;
+	tw->thread->c_patch_traces++;
 
 	oldFrac = tw->trace.fraction;
 
@@ -549,7 +572,7 @@ void CM_TraceThroughBrush (traceWork_t *tw, cbrush_t *brush)
 		return;
 	}
 
-	c_brush_traces++;
+	tw->thread->c_brush_traces++;
 
 	getout = qfalse;
 	startout = qfalse;
@@ -734,40 +757,15 @@ void CM_TraceThroughBrush (traceWork_t *tw, cbrush_t *brush)
 
 /*
 ================
-CM_TraceThroughLeaf
+CM_TraceThroughLeafPatches
 ================
 */
-void CM_TraceThroughLeaf (traceWork_t *tw, cLeaf_t *leaf)
+void CM_TraceThroughLeafPatches (traceWork_t *tw, cLeaf_t *leaf)
 {
 	int			k;
-	int			brushnum;
-	cbrush_t	*b;
+	int			surfnum;
 	cPatch_t	*patch;
 
-	// trace line against all brushes in the leaf
-	for (k = 0; k < leaf->numLeafBrushes; k++)
-	{
-		brushnum = cm.leafbrushes[leaf->firstLeafBrush + k];
-
-		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount)
-		{
-			continue;	// already checked this brush in another leaf
-		}
-		b->checkcount = cm.checkcount;
-
-		if (!(b->contents & tw->contents))
-		{
-			continue;
-		}
-
-		CM_TraceThroughBrush (tw, b);
-		if (!tw->trace.fraction)
-		{
-			return;
-		}
-	}
-
 	// trace line against all patches in the leaf
 #ifdef BSPC
 	if (1) {
@@ -777,16 +775,17 @@ void CM_TraceThroughLeaf (traceWork_t *tw, cLeaf_t *leaf)
 #endif
 		for (k = 0; k < leaf->numLeafSurfaces; k++)
 		{
-			patch = cm.surfaces[cm.leafsurfaces[leaf->firstLeafSurface + k]];
+			surfnum = cm.leafsurfaces[leaf->firstLeafSurface + k];
+			patch = cm.surfaces[surfnum];
 			if (!patch)
 			{
 				continue;
 			}
-			if (patch->checkcount == cm.checkcount)
+			if (tw->thread->patchChecks[surfnum] == tw->checkcount)
 			{
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->thread->patchChecks[surfnum] = tw->checkcount;
 
 			if (!(patch->contents & tw->contents))
 			{
@@ -802,840 +801,2648 @@ void CM_TraceThroughLeaf (traceWork_t *tw, cLeaf_t *leaf)
 	}
 }
 
-#define RADIUS_EPSILON		1.0f
-
 /*
 ================
-CM_TraceThroughSphere
-
-get the first intersection of the ray with the sphere
+CM_TraceThroughLeaf
 ================
 */
-void CM_TraceThroughSphere (traceWork_t *tw, vec3_t origin, float radius, vec3_t start, vec3_t end)
+void CM_TraceThroughLeaf (traceWork_t *tw, cLeaf_t *leaf)
 {
-	float l1, l2, length, scale, fraction;
-	float a, b, c, d, sqrtd;
-	vec3_t v1, dir, intersection;
-
-	// if inside the sphere
-	VectorSubtract (start, origin, dir);
-	l1 = VectorLengthSquared (dir);
-	if (l1 < Square (radius))
-	{
-		tw->trace.fraction = 0;
-		tw->trace.startsolid = qtrue;
-		// test for allsolid
-		VectorSubtract (end, origin, dir);
-		l1 = VectorLengthSquared (dir);
-		if (l1 < Square (radius))
-		{
-			tw->trace.allsolid = qtrue;
-		}
-		return;
-	}
-
-	VectorSubtract (end, start, dir);
-	length = VectorNormalize (dir);
-
-	l1 = CM_DistanceFromLineSquared (origin, start, end, dir);
-	VectorSubtract (end, origin, v1);
-	l2 = VectorLengthSquared (v1);
-	// if no intersection with the sphere and the end point is at least an epsilon away
-	if (l1 >= Square (radius) && l2 > Square (radius + SURFACE_CLIP_EPSILON))
-	{
-		return;
-	}
-
-	//	| origin - (start + t * dir) | = radius
-	//	a = dir[0]^2 + dir[1]^2 + dir[2]^2;
-	//	b = 2 * (dir[0] * (start[0] - origin[0]) + dir[1] * (start[1] - origin[1]) + dir[2] * (start[2] - origin[2]));
-	//	c = (start[0] - origin[0])^2 + (start[1] - origin[1])^2 + (start[2] - origin[2])^2 - radius^2;
-	VectorSubtract (start, origin, v1);
-	// dir is normalized so a = 1
-	a = 1.0f;//dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
-	b = 2.0f * (dir[0] * v1[0] + dir[1] * v1[1] + dir[2] * v1[2]);
-	c = v1[0] * v1[0] + v1[1] * v1[1] + v1[2] * v1[2] - (radius + RADIUS_EPSILON) * (radius + RADIUS_EPSILON);
+	int			k;
+	int			brushnum;
+	cbrush_t	*b;
 
-	d = b * b - 4.0f * c;// * a;
-	if (d > 0)
+	// trace line against all brushes in the leaf
+	for (k = 0; k < leaf->numLeafBrushes; k++)
 	{
-		sqrtd = SquareRootFloat (d);
-		// = (- b + sqrtd) * 0.5f; // / (2.0f * a);
-		fraction = (-b - sqrtd) * 0.5f; // / (2.0f * a);
+		brushnum = cm.leafbrushes[leaf->firstLeafBrush + k];
 
-		if (fraction < 0)
+		if (tw->thread->brushChecks[brushnum] == tw->checkcount)
 		{
-			fraction = 0;
+			continue;	// already checked this brush in another leaf
 		}
-		else
+		tw->thread->brushChecks[brushnum] = tw->checkcount;
+		b = &cm.brushes[brushnum];
+
+		if (!(b->contents & tw->contents))
 		{
-			fraction /= length;
+			continue;
 		}
-		if (fraction < tw->trace.fraction)
+
+		CM_TraceThroughBrush (tw, b);
+		if (!tw->trace.fraction)
 		{
-			tw->trace.fraction = fraction;
-			VectorSubtract (end, start, dir);
-			VectorMA (start, fraction, dir, intersection);
-			VectorSubtract (intersection, origin, dir);
-#ifdef CAPSULE_DEBUG
-			l2 = VectorLength(dir);
-			if (l2 < radius) {
-				int bah = 1;
-			}
-#endif
-			scale = 1 / (radius + RADIUS_EPSILON);
-			VectorScale (dir, scale, dir);
-			VectorCopy (dir, tw->trace.plane.normal);
-			VectorAdd (tw->modelOrigin, intersection, intersection);
-			tw->trace.plane.dist = DotProduct (tw->trace.plane.normal, intersection);
-			tw->trace.contents = CONTENTS_BODY;
+			return;
 		}
 	}
-	else if (d == 0)
-	{
-		//t1 = (- b ) / 2;
-		// slide along the sphere
-	}
-	// no intersection at all
+
+	CM_TraceThroughLeafPatches (tw, leaf);
+}
+
+/*
+===============================================================================
+
+FLATTENED LEAFS
+
+The world leafs as CM_FlattenLeafs packed them.  The brushes come in the
+same order as through cm.leafbrushes, so the first brush to reach a
+fraction still wins ties, but their bounds sit four to a vector and can be
+tested before the brush itself is touched, and big leafs skip whole runs
+of brushes on one box.  Only brushes that can't change the result are
+skipped: for sweeps that means axial brushes a unit clear of the sweep,
+for position tests the same bounds check CM_TestBoxInBrush starts with.
+
+===============================================================================
+*/
+
+/*
+================
+CM_FlatBoxOutside
+================
+*/
+static qboolean CM_FlatBoxOutside (const vec3_t lo, const vec3_t hi, vec3_t bounds[2])
+{
+	return lo[0] > bounds[1][0] || lo[1] > bounds[1][1] || lo[2] > bounds[1][2]
+		|| hi[0] < bounds[0][0] || hi[1] < bounds[0][1] || hi[2] < bounds[0][2];
 }
 
 /*
 ================
-CM_TraceThroughVerticalCylinder
+CM_FlatCull
 
-get the first intersection of the ray with the cylinder
-the cylinder extends halfheight above and below the origin
+Bit per brush of the four starting at bounds that are outside lo and hi
 ================
 */
-void CM_TraceThroughVerticalCylinder (traceWork_t *tw, vec3_t origin, float radius, float halfheight, vec3_t start, vec3_t end)
+static int CM_FlatCull (const float *bounds, int stride, const vec3_t lo, const vec3_t hi)
 {
-	float length, scale, fraction, l1, l2;
-	float a, b, c, d, sqrtd;
-	vec3_t v1, dir, start2d, end2d, org2d, intersection;
+	__m128	out;
 
-	// 2d coordinates
-	VectorSet (start2d, start[0], start[1], 0);
-	VectorSet (end2d, end[0], end[1], 0);
-	VectorSet (org2d, origin[0], origin[1], 0);
-	// if between lower and upper cylinder bounds
-	if (start[2] <= origin[2] + halfheight &&
-		start[2] >= origin[2] - halfheight)
+	out = _mm_cmpgt_ps (_mm_set1_ps (lo[0]), _mm_loadu_ps (bounds + 3 * stride));
+	out = _mm_or_ps (out, _mm_cmpgt_ps (_mm_set1_ps (lo[1]), _mm_loadu_ps (bounds + 4 * stride)));
+	out = _mm_or_ps (out, _mm_cmpgt_ps (_mm_set1_ps (lo[2]), _mm_loadu_ps (bounds + 5 * stride)));
+	out = _mm_or_ps (out, _mm_cmplt_ps (_mm_set1_ps (hi[0]), _mm_loadu_ps (bounds)));
+	out = _mm_or_ps (out, _mm_cmplt_ps (_mm_set1_ps (hi[1]), _mm_loadu_ps (bounds + stride)));
+	out = _mm_or_ps (out, _mm_cmplt_ps (_mm_set1_ps (hi[2]), _mm_loadu_ps (bounds + 2 * stride)));
+
+	return _mm_movemask_ps (out);
+}
+
+/*
+================
+CM_FlatSideDists
+
+The d1 and d2 CM_TraceThroughBrush finds for four sides at a time, with
+the same operations in the same order
+================
+*/
+static void CM_FlatSideDists (const traceWork_t *tw, const float *sides, int stride, float *d1, float *d2)
+{
+	__m128	nx, ny, nz, zero;
+	__m128	ox, oy, oz, neg;
+	__m128	dist;
+
+	nx = _mm_loadu_ps (sides);
+	ny = _mm_loadu_ps (sides + stride);
+	nz = _mm_loadu_ps (sides + 2 * stride);
+	zero = _mm_setzero_ps ();
+
+	// the signbits corner of the box
+	neg = _mm_cmplt_ps (nx, zero);
+	ox = _mm_or_ps (_mm_and_ps (neg, _mm_set1_ps (tw->size[1][0])), _mm_andnot_ps (neg, _mm_set1_ps (tw->size[0][0])));
+	neg = _mm_cmplt_ps (ny, zero);
+	oy = _mm_or_ps (_mm_and_ps (neg, _mm_set1_ps (tw->size[1][1])), _mm_andnot_ps (neg, _mm_set1_ps (tw->size[0][1])));
+	neg = _mm_cmplt_ps (nz, zero);
+	oz = _mm_or_ps (_mm_and_ps (neg, _mm_set1_ps (tw->size[1][2])), _mm_andnot_ps (neg, _mm_set1_ps (tw->size[0][2])));
+
+	dist = _mm_sub_ps (_mm_loadu_ps (sides + 3 * stride),
+		_mm_add_ps (_mm_add_ps (_mm_mul_ps (ox, nx), _mm_mul_ps (oy, ny)), _mm_mul_ps (oz, nz)));
+
+	_mm_storeu_ps (d1, _mm_sub_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (_mm_set1_ps (tw->start[0]), nx),
+		_mm_mul_ps (_mm_set1_ps (tw->start[1]), ny)), _mm_mul_ps (_mm_set1_ps (tw->start[2]), nz)), dist));
+	_mm_storeu_ps (d2, _mm_sub_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (_mm_set1_ps (tw->end[0]), nx),
+		_mm_mul_ps (_mm_set1_ps (tw->end[1]), ny)), _mm_mul_ps (_mm_set1_ps (tw->end[2]), nz)), dist));
+}
+
+/*
+================
+CM_TestBoxInFlatBrush
+
+CM_TestBoxInBrush for a box that already passed the bounds check
+================
+*/
+static void CM_TestBoxInFlatBrush (traceWork_t *tw, const cFlatBrush_t *fb)
+{
+	int			i, stride;
+	const float	*sides;
+	float		d1[4], d2[4];
+
+	sides = cm.flatSides + fb->firstSide;
+	stride = (fb->numsides + 3) & ~3;
+
+	// the first six planes are the axial planes, so we only
+	// need to test the remainder
+	for (i = 6; i < fb->numsides; i++)
 	{
-		// if inside the cylinder
-		VectorSubtract (start2d, org2d, dir);
-		l1 = VectorLengthSquared (dir);
-		if (l1 < Square (radius))
+		if (i == 6 || !(i & 3))
+		{
+			CM_FlatSideDists (tw, sides + (i & ~3), stride, d1, d2);
+		}
+
+		// if completely in front of face, no intersection
+		if (d1[i & 3] > 0)
 		{
-			tw->trace.fraction = 0;
-			tw->trace.startsolid = qtrue;
-			VectorSubtract (end2d, org2d, dir);
-			l1 = VectorLengthSquared (dir);
-			if (l1 < Square (radius))
-			{
-				tw->trace.allsolid = qtrue;
-			}
 			return;
 		}
 	}
 
-	VectorSubtract (end2d, start2d, dir);
-	length = VectorNormalize (dir);
+	// inside this brush
+	tw->trace.startsolid = tw->trace.allsolid = qtrue;
+	tw->trace.fraction = 0;
+	tw->trace.contents = fb->contents;
+}
 
-	l1 = CM_DistanceFromLineSquared (org2d, start2d, end2d, dir);
-	VectorSubtract (end2d, org2d, v1);
-	l2 = VectorLengthSquared (v1);
-	// if no intersection with the cylinder and the end point is at least an epsilon away
-	if (l1 >= Square (radius) && l2 > Square (radius + SURFACE_CLIP_EPSILON))
-	{
-		return;
-	}
+/*
+================
+CM_TestInFlatLeaf
 
-	// (start[0] - origin[0] - t * dir[0]) ^ 2 + (start[1] - origin[1] - t * dir[1]) ^ 2 = radius ^ 2
-	// (v1[0] + t * dir[0]) ^ 2 + (v1[1] + t * dir[1]) ^ 2 = radius ^ 2;
-	// v1[0] ^ 2 + 2 * v1[0] * t * dir[0] + (t * dir[0]) ^ 2 +
-	//						v1[1] ^ 2 + 2 * v1[1] * t * dir[1] + (t * dir[1]) ^ 2 = radius ^ 2
-	// t ^ 2 * (dir[0] ^ 2 + dir[1] ^ 2) + t * (2 * v1[0] * dir[0] + 2 * v1[1] * dir[1]) +
-	//						v1[0] ^ 2 + v1[1] ^ 2 - radius ^ 2 = 0
-	VectorSubtract (start, origin, v1);
-	// dir is normalized so we can use a = 1
-	a = 1.0f;// * (dir[0] * dir[0] + dir[1] * dir[1]);
-	b = 2.0f * (v1[0] * dir[0] + v1[1] * dir[1]);
-	c = v1[0] * v1[0] + v1[1] * v1[1] - (radius + RADIUS_EPSILON) * (radius + RADIUS_EPSILON);
+CM_TestInLeaf for world leaf leafnum
+================
+*/
+void CM_TestInFlatLeaf (traceWork_t *tw, int leafnum)
+{
+	int			k, stride;
+	int			outside;
+	cFlatLeaf_t	*fl;
+	cFlatBrush_t	*fb;
+	const float	*bounds;
 
-	d = b * b - 4.0f * c;// * a;
-	if (d > 0)
-	{
-		sqrtd = SquareRootFloat (d);
-		// = (- b + sqrtd) * 0.5f;// / (2.0f * a);
-		fraction = (-b - sqrtd) * 0.5f;// / (2.0f * a);
+	fl = &cm.flatLeafs[leafnum];
+	bounds = cm.flatBounds + fl->firstBounds;
+	stride = (fl->numBrushes + 3) & ~3;
+	outside = 0;
 
-		if (fraction < 0)
+	// test box position against all brushes in the leaf
+	for (k = 0; k < fl->numBrushes; k++)
+	{
+		if (fl->numGroups && !(k % FLAT_GROUP_BRUSHES)
+			&& CM_FlatBoxOutside (tw->bounds[0], tw->bounds[1], cm.flatGroups[fl->firstGroup + k / FLAT_GROUP_BRUSHES].bounds))
 		{
-			fraction = 0;
+			k += FLAT_GROUP_BRUSHES - 1;
+			continue;
 		}
-		else
+		if (!(k & 3))
 		{
-			fraction /= length;
+			outside = CM_FlatCull (bounds + k, stride, tw->bounds[0], tw->bounds[1]);
 		}
-		if (fraction < tw->trace.fraction)
+		if (outside & (1 << (k & 3)))
 		{
-			VectorSubtract (end, start, dir);
-			VectorMA (start, fraction, dir, intersection);
-			// if the intersection is between the cylinder lower and upper bound
-			if (intersection[2] <= origin[2] + halfheight &&
-				intersection[2] >= origin[2] - halfheight)
-			{
-				tw->trace.fraction = fraction;
-				VectorSubtract (intersection, origin, dir);
-				dir[2] = 0;
+			continue;
+		}
+
+		fb = &cm.flatBrushes[fl->firstBrush + k];
+		if (tw->thread->brushChecks[fb->brushnum] == tw->checkcount)
+		{
+			continue;	// already checked this brush in another leaf
+		}
+		tw->thread->brushChecks[fb->brushnum] = tw->checkcount;
+
+		if (!(fb->contents & tw->contents))
+		{
+			continue;
+		}
+
+		if (tw->sphere.use)
+		{
+			CM_TestBoxInBrush (tw, &cm.brushes[fb->brushnum]);
+		}
+		else
+		{
+			CM_TestBoxInFlatBrush (tw, fb);
+		}
+		if (tw->trace.allsolid)
+		{
+			return;
+		}
+	}
+
+	CM_TestInLeafPatches (tw, &cm.leafs[leafnum]);
+}
+
+/*
+================
+CM_TraceThroughFlatBrush
+
+CM_TraceThroughBrush for a box sweep
+================
+*/
+static void CM_TraceThroughFlatBrush (traceWork_t *tw, const cFlatBrush_t *fb)
+{
+	int			i, stride;
+	int			lead;
+	const float	*sides;
+	float		d1s[4], d2s[4];
+	float		enterFrac, leaveFrac;
+	float		d1, d2;
+	float		f;
+	qboolean	getout, startout;
+	cbrushside_t	*side;
+
+	tw->thread->c_brush_traces++;
+
+	enterFrac = -1.0;
+	leaveFrac = 1.0;
+	lead = -1;
+
+	getout = qfalse;
+	startout = qfalse;
+
+	sides = cm.flatSides + fb->firstSide;
+	stride = (fb->numsides + 3) & ~3;
+
+	// compare the trace against all planes of the brush
+	// find the latest time the trace crosses a plane towards the interior
+	// and the earliest time the trace crosses a plane towards the exterior
+	for (i = 0; i < fb->numsides; i++)
+	{
+		if (!(i & 3))
+		{
+			CM_FlatSideDists (tw, sides + i, stride, d1s, d2s);
+		}
+		d1 = d1s[i & 3];
+		d2 = d2s[i & 3];
+
+		if (d2 > 0)
+		{
+			getout = qtrue;	// endpoint is not in solid
+		}
+		if (d1 > 0)
+		{
+			startout = qtrue;
+		}
+
+		// if completely in front of face, no intersection with the entire brush
+		if (d1 > 0 && (d2 >= SURFACE_CLIP_EPSILON || d2 >= d1))
+		{
+			return;
+		}
+
+		// if it doesn't cross the plane, the plane isn't relevent
+		if (d1 <= 0 && d2 <= 0)
+		{
+			continue;
+		}
+
+		// crosses face
+		if (d1 > d2)
+		{	// enter
+			f = (d1 - SURFACE_CLIP_EPSILON) / (d1 - d2);
+			if (f < 0)
+			{
+				f = 0;
+			}
+			if (f > enterFrac)
+			{
+				enterFrac = f;
+				lead = i;
+			}
+		}
+		else
+		{	// leave
+			f = (d1 + SURFACE_CLIP_EPSILON) / (d1 - d2);
+			if (f > 1)
+			{
+				f = 1;
+			}
+			if (f < leaveFrac)
+			{
+				leaveFrac = f;
+			}
+		}
+	}
+
+	// all planes have been checked, and the trace was not
+	// completely outside the brush
+	if (!startout)
+	{	// original point was inside brush
+		tw->trace.startsolid = qtrue;
+		if (!getout)
+		{
+			tw->trace.allsolid = qtrue;
+			tw->trace.fraction = 0;
+			tw->trace.contents = fb->contents;
+		}
+		return;
+	}
+
+	if (enterFrac < leaveFrac)
+	{
+		if (enterFrac > -1 && enterFrac < tw->trace.fraction)
+		{
+			if (enterFrac < 0)
+			{
+				enterFrac = 0;
+			}
+			side = cm.brushes[fb->brushnum].sides + lead;
+			tw->trace.fraction = enterFrac;
+			tw->trace.plane = *side->plane;
+			tw->trace.surfaceFlags = side->surfaceFlags;
+			tw->trace.contents = fb->contents;
+		}
+	}
+}
+
+/*
+================
+CM_TraceThroughFlatLeaf
+
+CM_TraceThroughLeaf for world leaf leafnum
+================
+*/
+void CM_TraceThroughFlatLeaf (traceWork_t *tw, int leafnum)
+{
+	int			i, k, stride;
+	int			outside;
+	cFlatLeaf_t	*fl;
+	cFlatBrush_t	*fb;
+	cFlatGroup_t	*fg;
+	const float	*bounds;
+	vec3_t		lo, hi;
+
+	fl = &cm.flatLeafs[leafnum];
+	bounds = cm.flatBounds + fl->firstBounds;
+	stride = (fl->numBrushes + 3) & ~3;
+	outside = 0;
+
+	// brushes this far from the sweep can't clip it
+	for (i = 0; i < 3; i++)
+	{
+		lo[i] = tw->bounds[0][i] - 1;
+		hi[i] = tw->bounds[1][i] + 1;
+	}
+
+	// trace line against all brushes in the leaf
+	for (k = 0; k < fl->numBrushes; k++)
+	{
+		if (fl->numGroups && !(k % FLAT_GROUP_BRUSHES))
+		{
+			fg = &cm.flatGroups[fl->firstGroup + k / FLAT_GROUP_BRUSHES];
+			if (fg->axial && CM_FlatBoxOutside (lo, hi, fg->bounds))
+			{
+				k += FLAT_GROUP_BRUSHES - 1;
+				continue;
+			}
+		}
+		if (!(k & 3))
+		{
+			outside = CM_FlatCull (bounds + k, stride, lo, hi);
+		}
+
+		fb = &cm.flatBrushes[fl->firstBrush + k];
+		if ((outside & (1 << (k & 3))) && fb->axial)
+		{
+			continue;
+		}
+
+		if (tw->thread->brushChecks[fb->brushnum] == tw->checkcount)
+		{
+			continue;	// already checked this brush in another leaf
+		}
+		tw->thread->brushChecks[fb->brushnum] = tw->checkcount;
+
+		if (!(fb->contents & tw->contents))
+		{
+			continue;
+		}
+
+		if (tw->sphere.use)
+		{
+			CM_TraceThroughBrush (tw, &cm.brushes[fb->brushnum]);
+		}
+		else
+		{
+			CM_TraceThroughFlatBrush (tw, fb);
+		}
+		if (!tw->trace.fraction)
+		{
+			return;
+		}
+	}
+
+	CM_TraceThroughLeafPatches (tw, &cm.leafs[leafnum]);
+}
+
+#define RADIUS_EPSILON		1.0f
+
+/*
+================
+CM_TraceThroughSphere
+
+get the first intersection of the ray with the sphere
+================
+*/
+void CM_TraceThroughSphere (traceWork_t *tw, vec3_t origin, float radius, vec3_t start, vec3_t end)
+{
+	float l1, l2, length, scale, fraction;
+	float a, b, c, d, sqrtd;
+	vec3_t v1, dir, intersection;
+
+	// if inside the sphere
+	VectorSubtract (start, origin, dir);
+	l1 = VectorLengthSquared (dir);
+	if (l1 < Square (radius))
+	{
+		tw->trace.fraction = 0;
+		tw->trace.startsolid = qtrue;
+		// test for allsolid
+		VectorSubtract (end, origin, dir);
+		l1 = VectorLengthSquared (dir);
+		if (l1 < Square (radius))
+		{
+			tw->trace.allsolid = qtrue;
+		}
+		return;
+	}
+
+	VectorSubtract (end, start, dir);
+	length = VectorNormalize (dir);
+
+	l1 = CM_DistanceFromLineSquared (origin, start, end, dir);
+	VectorSubtract (end, origin, v1);
+	l2 = VectorLengthSquared (v1);
+	// if no intersection with the sphere and the end point is at least an epsilon away
+	if (l1 >= Square (radius) && l2 > Square (radius + SURFACE_CLIP_EPSILON))
+	{
+		return;
+	}
+
+	//	| origin - (start + t * dir) | = radius
+	//	a = dir[0]^2 + dir[1]^2 + dir[2]^2;
+	//	b = 2 * (dir[0] * (start[0] - origin[0]) + dir[1] * (start[1] - origin[1]) + dir[2] * (start[2] - origin[2]));
+	//	c = (start[0] - origin[0])^2 + (start[1] - origin[1])^2 + (start[2] - origin[2])^2 - radius^2;
+	VectorSubtract (start, origin, v1);
+	// dir is normalized so a = 1
+	a = 1.0f;//dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+	b = 2.0f * (dir[0] * v1[0] + dir[1] * v1[1] + dir[2] * v1[2]);
+	c = v1[0] * v1[0] + v1[1] * v1[1] + v1[2] * v1[2] - (radius + RADIUS_EPSILON) * (radius + RADIUS_EPSILON);
+
+	d = b * b - 4.0f * c;// * a;
+	if (d > 0)
+	{
+		sqrtd = SquareRootFloat (d);
+		// = (- b + sqrtd) * 0.5f; // / (2.0f * a);
+		fraction = (-b - sqrtd) * 0.5f; // / (2.0f * a);
+
+		if (fraction < 0)
+		{
+			fraction = 0;
+		}
+		else
+		{
+			fraction /= length;
+		}
+		if (fraction < tw->trace.fraction)
+		{
+			tw->trace.fraction = fraction;
+			VectorSubtract (end, start, dir);
+			VectorMA (start, fraction, dir, intersection);
+			VectorSubtract (intersection, origin, dir);
 #ifdef CAPSULE_DEBUG
-				l2 = VectorLength(dir);
-				if (l2 <= radius) {
-					int bah = 1;
-				}
+			l2 = VectorLength(dir);
+			if (l2 < radius) {
+				int bah = 1;
+			}
 #endif
-				scale = 1 / (radius + RADIUS_EPSILON);
-				VectorScale (dir, scale, dir);
-				VectorCopy (dir, tw->trace.plane.normal);
-				VectorAdd (tw->modelOrigin, intersection, intersection);
-				tw->trace.plane.dist = DotProduct (tw->trace.plane.normal, intersection);
-				tw->trace.contents = CONTENTS_BODY;
+			scale = 1 / (radius + RADIUS_EPSILON);
+			VectorScale (dir, scale, dir);
+			VectorCopy (dir, tw->trace.plane.normal);
+			VectorAdd (tw->modelOrigin, intersection, intersection);
+			tw->trace.plane.dist = DotProduct (tw->trace.plane.normal, intersection);
+			tw->trace.contents = CONTENTS_BODY;
+		}
+	}
+	else if (d == 0)
+	{
+		//t1 = (- b ) / 2;
+		// slide along the sphere
+	}
+	// no intersection at all
+}
+
+/*
+================
+CM_TraceThroughVerticalCylinder
+
+get the first intersection of the ray with the cylinder
+the cylinder extends halfheight above and below the origin
+================
+*/
+void CM_TraceThroughVerticalCylinder (traceWork_t *tw, vec3_t origin, float radius, float halfheight, vec3_t start, vec3_t end)
+{
+	float length, scale, fraction, l1, l2;
+	float a, b, c, d, sqrtd;
+	vec3_t v1, dir, start2d, end2d, org2d, intersection;
+
+	// 2d coordinates
+	VectorSet (start2d, start[0], start[1], 0);
+	VectorSet (end2d, end[0], end[1], 0);
+	VectorSet (org2d, origin[0], origin[1], 0);
+	// if between lower and upper cylinder bounds
+	if (start[2] <= origin[2] + halfheight &&
+		start[2] >= origin[2] - halfheight)
+	{
+		// if inside the cylinder
+		VectorSubtract (start2d, org2d, dir);
+		l1 = VectorLengthSquared (dir);
+		if (l1 < Square (radius))
+		{
+			tw->trace.fraction = 0;
+			tw->trace.startsolid = qtrue;
+			VectorSubtract (end2d, org2d, dir);
+			l1 = VectorLengthSquared (dir);
+			if (l1 < Square (radius))
+			{
+				tw->trace.allsolid = qtrue;
+			}
+			return;
+		}
+	}
+
+	VectorSubtract (end2d, start2d, dir);
+	length = VectorNormalize (dir);
+
+	l1 = CM_DistanceFromLineSquared (org2d, start2d, end2d, dir);
+	VectorSubtract (end2d, org2d, v1);
+	l2 = VectorLengthSquared (v1);
+	// if no intersection with the cylinder and the end point is at least an epsilon away
+	if (l1 >= Square (radius) && l2 > Square (radius + SURFACE_CLIP_EPSILON))
+	{
+		return;
+	}
+
+	// (start[0] - origin[0] - t * dir[0]) ^ 2 + (start[1] - origin[1] - t * dir[1]) ^ 2 = radius ^ 2
+	// (v1[0] + t * dir[0]) ^ 2 + (v1[1] + t * dir[1]) ^ 2 = radius ^ 2;
+	// v1[0] ^ 2 + 2 * v1[0] * t * dir[0] + (t * dir[0]) ^ 2 +
+	//						v1[1] ^ 2 + 2 * v1[1] * t * dir[1] + (t * dir[1]) ^ 2 = radius ^ 2
+	// t ^ 2 * (dir[0] ^ 2 + dir[1] ^ 2) + t * (2 * v1[0] * dir[0] + 2 * v1[1] * dir[1]) +
+	//						v1[0] ^ 2 + v1[1] ^ 2 - radius ^ 2 = 0
+	VectorSubtract (start, origin, v1);
+	// dir is normalized so we can use a = 1
+	a = 1.0f;// * (dir[0] * dir[0] + dir[1] * dir[1]);
+	b = 2.0f * (v1[0] * dir[0] + v1[1] * dir[1]);
+	c = v1[0] * v1[0] + v1[1] * v1[1] - (radius + RADIUS_EPSILON) * (radius + RADIUS_EPSILON);
+
+	d = b * b - 4.0f * c;// * a;
+	if (d > 0)
+	{
+		sqrtd = SquareRootFloat (d);
+		// = (- b + sqrtd) * 0.5f;// / (2.0f * a);
+		fraction = (-b - sqrtd) * 0.5f;// / (2.0f * a);
+
+		if (fraction < 0)
+		{
+			fraction = 0;
+		}
+		else
+		{
+			fraction /= length;
+		}
+		if (fraction < tw->trace.fraction)
+		{
+			VectorSubtract (end, start, dir);
+			VectorMA (start, fraction, dir, intersection);
+			// if the intersection is between the cylinder lower and upper bound
+			if (intersection[2] <= origin[2] + halfheight &&
+				intersection[2] >= origin[2] - halfheight)
+			{
+				tw->trace.fraction = fraction;
+				VectorSubtract (intersection, origin, dir);
+				dir[2] = 0;
+#ifdef CAPSULE_DEBUG
+				l2 = VectorLength(dir);
+				if (l2 <= radius) {
+					int bah = 1;
+				}
+#endif
+				scale = 1 / (radius + RADIUS_EPSILON);
+				VectorScale (dir, scale, dir);
+				VectorCopy (dir, tw->trace.plane.normal);
+				VectorAdd (tw->modelOrigin, intersection, intersection);
+				tw->trace.plane.dist = DotProduct (tw->trace.plane.normal, intersection);
+				tw->trace.contents = CONTENTS_BODY;
+			}
+		}
+	}
+	else if (d == 0)
+	{
+		//t[0] = (- b ) / 2 * a;
+		// slide along the cylinder
+	}
+	// no intersection at all
+}
+
+/*
+================
+CM_TraceCapsuleThroughCapsule
+
+capsule vs. capsule collision (not rotated)
+================
+*/
+void CM_TraceCapsuleThroughCapsule (traceWork_t *tw, clipHandle_t model)
+{
+	int i;
+	vec3_t mins, maxs;
+	vec3_t top, bottom, starttop, startbottom, endtop, endbottom;
+	vec3_t offset, symetricSize[2];
+	float radius, halfwidth, halfheight, offs, h;
+
+	CM_ModelBounds (model, mins, maxs);
+	// test trace bounds vs. capsule bounds
+	if (tw->bounds[0][0] > maxs[0] + RADIUS_EPSILON
+		|| tw->bounds[0][1] > maxs[1] + RADIUS_EPSILON
+		|| tw->bounds[0][2] > maxs[2] + RADIUS_EPSILON
+		|| tw->bounds[1][0] < mins[0] - RADIUS_EPSILON
+		|| tw->bounds[1][1] < mins[1] - RADIUS_EPSILON
+		|| tw->bounds[1][2] < mins[2] - RADIUS_EPSILON
+		)
+	{
+		return;
+	}
+	// top origin and bottom origin of each sphere at start and end of trace
+	VectorAdd (tw->start, tw->sphere.offset, starttop);
+	VectorSubtract (tw->start, tw->sphere.offset, startbottom);
+	VectorAdd (tw->end, tw->sphere.offset, endtop);
+	VectorSubtract (tw->end, tw->sphere.offset, endbottom);
+
+	// calculate top and bottom of the capsule spheres to collide with
+	for (i = 0; i < 3; i++)
+	{
+		offset[i] = (mins[i] + maxs[i]) * 0.5;
+		symetricSize[0][i] = mins[i] - offset[i];
+		symetricSize[1][i] = maxs[i] - offset[i];
+	}
+	halfwidth = symetricSize[1][0];
+	halfheight = symetricSize[1][2];
+	radius = (halfwidth > halfheight) ? halfheight : halfwidth;
+	offs = halfheight - radius;
+	VectorCopy (offset, top);
+	top[2] += offs;
+	VectorCopy (offset, bottom);
+	bottom[2] -= offs;
+	// expand radius of spheres
+	radius += tw->sphere.radius;
+	// if there is horizontal movement
+	if (tw->start[0] != tw->end[0] || tw->start[1] != tw->end[1])
+	{
+		// height of the expanded cylinder is the height of both cylinders minus the radius of both spheres
+		h = halfheight + tw->sphere.halfheight - radius;
+		// if the cylinder has a height
+		if (h > 0)
+		{
+			// test for collisions between the cylinders
+			CM_TraceThroughVerticalCylinder (tw, offset, radius, h, tw->start, tw->end);
+		}
+	}
+	// test for collision between the spheres
+	CM_TraceThroughSphere (tw, top, radius, startbottom, endbottom);
+	CM_TraceThroughSphere (tw, bottom, radius, starttop, endtop);
+}
+
+/*
+================
+CM_TraceBoundingBoxThroughCapsule
+
+bounding box vs. capsule collision
+================
+*/
+void CM_TraceBoundingBoxThroughCapsule (traceWork_t *tw, clipHandle_t model)
+{
+	vec3_t mins, maxs, offset, size[2];
+	clipHandle_t h;
+	cmodel_t *cmod;
+	int i;
+
+	// mins maxs of the capsule
+	CM_ModelBounds (model, mins, maxs);
+
+	// offset for capsule center
+	for (i = 0; i < 3; i++)
+	{
+		offset[i] = (mins[i] + maxs[i]) * 0.5;
+		size[0][i] = mins[i] - offset[i];
+		size[1][i] = maxs[i] - offset[i];
+		tw->start[i] -= offset[i];
+		tw->end[i] -= offset[i];
+	}
+
+	// replace the bounding box with the capsule
+	tw->sphere.use = qtrue;
+	tw->sphere.radius = (size[1][0] > size[1][2]) ? size[1][2] : size[1][0];
+	tw->sphere.halfheight = size[1][2];
+	VectorSet (tw->sphere.offset, 0, 0, size[1][2] - tw->sphere.radius);
+
+	// replace the capsule with the bounding box
+	h = CM_TempBoxModel (tw->size[0], tw->size[1], qfalse);
+	// calculate collision
+	cmod = CM_ClipHandleToModel (h);
+	CM_TraceThroughLeaf (tw, &cmod->leaf);
+}
+
+//=========================================================================================
+
+/*
+==================
+CM_TraceThroughTree
+
+Traverse all the contacted leafs from the start to the end position.
+If the trace is a point, they will be exactly in order, but for larger
+trace volumes it is possible to hit something in a later leaf with
+a smaller intercept fraction.
+==================
+*/
+void CM_TraceThroughTree (traceWork_t *tw, int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
+{
+	cFlatNode_t	*node;
+	cplane_t	*plane;
+	float		t1, t2, offset;
+	float		frac, frac2;
+	float		idist;
+	vec3_t		mid;
+	int			side;
+	float		midf;
+
+	if (tw->trace.fraction <= p1f)
+	{
+		return;		// already hit something nearer
+	}
+
+	// if < 0, we are in a leaf node
+	if (num < 0)
+	{
+		if (cm.flatLeafs)
+		{
+			CM_TraceThroughFlatLeaf (tw, -1 - num);
+		}
+		else
+		{
+			CM_TraceThroughLeaf (tw, &cm.leafs[-1 - num]);
+		}
+		return;
+	}
+
+	// find the point distances to the seperating plane
+	// and the offset for the size of the box
+	node = cm.flatNodes + num;
+	plane = &node->plane;
+
+	// adjust the plane distance apropriately for mins/maxs
+	if (plane->type < 3)
+	{
+		t1 = p1[plane->type] - plane->dist;
+		t2 = p2[plane->type] - plane->dist;
+		offset = tw->extents[plane->type];
+	}
+	else
+	{
+		t1 = DotProduct (plane->normal, p1) - plane->dist;
+		t2 = DotProduct (plane->normal, p2) - plane->dist;
+		if (tw->isPoint)
+		{
+			offset = 0;
+		}
+		else
+		{
+#if 0 // bk010201 - DEAD
+			// an axial brush right behind a slanted bsp plane
+			// will poke through when expanded, so adjust
+			// by sqrt(3)
+			offset = fabs(tw->extents[0]*plane->normal[0]) +
+				fabs(tw->extents[1]*plane->normal[1]) +
+				fabs(tw->extents[2]*plane->normal[2]);
+
+			offset *= 2;
+			offset = tw->maxOffset;
+#endif
+			// this is silly
+			offset = 2048;
+		}
+	}
+
+	// see which sides we need to consider
+	if (t1 >= offset + 1 && t2 >= offset + 1)
+	{
+		CM_TraceThroughTree (tw, node->children[0], p1f, p2f, p1, p2);
+		return;
+	}
+	if (t1 < -offset - 1 && t2 < -offset - 1)
+	{
+		CM_TraceThroughTree (tw, node->children[1], p1f, p2f, p1, p2);
+		return;
+	}
+
+	// put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
+	if (t1 < t2)
+	{
+		idist = 1.0 / (t1 - t2);
+		side = 1;
+		frac2 = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+		frac = (t1 - offset + SURFACE_CLIP_EPSILON)*idist;
+	}
+	else if (t1 > t2)
+	{
+		idist = 1.0 / (t1 - t2);
+		side = 0;
+		frac2 = (t1 - offset - SURFACE_CLIP_EPSILON)*idist;
+		frac = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+	}
+	else
+	{
+		side = 0;
+		frac = 1;
+		frac2 = 0;
+	}
+
+	// move up to the node
+	if (frac < 0)
+	{
+		frac = 0;
+	}
+	if (frac > 1)
+	{
+		frac = 1;
+	}
+
+	midf = p1f + (p2f - p1f)*frac;
+
+	mid[0] = p1[0] + frac*(p2[0] - p1[0]);
+	mid[1] = p1[1] + frac*(p2[1] - p1[1]);
+	mid[2] = p1[2] + frac*(p2[2] - p1[2]);
+
+	CM_TraceThroughTree (tw, node->children[side], p1f, midf, p1, mid);
+
+
+	// go past the node
+	if (frac2 < 0)
+	{
+		frac2 = 0;
+	}
+	if (frac2 > 1)
+	{
+		frac2 = 1;
+	}
+
+	midf = p1f + (p2f - p1f)*frac2;
+
+	mid[0] = p1[0] + frac2*(p2[0] - p1[0]);
+	mid[1] = p1[1] + frac2*(p2[1] - p1[1]);
+	mid[2] = p1[2] + frac2*(p2[2] - p1[2]);
+
+	CM_TraceThroughTree (tw, node->children[side ^ 1], midf, p2f, mid, p2);
+}
+
+/*
+===============================================================================
+
+PACKET TRACING
+
+CM_TraceBatch sweeps world traces in packets of four.  The whole packet
+walks the tree together, with the plane tests done four wide and a lane
+mask saying which rays are still visiting a node.  A ray that straddles a
+node stays in the packet: each lane carries its own segment, cut at the
+node like the scalar recursion would cut it, and the straddling lanes visit
+the near child before the far one, so every ray sees the nodes in the same
+order as CM_TraceThroughTree.  In the leafs the brush side tests are done
+four wide too.  Position tests and capsules never enter a packet, they go
+through CM_Trace.  The arithmetic mirrors the scalar code operation
+for operation, down to the double precision divides, so the results are
+bit identical to CM_BoxTrace.
+
+===============================================================================
+*/
+
+#define	PACKET_SIZE		4
+
+typedef struct
+{
+	traceWork_t	*tw[PACKET_SIZE];
+	cmThread_t	*thread;
+	int			stamp;				// brushChecks value, lanes that checked the brush in the low bits
+
+	// the lanes' parameters laid out for the vector code
+	float		start[3][PACKET_SIZE];
+	float		end[3][PACKET_SIZE];
+	float		extents[3][PACKET_SIZE];
+	float		slantOffset[PACKET_SIZE];	// offset CM_TraceThroughTree uses for non axial planes
+	float		offsets[8][3][PACKET_SIZE];
+} tracePacket_t;
+
+// the part of each lane's sweep that is being pushed down the tree
+typedef struct
+{
+	float		p1f[PACKET_SIZE];
+	float		p2f[PACKET_SIZE];
+	float		p1[3][PACKET_SIZE];
+	float		p2[3][PACKET_SIZE];
+} packetSegment_t;
+
+static const int	packetLaneNums[16] = { 0, 0, 1, 0, 2, 0, 0, 0, 3 };
+
+static const int	packetLaneMasks[16][4] = {
+	{ 0, 0, 0, 0 }, { -1, 0, 0, 0 }, { 0, -1, 0, 0 }, { -1, -1, 0, 0 },
+	{ 0, 0, -1, 0 }, { -1, 0, -1, 0 }, { 0, -1, -1, 0 }, { -1, -1, -1, 0 },
+	{ 0, 0, 0, -1 }, { -1, 0, 0, -1 }, { 0, -1, 0, -1 }, { -1, -1, 0, -1 },
+	{ 0, 0, -1, -1 }, { -1, 0, -1, -1 }, { 0, -1, -1, -1 }, { -1, -1, -1, -1 }
+};
+
+/*
+================
+CM_PacketDot
+
+DotProduct (normal, v) for all four lanes, summed in the same order;
+v is a [3][PACKET_SIZE] array
+================
+*/
+static __m128 CM_PacketDot (const vec3_t normal, const float *v)
+{
+	return _mm_add_ps (_mm_add_ps (
+		_mm_mul_ps (_mm_set1_ps (normal[0]), _mm_loadu_ps (v)),
+		_mm_mul_ps (_mm_set1_ps (normal[1]), _mm_loadu_ps (v + PACKET_SIZE))),
+		_mm_mul_ps (_mm_set1_ps (normal[2]), _mm_loadu_ps (v + 2 * PACKET_SIZE)));
+}
+
+/*
+================
+CM_PacketFrac
+
+(d1 + epsilon) / denom evaluated in double precision like the scalar code,
+where SURFACE_CLIP_EPSILON promotes the expression
+================
+*/
+static __m128 CM_PacketFrac (__m128 d1, double epsilon, __m128 denom)
+{
+	__m128d	eps;
+	__m128d	lo, hi;
+
+	eps = _mm_set1_pd (epsilon);
+
+	lo = _mm_div_pd (_mm_add_pd (_mm_cvtps_pd (d1), eps), _mm_cvtps_pd (denom));
+	hi = _mm_div_pd (_mm_add_pd (_mm_cvtps_pd (_mm_movehl_ps (d1, d1)), eps), _mm_cvtps_pd (_mm_movehl_ps (denom, denom)));
+
+	return _mm_movelh_ps (_mm_cvtpd_ps (lo), _mm_cvtpd_ps (hi));
+}
+
+/*
+================
+CM_PacketSelect
+================
+*/
+static __m128 CM_PacketSelect (__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps (_mm_and_ps (mask, a), _mm_andnot_ps (mask, b));
+}
+
+/*
+================
+CM_TracePacketThroughBrush
+
+CM_TraceThroughBrush for the lanes in mask, none of which are capsules
+================
+*/
+static void CM_TracePacketThroughBrush (tracePacket_t *packet, cbrush_t *brush, int mask)
+{
+	int			i, lane;
+	cplane_t	*plane;
+	cbrushside_t	*side;
+	traceWork_t	*tw;
+	__m128		live, getout, startout;
+	__m128		enterFrac, leaveFrac;
+	__m128i		leadside;
+	__m128		dist, d1, d2, denom, f;
+	__m128		cross, enter, leave, update;
+	__m128		zero, one, eps;
+	float		enterFracs[PACKET_SIZE], leaveFracs[PACKET_SIZE];
+	int			leadsides[PACKET_SIZE];
+	int			getouts, startouts;
+
+	if (!brush->numsides)
+	{
+		return;
+	}
+
+	for (lane = 0; lane < PACKET_SIZE; lane++)
+	{
+		if (mask & (1 << lane))
+		{
+			packet->thread->c_brush_traces++;
+		}
+	}
+
+	zero = _mm_setzero_ps ();
+	one = _mm_set1_ps (1.0f);
+	eps = _mm_set1_ps (SURFACE_CLIP_EPSILON);
+
+	live = _mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *) packetLaneMasks[mask]));
+	getout = zero;
+	startout = zero;
+	enterFrac = _mm_set1_ps (-1.0f);
+	leaveFrac = one;
+	leadside = _mm_setzero_si128 ();
+
+	for (i = 0; i < brush->numsides; i++)
+	{
+		side = brush->sides + i;
+		plane = side->plane;
+
+		// adjust the plane distance apropriately for mins/maxs
+		dist = _mm_sub_ps (_mm_set1_ps (plane->dist), CM_PacketDot (plane->normal, packet->offsets[plane->signbits][0]));
+
+		d1 = _mm_sub_ps (CM_PacketDot (plane->normal, packet->start[0]), dist);
+		d2 = _mm_sub_ps (CM_PacketDot (plane->normal, packet->end[0]), dist);
+
+		getout = _mm_or_ps (getout, _mm_cmpgt_ps (d2, zero));
+		startout = _mm_or_ps (startout, _mm_cmpgt_ps (d1, zero));
+
+		// if completely in front of face, no intersection with the entire brush
+		live = _mm_andnot_ps (_mm_and_ps (_mm_cmpgt_ps (d1, zero),
+			_mm_or_ps (_mm_cmpge_ps (d2, eps), _mm_cmpge_ps (d2, d1))), live);
+
+		if (!_mm_movemask_ps (live))
+		{
+			return;
+		}
+
+		// if it doesn't cross the plane, the plane isn't relevent
+		cross = _mm_and_ps (live, _mm_or_ps (_mm_cmpgt_ps (d1, zero), _mm_cmpgt_ps (d2, zero)));
+		if (!_mm_movemask_ps (cross))
+		{
+			continue;
+		}
+
+		enter = _mm_and_ps (cross, _mm_cmpgt_ps (d1, d2));
+		leave = _mm_andnot_ps (_mm_cmpgt_ps (d1, d2), cross);
+		denom = _mm_sub_ps (d1, d2);
+
+		// enter
+		f = CM_PacketFrac (d1, -SURFACE_CLIP_EPSILON, denom);
+		f = _mm_andnot_ps (_mm_cmplt_ps (f, zero), f);
+		update = _mm_and_ps (enter, _mm_cmpgt_ps (f, enterFrac));
+		enterFrac = CM_PacketSelect (update, f, enterFrac);
+		leadside = _mm_or_si128 (_mm_and_si128 (_mm_castps_si128 (update), _mm_set1_epi32 (i)),
+			_mm_andnot_si128 (_mm_castps_si128 (update), leadside));
+
+		// leave
+		f = CM_PacketFrac (d1, SURFACE_CLIP_EPSILON, denom);
+		f = CM_PacketSelect (_mm_cmpgt_ps (f, one), one, f);
+		update = _mm_and_ps (leave, _mm_cmplt_ps (f, leaveFrac));
+		leaveFrac = CM_PacketSelect (update, f, leaveFrac);
+	}
+
+	mask = _mm_movemask_ps (live);
+	getouts = _mm_movemask_ps (getout);
+	startouts = _mm_movemask_ps (startout);
+	_mm_storeu_ps (enterFracs, enterFrac);
+	_mm_storeu_ps (leaveFracs, leaveFrac);
+	_mm_storeu_si128 ((__m128i *) leadsides, leadside);
+
+	// the rest is the scalar code, per lane
+	for (lane = 0; lane < PACKET_SIZE; lane++)
+	{
+		if (!(mask & (1 << lane)))
+		{
+			continue;
+		}
+
+		tw = packet->tw[lane];
+
+		// all planes have been checked, and the trace was not
+		// completely outside the brush
+		if (!(startouts & (1 << lane)))
+		{	// original point was inside brush
+			tw->trace.startsolid = qtrue;
+			if (!(getouts & (1 << lane)))
+			{
+				tw->trace.allsolid = qtrue;
+				tw->trace.fraction = 0;
+				tw->trace.contents = brush->contents;
+			}
+			continue;
+		}
+
+		if (enterFracs[lane] < leaveFracs[lane])
+		{
+			if (enterFracs[lane] > -1 && enterFracs[lane] < tw->trace.fraction)
+			{
+				if (enterFracs[lane] < 0)
+				{
+					enterFracs[lane] = 0;
+				}
+				side = brush->sides + leadsides[lane];
+				tw->trace.fraction = enterFracs[lane];
+				tw->trace.plane = *side->plane;
+				tw->trace.surfaceFlags = side->surfaceFlags;
+				tw->trace.contents = brush->contents;
+			}
+		}
+	}
+}
+
+/*
+================
+CM_TracePacketThroughLeaf
+================
+*/
+static void CM_TracePacketThroughLeaf (tracePacket_t *packet, cLeaf_t *leaf, int mask)
+{
+	int			k, lane;
+	int			brushnum;
+	int			check, checked, test;
+	cbrush_t	*b;
+
+	// trace line against all brushes in the leaf
+	for (k = 0; k < leaf->numLeafBrushes; k++)
+	{
+		brushnum = cm.leafbrushes[leaf->firstLeafBrush + k];
+
+		// a brush stamped by something else just gets tested again,
+		// which can't change the result
+		check = packet->thread->brushChecks[brushnum];
+		checked = ((check & ~15) == packet->stamp) ? (check & 15) : 0;
+
+		test = mask & ~checked;
+		if (!test)
+		{
+			continue;	// already checked this brush in another leaf
+		}
+		packet->thread->brushChecks[brushnum] = packet->stamp | checked | mask;
+		b = &cm.brushes[brushnum];
+
+		for (lane = 0; lane < PACKET_SIZE; lane++)
+		{
+			if ((test & (1 << lane)) && !(b->contents & packet->tw[lane]->contents))
+			{
+				test &= ~(1 << lane);
+			}
+		}
+
+		if (!test)
+		{
+			continue;
+		}
+
+		// a lone ray is quicker through the scalar code
+		if (!(test & (test - 1)))
+		{
+			CM_TraceThroughBrush (packet->tw[packetLaneNums[test]], b);
+		}
+		else
+		{
+			CM_TracePacketThroughBrush (packet, b, test);
+		}
+
+		for (lane = 0; lane < PACKET_SIZE; lane++)
+		{
+			if ((test & (1 << lane)) && !packet->tw[lane]->trace.fraction)
+			{
+				mask &= ~(1 << lane);
+			}
+		}
+
+		if (!mask)
+		{
+			return;
+		}
+	}
+
+	for (lane = 0; lane < PACKET_SIZE; lane++)
+	{
+		if (mask & (1 << lane))
+		{
+			CM_TraceThroughLeafPatches (packet->tw[lane], leaf);
+		}
+	}
+}
+
+/*
+================
+CM_TracePacketThroughFlatLeaf
+
+CM_TracePacketThroughLeaf for world leaf leafnum.  The brushes are culled
+against the box around all the lanes' sweeps, then each lane against its own.
+================
+*/
+static void CM_TracePacketThroughFlatLeaf (tracePacket_t *packet, int leafnum, int mask)
+{
+	int			i, k, lane;
+	int			stride;
+	int			check, checked, test;
+	int			outside;
+	cFlatLeaf_t	*fl;
+	cFlatBrush_t	*fb;
+	cFlatGroup_t	*fg;
+	const float	*bounds;
+	traceWork_t	*tw;
+	vec3_t		lo, hi;
+	vec3_t		laneLo[PACKET_SIZE], laneHi[PACKET_SIZE];
+
+	fl = &cm.flatLeafs[leafnum];
+	bounds = cm.flatBounds + fl->firstBounds;
+	stride = (fl->numBrushes + 3) & ~3;
+	outside = 0;
+
+	// brushes this far from the sweeps can't clip them
+	ClearBounds (lo, hi);
+	for (lane = 0; lane < PACKET_SIZE; lane++)
+	{
+		if (!(mask & (1 << lane)))
+		{
+			continue;
+		}
+		tw = packet->tw[lane];
+		for (i = 0; i < 3; i++)
+		{
+			laneLo[lane][i] = tw->bounds[0][i] - 1;
+			laneHi[lane][i] = tw->bounds[1][i] + 1;
+		}
+		AddPointToBounds (laneLo[lane], lo, hi);
+		AddPointToBounds (laneHi[lane], lo, hi);
+	}
+
+	// trace line against all brushes in the leaf
+	for (k = 0; k < fl->numBrushes; k++)
+	{
+		if (fl->numGroups && !(k % FLAT_GROUP_BRUSHES))
+		{
+			fg = &cm.flatGroups[fl->firstGroup + k / FLAT_GROUP_BRUSHES];
+			if (fg->axial && CM_FlatBoxOutside (lo, hi, fg->bounds))
+			{
+				k += FLAT_GROUP_BRUSHES - 1;
+				continue;
+			}
+		}
+		if (!(k & 3))
+		{
+			outside = CM_FlatCull (bounds + k, stride, lo, hi);
+		}
+
+		fb = &cm.flatBrushes[fl->firstBrush + k];
+		if ((outside & (1 << (k & 3))) && fb->axial)
+		{
+			continue;
+		}
+
+		// a brush stamped by something else just gets tested again,
+		// which can't change the result
+		check = packet->thread->brushChecks[fb->brushnum];
+		checked = ((check & ~15) == packet->stamp) ? (check & 15) : 0;
+
+		test = mask & ~checked;
+		if (!test)
+		{
+			continue;	// already checked this brush in another leaf
+		}
+
+		for (lane = 0; lane < PACKET_SIZE; lane++)
+		{
+			if (!(test & (1 << lane)))
+			{
+				continue;
+			}
+			if (!(fb->contents & packet->tw[lane]->contents)
+				|| (fb->axial && CM_FlatBoxOutside (laneLo[lane], laneHi[lane], cm.brushes[fb->brushnum].bounds)))
+			{
+				test &= ~(1 << lane);
+			}
+		}
+
+		// lanes that skipped it would skip it again, so they count as checked too
+		packet->thread->brushChecks[fb->brushnum] = packet->stamp | checked | mask;
+
+		if (!test)
+		{
+			continue;
+		}
+
+		// a lone ray is quicker through the scalar code
+		if (!(test & (test - 1)))
+		{
+			CM_TraceThroughFlatBrush (packet->tw[packetLaneNums[test]], fb);
+		}
+		else
+		{
+			CM_TracePacketThroughBrush (packet, &cm.brushes[fb->brushnum], test);
+		}
+
+		for (lane = 0; lane < PACKET_SIZE; lane++)
+		{
+			if ((test & (1 << lane)) && !packet->tw[lane]->trace.fraction)
+			{
+				mask &= ~(1 << lane);
+			}
+		}
+
+		if (!mask)
+		{
+			return;
+		}
+	}
+
+	for (lane = 0; lane < PACKET_SIZE; lane++)
+	{
+		if (mask & (1 << lane))
+		{
+			CM_TraceThroughLeafPatches (packet->tw[lane], &cm.leafs[leafnum]);
+		}
+	}
+}
+
+/*
+================
+CM_PacketSplit
+
+(t + epsilon) * idist in double precision like the scalar code
+================
+*/
+static __m128 CM_PacketSplit (__m128 t, double epsilon, __m128 idist)
+{
+	__m128d	eps;
+	__m128d	lo, hi;
+
+	eps = _mm_set1_pd (epsilon);
+
+	lo = _mm_mul_pd (_mm_add_pd (_mm_cvtps_pd (t), eps), _mm_cvtps_pd (idist));
+	hi = _mm_mul_pd (_mm_add_pd (_mm_cvtps_pd (_mm_movehl_ps (t, t)), eps), _mm_cvtps_pd (_mm_movehl_ps (idist, idist)));
+
+	return _mm_movelh_ps (_mm_cvtpd_ps (lo), _mm_cvtpd_ps (hi));
+}
+
+/*
+================
+CM_PacketSegmentPart
+
+The part of the lanes' segments from frac to the end (far) or up to frac
+================
+*/
+static void CM_PacketSegmentPart (const packetSegment_t *seg, __m128 frac, qboolean far, packetSegment_t *out)
+{
+	int			i;
+	__m128		p1f, p2f, midf;
+	__m128		p1, p2, mid;
+
+	p1f = _mm_loadu_ps (seg->p1f);
+	p2f = _mm_loadu_ps (seg->p2f);
+	midf = _mm_add_ps (p1f, _mm_mul_ps (_mm_sub_ps (p2f, p1f), frac));
+
+	_mm_storeu_ps (out->p1f, far ? midf : p1f);
+	_mm_storeu_ps (out->p2f, far ? p2f : midf);
+
+	for (i = 0; i < 3; i++)
+	{
+		p1 = _mm_loadu_ps (seg->p1[i]);
+		p2 = _mm_loadu_ps (seg->p2[i]);
+		mid = _mm_add_ps (p1, _mm_mul_ps (frac, _mm_sub_ps (p2, p1)));
+
+		_mm_storeu_ps (out->p1[i], far ? mid : p1);
+		_mm_storeu_ps (out->p2[i], far ? p2 : mid);
+	}
+}
+
+/*
+================
+CM_PacketSegmentSelect
+================
+*/
+static void CM_PacketSegmentSelect (__m128 mask, const packetSegment_t *a, const packetSegment_t *b, packetSegment_t *out)
+{
+	int			i;
+
+	_mm_storeu_ps (out->p1f, CM_PacketSelect (mask, _mm_loadu_ps (a->p1f), _mm_loadu_ps (b->p1f)));
+	_mm_storeu_ps (out->p2f, CM_PacketSelect (mask, _mm_loadu_ps (a->p2f), _mm_loadu_ps (b->p2f)));
+
+	for (i = 0; i < 3; i++)
+	{
+		_mm_storeu_ps (out->p1[i], CM_PacketSelect (mask, _mm_loadu_ps (a->p1[i]), _mm_loadu_ps (b->p1[i])));
+		_mm_storeu_ps (out->p2[i], CM_PacketSelect (mask, _mm_loadu_ps (a->p2[i]), _mm_loadu_ps (b->p2[i])));
+	}
+}
+
+/*
+================
+CM_TracePacketThroughTree
+
+CM_TraceThroughTree for the lanes in mask, each with its own segment.
+A lane that crosses a node visits the near child before the far one just
+like the scalar recursion, so the lanes whose near side is the front
+child get their far side in a third pass over the front child.
+================
+*/
+static void CM_TracePacketThroughTree (tracePacket_t *packet, int num, int mask, const packetSegment_t *seg)
+{
+	int			lane;
+	int			front, back, cross, side1;
+	cFlatNode_t	*node;
+	cplane_t	*plane;
+	float		fractions[PACKET_SIZE];
+	__m128		dist, t1, t2, offset;
+	__m128		hi, lo, zero, one;
+	__m128		lt, gt, crossSide1;
+	__m128		idist, fracA, fracB, frac, frac2;
+	packetSegment_t	near, far, sub;
+
+	for (lane = 0; lane < PACKET_SIZE; lane++)
+	{
+		fractions[lane] = packet->tw[lane]->trace.fraction;
+	}
+
+	// already hit something nearer
+	mask &= ~_mm_movemask_ps (_mm_cmple_ps (_mm_loadu_ps (fractions), _mm_loadu_ps (seg->p1f)));
+
+	if (!mask)
+	{
+		return;
+	}
+
+	// if < 0, we are in a leaf node
+	if (num < 0)
+	{
+		if (cm.flatLeafs)
+		{
+			CM_TracePacketThroughFlatLeaf (packet, -1 - num, mask);
+		}
+		else
+		{
+			CM_TracePacketThroughLeaf (packet, &cm.leafs[-1 - num], mask);
+		}
+		return;
+	}
+
+	// find the point distances to the seperating plane
+	// and the offset for the size of the box
+	node = cm.flatNodes + num;
+	plane = &node->plane;
+	dist = _mm_set1_ps (plane->dist);
+
+	if (plane->type < 3)
+	{
+		t1 = _mm_sub_ps (_mm_loadu_ps (seg->p1[plane->type]), dist);
+		t2 = _mm_sub_ps (_mm_loadu_ps (seg->p2[plane->type]), dist);
+		offset = _mm_loadu_ps (packet->extents[plane->type]);
+	}
+	else
+	{
+		t1 = _mm_sub_ps (CM_PacketDot (plane->normal, seg->p1[0]), dist);
+		t2 = _mm_sub_ps (CM_PacketDot (plane->normal, seg->p2[0]), dist);
+		offset = _mm_loadu_ps (packet->slantOffset);
+	}
+
+	one = _mm_set1_ps (1.0f);
+	zero = _mm_setzero_ps ();
+
+	// see which sides we need to consider
+	hi = _mm_add_ps (offset, one);
+	lo = _mm_sub_ps (_mm_xor_ps (offset, _mm_set1_ps (-0.0f)), one);
+
+	front = _mm_movemask_ps (_mm_and_ps (_mm_cmpge_ps (t1, hi), _mm_cmpge_ps (t2, hi))) & mask;
+	back = _mm_movemask_ps (_mm_and_ps (_mm_cmplt_ps (t1, lo), _mm_cmplt_ps (t2, lo))) & mask & ~front;
+	cross = mask & ~(front | back);
+
+	if (!cross)
+	{
+		if (front)
+		{
+			CM_TracePacketThroughTree (packet, node->children[0], front, seg);
+		}
+		if (back)
+		{
+			CM_TracePacketThroughTree (packet, node->children[1], back, seg);
+		}
+		return;
+	}
+
+	// put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
+	lt = _mm_cmplt_ps (t1, t2);
+	gt = _mm_cmpgt_ps (t1, t2);
+
+	idist = _mm_sub_ps (t1, t2);
+	idist = _mm_movelh_ps (
+		_mm_cvtpd_ps (_mm_div_pd (_mm_set1_pd (1.0), _mm_cvtps_pd (idist))),
+		_mm_cvtpd_ps (_mm_div_pd (_mm_set1_pd (1.0), _mm_cvtps_pd (_mm_movehl_ps (idist, idist)))));
+
+	fracA = CM_PacketSplit (_mm_add_ps (t1, offset), SURFACE_CLIP_EPSILON, idist);
+	fracB = _mm_sub_ps (t1, offset);
+
+	frac = CM_PacketSelect (lt, CM_PacketSplit (fracB, SURFACE_CLIP_EPSILON, idist), CM_PacketSelect (gt, fracA, one));
+	frac2 = CM_PacketSelect (lt, fracA, CM_PacketSelect (gt, CM_PacketSplit (fracB, -SURFACE_CLIP_EPSILON, idist), zero));
+
+	// move up to the node
+	frac = CM_PacketSelect (_mm_cmplt_ps (frac, zero), zero, frac);
+	frac = CM_PacketSelect (_mm_cmpgt_ps (frac, one), one, frac);
+
+	// go past the node
+	frac2 = CM_PacketSelect (_mm_cmplt_ps (frac2, zero), zero, frac2);
+	frac2 = CM_PacketSelect (_mm_cmpgt_ps (frac2, one), one, frac2);
+
+	CM_PacketSegmentPart (seg, frac, qfalse, &near);
+	CM_PacketSegmentPart (seg, frac2, qtrue, &far);
+
+	side1 = _mm_movemask_ps (lt) & cross;
+	crossSide1 = _mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *) packetLaneMasks[side1]));
+
+	// front child: the ones entirely in front and the near part of the ones
+	// that start in front
+	if (front | (cross & ~side1))
+	{
+		CM_PacketSegmentSelect (_mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *) packetLaneMasks[cross & ~side1])),
+			&near, seg, &sub);
+		CM_TracePacketThroughTree (packet, node->children[0], front | (cross & ~side1), &sub);
+	}
+
+	// back child: the ones entirely behind, the near part of the ones that
+	// start behind and the far part of the ones that started in front
+	if (back | cross)
+	{
+		CM_PacketSegmentSelect (crossSide1, &near, &far, &sub);
+		CM_PacketSegmentSelect (_mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *) packetLaneMasks[cross])),
+			&sub, seg, &sub);
+		CM_TracePacketThroughTree (packet, node->children[1], back | cross, &sub);
+	}
+
+	// and back to the front child for the far part of the ones that started behind
+	if (side1)
+	{
+		CM_TracePacketThroughTree (packet, node->children[0], side1, &far);
+	}
+}
+
+/*
+================
+CM_TracePacket
+
+Sweeps up to PACKET_SIZE prepared world traces through the tree
+================
+*/
+static void CM_TracePacket (traceWork_t *tws, int count)
+{
+	tracePacket_t	packet;
+	packetSegment_t	seg;
+	traceWork_t		*tw;
+	int				lane, lanesrc;
+	int				i, j;
+
+	Com_Memset (&packet, 0, sizeof (packet));
+
+	packet.thread = tws[0].thread;
+	packet.thread->packetcount++;
+	packet.stamp = -16 * ((packet.thread->packetcount & 0x7ffffff) + 1);
+
+	for (lane = 0; lane < PACKET_SIZE; lane++)
+	{
+		// pad a short packet with copies, the extra lanes are masked off
+		lanesrc = lane < count ? lane : 0;
+		tw = &tws[lanesrc];
+		packet.tw[lane] = tw;
+
+		for (i = 0; i < 3; i++)
+		{
+			packet.start[i][lane] = tw->start[i];
+			packet.end[i][lane] = tw->end[i];
+			packet.extents[i][lane] = tw->extents[i];
+		}
+
+		packet.slantOffset[lane] = tw->isPoint ? 0 : 2048;
+
+		seg.p1f[lane] = 0;
+		seg.p2f[lane] = 1;
+		for (i = 0; i < 3; i++)
+		{
+			seg.p1[i][lane] = tw->start[i];
+			seg.p2[i][lane] = tw->end[i];
+		}
+
+		for (j = 0; j < 8; j++)
+		{
+			for (i = 0; i < 3; i++)
+			{
+				packet.offsets[j][i][lane] = tw->offsets[j][i];
+			}
+		}
+	}
+
+	CM_TracePacketThroughTree (&packet, 0, (1 << count) - 1, &seg);
+}
+
+
+//======================================================================
+
+
+/*
+==================
+CM_InitTraceWork
+
+Everything CM_Trace sets up before it starts clipping, returns qfalse
+if there is no map to trace against
+==================
+*/
+static qboolean CM_InitTraceWork (traceWork_t *tw, const vec3_t start, const vec3_t end, const float *mins, const float *maxs,
+	const vec3_t origin, int brushmask, int capsule, sphere_t *sphere)
+{
+	int			i;
+	vec3_t		offset;
+
+	// fill in a default trace
+	Com_Memset (tw, 0, sizeof (*tw));
+
+	tw->thread = CM_Thread ();
+	tw->checkcount = ++tw->thread->checkcount;		// for multi-check avoidance
+
+	tw->thread->c_traces++;			// for statistics, may be zeroed
+	tw->trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
+	VectorCopy (origin, tw->modelOrigin);
+
+	if (!cm.numNodes)
+	{
+		return qfalse;	// map not loaded, shouldn't happen
+	}
+
+	// allow NULL to be passed in for 0,0,0
+	if (!mins)
+	{
+		mins = vec3_origin;
+	}
+	if (!maxs)
+	{
+		maxs = vec3_origin;
+	}
+
+	// set basic parms
+	tw->contents = brushmask;
+
+	// adjust so that mins and maxs are always symetric, which
+	// avoids some complications with plane expanding of rotated
+	// bmodels
+	for (i = 0; i < 3; i++)
+	{
+		offset[i] = (mins[i] + maxs[i]) * 0.5;
+		tw->size[0][i] = mins[i] - offset[i];
+		tw->size[1][i] = maxs[i] - offset[i];
+		tw->start[i] = start[i] + offset[i];
+		tw->end[i] = end[i] + offset[i];
+	}
+
+	// if a sphere is already specified
+	if (sphere)
+	{
+		tw->sphere = *sphere;
+	}
+	else
+	{
+		tw->sphere.use = capsule;
+		tw->sphere.radius = (tw->size[1][0] > tw->size[1][2]) ? tw->size[1][2] : tw->size[1][0];
+		tw->sphere.halfheight = tw->size[1][2];
+		VectorSet (tw->sphere.offset, 0, 0, tw->size[1][2] - tw->sphere.radius);
+	}
+
+	tw->maxOffset = tw->size[1][0] + tw->size[1][1] + tw->size[1][2];
+
+	// tw->offsets[signbits] = vector to apropriate corner from origin
+	tw->offsets[0][0] = tw->size[0][0];
+	tw->offsets[0][1] = tw->size[0][1];
+	tw->offsets[0][2] = tw->size[0][2];
+
+	tw->offsets[1][0] = tw->size[1][0];
+	tw->offsets[1][1] = tw->size[0][1];
+	tw->offsets[1][2] = tw->size[0][2];
+
+	tw->offsets[2][0] = tw->size[0][0];
+	tw->offsets[2][1] = tw->size[1][1];
+	tw->offsets[2][2] = tw->size[0][2];
+
+	tw->offsets[3][0] = tw->size[1][0];
+	tw->offsets[3][1] = tw->size[1][1];
+	tw->offsets[3][2] = tw->size[0][2];
+
+	tw->offsets[4][0] = tw->size[0][0];
+	tw->offsets[4][1] = tw->size[0][1];
+	tw->offsets[4][2] = tw->size[1][2];
+
+	tw->offsets[5][0] = tw->size[1][0];
+	tw->offsets[5][1] = tw->size[0][1];
+	tw->offsets[5][2] = tw->size[1][2];
+
+	tw->offsets[6][0] = tw->size[0][0];
+	tw->offsets[6][1] = tw->size[1][1];
+	tw->offsets[6][2] = tw->size[1][2];
+
+	tw->offsets[7][0] = tw->size[1][0];
+	tw->offsets[7][1] = tw->size[1][1];
+	tw->offsets[7][2] = tw->size[1][2];
+
+	// calculate bounds
+	if (tw->sphere.use)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			if (tw->start[i] < tw->end[i])
+			{
+				tw->bounds[0][i] = tw->start[i] - fabs (tw->sphere.offset[i]) - tw->sphere.radius;
+				tw->bounds[1][i] = tw->end[i] + fabs (tw->sphere.offset[i]) + tw->sphere.radius;
+			}
+			else
+			{
+				tw->bounds[0][i] = tw->end[i] - fabs (tw->sphere.offset[i]) - tw->sphere.radius;
+				tw->bounds[1][i] = tw->start[i] + fabs (tw->sphere.offset[i]) + tw->sphere.radius;
+			}
+		}
+	}
+	else
+	{
+		for (i = 0; i < 3; i++)
+		{
+			if (tw->start[i] < tw->end[i])
+			{
+				tw->bounds[0][i] = tw->start[i] + tw->size[0][i];
+				tw->bounds[1][i] = tw->end[i] + tw->size[1][i];
+			}
+			else
+			{
+				tw->bounds[0][i] = tw->end[i] + tw->size[0][i];
+				tw->bounds[1][i] = tw->start[i] + tw->size[1][i];
+			}
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+==================
+CM_InitTraceExtents
+
+Sweeps (but not position tests) treat point traces specially
+==================
+*/
+static void CM_InitTraceExtents (traceWork_t *tw)
+{
+	// check for point special case
+	if (tw->size[0][0] == 0 && tw->size[0][1] == 0 && tw->size[0][2] == 0)
+	{
+		tw->isPoint = qtrue;
+		VectorClear (tw->extents);
+	}
+	else
+	{
+		tw->isPoint = qfalse;
+		tw->extents[0] = tw->size[1][0];
+		tw->extents[1] = tw->size[1][1];
+		tw->extents[2] = tw->size[1][2];
+	}
+}
+
+/*
+==================
+CM_FinishTrace
+==================
+*/
+static void CM_FinishTrace (traceWork_t *tw, trace_t *results, const vec3_t start, const vec3_t end)
+{
+	int			i;
+
+	// generate endpos from the original, unmodified start/end
+	if (tw->trace.fraction == 1)
+	{
+		VectorCopy (end, tw->trace.endpos);
+	}
+	else
+	{
+		for (i = 0; i < 3; i++)
+		{
+			tw->trace.endpos[i] = start[i] + tw->trace.fraction * (end[i] - start[i]);
+		}
+	}
+
+	// If allsolid is set (was entirely inside something solid), the plane is not valid.
+	// If fraction == 1.0, we never hit anything, and thus the plane is not valid.
+	// Otherwise, the normal on the plane should have unit length
+	assert (tw->trace.allsolid ||
+		tw->trace.fraction == 1.0 ||
+		VectorLengthSquared (tw->trace.plane.normal) > 0.9999);
+	*results = tw->trace;
+}
+
+/*
+==================
+CM_Trace
+==================
+*/
+void CM_Trace (trace_t *results, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs,
+	clipHandle_t model, const vec3_t origin, int brushmask, int capsule, sphere_t *sphere)
+{
+	traceWork_t	tw;
+	cmodel_t	*cmod;
+
+	cmod = CM_ClipHandleToModel (model);
+
+	if (!CM_InitTraceWork (&tw, start, end, mins, maxs, origin, brushmask, capsule, sphere))
+	{
+		*results = tw.trace;
+
+		return;	// map not loaded, shouldn't happen
+	}
+
+	// check for position test special case
+	if (start[0] == end[0] && start[1] == end[1] && start[2] == end[2])
+	{
+		if (model)
+		{
+#ifdef ALWAYS_BBOX_VS_BBOX // bk010201 - FIXME - compile time flag?
+			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
+				tw.sphere.use = qfalse;
+				CM_TestInLeaf( &tw, &cmod->leaf );
 			}
+			else
+#elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
+			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
+				CM_TestCapsuleInCapsule( &tw, model );
+			}
+			else
+#endif
+				if (model == CAPSULE_MODEL_HANDLE)
+				{
+					if (tw.sphere.use)
+					{
+						CM_TestCapsuleInCapsule (&tw, model);
+					}
+					else
+					{
+						CM_TestBoundingBoxInCapsule (&tw, model);
+					}
+				}
+				else
+				{
+					CM_TestInLeaf (&tw, &cmod->leaf);
+				}
+		}
+		else
+		{
+			CM_PositionTest (&tw);
 		}
 	}
-	else if (d == 0)
+	else
 	{
-		//t[0] = (- b ) / 2 * a;
-		// slide along the cylinder
+		CM_InitTraceExtents (&tw);
+
+		// general sweeping through world
+		if (model)
+		{
+#ifdef ALWAYS_BBOX_VS_BBOX
+			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
+				tw.sphere.use = qfalse;
+				CM_TraceThroughLeaf( &tw, &cmod->leaf );
+			}
+			else
+#elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
+			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
+				CM_TraceCapsuleThroughCapsule( &tw, model );
+			}
+			else
+#endif
+				if (model == CAPSULE_MODEL_HANDLE)
+				{
+					if (tw.sphere.use)
+					{
+						CM_TraceCapsuleThroughCapsule (&tw, model);
+					}
+					else
+					{
+						CM_TraceBoundingBoxThroughCapsule (&tw, model);
+					}
+				}
+				else
+				{
+					CM_TraceThroughLeaf (&tw, &cmod->leaf);
+				}
+		}
+		else
+		{
+			CM_TraceThroughTree (&tw, 0, 0, 1, tw.start, tw.end);
+		}
 	}
-	// no intersection at all
+
+	CM_FinishTrace (&tw, results, start, end);
 }
 
 /*
-================
-CM_TraceCapsuleThroughCapsule
+==================
+CM_BoxTrace
+==================
+*/
+void CM_BoxTrace (trace_t *results, const vec3_t start, const vec3_t end,
+	vec3_t mins, vec3_t maxs,
+	clipHandle_t model, int brushmask, int capsule)
+{
+	CM_Trace (results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL);
+}
 
-capsule vs. capsule collision (not rotated)
-================
+/*
+==================
+CM_TransformedBoxTrace
+
+Handles offseting and rotation of the end points for moving and
+rotating entities
+==================
 */
-void CM_TraceCapsuleThroughCapsule (traceWork_t *tw, clipHandle_t model)
+void CM_TransformedBoxTrace (trace_t *results, const vec3_t start, const vec3_t end,
+	vec3_t mins, vec3_t maxs,
+	clipHandle_t model, int brushmask,
+	const vec3_t origin, const vec3_t angles, int capsule)
 {
-	int i;
-	vec3_t mins, maxs;
-	vec3_t top, bottom, starttop, startbottom, endtop, endbottom;
-	vec3_t offset, symetricSize[2];
-	float radius, halfwidth, halfheight, offs, h;
+	trace_t		trace;
+	vec3_t		start_l, end_l;
+	qboolean	rotated;
+	vec3_t		offset;
+	vec3_t		symetricSize[2];
+	vec3_t		matrix[3], transpose[3];
+	int			i;
+	float		halfwidth;
+	float		halfheight;
+	float		t;
+	sphere_t	sphere;
 
-	CM_ModelBounds (model, mins, maxs);
-	// test trace bounds vs. capsule bounds
-	if (tw->bounds[0][0] > maxs[0] + RADIUS_EPSILON
-		|| tw->bounds[0][1] > maxs[1] + RADIUS_EPSILON
-		|| tw->bounds[0][2] > maxs[2] + RADIUS_EPSILON
-		|| tw->bounds[1][0] < mins[0] - RADIUS_EPSILON
-		|| tw->bounds[1][1] < mins[1] - RADIUS_EPSILON
-		|| tw->bounds[1][2] < mins[2] - RADIUS_EPSILON
-		)
+	if (!mins)
 	{
-		return;
+		mins = vec3_origin;
+	}
+	if (!maxs)
+	{
+		maxs = vec3_origin;
 	}
-	// top origin and bottom origin of each sphere at start and end of trace
-	VectorAdd (tw->start, tw->sphere.offset, starttop);
-	VectorSubtract (tw->start, tw->sphere.offset, startbottom);
-	VectorAdd (tw->end, tw->sphere.offset, endtop);
-	VectorSubtract (tw->end, tw->sphere.offset, endbottom);
 
-	// calculate top and bottom of the capsule spheres to collide with
+	// adjust so that mins and maxs are always symetric, which
+	// avoids some complications with plane expanding of rotated
+	// bmodels
 	for (i = 0; i < 3; i++)
 	{
 		offset[i] = (mins[i] + maxs[i]) * 0.5;
 		symetricSize[0][i] = mins[i] - offset[i];
 		symetricSize[1][i] = maxs[i] - offset[i];
+		start_l[i] = start[i] + offset[i];
+		end_l[i] = end[i] + offset[i];
+	}
+
+	// subtract origin offset
+	VectorSubtract (start_l, origin, start_l);
+	VectorSubtract (end_l, origin, end_l);
+
+	// rotate start and end into the models frame of reference
+	if (model != BOX_MODEL_HANDLE &&
+		(angles[0] || angles[1] || angles[2]))
+	{
+		rotated = qtrue;
+	}
+	else
+	{
+		rotated = qfalse;
 	}
+
 	halfwidth = symetricSize[1][0];
 	halfheight = symetricSize[1][2];
-	radius = (halfwidth > halfheight) ? halfheight : halfwidth;
-	offs = halfheight - radius;
-	VectorCopy (offset, top);
-	top[2] += offs;
-	VectorCopy (offset, bottom);
-	bottom[2] -= offs;
-	// expand radius of spheres
-	radius += tw->sphere.radius;
-	// if there is horizontal movement
-	if (tw->start[0] != tw->end[0] || tw->start[1] != tw->end[1])
+
+	sphere.use = capsule;
+	sphere.radius = (halfwidth > halfheight) ? halfheight : halfwidth;
+	sphere.halfheight = halfheight;
+	t = halfheight - sphere.radius;
+
+	if (rotated)
 	{
-		// height of the expanded cylinder is the height of both cylinders minus the radius of both spheres
-		h = halfheight + tw->sphere.halfheight - radius;
-		// if the cylinder has a height
-		if (h > 0)
-		{
-			// test for collisions between the cylinders
-			CM_TraceThroughVerticalCylinder (tw, offset, radius, h, tw->start, tw->end);
-		}
+		// rotation on trace line (start-end) instead of rotating the bmodel
+		// NOTE: This is still incorrect for bounding boxes because the actual bounding
+		//		 box that is swept through the model is not rotated. We cannot rotate
+		//		 the bounding box or the bmodel because that would make all the brush
+		//		 bevels invalid.
+		//		 However this is correct for capsules since a capsule itself is rotated too.
+		CreateRotationMatrix (angles, matrix);
+		RotatePoint (start_l, matrix);
+		RotatePoint (end_l, matrix);
+		// rotated sphere offset for capsule
+		sphere.offset[0] = matrix[0][2] * t;
+		sphere.offset[1] = -matrix[1][2] * t;
+		sphere.offset[2] = matrix[2][2] * t;
+	}
+	else
+	{
+		VectorSet (sphere.offset, 0, 0, t);
 	}
-	// test for collision between the spheres
-	CM_TraceThroughSphere (tw, top, radius, startbottom, endbottom);
-	CM_TraceThroughSphere (tw, bottom, radius, starttop, endtop);
-}
-
-/*
-================
-CM_TraceBoundingBoxThroughCapsule
-
-bounding box vs. capsule collision
-================
-*/
-void CM_TraceBoundingBoxThroughCapsule (traceWork_t *tw, clipHandle_t model)
-{
-	vec3_t mins, maxs, offset, size[2];
-	clipHandle_t h;
-	cmodel_t *cmod;
-	int i;
 
-	// mins maxs of the capsule
-	CM_ModelBounds (model, mins, maxs);
+	// sweep the box through the model
+	CM_Trace (&trace, start_l, end_l, symetricSize[0], symetricSize[1], model, origin, brushmask, capsule, &sphere);
 
-	// offset for capsule center
-	for (i = 0; i < 3; i++)
+	// if the bmodel was rotated and there was a collision
+	if (rotated && trace.fraction != 1.0)
 	{
-		offset[i] = (mins[i] + maxs[i]) * 0.5;
-		size[0][i] = mins[i] - offset[i];
-		size[1][i] = maxs[i] - offset[i];
-		tw->start[i] -= offset[i];
-		tw->end[i] -= offset[i];
+		// rotation of bmodel collision plane
+		TransposeMatrix (matrix, transpose);
+		RotatePoint (trace.plane.normal, transpose);
 	}
 
-	// replace the bounding box with the capsule
-	tw->sphere.use = qtrue;
-	tw->sphere.radius = (size[1][0] > size[1][2]) ? size[1][2] : size[1][0];
-	tw->sphere.halfheight = size[1][2];
-	VectorSet (tw->sphere.offset, 0, 0, size[1][2] - tw->sphere.radius);
+	// re-calculate the end position of the trace because the trace.endpos
+	// calculated by CM_Trace could be rotated and have an offset
+	trace.endpos[0] = start[0] + trace.fraction * (end[0] - start[0]);
+	trace.endpos[1] = start[1] + trace.fraction * (end[1] - start[1]);
+	trace.endpos[2] = start[2] + trace.fraction * (end[2] - start[2]);
 
-	// replace the capsule with the bounding box
-	h = CM_TempBoxModel (tw->size[0], tw->size[1], qfalse);
-	// calculate collision
-	cmod = CM_ClipHandleToModel (h);
-	CM_TraceThroughLeaf (tw, &cmod->leaf);
+	*results = trace;
 }
 
-//=========================================================================================
-
 /*
 ==================
-CM_TraceThroughTree
+CM_TraceBatchRun
 
-Traverse all the contacted leafs from the start to the end position.
-If the trace is a point, they will be exactly in order, but for larger
-trace volumes it is possible to hit something in a later leaf with
-a smaller intercept fraction.
+Position tests and capsules go through CM_Trace, everything else is
+collected into packets
 ==================
 */
-void CM_TraceThroughTree (traceWork_t *tw, int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
+static void CM_TraceBatchRun (trace_t *results, const traceRequest_t *requests, int count, int capsule)
 {
-	cNode_t		*node;
-	cplane_t	*plane;
-	float		t1, t2, offset;
-	float		frac, frac2;
-	float		idist;
-	vec3_t		mid;
-	int			side;
-	float		midf;
+	traceWork_t		tws[PACKET_SIZE];
+	int				indexes[PACKET_SIZE];
+	int				numLanes;
+	int				i, lane;
+	const traceRequest_t	*req;
 
-	if (tw->trace.fraction <= p1f)
-	{
-		return;		// already hit something nearer
-	}
+	numLanes = 0;
 
-	// if < 0, we are in a leaf node
-	if (num < 0)
+	for (i = 0; i < count; i++)
 	{
-		CM_TraceThroughLeaf (tw, &cm.leafs[-1 - num]);
-		return;
-	}
+		req = &requests[i];
 
-	// find the point distances to the seperating plane
-	// and the offset for the size of the box
-	node = cm.nodes + num;
-	plane = node->plane;
+		if (capsule || VectorCompare (req->start, req->end))
+		{
+			CM_Trace (&results[i], req->start, req->end, (float *) req->mins, (float *) req->maxs,
+				0, vec3_origin, req->contentmask, capsule, NULL);
+			continue;
+		}
 
-	// adjust the plane distance apropriately for mins/maxs
-	if (plane->type < 3)
-	{
-		t1 = p1[plane->type] - plane->dist;
-		t2 = p2[plane->type] - plane->dist;
-		offset = tw->extents[plane->type];
-	}
-	else
-	{
-		t1 = DotProduct (plane->normal, p1) - plane->dist;
-		t2 = DotProduct (plane->normal, p2) - plane->dist;
-		if (tw->isPoint)
+		if (!CM_InitTraceWork (&tws[numLanes], req->start, req->end, req->mins, req->maxs,
+			vec3_origin, req->contentmask, qfalse, NULL))
 		{
-			offset = 0;
+			results[i] = tws[numLanes].trace;
+			continue;
 		}
-		else
+
+		CM_InitTraceExtents (&tws[numLanes]);
+		indexes[numLanes] = i;
+
+		if (++numLanes < PACKET_SIZE && i != count - 1)
 		{
-#if 0 // bk010201 - DEAD
-			// an axial brush right behind a slanted bsp plane
-			// will poke through when expanded, so adjust
-			// by sqrt(3)
-			offset = fabs(tw->extents[0]*plane->normal[0]) +
-				fabs(tw->extents[1]*plane->normal[1]) +
-				fabs(tw->extents[2]*plane->normal[2]);
+			continue;
+		}
 
-			offset *= 2;
-			offset = tw->maxOffset;
-#endif
-			// this is silly
-			offset = 2048;
+		CM_TracePacket (tws, numLanes);
+
+		for (lane = 0; lane < numLanes; lane++)
+		{
+			req = &requests[indexes[lane]];
+			CM_FinishTrace (&tws[lane], &results[indexes[lane]], req->start, req->end);
 		}
-	}
 
-	// see which sides we need to consider
-	if (t1 >= offset + 1 && t2 >= offset + 1)
-	{
-		CM_TraceThroughTree (tw, node->children[0], p1f, p2f, p1, p2);
-		return;
-	}
-	if (t1 < -offset - 1 && t2 < -offset - 1)
-	{
-		CM_TraceThroughTree (tw, node->children[1], p1f, p2f, p1, p2);
-		return;
+		numLanes = 0;
 	}
 
-	// put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
-	if (t1 < t2)
-	{
-		idist = 1.0 / (t1 - t2);
-		side = 1;
-		frac2 = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
-		frac = (t1 - offset + SURFACE_CLIP_EPSILON)*idist;
-	}
-	else if (t1 > t2)
-	{
-		idist = 1.0 / (t1 - t2);
-		side = 0;
-		frac2 = (t1 - offset - SURFACE_CLIP_EPSILON)*idist;
-		frac = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
-	}
-	else
+	// the last request was not a packet one
+	if (numLanes)
 	{
-		side = 0;
-		frac = 1;
-		frac2 = 0;
-	}
+		CM_TracePacket (tws, numLanes);
 
-	// move up to the node
-	if (frac < 0)
-	{
-		frac = 0;
-	}
-	if (frac > 1)
-	{
-		frac = 1;
+		for (lane = 0; lane < numLanes; lane++)
+		{
+			req = &requests[indexes[lane]];
+			CM_FinishTrace (&tws[lane], &results[indexes[lane]], req->start, req->end);
+		}
 	}
+}
 
-	midf = p1f + (p2f - p1f)*frac;
+#define	BATCH_CHUNK		64
 
-	mid[0] = p1[0] + frac*(p2[0] - p1[0]);
-	mid[1] = p1[1] + frac*(p2[1] - p1[1]);
-	mid[2] = p1[2] + frac*(p2[2] - p1[2]);
+typedef struct
+{
+	trace_t					*results;
+	const traceRequest_t	*requests;
+	int						count;
+	int						capsule;
+} traceBatch_t;
 
-	CM_TraceThroughTree (tw, node->children[side], p1f, midf, p1, mid);
+/*
+==================
+CM_TraceBatchJob
+==================
+*/
+static void CM_TraceBatchJob (void *data, int index)
+{
+	traceBatch_t	*batch;
+	int				first, count;
 
+	batch = data;
 
-	// go past the node
-	if (frac2 < 0)
+	first = index * BATCH_CHUNK;
+	count = batch->count - first;
+	if (count > BATCH_CHUNK)
 	{
-		frac2 = 0;
+		count = BATCH_CHUNK;
 	}
-	if (frac2 > 1)
+
+	CM_TraceBatchRun (batch->results + first, batch->requests + first, count, batch->capsule);
+}
+
+/*
+==================
+CM_TraceBatch
+
+Sweeps count independent boxes through the world, giving the same
+results as calling CM_BoxTrace for each of them.  Big batches are split
+across the job threads.
+==================
+*/
+void CM_TraceBatch (trace_t *results, const traceRequest_t *requests, int count, int capsule)
+{
+	traceBatch_t	batch;
+
+	if (count <= 0)
 	{
-		frac2 = 1;
+		return;
 	}
 
-	midf = p1f + (p2f - p1f)*frac2;
-
-	mid[0] = p1[0] + frac2*(p2[0] - p1[0]);
-	mid[1] = p1[1] + frac2*(p2[1] - p1[1]);
-	mid[2] = p1[2] + frac2*(p2[2] - p1[2]);
+	batch.results = results;
+	batch.requests = requests;
+	batch.count = count;
+	batch.capsule = capsule;
 
-	CM_TraceThroughTree (tw, node->children[side ^ 1], midf, p2f, mid, p2);
+	Sys_RunJobs (CM_TraceBatchJob, &batch, (count + BATCH_CHUNK - 1) / BATCH_CHUNK);
 }
 
+/*
+===============================================================================
 
-//======================================================================
+STRESS TEST
+
+Runs a fixed set of random traces on the main thread, then again from all
+the job threads at once, and checks that every result is bit for bit the
+same as the single threaded one
+
+===============================================================================
+*/
+
+#define	STRESS_CHUNK		64
+
+typedef enum
+{
+	STRESS_WORLD,			// CM_BoxTrace against the world
+	STRESS_MODEL,			// CM_TransformedBoxTrace against a moved and rotated inline model
+	STRESS_TEMPBOX,			// CM_TempBoxModel followed by a trace against it
+	STRESS_POINT,			// CM_PointContents
+	NUM_STRESS_TYPES
+} stressType_t;
+
+typedef struct
+{
+	stressType_t	type;
+	vec3_t			start, end;
+	vec3_t			mins, maxs;
+	vec3_t			boxMins, boxMaxs;
+	vec3_t			origin, angles;
+	clipHandle_t	model;
+	int				brushmask;
+	int				capsule;
+
+	// single threaded results
+	trace_t			trace;
+	int				contents;
+} stressTrace_t;
+
+typedef struct
+{
+	stressTrace_t	*traces;
+	int				numTraces;
+	volatile int	mismatches;
+} stressTest_t;
 
 
 /*
 ==================
-CM_Trace
+CM_StressRun
 ==================
 */
-void CM_Trace (trace_t *results, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs,
-	clipHandle_t model, const vec3_t origin, int brushmask, int capsule, sphere_t *sphere)
+static void CM_StressRun (stressTrace_t *st, trace_t *trace, int *contents)
 {
-	int			i;
-	traceWork_t	tw;
-	vec3_t		offset;
-	cmodel_t	*cmod;
-
-	cmod = CM_ClipHandleToModel (model);
+	clipHandle_t	h;
+
+	Com_Memset (trace, 0, sizeof (*trace));
+	*contents = 0;
+
+	switch (st->type)
+	{
+	case STRESS_WORLD:
+		CM_BoxTrace (trace, st->start, st->end, st->mins, st->maxs, 0, st->brushmask, st->capsule);
+		break;
+	case STRESS_MODEL:
+		CM_TransformedBoxTrace (trace, st->start, st->end, st->mins, st->maxs, st->model, st->brushmask,
+			st->origin, st->angles, st->capsule);
+		*contents = CM_TransformedPointContents (st->end, st->model, st->origin, st->angles);
+		break;
+	case STRESS_TEMPBOX:
+		h = CM_TempBoxModel (st->boxMins, st->boxMaxs, qfalse);
+		CM_TransformedBoxTrace (trace, st->start, st->end, st->mins, st->maxs, h, st->brushmask,
+			st->origin, vec3_origin, qfalse);
+		*contents = CM_TransformedPointContents (st->start, h, st->origin, vec3_origin);
+		break;
+	default:
+		*contents = CM_PointContents (st->start, 0);
+		break;
+	}
+}
 
-	cm.checkcount++;		// for multi-check avoidance
+/*
+==================
+CM_StressSame
+==================
+*/
+static qboolean CM_StressSame (const trace_t *a, const trace_t *b)
+{
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid &&
+		a->fraction == b->fraction && VectorCompare (a->endpos, b->endpos) &&
+		VectorCompare (a->plane.normal, b->plane.normal) && a->plane.dist == b->plane.dist &&
+		a->surfaceFlags == b->surfaceFlags && a->contents == b->contents;
+}
 
-	c_traces++;				// for statistics, may be zeroed
+/*
+==================
+CM_StressJob
+==================
+*/
+static void CM_StressJob (void *data, int index)
+{
+	stressTest_t	*test;
+	stressTrace_t	*st;
+	trace_t			trace;
+	int				contents;
+	int				i, last;
 
-	// fill in a default trace
-	Com_Memset (&tw, 0, sizeof (tw));
-	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
-	VectorCopy (origin, tw.modelOrigin);
+	test = data;
 
-	if (!cm.numNodes)
+	last = (index + 1) * STRESS_CHUNK;
+	if (last > test->numTraces)
 	{
-		*results = tw.trace;
-
-		return;	// map not loaded, shouldn't happen
+		last = test->numTraces;
 	}
 
-	// allow NULL to be passed in for 0,0,0
-	if (!mins)
+	for (i = index * STRESS_CHUNK; i < last; i++)
 	{
-		mins = vec3_origin;
+		st = &test->traces[i];
+
+		CM_StressRun (st, &trace, &contents);
+
+		if (!CM_StressSame (&trace, &st->trace) || contents != st->contents)
+		{
+			Sys_AtomicAdd (&test->mismatches, 1);
+		}
 	}
-	if (!maxs)
+}
+
+/*
+==================
+CM_StressRandomVector
+==================
+*/
+static void CM_StressRandomVector (int *seed, const vec3_t mins, const vec3_t maxs, vec3_t out)
+{
+	int		i;
+
+	for (i = 0; i < 3; i++)
 	{
-		maxs = vec3_origin;
+		out[i] = mins[i] + Q_random (seed) * (maxs[i] - mins[i]);
 	}
+}
 
-	// set basic parms
-	tw.contents = brushmask;
+/*
+==================
+CM_TraceStress_f
 
-	// adjust so that mins and maxs are always symetric, which
-	// avoids some complications with plane expanding of rotated
-	// bmodels
-	for (i = 0; i < 3; i++)
+cm_tracestress [traces] [passes]
+==================
+*/
+void CM_TraceStress_f (void)
+{
+	stressTest_t	test;
+	stressTrace_t	*st;
+	trace_t			trace;
+	int				numChunks, passes;
+	int				i, j, pass;
+	int				seed;
+	int				start, singleUsec, multiUsec;
+	int				counts[NUM_STRESS_TYPES];
+	vec3_t			delta;
+
+	if (!cm.numNodes)
 	{
-		offset[i] = (mins[i] + maxs[i]) * 0.5;
-		tw.size[0][i] = mins[i] - offset[i];
-		tw.size[1][i] = maxs[i] - offset[i];
-		tw.start[i] = start[i] + offset[i];
-		tw.end[i] = end[i] + offset[i];
+		Com_Printf ("No map loaded.\n");
+		return;
 	}
 
-	// if a sphere is already specified
-	if (sphere)
+	test.numTraces = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : 65536;
+	passes = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 4;
+
+	if (test.numTraces < 1)
 	{
-		tw.sphere = *sphere;
+		test.numTraces = 1;
 	}
-	else
+	if (passes < 1)
 	{
-		tw.sphere.use = capsule;
-		tw.sphere.radius = (tw.size[1][0] > tw.size[1][2]) ? tw.size[1][2] : tw.size[1][0];
-		tw.sphere.halfheight = tw.size[1][2];
-		VectorSet (tw.sphere.offset, 0, 0, tw.size[1][2] - tw.sphere.radius);
+		passes = 1;
 	}
 
-	tw.maxOffset = tw.size[1][0] + tw.size[1][1] + tw.size[1][2];
-
-	// tw.offsets[signbits] = vector to apropriate corner from origin
-	tw.offsets[0][0] = tw.size[0][0];
-	tw.offsets[0][1] = tw.size[0][1];
-	tw.offsets[0][2] = tw.size[0][2];
-
-	tw.offsets[1][0] = tw.size[1][0];
-	tw.offsets[1][1] = tw.size[0][1];
-	tw.offsets[1][2] = tw.size[0][2];
+	test.traces = Z_Malloc (test.numTraces * sizeof (*test.traces));
+	test.mismatches = 0;
 
-	tw.offsets[2][0] = tw.size[0][0];
-	tw.offsets[2][1] = tw.size[1][1];
-	tw.offsets[2][2] = tw.size[0][2];
+	Com_Memset (counts, 0, sizeof (counts));
 
-	tw.offsets[3][0] = tw.size[1][0];
-	tw.offsets[3][1] = tw.size[1][1];
-	tw.offsets[3][2] = tw.size[0][2];
+	// the same set every time so failures can be reproduced
+	seed = 0x1d2c3b4a;
 
-	tw.offsets[4][0] = tw.size[0][0];
-	tw.offsets[4][1] = tw.size[0][1];
-	tw.offsets[4][2] = tw.size[1][2];
-
-	tw.offsets[5][0] = tw.size[1][0];
-	tw.offsets[5][1] = tw.size[0][1];
-	tw.offsets[5][2] = tw.size[1][2];
+	for (i = 0; i < test.numTraces; i++)
+	{
+		st = &test.traces[i];
 
-	tw.offsets[6][0] = tw.size[0][0];
-	tw.offsets[6][1] = tw.size[1][1];
-	tw.offsets[6][2] = tw.size[1][2];
+		st->type = Q_rand (&seed) % NUM_STRESS_TYPES;
+		if (st->type == STRESS_MODEL && cm.numSubModels < 2)
+		{
+			st->type = STRESS_WORLD;
+		}
+		counts[st->type]++;
 
-	tw.offsets[7][0] = tw.size[1][0];
-	tw.offsets[7][1] = tw.size[1][1];
-	tw.offsets[7][2] = tw.size[1][2];
+		CM_StressRandomVector (&seed, cm.cmodels[0].mins, cm.cmodels[0].maxs, st->start);
+		for (j = 0; j < 3; j++)
+		{
+			delta[j] = Q_crandom (&seed) * 1024;
+		}
+		VectorAdd (st->start, delta, st->end);
 
-	// calculate bounds
-	if (tw.sphere.use)
-	{
-		for (i = 0; i < 3; i++)
+		// half of them are point traces
+		if (Q_rand (&seed) & 1)
 		{
-			if (tw.start[i] < tw.end[i])
-			{
-				tw.bounds[0][i] = tw.start[i] - fabs (tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.end[i] + fabs (tw.sphere.offset[i]) + tw.sphere.radius;
-			}
-			else
+			for (j = 0; j < 3; j++)
 			{
-				tw.bounds[0][i] = tw.end[i] - fabs (tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.start[i] + fabs (tw.sphere.offset[i]) + tw.sphere.radius;
+				st->maxs[j] = Q_random (&seed) * 32;
+				st->mins[j] = -Q_random (&seed) * 32;
 			}
 		}
-	}
-	else
-	{
-		for (i = 0; i < 3; i++)
+
+		st->brushmask = (Q_rand (&seed) & 1) ? (CONTENTS_SOLID | CONTENTS_PLAYERCLIP | CONTENTS_BODY) : (CONTENTS_SOLID | CONTENTS_BODY | CONTENTS_CORPSE);
+		st->capsule = (Q_rand (&seed) & 7) == 0;
+
+		if (st->type == STRESS_MODEL)
 		{
-			if (tw.start[i] < tw.end[i])
+			st->model = 1 + Q_rand (&seed) % (cm.numSubModels - 1);
+			CM_StressRandomVector (&seed, cm.cmodels[0].mins, cm.cmodels[0].maxs, st->origin);
+			for (j = 0; j < 3; j++)
 			{
-				tw.bounds[0][i] = tw.start[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.end[i] + tw.size[1][i];
+				st->angles[j] = (Q_rand (&seed) & 3) ? 0 : Q_random (&seed) * 360;
 			}
-			else
+			// start close to the model so a good share of them hit it
+			VectorAdd (st->origin, delta, st->start);
+			VectorSubtract (st->origin, delta, st->end);
+		}
+		else if (st->type == STRESS_TEMPBOX)
+		{
+			for (j = 0; j < 3; j++)
 			{
-				tw.bounds[0][i] = tw.end[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.start[i] + tw.size[1][i];
+				st->boxMaxs[j] = 1 + Q_random (&seed) * 64;
+				st->boxMins[j] = -1 - Q_random (&seed) * 64;
 			}
+			CM_StressRandomVector (&seed, cm.cmodels[0].mins, cm.cmodels[0].maxs, st->origin);
+			VectorAdd (st->origin, delta, st->start);
+			VectorSubtract (st->origin, delta, st->end);
 		}
 	}
 
-	// check for position test special case
-	if (start[0] == end[0] && start[1] == end[1] && start[2] == end[2])
+	// single threaded baseline
+	start = Sys_Microseconds ();
+	for (i = 0; i < test.numTraces; i++)
 	{
-		if (model)
-		{
-#ifdef ALWAYS_BBOX_VS_BBOX // bk010201 - FIXME - compile time flag?
-			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
-				tw.sphere.use = qfalse;
-				CM_TestInLeaf( &tw, &cmod->leaf );
-			}
-			else
-#elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
-			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
-				CM_TestCapsuleInCapsule( &tw, model );
-			}
-			else
-#endif
-				if (model == CAPSULE_MODEL_HANDLE)
-				{
-					if (tw.sphere.use)
-					{
-						CM_TestCapsuleInCapsule (&tw, model);
-					}
-					else
-					{
-						CM_TestBoundingBoxInCapsule (&tw, model);
-					}
-				}
-				else
-				{
-					CM_TestInLeaf (&tw, &cmod->leaf);
-				}
-		}
-		else
-		{
-			CM_PositionTest (&tw);
-		}
+		st = &test.traces[i];
+		CM_StressRun (st, &st->trace, &st->contents);
 	}
-	else
+	singleUsec = Sys_Microseconds () - start;
+
+	// the baseline itself has to be repeatable on one thread
+	for (i = 0; i < test.numTraces; i++)
 	{
-		// check for point special case
-		if (tw.size[0][0] == 0 && tw.size[0][1] == 0 && tw.size[0][2] == 0)
-		{
-			tw.isPoint = qtrue;
-			VectorClear (tw.extents);
-		}
-		else
-		{
-			tw.isPoint = qfalse;
-			tw.extents[0] = tw.size[1][0];
-			tw.extents[1] = tw.size[1][1];
-			tw.extents[2] = tw.size[1][2];
-		}
+		int		contents;
 
-		// general sweeping through world
-		if (model)
-		{
-#ifdef ALWAYS_BBOX_VS_BBOX
-			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
-				tw.sphere.use = qfalse;
-				CM_TraceThroughLeaf( &tw, &cmod->leaf );
-			}
-			else
-#elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
-			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
-				CM_TraceCapsuleThroughCapsule( &tw, model );
-			}
-			else
-#endif
-				if (model == CAPSULE_MODEL_HANDLE)
-				{
-					if (tw.sphere.use)
-					{
-						CM_TraceCapsuleThroughCapsule (&tw, model);
-					}
-					else
-					{
-						CM_TraceBoundingBoxThroughCapsule (&tw, model);
-					}
-				}
-				else
-				{
-					CM_TraceThroughLeaf (&tw, &cmod->leaf);
-				}
-		}
-		else
+		st = &test.traces[i];
+		CM_StressRun (st, &trace, &contents);
+		if (!CM_StressSame (&trace, &st->trace) || contents != st->contents)
 		{
-			CM_TraceThroughTree (&tw, 0, 0, 1, tw.start, tw.end);
+			test.mismatches++;
 		}
 	}
 
-	// generate endpos from the original, unmodified start/end
-	if (tw.trace.fraction == 1)
+	numChunks = (test.numTraces + STRESS_CHUNK - 1) / STRESS_CHUNK;
+
+	start = Sys_Microseconds ();
+	for (pass = 0; pass < passes; pass++)
 	{
-		VectorCopy (end, tw.trace.endpos);
+		Sys_RunJobs (CM_StressJob, &test, numChunks);
+	}
+	multiUsec = Sys_Microseconds () - start;
+
+	Com_Printf ("%i traces (%i world, %i model, %i box, %i point), %i passes\n", test.numTraces,
+		counts[STRESS_WORLD], counts[STRESS_MODEL], counts[STRESS_TEMPBOX], counts[STRESS_POINT], passes);
+	Com_Printf (" 1 thread : %8.3f msec\n", singleUsec / 1000.0f);
+	Com_Printf ("%2i threads: %8.3f msec/pass\n", Sys_NumJobThreads (), multiUsec / (1000.0f * passes));
+
+	if (test.mismatches)
+	{
+		Com_Printf (S_COLOR_RED "%i results differ from the single threaded run\n", test.mismatches);
 	}
 	else
 	{
-		for (i = 0; i < 3; i++)
-		{
-			tw.trace.endpos[i] = start[i] + tw.trace.fraction * (end[i] - start[i]);
-		}
+		Com_Printf ("all results match\n");
 	}
 
-	// If allsolid is set (was entirely inside something solid), the plane is not valid.
-	// If fraction == 1.0, we never hit anything, and thus the plane is not valid.
-	// Otherwise, the normal on the plane should have unit length
-	assert (tw.trace.allsolid ||
-		tw.trace.fraction == 1.0 ||
-		VectorLengthSquared (tw.trace.plane.normal) > 0.9999);
-	*results = tw.trace;
+	Z_Free (test.traces);
 }
 
 /*
 ==================
-CM_BoxTrace
+CM_BenchOpenPoint
+
+A random point in the world that isn't inside a brush
 ==================
 */
-void CM_BoxTrace (trace_t *results, const vec3_t start, const vec3_t end,
-	vec3_t mins, vec3_t maxs,
-	clipHandle_t model, int brushmask, int capsule)
+static void CM_BenchOpenPoint (int *seed, vec3_t point)
 {
-	CM_Trace (results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL);
+	int		tries;
+
+	for (tries = 0; tries < 64; tries++)
+	{
+		CM_StressRandomVector (seed, cm.cmodels[0].mins, cm.cmodels[0].maxs, point);
+		if (!(CM_PointContents (point, 0) & CONTENTS_SOLID))
+		{
+			return;
+		}
+	}
 }
 
 /*
 ==================
-CM_TransformedBoxTrace
+CM_TraceBench_f
 
-Handles offseting and rotation of the end points for moving and
-rotating entities
+cm_tracebench [rays] [passes]
+
+Rays/sec for CM_BoxTrace one at a time, with and without the flattened
+leafs, against CM_TraceBatch on one and on all job threads.  The rays come
+in groups of eight from the same eye point, like visibility checks from one
+bot, and cross the whole map, so big open maps show the leaf culling most.
 ==================
 */
-void CM_TransformedBoxTrace (trace_t *results, const vec3_t start, const vec3_t end,
-	vec3_t mins, vec3_t maxs,
-	clipHandle_t model, int brushmask,
-	const vec3_t origin, const vec3_t angles, int capsule)
+void CM_TraceBench_f (void)
 {
-	trace_t		trace;
-	vec3_t		start_l, end_l;
-	qboolean	rotated;
-	vec3_t		offset;
-	vec3_t		symetricSize[2];
-	vec3_t		matrix[3], transpose[3];
-	int			i;
-	float		halfwidth;
-	float		halfheight;
-	float		t;
-	sphere_t	sphere;
+	traceRequest_t	*requests, *req;
+	trace_t			*baseline, *results;
+	int				numRays, passes;
+	int				i, j, pass;
+	int				seed;
+	int				start, usec;
+	int				mismatches;
+	int				threads, maxThreads;
+	vec3_t			eye;
+	cFlatLeaf_t		*flatLeafs;
 
-	if (!mins)
+	if (!cm.numNodes)
 	{
-		mins = vec3_origin;
+		Com_Printf ("No map loaded.\n");
+		return;
 	}
-	if (!maxs)
+
+	numRays = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : 65536;
+	passes = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 4;
+
+	if (numRays < 1)
 	{
-		maxs = vec3_origin;
+		numRays = 1;
 	}
-
-	// adjust so that mins and maxs are always symetric, which
-	// avoids some complications with plane expanding of rotated
-	// bmodels
-	for (i = 0; i < 3; i++)
+	if (passes < 1)
 	{
-		offset[i] = (mins[i] + maxs[i]) * 0.5;
-		symetricSize[0][i] = mins[i] - offset[i];
-		symetricSize[1][i] = maxs[i] - offset[i];
-		start_l[i] = start[i] + offset[i];
-		end_l[i] = end[i] + offset[i];
+		passes = 1;
 	}
 
-	// subtract origin offset
-	VectorSubtract (start_l, origin, start_l);
-	VectorSubtract (end_l, origin, end_l);
+	requests = Z_Malloc (numRays * sizeof (*requests));
+	baseline = Z_Malloc (numRays * sizeof (*baseline));
+	results = Z_Malloc (numRays * sizeof (*results));
 
-	// rotate start and end into the models frame of reference
-	if (model != BOX_MODEL_HANDLE &&
-		(angles[0] || angles[1] || angles[2]))
-	{
-		rotated = qtrue;
-	}
-	else
+	seed = 0x5eed;
+
+	for (i = 0; i < numRays; i++)
 	{
-		rotated = qfalse;
-	}
+		req = &requests[i];
 
-	halfwidth = symetricSize[1][0];
-	halfheight = symetricSize[1][2];
+		if (!(i & 7))
+		{
+			CM_BenchOpenPoint (&seed, eye);
+		}
 
-	sphere.use = capsule;
-	sphere.radius = (halfwidth > halfheight) ? halfheight : halfwidth;
-	sphere.halfheight = halfheight;
-	t = halfheight - sphere.radius;
+		VectorCopy (eye, req->start);
+		CM_BenchOpenPoint (&seed, req->end);
 
-	if (rotated)
+		// every other group is a player sized box instead of a line
+		if (i & 8)
+		{
+			VectorSet (req->mins, -15, -15, -24);
+			VectorSet (req->maxs, 15, 15, 32);
+		}
+
+		req->passEntityNum = ENTITYNUM_NONE;
+		req->contentmask = CONTENTS_SOLID | CONTENTS_PLAYERCLIP;
+	}
+
+	Com_Printf ("%i rays, %i passes\n", numRays, passes);
+
+	start = Sys_Microseconds ();
+	for (pass = 0; pass < passes; pass++)
 	{
-		// rotation on trace line (start-end) instead of rotating the bmodel
-		// NOTE: This is still incorrect for bounding boxes because the actual bounding
-		//		 box that is swept through the model is not rotated. We cannot rotate
-		//		 the bounding box or the bmodel because that would make all the brush
-		//		 bevels invalid.
-		//		 However this is correct for capsules since a capsule itself is rotated too.
-		CreateRotationMatrix (angles, matrix);
-		RotatePoint (start_l, matrix);
-		RotatePoint (end_l, matrix);
-		// rotated sphere offset for capsule
-		sphere.offset[0] = matrix[0][2] * t;
-		sphere.offset[1] = -matrix[1][2] * t;
-		sphere.offset[2] = matrix[2][2] * t;
+		for (i = 0; i < numRays; i++)
+		{
+			req = &requests[i];
+			CM_BoxTrace (&baseline[i], req->start, req->end, req->mins, req->maxs, 0, req->contentmask, qfalse);
+		}
 	}
-	else
+	usec = Sys_Microseconds () - start;
+
+	Com_Printf ("CM_BoxTrace          : %6.2f Mrays/sec\n", (float) numRays * passes / (usec ? usec : 1));
+
+	// the same through cm.leafbrushes, to see what the flattened leafs buy
+	flatLeafs = cm.flatLeafs;
+	if (flatLeafs)
 	{
-		VectorSet (sphere.offset, 0, 0, t);
+		cm.flatLeafs = NULL;
+
+		start = Sys_Microseconds ();
+		for (pass = 0; pass < passes; pass++)
+		{
+			for (i = 0; i < numRays; i++)
+			{
+				req = &requests[i];
+				CM_BoxTrace (&results[i], req->start, req->end, req->mins, req->maxs, 0, req->contentmask, qfalse);
+			}
+		}
+		usec = Sys_Microseconds () - start;
+
+		cm.flatLeafs = flatLeafs;
+
+		mismatches = 0;
+		for (j = 0; j < numRays; j++)
+		{
+			if (!CM_StressSame (&results[j], &baseline[j]))
+			{
+				mismatches++;
+			}
+		}
+
+		Com_Printf ("CM_BoxTrace unflat   : %6.2f Mrays/sec%s\n", (float) numRays * passes / (usec ? usec : 1),
+			mismatches ? va (S_COLOR_RED " %i results differ", mismatches) : "");
 	}
 
-	// sweep the box through the model
-	CM_Trace (&trace, start_l, end_l, symetricSize[0], symetricSize[1], model, origin, brushmask, capsule, &sphere);
+	maxThreads = Sys_NumJobThreads ();
 
-	// if the bmodel was rotated and there was a collision
-	if (rotated && trace.fraction != 1.0)
+	for (threads = 1; ; threads = maxThreads)
 	{
-		// rotation of bmodel collision plane
-		TransposeMatrix (matrix, transpose);
-		RotatePoint (trace.plane.normal, transpose);
+		Sys_SetJobThreadLimit (threads);
+
+		start = Sys_Microseconds ();
+		for (pass = 0; pass < passes; pass++)
+		{
+			CM_TraceBatch (results, requests, numRays, qfalse);
+		}
+		usec = Sys_Microseconds () - start;
+
+		mismatches = 0;
+		for (j = 0; j < numRays; j++)
+		{
+			if (!CM_StressSame (&results[j], &baseline[j]))
+			{
+				mismatches++;
+			}
+		}
+
+		Com_Printf ("CM_TraceBatch %2i thr : %6.2f Mrays/sec%s\n", threads, (float) numRays * passes / (usec ? usec : 1),
+			mismatches ? va (S_COLOR_RED " %i results differ", mismatches) : "");
+
+		if (threads == maxThreads)
+		{
+			break;
+		}
 	}
 
-	// re-calculate the end position of the trace because the trace.endpos
-	// calculated by CM_Trace could be rotated and have an offset
-	trace.endpos[0] = start[0] + trace.fraction * (end[0] - start[0]);
-	trace.endpos[1] = start[1] + trace.fraction * (end[1] - start[1]);
-	trace.endpos[2] = start[2] + trace.fraction * (end[2] - start[2]);
+	Sys_SetJobThreadLimit (0);
 
-	*results = trace;
+	Z_Free (requests);
+	Z_Free (baseline);
+	Z_Free (results);
 }
@@ -804,10 +804,17 @@ The rover can be left pointing at a non-empty block
 
 The zone calls are pretty much only used for small strings and structures,
 all big things are allocated on the hunk.
+
+Requests of up to SLAB_MAX_SIZE bytes don't go through the rover.  They are
+rounded up to a size class and served from slab pages, which are ordinary
+TAG_SLAB zone blocks cut into fixed size slots.  Every thread keeps a small
+cache of free slots per class, so most small allocations and frees never
+take the zone lock.
 ==============================================================================
 */
 
 #define	ZONEID	0x1d4a11
+#define	SLABID	0x1d4a12		// a slot in a slab page instead of a rover block
 #define MINFRAGMENT	64
 
 typedef struct zonedebug_s
@@ -840,7 +847,78 @@ memzone_t	*mainzone;
 // fragment the main zone (think of cvar and cmd strings)
 memzone_t	*smallzone;
 
+static	int		s_zoneTotal;
+static	int		s_smallZoneTotal;
+
+#define	SLAB_PAGE_SIZE		8192
+#define	SLAB_MAX_SIZE		512
+#define	SLAB_CACHE_SIZE		32		// free slots a thread holds on to per class
+#define	NUM_SLAB_CLASSES	10
+
+static const int slabSizes[NUM_SLAB_CLASSES] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512};
+
+// slots link through memblock_t next while free, and prev always
+// points back at the page they were cut from
+typedef struct slabPage_s
+{
+	int			classNum;
+	int			used;			// slots handed out, including the ones in thread caches
+	memblock_t	*free;
+	struct slabPage_s	*prev, *next;	// partial list of the class
+	struct slabPage_s	*nextPage;		// all pages of the class
+} slabPage_t;
+
+typedef struct
+{
+	int			size;			// largest request that fits
+	int			slotSize;		// including the header and trash tester
+	int			slotsPerPage;
+	int			numPages;
+	slabPage_t	partial;		// start / end cap for pages with free slots
+	slabPage_t	*pages;
+} slabClass_t;
+
+typedef struct
+{
+	int			count;
+	memblock_t	*blocks[SLAB_CACHE_SIZE];
+} slabCache_t;
+
+// a zone and the slabs cut from it
+typedef struct
+{
+	memzone_t	*zone;
+	volatile int	lock;
+	qboolean	slabs;			// qfalse sends everything through the rover
+	slabClass_t	classes[NUM_SLAB_CLASSES];
+	slabCache_t	caches[MAX_JOB_THREADS + 1][NUM_SLAB_CLASSES];
+} zoneArena_t;
+
+static zoneArena_t	z_mainArena;
+static zoneArena_t	z_smallArena;
+
+// size class for every 16 byte step up to SLAB_MAX_SIZE
+static byte	z_slabClass[(SLAB_MAX_SIZE >> 4) + 1];
+
+// allocation trace for zone_trace / zone_replay
+typedef struct
+{
+	int		key;			// zone offset of the block, high bit set for the small zone
+	int		size;			// -1 for a free
+	int		tag;
+} zoneTraceEvent_t;
+
+#define	ZONE_TRACE_IDENT	(('1'<<24)+('R'<<16)+('T'<<8)+'Z')
+
+static qboolean			z_tracing;
+static char				z_traceName[MAX_QPATH];
+static zoneTraceEvent_t	*z_trace;
+static int				z_traceCount;
+static int				z_traceMax;
+static volatile int		z_traceLock;
+
 void Z_CheckHeap (void);
+static void Frame_Meminfo (void);
 
 /*
 ========================
@@ -890,148 +968,69 @@ int Z_AvailableMemory (void)
 
 /*
 ========================
-Z_Free
+Z_InitArena
 ========================
 */
-void Z_Free (void *ptr)
+static void Z_InitArena (zoneArena_t *arena, memzone_t *zone)
 {
-	memblock_t	*block, *other;
-	memzone_t *zone;
-
-	if (!ptr)
-	{
-		Com_Error (ERR_DROP, "Z_Free: NULL pointer");
-	}
-
-	block = (memblock_t *) ((byte *) ptr - sizeof (memblock_t));
-	if (block->id != ZONEID)
-	{
-		Com_Error (ERR_FATAL, "Z_Free: freed a pointer without ZONEID");
-	}
-	if (block->tag == 0)
-	{
-		Com_Error (ERR_FATAL, "Z_Free: freed a freed pointer");
-	}
-	// if static memory
-	if (block->tag == TAG_STATIC)
-	{
-		return;
-	}
-
-	// check the memory trash tester
-	if (*(int *) ((byte *) block + block->size - 4) != ZONEID)
-	{
-		Com_Error (ERR_FATAL, "Z_Free: memory block wrote past end");
-	}
-
-	if (block->tag == TAG_SMALL)
-	{
-		zone = smallzone;
-	}
-	else
-	{
-		zone = mainzone;
-	}
-
-	zone->used -= block->size;
-	// set the block to something that should cause problems
-	// if it is referenced...
-	Com_Memset (ptr, 0xaa, block->size - sizeof (*block));
+	slabClass_t	*cl;
+	int			i, c;
 
-	block->tag = 0;		// mark as free
+	Com_Memset (arena, 0, sizeof (*arena));
+	arena->zone = zone;
+	arena->slabs = qtrue;
 
-	other = block->prev;
-	if (!other->tag)
+	for (c = 0; c < NUM_SLAB_CLASSES; c++)
 	{
-		// merge with previous free block
-		other->size += block->size;
-		other->next = block->next;
-		other->next->prev = other;
-		if (block == zone->rover)
-		{
-			zone->rover = other;
-		}
-		block = other;
+		cl = &arena->classes[c];
+		cl->size = slabSizes[c];
+		cl->slotSize = (sizeof (memblock_t) + cl->size + 4 + 3) & ~3;
+		cl->slotsPerPage = (SLAB_PAGE_SIZE - sizeof (memblock_t) - 4 - sizeof (slabPage_t)) / cl->slotSize;
+		cl->partial.next = cl->partial.prev = &cl->partial;
 	}
 
-	zone->rover = block;
-
-	other = block->next;
-	if (!other->tag)
+	for (i = 0, c = 0; i <= SLAB_MAX_SIZE >> 4; i++)
 	{
-		// merge the next free block onto the end
-		block->size += other->size;
-		block->next = other->next;
-		block->next->prev = block;
-		if (other == zone->rover)
+		while (slabSizes[c] < i << 4)
 		{
-			zone->rover = block;
+			c++;
 		}
+		z_slabClass[i] = c;
 	}
 }
 
-
 /*
-================
-Z_FreeTags
-================
+========================
+Z_LockArena
+========================
 */
-void Z_FreeTags (int tag)
+static void Z_LockArena (zoneArena_t *arena)
 {
-	int			count;
-	memzone_t	*zone;
-
-	if (tag == TAG_SMALL)
-	{
-		zone = smallzone;
-	}
-	else
-	{
-		zone = mainzone;
-	}
-	count = 0;
-	// use the rover as our pointer, because
-	// Z_Free automatically adjusts it
-	zone->rover = zone->blocklist.next;
-	do
-	{
-		if (zone->rover->tag == tag)
-		{
-			count++;
-			Z_Free ((void *) (zone->rover + 1));
-			continue;
-		}
-		zone->rover = zone->rover->next;
-	} while (zone->rover != &zone->blocklist);
+	while (Sys_AtomicCompareExchange (&arena->lock, 1, 0))
+		;
 }
 
-
 /*
-================
-Z_TagMalloc
-================
+========================
+Z_UnlockArena
+========================
 */
-void *Z_TagMalloc (int size, int tag)
+static void Z_UnlockArena (zoneArena_t *arena)
 {
-	int		extra, allocSize;
-	memblock_t	*start, *rover, *new, *base;
-	memzone_t *zone;
-
-	if (!tag)
-	{
-		Com_Error (ERR_FATAL, "Z_TagMalloc: tried to use a 0 tag");
-	}
+	Sys_AtomicCompareExchange (&arena->lock, 0, 1);
+}
 
-	if (tag == TAG_SMALL)
-	{
-		zone = smallzone;
-	}
-	else
-	{
-		zone = mainzone;
-	}
+/*
+========================
+Z_ZoneAlloc
 
-	allocSize = size;
+First fit from the rover, returns NULL if nothing is big enough
+========================
+*/
+static memblock_t *Z_ZoneAlloc (memzone_t *zone, int size, int tag)
+{
+	int		extra;
+	memblock_t	*start, *rover, *new, *base;
 
 	// scan through the block list looking for the first free block
 	// of sufficient size
@@ -1047,8 +1046,6 @@ void *Z_TagMalloc (int size, int tag)
 		if (rover == start)
 		{
 			// scaned all the way around the list
-			Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
-				size, zone == smallzone ? "small" : "main");
 			return NULL;
 		}
 		if (rover->tag)
@@ -1087,101 +1084,966 @@ void *Z_TagMalloc (int size, int tag)
 	// marker for memory trash testing
 	*(int *) ((byte *) base + base->size - 4) = ZONEID;
 
-	return (void *) ((byte *) base + sizeof (memblock_t));
+	return base;
 }
 
 /*
 ========================
-Z_Malloc
+Z_ZoneFree
 ========================
 */
-void *Z_Malloc (int size)
+static void Z_ZoneFree (memzone_t *zone, memblock_t *block)
 {
-	void	*buf;
+	memblock_t	*other;
 
-	//Z_CheckHeap ();	// DEBUG
+	zone->used -= block->size;
+	// set the block to something that should cause problems
+	// if it is referenced...
+	Com_Memset (block + 1, 0xaa, block->size - sizeof (*block));
 
-	buf = Z_TagMalloc (size, TAG_GENERAL);
-	Com_Memset (buf, 0, size);
+	block->tag = 0;		// mark as free
 
-	return buf;
+	other = block->prev;
+	if (!other->tag)
+	{
+		// merge with previous free block
+		other->size += block->size;
+		other->next = block->next;
+		other->next->prev = other;
+		if (block == zone->rover)
+		{
+			zone->rover = other;
+		}
+		block = other;
+	}
+
+	zone->rover = block;
+
+	other = block->next;
+	if (!other->tag)
+	{
+		// merge the next free block onto the end
+		block->size += other->size;
+		block->next = other->next;
+		block->next->prev = block;
+		if (other == zone->rover)
+		{
+			zone->rover = block;
+		}
+	}
 }
 
-void *S_Malloc (int size)
+/*
+========================
+Z_NewSlabPage
+
+Called with the arena locked, returns NULL if the zone is full
+========================
+*/
+static slabPage_t *Z_NewSlabPage (zoneArena_t *arena, int classNum)
 {
-	return Z_TagMalloc (size, TAG_SMALL);
+	slabClass_t	*cl;
+	slabPage_t	*page;
+	memblock_t	*block, *slot;
+	int			i;
+
+	cl = &arena->classes[classNum];
+	block = Z_ZoneAlloc (arena->zone, sizeof (slabPage_t) + cl->slotsPerPage * cl->slotSize, TAG_SLAB);
+	if (!block)
+	{
+		return NULL;
+	}
+
+	page = (slabPage_t *) (block + 1);
+	page->classNum = classNum;
+	page->used = 0;
+	page->free = NULL;
+
+	// build the free list backwards so it hands out slots in address order
+	for (i = cl->slotsPerPage - 1; i >= 0; i--)
+	{
+		slot = (memblock_t *) ((byte *) (page + 1) + i * cl->slotSize);
+		slot->size = cl->slotSize;
+		slot->tag = 0;
+		slot->id = SLABID;
+		slot->prev = (memblock_t *) page;
+		slot->next = page->free;
+		page->free = slot;
+
+		// marker for memory trash testing
+		*(int *) ((byte *) slot + slot->size - 4) = ZONEID;
+	}
+
+	page->next = cl->partial.next;
+	page->prev = &cl->partial;
+	page->next->prev = page;
+	cl->partial.next = page;
+
+	page->nextPage = cl->pages;
+	cl->pages = page;
+	cl->numPages++;
+
+	return page;
 }
 
 /*
 ========================
-Z_CheckHeap
+Z_FreeSlabPage
+
+Called with the arena locked, the page must be empty
 ========================
 */
-void Z_CheckHeap (void)
+static void Z_FreeSlabPage (zoneArena_t *arena, slabPage_t *page)
 {
-	memblock_t	*block;
+	slabClass_t	*cl;
+	slabPage_t	**link;
 
-	for (block = mainzone->blocklist.next;; block = block->next)
+	cl = &arena->classes[page->classNum];
+
+	page->prev->next = page->next;
+	page->next->prev = page->prev;
+
+	for (link = &cl->pages; *link != page; link = &(*link)->nextPage)
+		;
+	*link = page->nextPage;
+	cl->numPages--;
+
+	Z_ZoneFree (arena->zone, (memblock_t *) page - 1);
+}
+
+/*
+========================
+Z_SlabTake
+
+Called with the arena locked, returns NULL if the zone is full
+========================
+*/
+static memblock_t *Z_SlabTake (zoneArena_t *arena, int classNum)
+{
+	slabClass_t	*cl;
+	slabPage_t	*page;
+	memblock_t	*slot;
+
+	cl = &arena->classes[classNum];
+	page = cl->partial.next;
+	if (page == &cl->partial)
 	{
-		if (block->next == &mainzone->blocklist)
-		{
-			break;			// all blocks have been hit
-		}
-		if ((byte *) block + block->size != (byte *) block->next)
-			Com_Error (ERR_FATAL, "Z_CheckHeap: block size does not touch the next block\n");
-		if (block->next->prev != block)
-		{
-			Com_Error (ERR_FATAL, "Z_CheckHeap: next block doesn't have proper back link\n");
-		}
-		if (!block->tag && !block->next->tag)
+		page = Z_NewSlabPage (arena, classNum);
+		if (!page)
 		{
-			Com_Error (ERR_FATAL, "Z_CheckHeap: two consecutive free blocks\n");
+			return NULL;
 		}
 	}
+
+	slot = page->free;
+	page->free = slot->next;
+	page->used++;
+
+	if (!page->free)
+	{
+		// full, take it off the partial list
+		page->prev->next = page->next;
+		page->next->prev = page->prev;
+	}
+
+	return slot;
 }
 
 /*
 ========================
-Z_LogZoneHeap
+Z_SlabReturn
+
+Called with the arena locked.  If trim is set, a page left empty is given
+back to the zone unless it is the last one with free slots in its class.
 ========================
 */
-void Z_LogZoneHeap (memzone_t *zone, char *name)
+static void Z_SlabReturn (zoneArena_t *arena, memblock_t *slot, qboolean trim)
 {
-	memblock_t	*block;
-	char		buf[4096];
-	int size, allocSize, numBlocks;
+	slabClass_t	*cl;
+	slabPage_t	*page;
+
+	page = (slabPage_t *) slot->prev;
+	cl = &arena->classes[page->classNum];
+
+	if (!page->free)
+	{
+		// it was full, make it available again
+		page->next = cl->partial.next;
+		page->prev = &cl->partial;
+		page->next->prev = page;
+		cl->partial.next = page;
+	}
+
+	slot->next = page->free;
+	page->free = slot;
+	page->used--;
+
+	if (trim && !page->used && (page->prev != &cl->partial || page->next != &cl->partial))
+	{
+		Z_FreeSlabPage (arena, page);
+	}
+}
+
+/*
+========================
+Z_FlushSlabCaches
+
+Gives every thread's cached slots back to their pages.  Only safe while
+no jobs are running.
+========================
+*/
+static void Z_FlushSlabCaches (zoneArena_t *arena)
+{
+	slabCache_t	*cache;
+	int			i, c;
+
+	Z_LockArena (arena);
+	for (i = 0; i <= MAX_JOB_THREADS; i++)
+	{
+		for (c = 0; c < NUM_SLAB_CLASSES; c++)
+		{
+			cache = &arena->caches[i][c];
+			while (cache->count)
+			{
+				Z_SlabReturn (arena, cache->blocks[--cache->count], qtrue);
+			}
+		}
+	}
+	Z_UnlockArena (arena);
+}
+
+/*
+========================
+Z_ArenaTryAlloc
+
+Returns NULL when the arena is full
+========================
+*/
+static memblock_t *Z_ArenaTryAlloc (zoneArena_t *arena, int size, int tag)
+{
+	memblock_t	*block;
+	slabCache_t	*cache;
+	int			classNum;
+
+	if (arena->slabs && size <= SLAB_MAX_SIZE)
+	{
+		classNum = z_slabClass[(size + 15) >> 4];
+		cache = &arena->caches[Sys_ThreadIndex ()][classNum];
+
+		if (!cache->count)
+		{
+			// refill half the cache so a following free doesn't
+			// have to go straight back to the pages
+			Z_LockArena (arena);
+			while (cache->count < SLAB_CACHE_SIZE / 2)
+			{
+				block = Z_SlabTake (arena, classNum);
+				if (!block)
+				{
+					break;
+				}
+				cache->blocks[cache->count++] = block;
+			}
+			Z_UnlockArena (arena);
+		}
+
+		block = cache->count ? cache->blocks[--cache->count] : NULL;
+	}
+	else
+	{
+		Z_LockArena (arena);
+		block = Z_ZoneAlloc (arena->zone, size, tag);
+		Z_UnlockArena (arena);
+	}
+
+	if (block)
+	{
+		block->tag = tag;
+	}
+
+	return block;
+}
+
+/*
+========================
+Z_ArenaAlloc
+========================
+*/
+static void *Z_ArenaAlloc (zoneArena_t *arena, int size, int tag)
+{
+	memblock_t	*block;
+
+	block = Z_ArenaTryAlloc (arena, size, tag);
+	if (!block)
+	{
+		Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
+			size, arena == &z_smallArena ? "small" : "main");
+		return NULL;
+	}
+
+	return (void *) (block + 1);
+}
+
+/*
+========================
+Z_ArenaFree
+========================
+*/
+static void Z_ArenaFree (zoneArena_t *arena, memblock_t *block)
+{
+	slabCache_t	*cache;
+
+	if (block->id != SLABID)
+	{
+		Z_LockArena (arena);
+		Z_ZoneFree (arena->zone, block);
+		Z_UnlockArena (arena);
+		return;
+	}
+
+	// set the slot to something that should cause problems
+	// if it is referenced, but leave the trash tester
+	Com_Memset (block + 1, 0xaa, block->size - sizeof (*block) - 4);
+	block->tag = 0;
+
+	cache = &arena->caches[Sys_ThreadIndex ()][((slabPage_t *) block->prev)->classNum];
+	if (cache->count == SLAB_CACHE_SIZE)
+	{
+		Z_LockArena (arena);
+		while (cache->count > SLAB_CACHE_SIZE / 2)
+		{
+			Z_SlabReturn (arena, cache->blocks[--cache->count], qtrue);
+		}
+		Z_UnlockArena (arena);
+	}
+	cache->blocks[cache->count++] = block;
+}
+
+/*
+========================
+Z_SlabUsage
+
+Adds the bytes of in use slots to tagBytes by tag
+========================
+*/
+static void Z_SlabUsage (zoneArena_t *arena, int tagBytes[TAG_SLAB + 1], int *blocks)
+{
+	slabClass_t	*cl;
+	slabPage_t	*page;
+	memblock_t	*slot;
+	int			i, c;
+
+	for (c = 0; c < NUM_SLAB_CLASSES; c++)
+	{
+		cl = &arena->classes[c];
+		for (page = cl->pages; page; page = page->nextPage)
+		{
+			for (i = 0; i < cl->slotsPerPage; i++)
+			{
+				slot = (memblock_t *) ((byte *) (page + 1) + i * cl->slotSize);
+				if (slot->tag)
+				{
+					tagBytes[slot->tag] += slot->size;
+					(*blocks)++;
+				}
+			}
+		}
+	}
+}
+
+/*
+========================
+Z_TraceEvent
+========================
+*/
+static void Z_TraceEvent (zoneArena_t *arena, memblock_t *block, int size, int tag)
+{
+	zoneTraceEvent_t	*ev;
+
+	while (Sys_AtomicCompareExchange (&z_traceLock, 1, 0))
+		;
+
+	if (z_tracing && z_traceCount == z_traceMax)
+	{
+		z_traceMax = z_traceMax ? z_traceMax * 2 : 65536;
+		ev = realloc (z_trace, z_traceMax * sizeof (*z_trace));
+		if (ev)
+		{
+			z_trace = ev;
+		}
+		else
+		{
+			// out of memory, keep what we have
+			z_tracing = qfalse;
+		}
+	}
+
+	if (z_tracing)
+	{
+		ev = &z_trace[z_traceCount++];
+		ev->key = (byte *) block - (byte *) arena->zone;
+		if (arena == &z_smallArena)
+		{
+			ev->key |= 0x80000000;
+		}
+		ev->size = size;
+		ev->tag = tag;
+	}
+
+	Sys_AtomicCompareExchange (&z_traceLock, 0, 1);
+}
+
+/*
+========================
+Z_Free
+========================
+*/
+void Z_Free (void *ptr)
+{
+	memblock_t	*block;
+	zoneArena_t	*arena;
+
+	if (!ptr)
+	{
+		Com_Error (ERR_DROP, "Z_Free: NULL pointer");
+	}
+
+	block = (memblock_t *) ((byte *) ptr - sizeof (memblock_t));
+	if (block->id != ZONEID && block->id != SLABID)
+	{
+		Com_Error (ERR_FATAL, "Z_Free: freed a pointer without ZONEID");
+	}
+	if (block->tag == 0)
+	{
+		Com_Error (ERR_FATAL, "Z_Free: freed a freed pointer");
+	}
+	// if static memory
+	if (block->tag == TAG_STATIC)
+	{
+		return;
+	}
+
+	// check the memory trash tester
+	if (*(int *) ((byte *) block + block->size - 4) != ZONEID)
+	{
+		Com_Error (ERR_FATAL, "Z_Free: memory block wrote past end");
+	}
+
+	if (block->tag == TAG_SMALL)
+	{
+		arena = &z_smallArena;
+	}
+	else
+	{
+		arena = &z_mainArena;
+	}
+
+	if (z_tracing)
+	{
+		Z_TraceEvent (arena, block, -1, block->tag);
+	}
+
+	Z_ArenaFree (arena, block);
+}
+
+
+/*
+================
+Z_FreeTags
+================
+*/
+void Z_FreeTags (int tag)
+{
+	zoneArena_t	*arena;
+	memzone_t	*zone;
+	slabClass_t	*cl;
+	slabPage_t	*page, *next;
+	memblock_t	*slot;
+	int			i, c;
+
+	if (tag == TAG_SMALL)
+	{
+		arena = &z_smallArena;
+	}
+	else
+	{
+		arena = &z_mainArena;
+	}
+	zone = arena->zone;
+
+	Z_FlushSlabCaches (arena);
+	Z_LockArena (arena);
+
+	// use the rover as our pointer, because
+	// Z_ZoneFree automatically adjusts it
+	zone->rover = zone->blocklist.next;
+	do
+	{
+		if (zone->rover->tag == tag)
+		{
+			if (z_tracing)
+			{
+				Z_TraceEvent (arena, zone->rover, -1, tag);
+			}
+			Z_ZoneFree (zone, zone->rover);
+			continue;
+		}
+		zone->rover = zone->rover->next;
+	} while (zone->rover != &zone->blocklist);
+
+	// the pages stay put while they are swept and are trimmed afterwards
+	for (c = 0; c < NUM_SLAB_CLASSES; c++)
+	{
+		cl = &arena->classes[c];
+		for (page = cl->pages; page; page = page->nextPage)
+		{
+			for (i = 0; i < cl->slotsPerPage; i++)
+			{
+				slot = (memblock_t *) ((byte *) (page + 1) + i * cl->slotSize);
+				if (slot->tag == tag)
+				{
+					if (z_tracing)
+					{
+						Z_TraceEvent (arena, slot, -1, tag);
+					}
+					Com_Memset (slot + 1, 0xaa, slot->size - sizeof (*slot) - 4);
+					slot->tag = 0;
+					Z_SlabReturn (arena, slot, qfalse);
+				}
+			}
+		}
+
+		for (page = cl->pages; page; page = next)
+		{
+			next = page->nextPage;
+			if (!page->used && (page->prev != &cl->partial || page->next != &cl->partial))
+			{
+				Z_FreeSlabPage (arena, page);
+			}
+		}
+	}
+
+	Z_UnlockArena (arena);
+}
+
+
+/*
+================
+Z_TagMalloc
+================
+*/
+void *Z_TagMalloc (int size, int tag)
+{
+	zoneArena_t	*arena;
+	void		*buf;
+
+	if (!tag)
+	{
+		Com_Error (ERR_FATAL, "Z_TagMalloc: tried to use a 0 tag");
+	}
+
+	if (tag == TAG_SMALL)
+	{
+		arena = &z_smallArena;
+	}
+	else
+	{
+		arena = &z_mainArena;
+	}
+
+	buf = Z_ArenaAlloc (arena, size, tag);
+
+	if (z_tracing)
+	{
+		Z_TraceEvent (arena, (memblock_t *) buf - 1, size, tag);
+	}
+
+	return buf;
+}
+
+/*
+========================
+Z_Malloc
+========================
+*/
+void *Z_Malloc (int size)
+{
+	void	*buf;
+
+	//Z_CheckHeap ();	// DEBUG
+
+	buf = Z_TagMalloc (size, TAG_GENERAL);
+	Com_Memset (buf, 0, size);
+
+	return buf;
+}
+
+void *S_Malloc (int size)
+{
+	return Z_TagMalloc (size, TAG_SMALL);
+}
+
+/*
+========================
+Z_CheckHeap
+========================
+*/
+void Z_CheckHeap (void)
+{
+	memblock_t	*block;
+
+	for (block = mainzone->blocklist.next;; block = block->next)
+	{
+		if (block->next == &mainzone->blocklist)
+		{
+			break;			// all blocks have been hit
+		}
+		if ((byte *) block + block->size != (byte *) block->next)
+			Com_Error (ERR_FATAL, "Z_CheckHeap: block size does not touch the next block\n");
+		if (block->next->prev != block)
+		{
+			Com_Error (ERR_FATAL, "Z_CheckHeap: next block doesn't have proper back link\n");
+		}
+		if (!block->tag && !block->next->tag)
+		{
+			Com_Error (ERR_FATAL, "Z_CheckHeap: two consecutive free blocks\n");
+		}
+	}
+}
+
+/*
+========================
+Z_LogZoneHeap
+========================
+*/
+void Z_LogZoneHeap (zoneArena_t *arena, char *name)
+{
+	memblock_t	*block;
+	memzone_t	*zone;
+	char		buf[4096];
+	int			tagBytes[TAG_SLAB + 1];
+	int size, allocSize, numBlocks;
+	int			i;
+
+	if (!logfile || !FS_Initialized ())
+		return;
+	zone = arena->zone;
+	size = allocSize = numBlocks = 0;
+	Com_sprintf (buf, sizeof (buf), "\r\n================\r\n%s log\r\n================\r\n", name);
+	FS_Write (buf, strlen (buf), logfile);
+	for (block = zone->blocklist.next; block->next != &zone->blocklist; block = block->next)
+	{
+		if (block->tag && block->tag != TAG_SLAB)
+		{
+			size += block->size;
+			numBlocks++;
+		}
+	}
+
+	Com_Memset (tagBytes, 0, sizeof (tagBytes));
+	Z_SlabUsage (arena, tagBytes, &numBlocks);
+	for (i = 0; i <= TAG_SLAB; i++)
+	{
+		size += tagBytes[i];
+	}
+
+	allocSize = numBlocks * sizeof (memblock_t); // + 32 bit alignment
+
+	Com_sprintf (buf, sizeof (buf), "%d %s memory in %d blocks\r\n", size, name, numBlocks);
+	FS_Write (buf, strlen (buf), logfile);
+	Com_sprintf (buf, sizeof (buf), "%d %s memory overhead\r\n", size - allocSize, name);
+	FS_Write (buf, strlen (buf), logfile);
+}
+
+/*
+========================
+Z_LogHeap
+========================
+*/
+void Z_LogHeap (void)
+{
+	Z_LogZoneHeap (&z_mainArena, "MAIN");
+	Z_LogZoneHeap (&z_smallArena, "SMALL");
+}
+
+/*
+========================
+Z_Trace_f
+
+zone_trace <file> starts recording every zone allocation and free,
+zone_trace again stops and writes them out for zone_replay
+========================
+*/
+void Z_Trace_f (void)
+{
+	fileHandle_t	f;
+	int				header[3];
+	int				i, count;
+
+	if (!z_tracing)
+	{
+		if (Cmd_Argc () != 2)
+		{
+			Com_Printf ("usage: zone_trace <file>\n");
+			return;
+		}
+		Q_strncpyz (z_traceName, Cmd_Argv (1), sizeof (z_traceName));
+		z_traceCount = 0;
+		z_tracing = qtrue;
+		Com_Printf ("tracing zone allocations, zone_trace again to stop\n");
+		return;
+	}
+
+	// stop first, writing the file allocates
+	while (Sys_AtomicCompareExchange (&z_traceLock, 1, 0))
+		;
+	z_tracing = qfalse;
+	count = z_traceCount;
+	Sys_AtomicCompareExchange (&z_traceLock, 0, 1);
+
+	f = FS_FOpenFileWrite (z_traceName);
+	if (!f)
+	{
+		Com_Printf ("Couldn't write %s\n", z_traceName);
+	}
+	else
+	{
+		header[0] = LittleLong (ZONE_TRACE_IDENT);
+		header[1] = LittleLong (count);
+		header[2] = 0;
+		for (i = 0; i < count; i++)
+		{
+			z_trace[i].key = LittleLong (z_trace[i].key);
+			z_trace[i].size = LittleLong (z_trace[i].size);
+			z_trace[i].tag = LittleLong (z_trace[i].tag);
+		}
+		FS_Write (header, sizeof (header), f);
+		FS_Write (z_trace, count * sizeof (*z_trace), f);
+		FS_FCloseFile (f);
+		Com_Printf ("wrote %i zone events to %s\n", count, z_traceName);
+	}
+
+	free (z_trace);
+	z_trace = NULL;
+	z_traceCount = z_traceMax = 0;
+}
+
+/*
+========================
+Z_ReplayTrace
+
+Runs a trace against a scratch copy of the zones, with or without slabs.
+A trace that doesn't fit in zones of the current size is stopped at the
+first allocation that fails.
+========================
+*/
+static void Z_ReplayTrace (zoneTraceEvent_t *events, int numEvents, int numIds, int passes, qboolean slabs)
+{
+	zoneArena_t	*arenas[2];
+	memzone_t	*zones[2];
+	memblock_t	*block;
+	void		**live;
+	int			fragments, largest;
+	int			start, usec;
+	int			i, p;
+	qboolean	full;
+
+	zones[0] = calloc (s_zoneTotal, 1);
+	zones[1] = calloc (s_smallZoneTotal, 1);
+	arenas[0] = calloc (1, sizeof (zoneArena_t));
+	arenas[1] = calloc (1, sizeof (zoneArena_t));
+	live = calloc (numIds + 1, sizeof (*live));
+	if (!zones[0] || !zones[1] || !arenas[0] || !arenas[1] || !live)
+	{
+		Com_Printf ("zone_replay: not enough memory\n");
+		free (zones[0]);
+		free (zones[1]);
+		free (arenas[0]);
+		free (arenas[1]);
+		free (live);
+		return;
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		Z_ClearZone (zones[i], i ? s_smallZoneTotal : s_zoneTotal);
+		Z_InitArena (arenas[i], zones[i]);
+		arenas[i]->slabs = slabs;
+	}
+
+	usec = 0;
+	fragments = largest = 0;
+	full = qfalse;
+	for (p = 0; p < passes && !full; p++)
+	{
+		start = Sys_Microseconds ();
+		for (i = 0; i < numEvents; i++)
+		{
+			if (events[i].size >= 0)
+			{
+				block = Z_ArenaTryAlloc (arenas[events[i].tag == TAG_SMALL], events[i].size, events[i].tag);
+				if (!block)
+				{
+					Com_Printf ("%-12s ran out of the %s zone at event %i of %i, allocating %i bytes\n",
+						slabs ? "size classes" : "first fit", events[i].tag == TAG_SMALL ? "small" : "main",
+						i, numEvents, events[i].size);
+					full = qtrue;
+					break;
+				}
+				live[events[i].key] = block + 1;
+			}
+			else if (live[events[i].key])
+			{
+				Z_ArenaFree (arenas[events[i].tag == TAG_SMALL], (memblock_t *) live[events[i].key] - 1);
+				live[events[i].key] = NULL;
+			}
+		}
+		usec += Sys_Microseconds () - start;
+
+		// see how chopped up the main zone was left
+		fragments = largest = 0;
+		for (block = zones[0]->blocklist.next; block != &zones[0]->blocklist; block = block->next)
+		{
+			if (!block->tag)
+			{
+				fragments++;
+				if (block->size > largest)
+				{
+					largest = block->size;
+				}
+			}
+		}
+
+		// free whatever outlived the trace
+		for (i = 1; i <= numIds; i++)
+		{
+			if (live[i])
+			{
+				block = (memblock_t *) live[i] - 1;
+				Z_ArenaFree (arenas[block->tag == TAG_SMALL], block);
+				live[i] = NULL;
+			}
+		}
+	}
+
+	if (!full)
+	{
+		Com_Printf ("%-12s %8.2f msec %8.1f nsec/event %6i free fragments, largest %i\n",
+			slabs ? "size classes" : "first fit", usec / 1000.0f,
+			usec * 1000.0f / ((float) numEvents * passes), fragments, largest);
+	}
+
+	free (zones[0]);
+	free (zones[1]);
+	free (arenas[0]);
+	free (arenas[1]);
+	free (live);
+}
+
+/*
+========================
+Z_Replay_f
+
+zone_replay <file> [passes]
+
+No traces ship with the game, record one with zone_trace first
+========================
+*/
+void Z_Replay_f (void)
+{
+	zoneTraceEvent_t	*events;
+	int					*buf;
+	int					*hashKeys, *hashIds;
+	int					hashSize, h;
+	int					len, numEvents, numIds, passes;
+	int					i, j;
+
+	if (Cmd_Argc () < 2)
+	{
+		Com_Printf ("usage: zone_replay <file> [passes]\n");
+		return;
+	}
+
+	passes = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 1;
+	if (passes < 1)
+	{
+		passes = 1;
+	}
+
+	len = FS_ReadFile (Cmd_Argv (1), (void **) &buf);
+	if (!buf)
+	{
+		Com_Printf ("Couldn't read %s\n", Cmd_Argv (1));
+		return;
+	}
+	if (len < 12 || LittleLong (buf[0]) != ZONE_TRACE_IDENT
+		|| LittleLong (buf[1]) < 0 || LittleLong (buf[1]) > (len - 12) / (int) sizeof (zoneTraceEvent_t))
+	{
+		Com_Printf ("%s is not a zone trace\n", Cmd_Argv (1));
+		FS_FreeFile (buf);
+		return;
+	}
+
+	numEvents = LittleLong (buf[1]);
+	events = malloc ((numEvents + 1) * sizeof (*events));
+	for (hashSize = 1024; hashSize < numEvents * 2; hashSize <<= 1)
+		;
+	hashKeys = malloc (hashSize * sizeof (*hashKeys));
+	hashIds = calloc (hashSize, sizeof (*hashIds));
+	if (!events || !hashKeys || !hashIds)
+	{
+		Com_Printf ("zone_replay: not enough memory\n");
+		free (events);
+		free (hashKeys);
+		free (hashIds);
+		FS_FreeFile (buf);
+		return;
+	}
+
+	// turn block addresses into one id per allocation, dropping
+	// frees of blocks that were allocated before the trace started
+	numIds = 0;
+	for (i = 0, j = 0; i < numEvents; i++)
+	{
+		events[j].key = LittleLong (buf[3 + i * 3]);
+		events[j].size = LittleLong (buf[4 + i * 3]);
+		events[j].tag = LittleLong (buf[5 + i * 3]);
+		if (events[j].tag <= TAG_FREE || events[j].tag >= TAG_STATIC)
+		{
+			continue;
+		}
+
+		for (h = ((unsigned) events[j].key * 0x9e3779b1u) & (hashSize - 1); hashIds[h]; h = (h + 1) & (hashSize - 1))
+		{
+			if (hashKeys[h] == events[j].key)
+			{
+				break;
+			}
+		}
 
-	if (!logfile || !FS_Initialized ())
-		return;
-	size = allocSize = numBlocks = 0;
-	Com_sprintf (buf, sizeof (buf), "\r\n================\r\n%s log\r\n================\r\n", name);
-	FS_Write (buf, strlen (buf), logfile);
-	for (block = zone->blocklist.next; block->next != &zone->blocklist; block = block->next)
-	{
-		if (block->tag)
+		if (events[j].size >= 0)
 		{
-			size += block->size;
-			numBlocks++;
+			hashKeys[h] = events[j].key;
+			hashIds[h] = ++numIds;
+			events[j++].key = numIds;
+		}
+		else if (hashIds[h] > 0)
+		{
+			events[j++].key = hashIds[h];
+			hashIds[h] = -1;	// keep the slot so the probe chains stay intact
 		}
 	}
+	numEvents = j;
 
-	allocSize = numBlocks * sizeof (memblock_t); // + 32 bit alignment
+	free (hashKeys);
+	free (hashIds);
+	FS_FreeFile (buf);
 
-	Com_sprintf (buf, sizeof (buf), "%d %s memory in %d blocks\r\n", size, name, numBlocks);
-	FS_Write (buf, strlen (buf), logfile);
-	Com_sprintf (buf, sizeof (buf), "%d %s memory overhead\r\n", size - allocSize, name);
-	FS_Write (buf, strlen (buf), logfile);
-}
+	Com_Printf ("%i events, %i allocations, %i passes\n", numEvents, numIds, passes);
+	Z_ReplayTrace (events, numEvents, numIds, passes, qfalse);
+	Z_ReplayTrace (events, numEvents, numIds, passes, qtrue);
 
-/*
-========================
-Z_LogHeap
-========================
-*/
-void Z_LogHeap (void)
-{
-	Z_LogZoneHeap (mainzone, "MAIN");
-	Z_LogZoneHeap (smallzone, "SMALL");
+	free (events);
 }
 
 // static mem blocks to reduce a lot of small zone overhead
@@ -1305,8 +2167,6 @@ static	hunkUsed_t	*hunk_permanent, *hunk_temp;
 static	byte	*s_hunkData = NULL;
 static	int		s_hunkTotal;
 
-static	int		s_zoneTotal;
-static	int		s_smallZoneTotal;
 
 
 /*
@@ -1320,12 +2180,18 @@ void Com_Meminfo_f (void)
 	int			zoneBytes, zoneBlocks;
 	int			smallZoneBytes, smallZoneBlocks;
 	int			botlibBytes, rendererBytes;
+	int			slabBytes, slabPages;
+	int			smallSlabBytes, smallSlabPages;
+	int			tagBytes[TAG_SLAB + 1];
 	int			unused;
+	int			i;
 
 	zoneBytes = 0;
 	botlibBytes = 0;
 	rendererBytes = 0;
 	zoneBlocks = 0;
+	slabBytes = 0;
+	slabPages = 0;
 	for (block = mainzone->blocklist.next;; block = block->next)
 	{
 		if (Cmd_Argc () != 1)
@@ -1333,7 +2199,13 @@ void Com_Meminfo_f (void)
 			Com_Printf ("block:%p    size:%7i    tag:%3i\n",
 				block, block->size, block->tag);
 		}
-		if (block->tag)
+		if (block->tag == TAG_SLAB)
+		{
+			// the slots are counted by tag below
+			slabBytes += block->size;
+			slabPages++;
+		}
+		else if (block->tag)
 		{
 			zoneBytes += block->size;
 			zoneBlocks++;
@@ -1365,11 +2237,27 @@ void Com_Meminfo_f (void)
 		}
 	}
 
+	Com_Memset (tagBytes, 0, sizeof (tagBytes));
+	Z_SlabUsage (&z_mainArena, tagBytes, &zoneBlocks);
+	for (i = 0; i <= TAG_SLAB; i++)
+	{
+		zoneBytes += tagBytes[i];
+	}
+	botlibBytes += tagBytes[TAG_BOTLIB];
+	rendererBytes += tagBytes[TAG_RENDERER];
+
 	smallZoneBytes = 0;
 	smallZoneBlocks = 0;
+	smallSlabBytes = 0;
+	smallSlabPages = 0;
 	for (block = smallzone->blocklist.next;; block = block->next)
 	{
-		if (block->tag)
+		if (block->tag == TAG_SLAB)
+		{
+			smallSlabBytes += block->size;
+			smallSlabPages++;
+		}
+		else if (block->tag)
 		{
 			smallZoneBytes += block->size;
 			smallZoneBlocks++;
@@ -1381,6 +2269,13 @@ void Com_Meminfo_f (void)
 		}
 	}
 
+	Com_Memset (tagBytes, 0, sizeof (tagBytes));
+	Z_SlabUsage (&z_smallArena, tagBytes, &smallZoneBlocks);
+	for (i = 0; i <= TAG_SLAB; i++)
+	{
+		smallZoneBytes += tagBytes[i];
+	}
+
 	Com_Printf ("%8i bytes total hunk\n", s_hunkTotal);
 	Com_Printf ("%8i bytes total zone\n", s_zoneTotal);
 	Com_Printf ("\n");
@@ -1417,6 +2312,10 @@ void Com_Meminfo_f (void)
 	Com_Printf ("        %8i bytes in dynamic renderer\n", rendererBytes);
 	Com_Printf ("        %8i bytes in dynamic other\n", zoneBytes - (botlibBytes + rendererBytes));
 	Com_Printf ("        %8i bytes in small Zone memory\n", smallZoneBytes);
+	Com_Printf ("%8i bytes in %i main zone slab pages\n", slabBytes, slabPages);
+	Com_Printf ("%8i bytes in %i small zone slab pages\n", smallSlabBytes, smallSlabPages);
+	Com_Printf ("\n");
+	Frame_Meminfo ();
 }
 
 /*
@@ -1490,6 +2389,7 @@ void Com_InitSmallZoneMemory (void)
 		Com_Error (ERR_FATAL, "Small zone data failed to allocate %1.1f megs", (float) s_smallZoneTotal / (1024 * 1024));
 	}
 	Z_ClearZone (smallzone, s_smallZoneTotal);
+	Z_InitArena (&z_smallArena, smallzone);
 
 	return;
 }
@@ -1516,7 +2416,13 @@ void Com_InitZoneMemory (void)
 		Com_Error (ERR_FATAL, "Zone data failed to allocate %i megs", s_zoneTotal / (1024 * 1024));
 	}
 	Z_ClearZone (mainzone, s_zoneTotal);
+	Z_InitArena (&z_mainArena, mainzone);
 
+	// small blocks come from size class slabs unless this is off,
+	// the rover still serves everything bigger
+	cv = Cvar_Get ("com_zoneSlabs", "1", CVAR_LATCH | CVAR_ARCHIVE);
+	z_mainArena.slabs = cv->integer != 0;
+	z_smallArena.slabs = cv->integer != 0;
 }
 
 /*
@@ -1655,6 +2561,8 @@ void Com_InitHunkMemory (void)
 	Hunk_Clear ();
 
 	Cmd_AddCommand ("meminfo", Com_Meminfo_f);
+	Cmd_AddCommand ("zone_trace", Z_Trace_f);
+	Cmd_AddCommand ("zone_replay", Z_Replay_f);
 }
 
 
@@ -2014,6 +2922,230 @@ void Hunk_Trash (void)
 /*
 ===================================================================
 
+FRAME MEMORY
+
+Scratch memory that only has to live until the end of the frame.  Every
+thread bumps through its own arena, so nothing is locked, and allocations
+can be given back early with Frame_Mark / Frame_Release in any nesting
+that keeps to the stack order of the marks.  Com_Frame clears all of the
+arenas at the start of every frame.
+
+If an arena fills up, the rest of the frame falls back to malloc and the
+overflow is reported by meminfo so com_frameKB can be raised.
+===================================================================
+*/
+
+typedef struct frameOverflow_s
+{
+	struct frameOverflow_s	*next;
+	int						size;
+} frameOverflow_t;
+
+// keeps the buffers after an overflow header 16 byte aligned
+#define	FRAME_OVERFLOW_HEADER	((sizeof (frameOverflow_t) + 15) & ~15)
+
+typedef struct
+{
+	byte			*base;
+	int				size;
+	int				used;
+	int				overflowBytes;
+	frameOverflow_t	*overflow;		// malloced once the arena was full, newest first
+	int				peak;			// most in use this frame, overflow included
+} frameArena_t;
+
+static frameArena_t	com_frameArenas[MAX_JOB_THREADS + 1];
+static int			s_frameArenaSize;
+
+static int			com_frameLastPeak;		// of the previous frame, all threads
+static int			com_frameHighPeak;
+static int			com_frameOverflows;		// since the last meminfo
+
+/*
+=================
+Com_InitFrameMemory
+=================
+*/
+void Com_InitFrameMemory (void)
+{
+	cvar_t	*cv;
+
+	cv = Cvar_Get ("com_frameKB", "512", CVAR_LATCH | CVAR_ARCHIVE);
+	if (cv->integer < 64)
+	{
+		s_frameArenaSize = 64 * 1024;
+	}
+	else
+	{
+		s_frameArenaSize = cv->integer * 1024;
+	}
+}
+
+/*
+=================
+Frame_Alloc
+
+Returns 16 byte aligned memory that is NOT 0 filled and stays valid until
+the next Frame_Release of an older mark or the end of the frame.  Safe to
+call from job threads.
+=================
+*/
+void *Frame_Alloc (int size)
+{
+	frameArena_t	*arena;
+	frameOverflow_t	*block;
+	void			*buf;
+
+	arena = &com_frameArenas[Sys_ThreadIndex ()];
+
+	// the arenas are only touched once a thread needs one
+	if (!arena->base && s_frameArenaSize)
+	{
+		arena->base = malloc (s_frameArenaSize + 15);
+		if (arena->base)
+		{
+			arena->size = s_frameArenaSize;
+		}
+	}
+
+	size = (size + 15) & ~15;
+
+	if (arena->used + size <= arena->size)
+	{
+		buf = (void *) ((((size_t) arena->base + 15) & ~15) + arena->used);
+		arena->used += size;
+	}
+	else
+	{
+		block = malloc (FRAME_OVERFLOW_HEADER + size);
+		if (!block)
+		{
+			Com_Error (ERR_FATAL, "Frame_Alloc: failed on %i", size);
+		}
+		block->size = size;
+		block->next = arena->overflow;
+		arena->overflow = block;
+		arena->overflowBytes += size;
+		buf = (byte *) block + FRAME_OVERFLOW_HEADER;
+
+		Sys_AtomicAdd (&com_frameOverflows, 1);
+	}
+
+	if (arena->used + arena->overflowBytes > arena->peak)
+	{
+		arena->peak = arena->used + arena->overflowBytes;
+	}
+
+	return buf;
+}
+
+/*
+=================
+Frame_Mark
+=================
+*/
+frameMark_t Frame_Mark (void)
+{
+	frameArena_t	*arena;
+	frameMark_t		mark;
+
+	arena = &com_frameArenas[Sys_ThreadIndex ()];
+	mark.used = arena->used;
+	mark.overflow = arena->overflow;
+
+	return mark;
+}
+
+/*
+=================
+Frame_Release
+
+Gives back everything the calling thread allocated since the mark
+=================
+*/
+void Frame_Release (frameMark_t mark)
+{
+	frameArena_t	*arena;
+	frameOverflow_t	*block;
+
+	arena = &com_frameArenas[Sys_ThreadIndex ()];
+
+	while (arena->overflow != mark.overflow)
+	{
+		block = arena->overflow;
+		arena->overflow = block->next;
+		arena->overflowBytes -= block->size;
+		free (block);
+	}
+
+	arena->used = mark.used;
+}
+
+/*
+=================
+Frame_Clear
+
+Called at the start of every frame, while no jobs are running
+=================
+*/
+void Frame_Clear (void)
+{
+	frameArena_t	*arena;
+	frameOverflow_t	*block;
+	int				i, total;
+
+	total = 0;
+	for (i = 0, arena = com_frameArenas; i <= MAX_JOB_THREADS; i++, arena++)
+	{
+		while (arena->overflow)
+		{
+			block = arena->overflow;
+			arena->overflow = block->next;
+			free (block);
+		}
+		arena->overflowBytes = 0;
+		arena->used = 0;
+
+		total += arena->peak;
+		arena->peak = 0;
+	}
+
+	com_frameLastPeak = total;
+	if (total > com_frameHighPeak)
+	{
+		com_frameHighPeak = total;
+	}
+}
+
+/*
+=================
+Frame_Meminfo
+=================
+*/
+static void Frame_Meminfo (void)
+{
+	int		i, threads;
+
+	threads = 0;
+	for (i = 0; i <= MAX_JOB_THREADS; i++)
+	{
+		if (com_frameArenas[i].base)
+		{
+			threads++;
+		}
+	}
+
+	Com_Printf ("%8i bytes frame arena in %i threads\n", s_frameArenaSize, threads);
+	Com_Printf ("        %8i last frame peak\n", com_frameLastPeak);
+	Com_Printf ("        %8i highest frame peak\n", com_frameHighPeak);
+	Com_Printf ("        %8i overflows to malloc\n", com_frameOverflows);
+
+	com_frameOverflows = 0;
+}
+
+/*
+===================================================================
+
 EVENTS AND JOURNALING
 
 In addition to these events, .cfg files are also copied to the
@@ -2548,6 +3680,182 @@ static void Com_WriteCDKey (const char *filename, const char *ikey)
 #endif
 
 
+/*
+==============================================================================
+
+MAP LOAD TIMES
+
+The server, collision, bot and renderer loaders mark the stages of a map load
+so map_loadtime can show where the time went.  Stages nest, and the many small
+registrations of models, sounds and shaders are added up into one stage each.
+
+==============================================================================
+*/
+
+#define	MAX_LOAD_STAGES		64
+#define	MAX_LOAD_DEPTH		8
+
+typedef struct
+{
+	char	name[32];
+	int		depth;
+	int		usec;
+	int		calls;
+} loadStage_t;
+
+static loadStage_t	com_loadStages[MAX_LOAD_STAGES];
+static int			com_numLoadStages;
+static int			com_loadStack[MAX_LOAD_DEPTH];		// open stages
+static int			com_loadStart[MAX_LOAD_DEPTH];
+static int			com_loadDepth;
+
+/*
+=================
+Com_ClearLoadStages
+=================
+*/
+void Com_ClearLoadStages (void)
+{
+	com_numLoadStages = 0;
+	com_loadDepth = 0;
+}
+
+/*
+=================
+Com_FindLoadStage
+
+Finds or adds a stage at the current depth
+=================
+*/
+static int Com_FindLoadStage (const char *name)
+{
+	loadStage_t	*stage;
+	int			i;
+
+	// only look among the siblings, the same name can come up under different parents
+	for (i = com_numLoadStages - 1; i >= 0; i--)
+	{
+		stage = &com_loadStages[i];
+		if (stage->depth < com_loadDepth)
+		{
+			break;
+		}
+		if (stage->depth == com_loadDepth && !Q_stricmp (stage->name, name))
+		{
+			return i;
+		}
+	}
+
+	if (com_numLoadStages == MAX_LOAD_STAGES)
+	{
+		return -1;
+	}
+
+	stage = &com_loadStages[com_numLoadStages];
+	Q_strncpyz (stage->name, name, sizeof (stage->name));
+	stage->depth = com_loadDepth;
+	stage->usec = 0;
+	stage->calls = 0;
+
+	return com_numLoadStages++;
+}
+
+/*
+=================
+Com_BeginLoadStage
+=================
+*/
+void Com_BeginLoadStage (const char *name)
+{
+	if (com_loadDepth == MAX_LOAD_DEPTH)
+	{
+		com_loadDepth++;	// too deep to keep, but keep the nesting balanced
+		return;
+	}
+
+	com_loadStack[com_loadDepth] = Com_FindLoadStage (name);
+	com_loadStart[com_loadDepth] = Sys_Microseconds ();
+	com_loadDepth++;
+}
+
+/*
+=================
+Com_EndLoadStage
+=================
+*/
+void Com_EndLoadStage (void)
+{
+	loadStage_t	*stage;
+
+	if (!com_loadDepth)
+	{
+		return;
+	}
+
+	com_loadDepth--;
+	if (com_loadDepth >= MAX_LOAD_DEPTH || com_loadStack[com_loadDepth] < 0)
+	{
+		return;
+	}
+
+	stage = &com_loadStages[com_loadStack[com_loadDepth]];
+	stage->usec += Sys_Microseconds () - com_loadStart[com_loadDepth];
+	stage->calls++;
+}
+
+/*
+=================
+Com_AddLoadTime
+
+Adds to a stage under the one currently open, for calls too small to bracket
+=================
+*/
+void Com_AddLoadTime (const char *name, int usec)
+{
+	int		i;
+
+	// registrations outside of a load don't count
+	if (!com_loadDepth || com_loadDepth >= MAX_LOAD_DEPTH)
+	{
+		return;
+	}
+
+	i = Com_FindLoadStage (name);
+	if (i < 0)
+	{
+		return;
+	}
+
+	com_loadStages[i].usec += usec;
+	com_loadStages[i].calls++;
+}
+
+/*
+=================
+Com_MapLoadTime_f
+=================
+*/
+static void Com_MapLoadTime_f (void)
+{
+	loadStage_t	*stage;
+	int			i;
+
+	if (!com_numLoadStages)
+	{
+		Com_Printf ("No map has been loaded.\n");
+		return;
+	}
+
+	Com_Printf ("    msec  calls  stage\n");
+	for (i = 0, stage = com_loadStages; i < com_numLoadStages; i++, stage++)
+	{
+		Com_Printf ("%8.1f %6i  %*s%s\n", stage->usec / 1000.0f, stage->calls, stage->depth * 2, "", stage->name);
+	}
+
+	Com_Printf ("%i job threads\n", Sys_ThreadCount ());
+}
+
+
 /*
 =================
 Com_Init
@@ -2616,6 +3924,7 @@ void Com_Init (char *commandLine)
 #endif
 	// allocate the stack based hunk allocator
 	Com_InitHunkMemory ();
+	Com_InitFrameMemory ();
 
 	// if any archived cvars are modified after this, we will trigger a writing
 	// of the config file
@@ -2665,6 +3974,8 @@ void Com_Init (char *commandLine)
 	}
 	Cmd_AddCommand ("quit", Com_Quit_f);
 	Cmd_AddCommand ("changeVectors", MSG_ReportChangeVectors_f);
+	Cmd_AddCommand ("huffbench", MSG_HuffmanBench_f);
+	Cmd_AddCommand ("map_loadtime", Com_MapLoadTime_f);
 	Cmd_AddCommand ("writeconfig", Com_WriteConfig_f);
 
 	s = va ("%s %s %s", Q3_VERSION, CPUSTRING, __DATE__);
@@ -2889,6 +4200,9 @@ void Com_Frame (void)
 		return;			// an ERR_DROP was thrown
 	}
 
+	// nothing allocated last frame survives into this one
+	Frame_Clear ();
+
 	// bk001204 - init to zero.
 	//  also:  might be clobbered by `longjmp' or `vfork'
 	timeBeforeFirstEvents = 0;
@@ -3020,15 +4334,13 @@ void Com_Frame (void)
 	// trace optimization tracking
 	if (com_showtrace->integer)
 	{
-		extern	int c_traces, c_brush_traces, c_patch_traces;
-		extern	int	c_pointcontents;
+		int		c_traces, c_brush_traces, c_patch_traces;
+		int		c_pointcontents;
+
+		CM_TraceCounts (&c_traces, &c_brush_traces, &c_patch_traces, &c_pointcontents, qtrue);
 
 		Com_Printf ("%4i traces  (%ib %ip) %4i points\n", c_traces,
 			c_brush_traces, c_patch_traces, c_pointcontents);
-		c_traces = 0;
-		c_brush_traces = 0;
-		c_patch_traces = 0;
-		c_pointcontents = 0;
 	}
 
 	// old net chan encryption key
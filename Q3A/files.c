@@ -212,10 +212,18 @@ game directory passing and restarting
 #define	MAX_SEARCH_PATHS	4096
 #define MAX_FILEHASH_SIZE	1024
 
+#define ZIP_LOCALHEADER_SIZE	30
+#define ZIP_LOCALHEADER_MAGIC	0x04034b50
+#define ZIP_DEFLATED			8
+
 typedef struct fileInPack_s
 {
 	char					*name;		// name of the file
 	unsigned long			pos;		// file info position in zip
+	unsigned long			offset;		// local header position in the pak file
+	int						method;		// 0 stored, ZIP_DEFLATED
+	int						compressedSize;
+	int						size;
 	struct	fileInPack_s*	next;		// next file in the hash
 } fileInPack_t;
 
@@ -232,6 +240,8 @@ typedef struct
 	int				hashSize;					// hash table size (power of 2)
 	fileInPack_t*	*hashTable;					// hash table
 	fileInPack_t*	buildBuffer;				// buffer with the filenames etc.
+	void			*mapping;					// read only file mapping, NULL without fs_mappedReads
+	int				mappedSize;
 } pack_t;
 
 typedef struct
@@ -257,12 +267,28 @@ static	cvar_t		*fs_cdpath;
 static	cvar_t		*fs_copyfiles;
 static	cvar_t		*fs_gamedirvar;
 static	cvar_t		*fs_restrict;
+static	cvar_t		*fs_mappedReads;
 static	searchpath_t	*fs_searchpaths;
 static	int			fs_readCount;			// total bytes read
 static	int			fs_loadCount;			// total files read
 static	int			fs_loadStack;			// total files in memory
 static	int			fs_packFiles;			// total number of files in packs
 
+// every pak entry of the search path hashed by its full name, so a lookup is a
+// single probe instead of one per pk3.  Entries for the same name are chained
+// in search path order, which FS_ReorderPurePaks has already settled
+typedef struct pakIndexEntry_s
+{
+	pack_t					*pack;
+	fileInPack_t			*file;
+	struct pakIndexEntry_s	*nextName;	// next name in the hash chain
+	struct pakIndexEntry_s	*nextPak;	// same name in a later pak
+} pakIndexEntry_t;
+
+static	pakIndexEntry_t	**fs_pakIndex;
+static	pakIndexEntry_t	*fs_pakIndexEntries;
+static	int			fs_pakIndexSize;		// power of 2
+
 static int fs_fakeChkSum;
 static int fs_checksumFeed;
 
@@ -287,6 +313,9 @@ typedef struct
 	int			zipFilePos;
 	qboolean	zipFile;
 	qboolean	streamed;
+	qboolean	mapped;			// pak entry not opened yet, FS_ReadFile reads it from the mapping
+	pack_t		*pak;
+	fileInPack_t	*pakFile;
 	char		name[MAX_ZPATH];
 } fileHandleData_t;
 
@@ -396,6 +425,160 @@ static long FS_HashFileName (const char *fname, int hashSize)
 	return hash;
 }
 
+/*
+================
+FS_HashPakPath
+
+Like FS_HashFileName, but the extension is part of the
+hash so model, skin and shader files of the same name
+don't share a chain
+================
+*/
+static unsigned FS_HashPakPath (const char *fname, int hashSize)
+{
+	unsigned	hash;
+	char		letter;
+
+	hash = 2166136261u;
+	while (*fname)
+	{
+		letter = tolower (*fname++);
+		if (letter == '\\' || letter == PATH_SEP) letter = '/';
+		hash = (hash ^ (byte) letter) * 16777619u;
+	}
+	return (hash ^ (hash >> 16)) & (hashSize - 1);
+}
+
+/*
+================
+FS_BuildPakIndex
+
+Called once the search path is complete and in its final order
+================
+*/
+static void FS_BuildPakIndex (void)
+{
+	searchpath_t	*search;
+	pakIndexEntry_t	*entry, *found;
+	fileInPack_t	*pakFile;
+	unsigned		hash;
+	int				total, used, i;
+
+	total = 0;
+	for (search = fs_searchpaths; search; search = search->next)
+	{
+		if (search->pack)
+		{
+			total += search->pack->numfiles;
+		}
+	}
+
+	fs_pakIndexSize = 1024;
+	while (fs_pakIndexSize < total)
+	{
+		fs_pakIndexSize <<= 1;
+	}
+
+	fs_pakIndex = Z_Malloc (fs_pakIndexSize * sizeof (*fs_pakIndex));
+	fs_pakIndexEntries = Z_Malloc ((total ? total : 1) * sizeof (*fs_pakIndexEntries));
+
+	used = 0;
+	for (search = fs_searchpaths; search; search = search->next)
+	{
+		if (!search->pack)
+		{
+			continue;
+		}
+		for (i = 0; i < search->pack->numfiles; i++)
+		{
+			pakFile = &search->pack->buildBuffer[i];
+			hash = FS_HashPakPath (pakFile->name, fs_pakIndexSize);
+			for (found = fs_pakIndex[hash]; found; found = found->nextName)
+			{
+				if (!FS_FilenameCompare (found->file->name, pakFile->name))
+				{
+					break;
+				}
+			}
+
+			if (found)
+			{
+				// paks are added one at a time, so an entry of this pak can
+				// only be the tail.  A zip that lists a name twice resolved to
+				// the last one through its own hash table, keep doing that
+				while (found->nextPak)
+				{
+					found = found->nextPak;
+				}
+				if (found->pack == search->pack)
+				{
+					found->file = pakFile;
+					continue;
+				}
+			}
+
+			entry = &fs_pakIndexEntries[used++];
+			entry->pack = search->pack;
+			entry->file = pakFile;
+			entry->nextName = NULL;
+			entry->nextPak = NULL;
+
+			if (found)
+			{
+				found->nextPak = entry;
+			}
+			else
+			{
+				entry->nextName = fs_pakIndex[hash];
+				fs_pakIndex[hash] = entry;
+			}
+		}
+	}
+}
+
+/*
+================
+FS_FreePakIndex
+================
+*/
+static void FS_FreePakIndex (void)
+{
+	if (fs_pakIndex)
+	{
+		Z_Free (fs_pakIndex);
+		Z_Free (fs_pakIndexEntries);
+	}
+	fs_pakIndex = NULL;
+	fs_pakIndexEntries = NULL;
+	fs_pakIndexSize = 0;
+}
+
+/*
+================
+FS_FindInPakIndex
+
+Returns the first pak entry for filename in search path order, later
+paks holding the same name follow through nextPak
+================
+*/
+static pakIndexEntry_t *FS_FindInPakIndex (const char *filename)
+{
+	pakIndexEntry_t	*entry;
+
+	if (!fs_pakIndex)
+	{
+		return NULL;
+	}
+	for (entry = fs_pakIndex[FS_HashPakPath (filename, fs_pakIndexSize)]; entry; entry = entry->nextName)
+	{
+		if (!FS_FilenameCompare (entry->file->name, filename))
+		{
+			return entry;
+		}
+	}
+	return NULL;
+}
+
 static fileHandle_t	FS_HandleForFile (void)
 {
 	int		i;
@@ -884,6 +1067,12 @@ void FS_FCloseFile (fileHandle_t f)
 	{
 		Sys_EndStreamedFile (f);
 	}
+	if (fsh[f].mapped)
+	{
+		// never opened in the zip
+		Com_Memset (&fsh[f], 0, sizeof (fsh[f]));
+		return;
+	}
 	if (fsh[f].zipFile == qtrue)
 	{
 		unzCloseCurrentFile (fsh[f].handleFiles.file.z);
@@ -1061,6 +1250,48 @@ char *FS_ShiftedStrStr (const char *string, const char *substring, int shift)
 	return strstr (string, buf);
 }
 
+/*
+===========
+FS_OpenFileInPak
+
+Positions a handle on a pak entry for FS_Read
+===========
+*/
+static int FS_OpenFileInPak (fileHandle_t f, pack_t *pak, fileInPack_t *pakFile, qboolean uniqueFILE)
+{
+	unz_s	*zfi;
+	FILE	*temp;
+
+	if (uniqueFILE)
+	{
+		// open a new file on the pakfile
+		fsh[f].handleFiles.file.z = unzReOpen (pak->pakFilename, pak->handle);
+		if (fsh[f].handleFiles.file.z == NULL)
+		{
+			Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->pakFilename);
+		}
+	}
+	else
+	{
+		fsh[f].handleFiles.file.z = pak->handle;
+	}
+	zfi = (unz_s *) fsh[f].handleFiles.file.z;
+	// in case the file was new
+	temp = zfi->file;
+	// set the file position in the zip file (also sets the current file info)
+	unzSetCurrentFileInfoPosition (pak->handle, pakFile->pos);
+	// copy the file info into the unzip structure
+	Com_Memcpy (zfi, pak->handle, sizeof (unz_s));
+	// we copy this back into the structure
+	zfi->file = temp;
+	// open the file in the zip
+	unzOpenCurrentFile (fsh[f].handleFiles.file.z);
+	fsh[f].zipFilePos = pakFile->pos;
+	fsh[f].mapped = qfalse;
+
+	return zfi->cur_file_info.uncompressed_size;
+}
+
 /*
 ===========
 FS_FOpenFileRead
@@ -1069,25 +1300,25 @@ Finds the file in the search path.
 Returns filesize and an open FILE pointer.
 Used for streaming data out of either a
 separate file or a ZIP file.
+
+With mapped set, pak entries are only located and
+FS_ReadFile reads them through the pak mapping.
 ===========
 */
 extern qboolean		com_fullyInitialized;
 
-int FS_FOpenFileRead (const char *filename, fileHandle_t *file, qboolean uniqueFILE)
+static int FS_OpenFileRead (const char *filename, fileHandle_t *file, qboolean uniqueFILE, qboolean mapped)
 {
 	searchpath_t	*search;
 	char			*netpath;
 	pack_t			*pak;
 	fileInPack_t	*pakFile;
+	pakIndexEntry_t	*entry;
 	directory_t		*dir;
-	long			hash;
-	unz_s			*zfi;
 	FILE			*temp;
 	int				l;
 	char demoExt[16];
 
-	hash = 0;
-
 	if (!fs_searchpaths)
 	{
 		Com_Error (ERR_FATAL, "Filesystem call made without initialization\n");
@@ -1095,31 +1326,14 @@ int FS_FOpenFileRead (const char *filename, fileHandle_t *file, qboolean uniqueF
 
 	if (file == NULL)
 	{
-		// just wants to see if file is there
+		// just wants to see if file is there, any pak will do
+		if (FS_FindInPakIndex (filename))
+		{
+			return qtrue;
+		}
 		for (search = fs_searchpaths; search; search = search->next)
 		{
-			if (search->pack)
-			{
-				hash = FS_HashFileName (filename, search->pack->hashSize);
-			}
-			// is the element a pak file?
-			if (search->pack && search->pack->hashTable[hash])
-			{
-				// look through all the pak file elements
-				pak = search->pack;
-				pakFile = pak->hashTable[hash];
-				do
-				{
-					// case and separator insensitive comparisons
-					if (!FS_FilenameCompare (pakFile->name, filename))
-					{
-						// found it!
-						return qtrue;
-					}
-					pakFile = pakFile->next;
-				} while (pakFile != NULL);
-			}
-			else if (search->dir)
+			if (search->dir)
 			{
 				dir = search->dir;
 
@@ -1169,107 +1383,89 @@ int FS_FOpenFileRead (const char *filename, fileHandle_t *file, qboolean uniqueF
 	*file = FS_HandleForFile ();
 	fsh[*file].handleFiles.unique = uniqueFILE;
 
+	// the paks holding the name, in the same order as the search path
+	entry = FS_FindInPakIndex (filename);
+
 	for (search = fs_searchpaths; search; search = search->next)
 	{
-		if (search->pack)
-		{
-			hash = FS_HashFileName (filename, search->pack->hashSize);
-		}
 		// is the element a pak file?
-		if (search->pack && search->pack->hashTable[hash])
+		if (search->pack)
 		{
+			if (!entry || entry->pack != search->pack)
+			{
+				continue;
+			}
+			pak = search->pack;
+			pakFile = entry->file;
+			entry = entry->nextPak;
+
 			// disregard if it doesn't match one of the allowed pure pak files
-			if (!FS_PakIsPure (search->pack))
+			if (!FS_PakIsPure (pak))
 			{
 				continue;
 			}
 
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do
+			// found it!
+
+			// mark the pak as having been referenced and mark specifics on cgame and ui
+			// shaders, txt, arena files  by themselves do not count as a reference as 
+			// these are loaded from all pk3s 
+			// from every pk3 file.. 
+			l = strlen (filename);
+			if (!(pak->referenced & FS_GENERAL_REF))
 			{
-				// case and separator insensitive comparisons
-				if (!FS_FilenameCompare (pakFile->name, filename))
+				if (Q_stricmp (filename + l - 7, ".shader") != 0 &&
+					Q_stricmp (filename + l - 4, ".txt") != 0 &&
+					Q_stricmp (filename + l - 4, ".cfg") != 0 &&
+					Q_stricmp (filename + l - 7, ".config") != 0 &&
+					strstr (filename, "levelshots") == NULL &&
+					Q_stricmp (filename + l - 4, ".bot") != 0 &&
+					Q_stricmp (filename + l - 6, ".arena") != 0 &&
+					Q_stricmp (filename + l - 5, ".menu") != 0)
 				{
-					// found it!
-
-					// mark the pak as having been referenced and mark specifics on cgame and ui
-					// shaders, txt, arena files  by themselves do not count as a reference as 
-					// these are loaded from all pk3s 
-					// from every pk3 file.. 
-					l = strlen (filename);
-					if (!(pak->referenced & FS_GENERAL_REF))
-					{
-						if (Q_stricmp (filename + l - 7, ".shader") != 0 &&
-							Q_stricmp (filename + l - 4, ".txt") != 0 &&
-							Q_stricmp (filename + l - 4, ".cfg") != 0 &&
-							Q_stricmp (filename + l - 7, ".config") != 0 &&
-							strstr (filename, "levelshots") == NULL &&
-							Q_stricmp (filename + l - 4, ".bot") != 0 &&
-							Q_stricmp (filename + l - 6, ".arena") != 0 &&
-							Q_stricmp (filename + l - 5, ".menu") != 0)
-						{
-							pak->referenced |= FS_GENERAL_REF;
-						}
-					}
+					pak->referenced |= FS_GENERAL_REF;
+				}
+			}
 
-					// qagame.qvm	- 13
-					// dTZT`X!di`
-					if (!(pak->referenced & FS_QAGAME_REF) && FS_ShiftedStrStr (filename, "dTZT`X!di`", 13))
-					{
-						pak->referenced |= FS_QAGAME_REF;
-					}
-					// cgame.qvm	- 7
-					// \`Zf^'jof
-					if (!(pak->referenced & FS_CGAME_REF) && FS_ShiftedStrStr (filename, "\\`Zf^'jof", 7))
-					{
-						pak->referenced |= FS_CGAME_REF;
-					}
-					// ui.qvm		- 5
-					// pd)lqh
-					if (!(pak->referenced & FS_UI_REF) && FS_ShiftedStrStr (filename, "pd)lqh", 5))
-					{
-						pak->referenced |= FS_UI_REF;
-					}
+			// qagame.qvm	- 13
+			// dTZT`X!di`
+			if (!(pak->referenced & FS_QAGAME_REF) && FS_ShiftedStrStr (filename, "dTZT`X!di`", 13))
+			{
+				pak->referenced |= FS_QAGAME_REF;
+			}
+			// cgame.qvm	- 7
+			// \`Zf^'jof
+			if (!(pak->referenced & FS_CGAME_REF) && FS_ShiftedStrStr (filename, "\\`Zf^'jof", 7))
+			{
+				pak->referenced |= FS_CGAME_REF;
+			}
+			// ui.qvm		- 5
+			// pd)lqh
+			if (!(pak->referenced & FS_UI_REF) && FS_ShiftedStrStr (filename, "pd)lqh", 5))
+			{
+				pak->referenced |= FS_UI_REF;
+			}
 
-					if (uniqueFILE)
-					{
-						// open a new file on the pakfile
-						fsh[*file].handleFiles.file.z = unzReOpen (pak->pakFilename, pak->handle);
-						if (fsh[*file].handleFiles.file.z == NULL)
-						{
-							Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->pakFilename);
-						}
-					}
-					else
-					{
-						fsh[*file].handleFiles.file.z = pak->handle;
-					}
-					Q_strncpyz (fsh[*file].name, filename, sizeof (fsh[*file].name));
-					fsh[*file].zipFile = qtrue;
-					zfi = (unz_s *) fsh[*file].handleFiles.file.z;
-					// in case the file was new
-					temp = zfi->file;
-					// set the file position in the zip file (also sets the current file info)
-					unzSetCurrentFileInfoPosition (pak->handle, pakFile->pos);
-					// copy the file info into the unzip structure
-					Com_Memcpy (zfi, pak->handle, sizeof (unz_s));
-					// we copy this back into the structure
-					zfi->file = temp;
-					// open the file in the zip
-					unzOpenCurrentFile (fsh[*file].handleFiles.file.z);
-					fsh[*file].zipFilePos = pakFile->pos;
-
-					if (fs_debug->integer)
-					{
-						Com_Printf ("FS_FOpenFileRead: %s (found in '%s')\n",
-							filename, pak->pakFilename);
-					}
-					return zfi->cur_file_info.uncompressed_size;
-				}
-				pakFile = pakFile->next;
-			} while (pakFile != NULL);
+			Q_strncpyz (fsh[*file].name, filename, sizeof (fsh[*file].name));
+			fsh[*file].zipFile = qtrue;
+			fsh[*file].pak = pak;
+			fsh[*file].pakFile = pakFile;
+
+			if (fs_debug->integer)
+			{
+				Com_Printf ("FS_FOpenFileRead: %s (found in '%s')\n",
+					filename, pak->pakFilename);
+			}
+
+			if (mapped && pak->mapping && !uniqueFILE)
+			{
+				// FS_ReadFile takes the whole entry from the mapping, the
+				// shared pak handle only marks the slot as used
+				fsh[*file].handleFiles.file.z = pak->handle;
+				fsh[*file].mapped = qtrue;
+				return pakFile->size;
+			}
+			return FS_OpenFileInPak (*file, pak, pakFile, uniqueFILE);
 		}
 		else if (search->dir)
 		{
@@ -1348,6 +1544,11 @@ int FS_FOpenFileRead (const char *filename, fileHandle_t *file, qboolean uniqueF
 	return -1;
 }
 
+int FS_FOpenFileRead (const char *filename, fileHandle_t *file, qboolean uniqueFILE)
+{
+	return FS_OpenFileRead (filename, file, uniqueFILE, qfalse);
+}
+
 
 /*
 =================
@@ -1595,10 +1796,7 @@ CONVENIENCE FUNCTIONS FOR ENTIRE FILES
 
 int	FS_FileIsInPAK (const char *filename, int *pChecksum)
 {
-	searchpath_t	*search;
-	pack_t			*pak;
-	fileInPack_t	*pakFile;
-	long			hash = 0;
+	pakIndexEntry_t	*entry;
 
 	if (!fs_searchpaths)
 	{
@@ -1624,41 +1822,94 @@ int	FS_FileIsInPAK (const char *filename, int *pChecksum)
 		return -1;
 	}
 
-	// search through the path, one element at a time
-	for (search = fs_searchpaths; search; search = search->next)
+	// the index already lists the paks in search path order
+	for (entry = FS_FindInPakIndex (filename); entry; entry = entry->nextPak)
 	{
-		if (search->pack)
+		// disregard if it doesn't match one of the allowed pure pak files
+		if (!FS_PakIsPure (entry->pack))
 		{
-			hash = FS_HashFileName (filename, search->pack->hashSize);
+			continue;
 		}
-		// is the element a pak file?
-		if (search->pack && search->pack->hashTable[hash])
+		if (pChecksum)
 		{
-			// disregard if it doesn't match one of the allowed pure pak files
-			if (!FS_PakIsPure (search->pack))
+			*pChecksum = entry->pack->pure_checksum;
+		}
+		return 1;
+	}
+	return -1;
+}
+
+/*
+============
+FS_ReadMapped
+
+Reads a whole pak entry through a view of the pak file, without the
+unzip stream setup, the stdio seeks and the read buffer copies.
+Stored entries are copied once, deflated ones are inflated straight
+from the view.  Anything the view can't serve goes through unzip
+============
+*/
+static void FS_ReadMapped (fileHandle_t f, byte *buffer, int len)
+{
+	fileHandleData_t	*fh;
+	fileInPack_t		*pakFile;
+	byte				*header;
+	byte				*data;
+	void				*view;
+	int					viewLength;
+	int					dataOffset;
+	int					read;
+
+	fh = &fsh[f];
+	pakFile = fh->pakFile;
+
+	// the local name and extra field can each be up to 64k long, and
+	// inflate wants one byte past the compressed data
+	viewLength = ZIP_LOCALHEADER_SIZE + 0x1fffe + pakFile->compressedSize + 1;
+	if (viewLength > fh->pak->mappedSize - (int) pakFile->offset)
+	{
+		viewLength = fh->pak->mappedSize - pakFile->offset;
+	}
+
+	read = -1;
+	view = NULL;
+	header = NULL;
+	if (viewLength >= ZIP_LOCALHEADER_SIZE)
+	{
+		header = Sys_MapFileView (fh->pak->mapping, pakFile->offset, viewLength, &view);
+	}
+	if (header &&
+		(header[0] | (header[1] << 8) | (header[2] << 16) | (header[3] << 24)) == ZIP_LOCALHEADER_MAGIC)
+	{
+		dataOffset = ZIP_LOCALHEADER_SIZE + (header[26] | (header[27] << 8)) + (header[28] | (header[29] << 8));
+		data = header + dataOffset;
+		if (dataOffset + pakFile->compressedSize <= viewLength)
+		{
+			if (pakFile->method == 0 && pakFile->compressedSize == len)
 			{
-				continue;
+				Com_Memcpy (buffer, data, len);
+				read = len;
 			}
-
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do
+			else if (pakFile->method == ZIP_DEFLATED)
 			{
-				// case and separator insensitive comparisons
-				if (!FS_FilenameCompare (pakFile->name, filename))
-				{
-					if (pChecksum)
-					{
-						*pChecksum = pak->pure_checksum;
-					}
-					return 1;
-				}
-				pakFile = pakFile->next;
-			} while (pakFile != NULL);
+				read = unzInflateBuffer (data, viewLength - dataOffset, buffer, len);
+			}
 		}
 	}
-	return -1;
+	if (view)
+	{
+		Sys_UnmapFileView (view);
+	}
+
+	if (read == len)
+	{
+		fs_readCount += len;
+		return;
+	}
+
+	Com_DPrintf ("FS_ReadMapped: %s not readable from the mapping of %s\n", fh->name, fh->pak->pakFilename);
+	FS_OpenFileInPak (f, fh->pak, pakFile, qfalse);
+	FS_Read (buffer, len, f);
 }
 
 /*
@@ -1743,7 +1994,7 @@ int FS_ReadFile (const char *qpath, void **buffer)
 	}
 
 	// look for it in the filesystem or pack files
-	len = FS_FOpenFileRead (qpath, &h, qfalse);
+	len = FS_OpenFileRead (qpath, &h, qfalse, qtrue);
 	if (h == 0)
 	{
 		if (buffer)
@@ -1779,7 +2030,14 @@ int FS_ReadFile (const char *qpath, void **buffer)
 	buf = Hunk_AllocateTempMemory (len + 1);
 	*buffer = buf;
 
-	FS_Read (buf, len, h);
+	if (fsh[h].mapped)
+	{
+		FS_ReadMapped (h, buf, len);
+	}
+	else
+	{
+		FS_Read (buf, len, h);
+	}
 
 	// guarantee that it will have a trailing 0 for string operations
 	buf[len] = 0;
@@ -1964,6 +2222,11 @@ static pack_t *FS_LoadZipFile (char *zipfile, const char *basename)
 		namePtr += strlen (filename_inzip) + 1;
 		// store the file position in the zip
 		unzGetCurrentFileInfoPosition (uf, &buildBuffer[i].pos);
+		// and what FS_ReadMapped needs to find the data without unzip
+		buildBuffer[i].offset = ((unz_s *) uf)->cur_file_info_internal.offset_curfile + ((unz_s *) uf)->byte_before_the_zipfile;
+		buildBuffer[i].method = file_info.compression_method;
+		buildBuffer[i].compressedSize = file_info.compressed_size;
+		buildBuffer[i].size = file_info.uncompressed_size;
 
 		buildBuffer[i].next = pack->hashTable[hash];
 		pack->hashTable[hash] = &buildBuffer[i];
@@ -1978,6 +2241,11 @@ static pack_t *FS_LoadZipFile (char *zipfile, const char *basename)
 	Z_Free (fs_headerLongs);
 
 	pack->buildBuffer = buildBuffer;
+
+	if (fs_mappedReads->integer)
+	{
+		pack->mapping = Sys_OpenFileMapping (zipfile, &pack->mappedSize);
+	}
 	return pack;
 }
 
@@ -2016,28 +2284,38 @@ static int FS_ReturnPath (const char *zname, char *zpath, int *depth)
 	return len;
 }
 
+// list index + 1 of every name added to the list being built
+static short	fs_foundHash[MAX_FOUND_FILES * 2];
+
 /*
 ==================
 FS_AddFileToList
+
+Starting a new list at nfiles 0 resets the dupe hash
 ==================
 */
 static int FS_AddFileToList (char *name, char *list[MAX_FOUND_FILES], int nfiles)
 {
 	int		i;
 
+	if (!nfiles)
+	{
+		Com_Memset (fs_foundHash, 0, sizeof (fs_foundHash));
+	}
 	if (nfiles == MAX_FOUND_FILES - 1)
 	{
 		return nfiles;
 	}
-	for (i = 0; i < nfiles; i++)
+	for (i = FS_HashPakPath (name, MAX_FOUND_FILES * 2); fs_foundHash[i]; i = (i + 1) & (MAX_FOUND_FILES * 2 - 1))
 	{
-		if (!Q_stricmp (name, list[i]))
+		if (!Q_stricmp (name, list[fs_foundHash[i] - 1]))
 		{
 			return nfiles;		// allready in list
 		}
 	}
 	list[nfiles] = CopyString (name);
 	nfiles++;
+	fs_foundHash[i] = nfiles;
 
 	return nfiles;
 }
@@ -2124,9 +2402,15 @@ char **FS_ListFilteredFiles (const char *path, const char *extension, char *filt
 				else
 				{
 
+					// most names fail on the prefix, test it before copying the path out
+					if (Q_stricmpn (name, path, pathLength))
+					{
+						continue;
+					}
+
 					zpathLen = FS_ReturnPath (name, zpath, &depth);
 
-					if ((depth - pathDepth) > 2 || pathLength > zpathLen || Q_stricmpn (name, path, pathLength))
+					if ((depth - pathDepth) > 2 || pathLength > zpathLen)
 					{
 						continue;
 					}
@@ -2732,6 +3016,64 @@ void FS_TouchFile_f (void)
 	}
 }
 
+/*
+============
+FS_Bench_f
+
+Times listing a directory and reading every file in it, the two
+things a map load spends its file system time on
+============
+*/
+void FS_Bench_f (void)
+{
+	char	**list;
+	void	*buffer;
+	int		numFiles, passes;
+	int		i, pass, len, bytes;
+	int		start, listUsec, readUsec;
+
+	if (Cmd_Argc () < 3)
+	{
+		Com_Printf ("Usage: fs_bench <path> <extension> [passes]\n");
+		return;
+	}
+	passes = Cmd_Argc () > 3 ? atoi (Cmd_Argv (3)) : 1;
+	if (passes < 1)
+	{
+		passes = 1;
+	}
+
+	listUsec = 0;
+	readUsec = 0;
+	bytes = 0;
+	numFiles = 0;
+	for (pass = 0; pass < passes; pass++)
+	{
+		start = Sys_Microseconds ();
+		list = FS_ListFiles (Cmd_Argv (1), Cmd_Argv (2), &numFiles);
+		listUsec += Sys_Microseconds () - start;
+
+		start = Sys_Microseconds ();
+		for (i = 0; i < numFiles; i++)
+		{
+			len = FS_ReadFile (va ("%s/%s", Cmd_Argv (1), list[i]), &buffer);
+			if (buffer)
+			{
+				bytes += len;
+				FS_FreeFile (buffer);
+			}
+		}
+		readUsec += Sys_Microseconds () - start;
+
+		FS_FreeFileList (list);
+	}
+
+	Com_Printf ("%i files, %i passes, fs_mappedReads %i\n", numFiles, passes, fs_mappedReads->integer);
+	Com_Printf ("list: %.3f msec per pass\n", listUsec / (1000.0f * passes));
+	Com_Printf ("read: %.3f msec per pass, %.1f MB/sec\n", readUsec / (1000.0f * passes),
+		readUsec ? bytes / (float) readUsec : 0.0f);
+}
+
 //===========================================================================
 
 
@@ -2983,6 +3325,10 @@ void FS_Shutdown (qboolean closemfp)
 
 		if (p->pack)
 		{
+			if (p->pack->mapping)
+			{
+				Sys_CloseFileMapping (p->pack->mapping);
+			}
 			unzClose (p->pack->handle);
 			Z_Free (p->pack->buildBuffer);
 			Z_Free (p->pack);
@@ -2996,11 +3342,13 @@ void FS_Shutdown (qboolean closemfp)
 
 	// any FS_ calls will now be an error until reinitialized
 	fs_searchpaths = NULL;
+	FS_FreePakIndex ();
 
 	Cmd_RemoveCommand ("path");
 	Cmd_RemoveCommand ("dir");
 	Cmd_RemoveCommand ("fdir");
 	Cmd_RemoveCommand ("touchFile");
+	Cmd_RemoveCommand ("fs_bench");
 
 #ifdef FS_MISSING
 	if (closemfp) {
@@ -3080,6 +3428,7 @@ static void FS_Startup (const char *gameName)
 	fs_homepath = Cvar_Get ("fs_homepath", homePath, CVAR_INIT);
 	fs_gamedirvar = Cvar_Get ("fs_game", "", CVAR_INIT | CVAR_SYSTEMINFO);
 	fs_restrict = Cvar_Get ("fs_restrict", "", CVAR_INIT);
+	fs_mappedReads = Cvar_Get ("fs_mappedReads", "1", CVAR_LATCH | CVAR_ARCHIVE);
 
 	// add search path elements in reverse priority order
 	if (fs_cdpath->string[0])
@@ -3143,11 +3492,15 @@ static void FS_Startup (const char *gameName)
 	Cmd_AddCommand ("dir", FS_Dir_f);
 	Cmd_AddCommand ("fdir", FS_NewDir_f);
 	Cmd_AddCommand ("touchFile", FS_TouchFile_f);
+	Cmd_AddCommand ("fs_bench", FS_Bench_f);
 
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=506
 	// reorder the pure pk3 files according to server order
 	FS_ReorderPurePaks ();
 
+	// lookups follow the final search order
+	FS_BuildPakIndex ();
+
 	// print the current search paths
 	FS_Path_f ();
 
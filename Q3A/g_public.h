@@ -229,6 +229,10 @@ typedef enum
 	// 1.32
 	G_FS_SEEK,
 
+	G_TRACEBATCH,	// ( trace_t *results, const traceRequest_t *requests, int count, int capsule );
+	// one trap_Trace (or trap_TraceCapsule) per request, the world traces run in parallel
+	// count is clamped to MAX_TRACE_BATCH
+
 	BOTLIB_SETUP = 200,				// ( void );
 	BOTLIB_SHUTDOWN,				// ( void );
 	BOTLIB_LIBVAR_SET,
@@ -29,26 +29,28 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 static int			bloc = 0;
 
+// the offset based functions are used by the message code from several
+// threads at once, so unlike the whole-buffer functions below they keep
+// the bit position in locals instead of bloc
+
 void	Huff_putBit (int bit, byte *fout, int *offset)
 {
-	bloc = *offset;
-	if ((bloc & 7) == 0)
+	int		pos = *offset;
+
+	if ((pos & 7) == 0)
 	{
-		fout[(bloc >> 3)] = 0;
+		fout[(pos >> 3)] = 0;
 	}
-	fout[(bloc >> 3)] |= bit << (bloc & 7);
-	bloc++;
-	*offset = bloc;
+	fout[(pos >> 3)] |= bit << (pos & 7);
+	*offset = pos + 1;
 }
 
 int		Huff_getBit (byte *fin, int *offset)
 {
-	int t;
-	bloc = *offset;
-	t = (fin[(bloc >> 3)] >> (bloc & 7)) & 0x1;
-	bloc++;
-	*offset = bloc;
-	return t;
+	int		pos = *offset;
+
+	*offset = pos + 1;
+	return (fin[(pos >> 3)] >> (pos & 7)) & 0x1;
 }
 
 /* Add a bit to the output file (buffered) */
@@ -343,10 +345,11 @@ int Huff_Receive (node_t *node, int *ch, byte *fin)
 /* Get a symbol */
 void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset)
 {
-	bloc = *offset;
+	int		pos = *offset;
+
 	while (node && node->symbol == INTERNAL_NODE)
 	{
-		if (get_bit (fin))
+		if ((fin[(pos >> 3)] >> (pos & 7)) & 0x1)
 		{
 			node = node->right;
 		}
@@ -354,6 +357,7 @@ void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset)
 		{
 			node = node->left;
 		}
+		pos++;
 	}
 	if (!node)
 	{
@@ -362,7 +366,7 @@ void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset)
 		//		Com_Error(ERR_DROP, "Illegal tree!\n");
 	}
 	*ch = node->symbol;
-	*offset = bloc;
+	*offset = pos;
 }
 
 /* Send the prefix code for this node */
@@ -406,9 +410,65 @@ void Huff_transmit (huff_t *huff, int ch, byte *fout)
 
 void Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset)
 {
-	bloc = *offset;
-	send (huff->loc[ch], NULL, fout);
-	*offset = bloc;
+	node_t	*node;
+	int		path[HMAX + 1];
+	int		depth;
+
+	// collect the path from the leaf up, then write it out root first
+	depth = 0;
+	for (node = huff->loc[ch]; node->parent; node = node->parent)
+	{
+		path[depth++] = (node->parent->right == node);
+	}
+
+	while (depth--)
+	{
+		Huff_putBit (path[depth], fout, offset);
+	}
+}
+
+/* Flatten a tree that won't be updated any more into code and lookup tables */
+void Huff_BuildTable (huff_t *huff, huffTable_t *table)
+{
+	node_t		*node;
+	unsigned	code;
+	int			ch, length, i;
+
+	Com_Memset (table, 0, sizeof (*table));
+
+	for (ch = 0; ch <= HMAX; ch++)
+	{
+		if (!huff->loc[ch])
+		{
+			continue;
+		}
+
+		// walking up from the leaf finds the last bit first
+		code = 0;
+		length = 0;
+		for (node = huff->loc[ch]; node->parent; node = node->parent)
+		{
+			code = (code << 1) | (node->parent->right == node);
+			length++;
+		}
+
+		table->code[ch] = code;
+		table->length[ch] = length;
+
+		if (length > table->maxLength)
+		{
+			table->maxLength = length;
+		}
+
+		// every lookup index that starts with this code decodes to it
+		if (length <= HUFF_LOOKUP_BITS)
+		{
+			for (i = code; i < (1 << HUFF_LOOKUP_BITS); i += 1 << length)
+			{
+				table->lookup[i] = ch | (length << 9);
+			}
+		}
+	}
 }
 
 void Huff_Decompress (msg_t *mbuf, int offset)
@@ -22,7 +22,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "q_shared.h"
 #include "qcommon.h"
 
+#include <emmintrin.h>
+
 static huffman_t		msgHuff;
+static huffTable_t		msgHuffTable;		// flattened msgHuff, built once the tree is complete
 
 static qboolean			msgInit = qfalse;
 
@@ -110,14 +113,209 @@ bit functions
 =============================================================================
 */
 
+/*
+Both trees in msgHuff are fed the same references and never change once
+MSG_initHuffman is done, so every value goes through the flat tables in
+msgHuffTable.  The low (bits & 7) bits go out raw, followed by one code per
+byte, and the whole lot is gathered in one 64 bit accumulator: 7 raw bits and
+four codes of at most HUFF_LOOKUP_BITS bits always fit in the 57 bits a peek
+can provide.  The tree walks are kept as the reference implementation and as
+the fallback for a tree too deep for the lookup table.
+*/
+
+/*
+=================
+MSG_PutBits
+
+Writes the low count bits of bits at offset, touching the bytes exactly as
+Huff_putBit would: the first byte of a fresh byte boundary is overwritten,
+a partly used byte is or'ed into
+=================
+*/
+static void MSG_PutBits (byte *data, int *offset, unsigned long long bits, int count)
+{
+	int		pos = *offset;
+	int		shift = pos & 7;
+	byte	*out = data + (pos >> 3);
+
+	*offset = pos + count;
+
+	if (shift)
+	{
+		*out++ |= (byte) (bits << shift);
+		bits >>= 8 - shift;
+		count -= 8 - shift;
+	}
+
+	while (count > 0)
+	{
+		*out++ = (byte) bits;
+		bits >>= 8;
+		count -= 8;
+	}
+}
+
+/*
+=================
+MSG_PeekBits
+
+Returns at least 57 bits from offset on, padding with zeros past the end of
+the buffer instead of reading beyond it
+=================
+*/
+static unsigned long long MSG_PeekBits (const msg_t *msg, int offset)
+{
+	unsigned long long	bits;
+	const byte			*in;
+	int					i, avail;
+
+	in = msg->data + (offset >> 3);
+	avail = msg->maxsize - (offset >> 3);
+
+	if (avail > 8)
+	{
+		avail = 8;
+	}
+
+	bits = 0;
+	for (i = 0; i < avail; i++)
+	{
+		bits |= (unsigned long long) in[i] << (i << 3);
+	}
+
+	return bits >> (offset & 7);
+}
+
+/*
+=================
+MSG_WriteHuffBits
+=================
+*/
+static void MSG_WriteHuffBits (msg_t *msg, unsigned value, int bits)
+{
+	unsigned long long	acc;
+	int					count;
+	int					nbits;
+	int					i, b;
+
+	nbits = bits & 7;
+	acc = value & ((1 << nbits) - 1);
+	count = nbits;
+	value >>= nbits;
+
+	for (i = nbits; i < bits; i += 8)
+	{
+		b = value & 0xff;
+		acc |= (unsigned long long) msgHuffTable.code[b] << count;
+		count += msgHuffTable.length[b];
+		value >>= 8;
+	}
+
+	MSG_PutBits (msg->data, &msg->bit, acc, count);
+}
+
+/*
+=================
+MSG_ReadHuffBits
+=================
+*/
+static int MSG_ReadHuffBits (msg_t *msg, int bits)
+{
+	unsigned long long	acc;
+	int					value;
+	int					used;
+	int					nbits;
+	int					i, entry;
+
+	acc = MSG_PeekBits (msg, msg->bit);
+
+	nbits = bits & 7;
+	value = (int) acc & ((1 << nbits) - 1);
+	acc >>= nbits;
+	used = nbits;
+
+	for (i = nbits; i < bits; i += 8)
+	{
+		entry = msgHuffTable.lookup[acc & ((1 << HUFF_LOOKUP_BITS) - 1)];
+		value |= (entry & 511) << i;
+		acc >>= entry >> 9;
+		used += entry >> 9;
+	}
+
+	msg->bit += used;
+
+	return value;
+}
+
+/*
+=================
+MSG_WriteHuffBitsTree
+=================
+*/
+static void MSG_WriteHuffBitsTree (msg_t *msg, int value, int bits)
+{
+	int	i;
+
+	if (bits & 7)
+	{
+		int nbits;
+		nbits = bits & 7;
+		for (i = 0; i < nbits; i++)
+		{
+			Huff_putBit ((value & 1), msg->data, &msg->bit);
+			value = (value >> 1);
+		}
+		bits = bits - nbits;
+	}
+	if (bits)
+	{
+		for (i = 0; i < bits; i += 8)
+		{
+			Huff_offsetTransmit (&msgHuff.compressor, (value & 0xff), msg->data, &msg->bit);
+			value = (value >> 8);
+		}
+	}
+}
+
+/*
+=================
+MSG_ReadHuffBitsTree
+=================
+*/
+static int MSG_ReadHuffBitsTree (msg_t *msg, int bits)
+{
+	int	value;
+	int	get;
+	int	i, nbits;
+
+	value = 0;
+	nbits = 0;
+	if (bits & 7)
+	{
+		nbits = bits & 7;
+		for (i = 0; i < nbits; i++)
+		{
+			value |= (Huff_getBit (msg->data, &msg->bit) << i);
+		}
+		bits = bits - nbits;
+	}
+	if (bits)
+	{
+		for (i = 0; i < bits; i += 8)
+		{
+			Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
+			value |= (get << (i + nbits));
+		}
+	}
+
+	return value;
+}
+
 int	overflows;
 
 // negative bit values include signs
 void MSG_WriteBits (msg_t *msg, int value, int bits)
 {
-	int	i;
-	//	FILE*	fp;
-
 	oldsize += bits;
 
 	// this isn't an exact overflow check, but close enough
@@ -187,40 +385,80 @@ void MSG_WriteBits (msg_t *msg, int value, int bits)
 	}
 	else
 	{
-		//		fp = fopen("c:\\netchan.bin", "a");
 		value &= (0xffffffff >> (32 - bits));
-		if (bits & 7)
+		if (msgHuffTable.maxLength <= HUFF_LOOKUP_BITS)
 		{
-			int nbits;
-			nbits = bits & 7;
-			for (i = 0; i < nbits; i++)
-			{
-				Huff_putBit ((value & 1), msg->data, &msg->bit);
-				value = (value >> 1);
-			}
-			bits = bits - nbits;
+			MSG_WriteHuffBits (msg, value, bits);
 		}
-		if (bits)
+		else
 		{
-			for (i = 0; i < bits; i += 8)
-			{
-				//				fwrite(bp, 1, 1, fp);
-				Huff_offsetTransmit (&msgHuff.compressor, (value & 0xff), msg->data, &msg->bit);
-				value = (value >> 8);
-			}
+			MSG_WriteHuffBitsTree (msg, value, bits);
 		}
 		msg->cursize = (msg->bit >> 3) + 1;
-		//		fclose(fp);
 	}
 }
 
+/*
+=================
+MSG_WriteBitString
+
+Appends bits recorded from another message.  The message tree doesn't
+adapt, so a run of codes reads the same wherever it starts and copying it is
+the same as repeating the writes that produced it.  Returns qfalse without
+writing anything if the message could overflow part way through, where the
+writes themselves would have stopped.
+=================
+*/
+qboolean MSG_WriteBitString (msg_t *msg, const byte *data, int numBits)
+{
+	unsigned long long	bits;
+	int					i, j, count;
+
+	if (msg->oob)
+	{
+		return qfalse;
+	}
+
+	if (!numBits)
+	{
+		return qtrue;
+	}
+
+	// every write checks for 4 bytes of room before it starts
+	if (msg->maxsize - msg->cursize < ((numBits + 7) >> 3) + 5)
+	{
+		return qfalse;
+	}
+
+	// 7 bytes at a time, so a chunk always starts on a byte of the source
+	for (i = 0; i < numBits; i += 56)
+	{
+		count = numBits - i;
+		if (count > 56)
+		{
+			count = 56;
+		}
+
+		bits = 0;
+		for (j = 0; j < (count + 7) >> 3; j++)
+		{
+			bits |= (unsigned long long) data[(i >> 3) + j] << (j << 3);
+		}
+		bits &= (1ULL << count) - 1;
+
+		MSG_PutBits (msg->data, &msg->bit, bits, count);
+	}
+
+	oldsize += numBits;
+	msg->cursize = (msg->bit >> 3) + 1;
+
+	return qtrue;
+}
+
 int MSG_ReadBits (msg_t *msg, int bits)
 {
 	int			value;
-	int			get;
 	qboolean	sgn;
-	int			i, nbits;
-	//	FILE*	fp;
 
 	value = 0;
 
@@ -263,26 +501,13 @@ int MSG_ReadBits (msg_t *msg, int bits)
 	}
 	else
 	{
-		nbits = 0;
-		if (bits & 7)
+		if (msgHuffTable.maxLength <= HUFF_LOOKUP_BITS)
 		{
-			nbits = bits & 7;
-			for (i = 0; i < nbits; i++)
-			{
-				value |= (Huff_getBit (msg->data, &msg->bit) << i);
-			}
-			bits = bits - nbits;
+			value = MSG_ReadHuffBits (msg, bits);
 		}
-		if (bits)
+		else
 		{
-			//			fp = fopen("c:\\netchan.bin", "a");
-			for (i = 0; i < bits; i += 8)
-			{
-				Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
-				//				fwrite(&get, 1, 1, fp);
-				value |= (get << (i + nbits));
-			}
-			//			fclose(fp);
+			value = MSG_ReadHuffBitsTree (msg, bits);
 		}
 		msg->readcount = (msg->bit >> 3) + 1;
 	}
@@ -984,103 +1209,259 @@ netField_t	entityStateFields[] =
 #define	FLOAT_INT_BITS	13
 #define	FLOAT_INT_BIAS	(1<<(FLOAT_INT_BITS-1))
 
+/*
+==============================================================================
+
+CHANGE MASKS
+
+Instead of comparing the fields one at a time through the field tables, the
+two structs are compared four words at a time and the words that differ are
+mapped to their field numbers with a table built at init.  Most deltas touch
+only a handful of words, so the mapping costs next to nothing.
+
+Words are compared as ints, exactly like the field loops did, so floats
+that compare equal but differ in their bits (0 and -0) still count as
+changes.
+
+==============================================================================
+*/
+
+#define	MAX_NETFIELD_WORDS	128
+#define	MAX_NETFIELDS		64
+
+typedef struct
+{
+	int			numWords;
+	signed char	fieldForWord[MAX_NETFIELD_WORDS];	// -1 if the word isn't sent as a field
+	int			numArrays;
+	int			arrayWords[4];						// start of each 16 word array sent by bitmask
+} netFieldMap_t;
+
+typedef struct
+{
+	unsigned long long	fields;			// one bit per entry in the field table
+	int					lc;				// last changed field + 1
+	int					arrays[4];		// one bit per array element
+} netChanges_t;
+
+static netFieldMap_t	entityStateMap;
+static netFieldMap_t	playerStateMap;
+
 /*
 ==================
-MSG_WriteDeltaEntity
+MSG_BuildFieldMap
+==================
+*/
+static void MSG_BuildFieldMap (netFieldMap_t *map, const netField_t *fields, int numFields, int size)
+{
+	int		i;
 
-Writes part of a packetentities message, including the entity number.
-Can delta from either a baseline or a previous packet_entity
-If to is NULL, a remove entity update will be sent
-If force is not set, then nothing at all will be generated if the entity is
-identical, under the assumption that the in-order delta code will catch it.
+	if (size / 4 > MAX_NETFIELD_WORDS || numFields > MAX_NETFIELDS)
+	{
+		Com_Error (ERR_FATAL, "MSG_BuildFieldMap: %i words, %i fields", size / 4, numFields);
+	}
+
+	Com_Memset (map, 0, sizeof (*map));
+	Com_Memset (map->fieldForWord, -1, sizeof (map->fieldForWord));
+	map->numWords = size / 4;
+
+	for (i = 0; i < numFields; i++)
+	{
+		map->fieldForWord[fields[i].offset >> 2] = i;
+	}
+}
+
+/*
+==================
+MSG_ChangedWords
 ==================
 */
-void MSG_WriteDeltaEntity (msg_t *msg, struct entityState_s *from, struct entityState_s *to,
-	qboolean force)
+static void MSG_ChangedWords (const void *from, const void *to, int numWords, unsigned *changed)
 {
-	int			i, lc;
-	int			numFields;
-	netField_t	*field;
-	int			trunc;
-	float		fullFloat;
-	int			*fromF, *toF;
+	const int	*f = (const int *) from;
+	const int	*t = (const int *) to;
+	__m128i		eq;
+	int			i;
 
-	numFields = sizeof (entityStateFields) / sizeof (entityStateFields[0]);
+	Com_Memset (changed, 0, ((numWords + 31) >> 5) * sizeof (*changed));
 
-	// all fields should be 32 bits to avoid any compiler packing issues
-	// the "number" field is not part of the field list
-	// if this assert fails, someone added a field to the entityState_t
-	// struct without updating the message fields
-	assert (numFields + 1 == sizeof (*from) / 4);
+	// i stays a multiple of 4, so each group of bits lands inside one mask word
+	for (i = 0; i + 4 <= numWords; i += 4)
+	{
+		eq = _mm_cmpeq_epi32 (_mm_loadu_si128 ((const __m128i *) (f + i)), _mm_loadu_si128 ((const __m128i *) (t + i)));
+		changed[i >> 5] |= (unsigned) (_mm_movemask_ps (_mm_castsi128_ps (eq)) ^ 15) << (i & 31);
+	}
 
-	// a NULL to is a delta remove message
-	if (to == NULL)
+	for (; i < numWords; i++)
 	{
-		if (from == NULL)
+		if (f[i] != t[i])
 		{
-			return;
+			changed[i >> 5] |= 1u << (i & 31);
 		}
-		MSG_WriteBits (msg, from->number, GENTITYNUM_BITS);
-		MSG_WriteBits (msg, 1, 1);
-		return;
 	}
+}
 
-	if (to->number < 0 || to->number >= MAX_GENTITIES)
-	{
-		Com_Error (ERR_FATAL, "MSG_WriteDeltaEntity: Bad entity number: %i", to->number);
-	}
+/*
+==================
+MSG_FieldChanges
+==================
+*/
+static void MSG_FieldChanges (const netFieldMap_t *map, const void *from, const void *to, netChanges_t *changes)
+{
+	unsigned	changed[MAX_NETFIELD_WORDS / 32];
+	unsigned	bits;
+	int			i, w, field, shift;
 
-	lc = 0;
-	// build the change vector as bytes so it is endien independent
-	for (i = 0, field = entityStateFields; i < numFields; i++, field++)
+	MSG_ChangedWords (from, to, map->numWords, changed);
+
+	changes->fields = 0;
+	changes->lc = 0;
+
+	for (i = 0; i < (map->numWords + 31) >> 5; i++)
 	{
-		fromF = (int *) ((byte *) from + field->offset);
-		toF = (int *) ((byte *) to + field->offset);
-		if (*fromF != *toF)
+		for (bits = changed[i], w = i << 5; bits; bits >>= 1, w++)
 		{
-			lc = i + 1;
+			if (!(bits & 1))
+			{
+				continue;
+			}
+
+			field = map->fieldForWord[w];
+			if (field < 0)
+			{
+				continue;
+			}
+
+			changes->fields |= 1ULL << field;
+			if (field >= changes->lc)
+			{
+				changes->lc = field + 1;
+			}
 		}
 	}
 
-	if (lc == 0)
+	for (i = 0; i < map->numArrays; i++)
 	{
-		// nothing at all changed
-		if (!force)
+		w = map->arrayWords[i];
+		shift = w & 31;
+
+		bits = changed[w >> 5] >> shift;
+		if (shift > 16)
 		{
-			return;		// nothing at all
+			bits |= changed[(w >> 5) + 1] << (32 - shift);
 		}
-		// write two bits for no change
-		MSG_WriteBits (msg, to->number, GENTITYNUM_BITS);
-		MSG_WriteBits (msg, 0, 1);		// not removed
-		MSG_WriteBits (msg, 0, 1);		// no delta
-		return;
+
+		changes->arrays[i] = bits & 0xffff;
 	}
+}
 
-	MSG_WriteBits (msg, to->number, GENTITYNUM_BITS);
-	MSG_WriteBits (msg, 0, 1);			// not removed
-	MSG_WriteBits (msg, 1, 1);			// we have a delta
+/*
+==================
+MSG_FieldChangesSlow
 
-	MSG_WriteByte (msg, lc);	// # of changes
+The field by field comparison the masks replace, kept to check them against
+==================
+*/
+static void MSG_FieldChangesSlow (const netFieldMap_t *map, const netField_t *fields, int numFields,
+	const void *from, const void *to, netChanges_t *changes)
+{
+	const int	*fromF, *toF;
+	int			i, j;
 
-	oldsize += numFields;
+	changes->fields = 0;
+	changes->lc = 0;
 
-	for (i = 0, field = entityStateFields; i < lc; i++, field++)
+	for (i = 0; i < numFields; i++)
 	{
-		fromF = (int *) ((byte *) from + field->offset);
-		toF = (int *) ((byte *) to + field->offset);
-
-		if (*fromF == *toF)
+		fromF = (const int *) ((const byte *) from + fields[i].offset);
+		toF = (const int *) ((const byte *) to + fields[i].offset);
+		if (*fromF != *toF)
 		{
-			MSG_WriteBits (msg, 0, 1);	// no change
-			continue;
+			changes->fields |= 1ULL << i;
+			changes->lc = i + 1;
 		}
+	}
 
-		MSG_WriteBits (msg, 1, 1);	// changed
+	for (i = 0; i < map->numArrays; i++)
+	{
+		fromF = (const int *) from + map->arrayWords[i];
+		toF = (const int *) to + map->arrayWords[i];
 
-		if (field->bits == 0)
+		changes->arrays[i] = 0;
+		for (j = 0; j < 16; j++)
 		{
-			// float
-			fullFloat = *(float *) toF;
+			if (fromF[j] != toF[j])
+			{
+				changes->arrays[i] |= 1 << j;
+			}
+		}
+	}
+}
+
+
+/*
+==================
+MSG_WriteEntityChanges
+
+Everything after the remove check, given the changes from the old state
+==================
+*/
+static void MSG_WriteEntityChanges (msg_t *msg, entityState_t *to, qboolean force, const netChanges_t *changes)
+{
+	int			i, lc;
+	int			numFields;
+	netField_t	*field;
+	int			trunc;
+	float		fullFloat;
+	int			*toF;
+
+	numFields = sizeof (entityStateFields) / sizeof (entityStateFields[0]);
+
+	if (to->number < 0 || to->number >= MAX_GENTITIES)
+	{
+		Com_Error (ERR_FATAL, "MSG_WriteDeltaEntity: Bad entity number: %i", to->number);
+	}
+
+	lc = changes->lc;
+
+	if (lc == 0)
+	{
+		// nothing at all changed
+		if (!force)
+		{
+			return;		// nothing at all
+		}
+		// write two bits for no change
+		MSG_WriteBits (msg, to->number, GENTITYNUM_BITS);
+		MSG_WriteBits (msg, 0, 1);		// not removed
+		MSG_WriteBits (msg, 0, 1);		// no delta
+		return;
+	}
+
+	MSG_WriteBits (msg, to->number, GENTITYNUM_BITS);
+	MSG_WriteBits (msg, 0, 1);			// not removed
+	MSG_WriteBits (msg, 1, 1);			// we have a delta
+
+	MSG_WriteByte (msg, lc);	// # of changes
+
+	oldsize += numFields;
+
+	for (i = 0, field = entityStateFields; i < lc; i++, field++)
+	{
+		if (!(changes->fields & (1ULL << i)))
+		{
+			MSG_WriteBits (msg, 0, 1);	// no change
+			continue;
+		}
+
+		toF = (int *) ((byte *) to + field->offset);
+
+		MSG_WriteBits (msg, 1, 1);	// changed
+
+		if (field->bits == 0)
+		{
+			// float
+			fullFloat = *(float *) toF;
 			trunc = (int) fullFloat;
 
 			if (fullFloat == 0.0f)
@@ -1122,6 +1503,90 @@ void MSG_WriteDeltaEntity (msg_t *msg, struct entityState_s *from, struct entity
 	}
 }
 
+/*
+==================
+MSG_WriteDeltaEntity
+
+Writes part of a packetentities message, including the entity number.
+Can delta from either a baseline or a previous packet_entity
+If to is NULL, a remove entity update will be sent
+If force is not set, then nothing at all will be generated if the entity is
+identical, under the assumption that the in-order delta code will catch it.
+==================
+*/
+void MSG_WriteDeltaEntity (msg_t *msg, struct entityState_s *from, struct entityState_s *to,
+	qboolean force)
+{
+	netChanges_t	changes;
+
+	// all fields should be 32 bits to avoid any compiler packing issues
+	// the "number" field is not part of the field list
+	// if this assert fails, someone added a field to the entityState_t
+	// struct without updating the message fields
+	assert (sizeof (entityStateFields) / sizeof (entityStateFields[0]) + 1 == sizeof (*from) / 4);
+
+	// a NULL to is a delta remove message
+	if (to == NULL)
+	{
+		if (from == NULL)
+		{
+			return;
+		}
+		MSG_WriteBits (msg, from->number, GENTITYNUM_BITS);
+		MSG_WriteBits (msg, 1, 1);
+		return;
+	}
+
+	MSG_FieldChanges (&entityStateMap, from, to, &changes);
+	MSG_WriteEntityChanges (msg, to, force, &changes);
+}
+
+/*
+==================
+MSG_WriteDeltaEntities
+
+MSG_WriteDeltaEntity for a whole list, finding the changes for a batch of
+entities before writing any of them
+==================
+*/
+#define	DELTA_BATCH		32
+
+void MSG_WriteDeltaEntities (msg_t *msg, const entityDelta_t *deltas, int count)
+{
+	netChanges_t	changes[DELTA_BATCH];
+	int				start, num;
+	int				i;
+
+	for (start = 0; start < count; start += num)
+	{
+		num = count - start;
+		if (num > DELTA_BATCH)
+		{
+			num = DELTA_BATCH;
+		}
+
+		for (i = 0; i < num; i++)
+		{
+			if (deltas[start + i].to)
+			{
+				MSG_FieldChanges (&entityStateMap, deltas[start + i].from, deltas[start + i].to, &changes[i]);
+			}
+		}
+
+		for (i = 0; i < num; i++)
+		{
+			if (deltas[start + i].to)
+			{
+				MSG_WriteEntityChanges (msg, deltas[start + i].to, deltas[start + i].force, &changes[i]);
+			}
+			else
+			{
+				MSG_WriteDeltaEntity (msg, deltas[start + i].from, NULL, deltas[start + i].force);
+			}
+		}
+	}
+}
+
 /*
 ==================
 MSG_ReadDeltaEntity
@@ -1349,45 +1814,27 @@ netField_t	playerStateFields[] =
 
 /*
 =============
-MSG_WriteDeltaPlayerstate
+MSG_WritePlayerChanges
 
+Writes a playerstate delta given the changes from the old state
 =============
 */
-void MSG_WriteDeltaPlayerstate (msg_t *msg, struct playerState_s *from, struct playerState_s *to)
+static void MSG_WritePlayerChanges (msg_t *msg, playerState_t *to, const netChanges_t *changes)
 {
 	int				i;
-	playerState_t	dummy;
 	int				statsbits;
 	int				persistantbits;
 	int				ammobits;
 	int				powerupbits;
 	int				numFields;
-	int				c;
 	netField_t		*field;
-	int				*fromF, *toF;
+	int				*toF;
 	float			fullFloat;
 	int				trunc, lc;
 
-	if (!from)
-	{
-		from = &dummy;
-		Com_Memset (&dummy, 0, sizeof (dummy));
-	}
-
-	c = msg->cursize;
-
 	numFields = sizeof (playerStateFields) / sizeof (playerStateFields[0]);
 
-	lc = 0;
-	for (i = 0, field = playerStateFields; i < numFields; i++, field++)
-	{
-		fromF = (int *) ((byte *) from + field->offset);
-		toF = (int *) ((byte *) to + field->offset);
-		if (*fromF != *toF)
-		{
-			lc = i + 1;
-		}
-	}
+	lc = changes->lc;
 
 	MSG_WriteByte (msg, lc);	// # of changes
 
@@ -1395,15 +1842,14 @@ void MSG_WriteDeltaPlayerstate (msg_t *msg, struct playerState_s *from, struct p
 
 	for (i = 0, field = playerStateFields; i < lc; i++, field++)
 	{
-		fromF = (int *) ((byte *) from + field->offset);
-		toF = (int *) ((byte *) to + field->offset);
-
-		if (*fromF == *toF)
+		if (!(changes->fields & (1ULL << i)))
 		{
 			MSG_WriteBits (msg, 0, 1);	// no change
 			continue;
 		}
 
+		toF = (int *) ((byte *) to + field->offset);
+
 		MSG_WriteBits (msg, 1, 1);	// changed
 		//		pcount[i]++;
 
@@ -1433,41 +1879,12 @@ void MSG_WriteDeltaPlayerstate (msg_t *msg, struct playerState_s *from, struct p
 			MSG_WriteBits (msg, *toF, field->bits);
 		}
 	}
-	c = msg->cursize - c;
 
 	// send the arrays
-	statsbits = 0;
-	for (i = 0; i < 16; i++)
-	{
-		if (to->stats[i] != from->stats[i])
-		{
-			statsbits |= 1 << i;
-		}
-	}
-	persistantbits = 0;
-	for (i = 0; i < 16; i++)
-	{
-		if (to->persistant[i] != from->persistant[i])
-		{
-			persistantbits |= 1 << i;
-		}
-	}
-	ammobits = 0;
-	for (i = 0; i < 16; i++)
-	{
-		if (to->ammo[i] != from->ammo[i])
-		{
-			ammobits |= 1 << i;
-		}
-	}
-	powerupbits = 0;
-	for (i = 0; i < 16; i++)
-	{
-		if (to->powerups[i] != from->powerups[i])
-		{
-			powerupbits |= 1 << i;
-		}
-	}
+	statsbits = changes->arrays[0];
+	persistantbits = changes->arrays[1];
+	ammobits = changes->arrays[2];
+	powerupbits = changes->arrays[3];
 
 	if (!statsbits && !persistantbits && !ammobits && !powerupbits)
 	{
@@ -1533,6 +1950,27 @@ void MSG_WriteDeltaPlayerstate (msg_t *msg, struct playerState_s *from, struct p
 	}
 }
 
+/*
+=============
+MSG_WriteDeltaPlayerstate
+
+=============
+*/
+void MSG_WriteDeltaPlayerstate (msg_t *msg, struct playerState_s *from, struct playerState_s *to)
+{
+	playerState_t	dummy;
+	netChanges_t	changes;
+
+	if (!from)
+	{
+		from = &dummy;
+		Com_Memset (&dummy, 0, sizeof (dummy));
+	}
+
+	MSG_FieldChanges (&playerStateMap, from, to, &changes);
+	MSG_WritePlayerChanges (msg, to, &changes);
+}
+
 
 /*
 ===================
@@ -1986,6 +2424,20 @@ void MSG_initHuffman ()
 			Huff_addRef (&msgHuff.decompressor, (byte) i);			// Do update
 		}
 	}
+	Huff_BuildTable (&msgHuff.compressor, &msgHuffTable);
+
+	// the rest of the one time message setup
+	MSG_BuildFieldMap (&entityStateMap, entityStateFields,
+		sizeof (entityStateFields) / sizeof (entityStateFields[0]), sizeof (entityState_t));
+	MSG_BuildFieldMap (&playerStateMap, playerStateFields,
+		sizeof (playerStateFields) / sizeof (playerStateFields[0]), sizeof (playerState_t));
+
+	// in the order they are written
+	playerStateMap.numArrays = 4;
+	playerStateMap.arrayWords[0] = (int) (size_t) &((playerState_t *) 0)->stats >> 2;
+	playerStateMap.arrayWords[1] = (int) (size_t) &((playerState_t *) 0)->persistant >> 2;
+	playerStateMap.arrayWords[2] = (int) (size_t) &((playerState_t *) 0)->ammo >> 2;
+	playerStateMap.arrayWords[3] = (int) (size_t) &((playerState_t *) 0)->powerups >> 2;
 }
 
 /*
@@ -2024,3 +2476,621 @@ Cbuf_AddText( "condump dump.txt\n" );
 */
 
 //===========================================================================
+
+/*
+=============================================================================
+
+HUFFMAN CODEC BENCHMARK
+
+=============================================================================
+*/
+
+#define	MAX_BENCH_VALUES	0x20000
+
+typedef struct
+{
+	int		bits;
+	int		value;
+} msgBenchValue_t;
+
+/*
+=================
+MSG_BenchRandom
+=================
+*/
+static int MSG_BenchRandom (unsigned *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 8) & 0xffff;
+}
+
+/*
+=================
+MSG_BenchByte
+
+Picks a byte with the frequencies the message tree was built from
+=================
+*/
+static int MSG_BenchByte (unsigned *seed, const int *cumulative)
+{
+	int		r, lo, hi, mid;
+
+	r = ((MSG_BenchRandom (seed) << 16) | MSG_BenchRandom (seed)) % cumulative[255];
+
+	lo = 0;
+	hi = 255;
+	while (lo < hi)
+	{
+		mid = (lo + hi) >> 1;
+		if (r < cumulative[mid])
+		{
+			hi = mid;
+		}
+		else
+		{
+			lo = mid + 1;
+		}
+	}
+
+	return lo;
+}
+
+/*
+=================
+MSG_HuffmanFuzz
+
+Writes random fields of every width with both codecs into buffers holding
+the same garbage, and reads them back with both.  Returns the number of
+messages that differ in any way.
+=================
+*/
+static int MSG_HuffmanFuzz (int numMessages)
+{
+	static byte		treeBuf[1024];
+	static byte		tableBuf[1024];
+	msgBenchValue_t	values[128];
+	msg_t			tree, table;
+	unsigned		seed;
+	int				i, m, numValues;
+	int				a, b;
+	int				failed;
+
+	seed = 0x5eed;
+	failed = 0;
+
+	for (m = 0; m < numMessages; m++)
+	{
+		for (i = 0; i < sizeof (treeBuf); i++)
+		{
+			treeBuf[i] = tableBuf[i] = MSG_BenchRandom (&seed);
+		}
+
+		MSG_Init (&tree, treeBuf, sizeof (treeBuf));
+		MSG_Init (&table, tableBuf, sizeof (tableBuf));
+
+		numValues = 1 + MSG_BenchRandom (&seed) % 128;
+		for (i = 0; i < numValues; i++)
+		{
+			values[i].bits = 1 + MSG_BenchRandom (&seed) % 32;
+			values[i].value = (MSG_BenchRandom (&seed) << 16) | MSG_BenchRandom (&seed);
+			values[i].value &= (0xffffffff >> (32 - values[i].bits));
+
+			MSG_WriteHuffBitsTree (&tree, values[i].value, values[i].bits);
+			MSG_WriteHuffBits (&table, values[i].value, values[i].bits);
+		}
+
+		if (tree.bit != table.bit || memcmp (treeBuf, tableBuf, sizeof (treeBuf)))
+		{
+			failed++;
+			continue;
+		}
+
+		tree.bit = table.bit = 0;
+		for (i = 0; i < numValues; i++)
+		{
+			a = MSG_ReadHuffBitsTree (&tree, values[i].bits);
+			b = MSG_ReadHuffBits (&table, values[i].bits);
+
+			if (a != values[i].value || b != values[i].value || tree.bit != table.bit)
+			{
+				failed++;
+				break;
+			}
+		}
+	}
+
+	return failed;
+}
+
+/*
+=================
+MSG_LoadBenchDemo
+
+Decodes every message of a recorded demo into a stream of bytes
+=================
+*/
+static int MSG_LoadBenchDemo (const char *name, msgBenchValue_t *values)
+{
+	char	path[MAX_QPATH];
+	byte	*buffer;
+	int		length, offset, msglen;
+	int		numValues;
+	msg_t	msg;
+
+	Q_strncpyz (path, name, sizeof (path));
+	if (!strchr (name, '.'))
+	{
+		Com_sprintf (path, sizeof (path), "demos/%s.dm_%d", name, PROTOCOL_VERSION);
+	}
+
+	length = FS_ReadFile (path, (void **) &buffer);
+	if (!buffer)
+	{
+		Com_Printf ("Couldn't load %s\n", path);
+		return 0;
+	}
+
+	// each message is a sequence number and a length followed by the bit stream
+	numValues = 0;
+	for (offset = 0; offset + 8 <= length && numValues < MAX_BENCH_VALUES; offset += msglen)
+	{
+		msglen = LittleLong (*(int *) (buffer + offset + 4));
+		offset += 8;
+
+		if (msglen <= 0 || msglen > MAX_MSGLEN || offset + msglen > length)
+		{
+			break;
+		}
+
+		MSG_Init (&msg, buffer + offset, msglen);
+		msg.cursize = msglen;
+
+		while ((msg.bit >> 3) < msglen && numValues < MAX_BENCH_VALUES)
+		{
+			values[numValues].bits = 8;
+			values[numValues].value = MSG_ReadHuffBitsTree (&msg, 8);
+			numValues++;
+		}
+	}
+
+	FS_FreeFile (buffer);
+
+	return numValues;
+}
+
+/*
+=================
+MSG_HuffmanBench_f
+
+huffbench [demo] [iterations]
+
+Checks the table codec against the tree walk, then times both on the bytes of
+a recorded demo, or on typical entity fields if no demo is given
+=================
+*/
+void MSG_HuffmanBench_f (void)
+{
+	static const int	widths[] = { 1, 1, 1, 4, 8, 8, 8, 10, 13, 16, 16, 32 };
+	msgBenchValue_t		*values;
+	byte				*treeBuf, *tableBuf;
+	int					cumulative[256];
+	int					numValues, numIterations;
+	int					i, j, it, size;
+	int					start, usec[4];
+	int					failed;
+	unsigned			seed;
+	msg_t				msg;
+
+	if (!msgInit)
+	{
+		MSG_initHuffman ();
+	}
+
+	numIterations = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 20;
+	if (numIterations < 1)
+	{
+		numIterations = 1;
+	}
+
+	failed = MSG_HuffmanFuzz (2000);
+	Com_Printf ("round trip: 2000 random messages, %i failed\n", failed);
+
+	values = Z_Malloc (MAX_BENCH_VALUES * sizeof (*values));
+
+	if (Cmd_Argc () > 1)
+	{
+		numValues = MSG_LoadBenchDemo (Cmd_Argv (1), values);
+		if (!numValues)
+		{
+			Z_Free (values);
+			return;
+		}
+	}
+	else
+	{
+		cumulative[0] = msg_hData[0];
+		for (i = 1; i < 256; i++)
+		{
+			cumulative[i] = cumulative[i - 1] + msg_hData[i];
+		}
+
+		seed = 1;
+		numValues = MAX_BENCH_VALUES;
+		for (i = 0; i < numValues; i++)
+		{
+			values[i].bits = widths[MSG_BenchRandom (&seed) % (sizeof (widths) / sizeof (widths[0]))];
+			values[i].value = 0;
+			for (j = 0; j < values[i].bits; j += 8)
+			{
+				values[i].value |= MSG_BenchByte (&seed, cumulative) << j;
+			}
+			values[i].value &= (0xffffffff >> (32 - values[i].bits));
+		}
+	}
+
+	// 7 raw bits and four codes per value at most
+	size = numValues * 7 + 8;
+	treeBuf = Z_Malloc (size);
+	tableBuf = Z_Malloc (size);
+
+	Com_Memset (usec, 0, sizeof (usec));
+
+	for (it = 0; it < numIterations; it++)
+	{
+		MSG_Init (&msg, treeBuf, size);
+		start = Sys_Microseconds ();
+		for (i = 0; i < numValues; i++)
+		{
+			MSG_WriteHuffBitsTree (&msg, values[i].value, values[i].bits);
+		}
+		usec[0] += Sys_Microseconds () - start;
+
+		MSG_Init (&msg, tableBuf, size);
+		start = Sys_Microseconds ();
+		for (i = 0; i < numValues; i++)
+		{
+			MSG_WriteHuffBits (&msg, values[i].value, values[i].bits);
+		}
+		usec[1] += Sys_Microseconds () - start;
+
+		MSG_Init (&msg, treeBuf, size);
+		start = Sys_Microseconds ();
+		for (i = 0; i < numValues; i++)
+		{
+			MSG_ReadHuffBitsTree (&msg, values[i].bits);
+		}
+		usec[2] += Sys_Microseconds () - start;
+
+		MSG_Init (&msg, tableBuf, size);
+		start = Sys_Microseconds ();
+		for (i = 0; i < numValues; i++)
+		{
+			if (MSG_ReadHuffBits (&msg, values[i].bits) != values[i].value)
+			{
+				failed++;
+			}
+		}
+		usec[3] += Sys_Microseconds () - start;
+	}
+
+	if (memcmp (treeBuf, tableBuf, (msg.bit + 7) >> 3))
+	{
+		failed++;
+	}
+
+	Com_Printf ("%i values, %i bytes coded, %i iterations\n", numValues, (msg.bit + 7) >> 3, numIterations);
+	Com_Printf ("tree:  write %8.3f msec  read %8.3f msec\n", usec[0] / (1000.0f * numIterations), usec[2] / (1000.0f * numIterations));
+	Com_Printf ("table: write %8.3f msec  read %8.3f msec\n", usec[1] / (1000.0f * numIterations), usec[3] / (1000.0f * numIterations));
+	Com_Printf ("speedup: write %.2fx  read %.2fx\n", usec[0] / (float) (usec[1] ? usec[1] : 1), usec[2] / (float) (usec[3] ? usec[3] : 1));
+	Com_Printf ("%s\n", failed ? "^1streams differ" : "streams identical");
+
+	Z_Free (tableBuf);
+	Z_Free (treeBuf);
+	Z_Free (values);
+}
+
+/*
+=============================================================================
+
+DELTA BENCHMARK
+
+=============================================================================
+*/
+
+#define	DELTA_FUZZ_PASSES	8
+
+typedef enum
+{
+	DELTA_FIELDS,		// the old field by field comparison
+	DELTA_MASKS,		// MSG_WriteDeltaEntity / MSG_WriteDeltaPlayerstate
+	DELTA_LIST			// MSG_WriteDeltaEntities
+} deltaMethod_t;
+
+/*
+=================
+MSG_DeltaEntities
+
+Writes every delta with one method, DELTA_BATCH at a time so every method
+restarts the message at the same points, and checksums the output.  cursize
+counts a byte that hasn't been written yet when the last write ended on a
+byte boundary, so only the bytes holding bits are summed.
+=================
+*/
+static unsigned MSG_DeltaEntities (deltaMethod_t method, const entityDelta_t *deltas, int count, byte *buf)
+{
+	netChanges_t	changes;
+	msg_t			msg;
+	unsigned		checksum;
+	int				start, num, i;
+	int				numFields;
+
+	numFields = sizeof (entityStateFields) / sizeof (entityStateFields[0]);
+	checksum = 0;
+
+	MSG_Init (&msg, buf, MAX_MSGLEN);
+
+	for (start = 0; start < count; start += num)
+	{
+		num = count - start;
+		if (num > DELTA_BATCH)
+		{
+			num = DELTA_BATCH;
+		}
+
+		if (method == DELTA_LIST)
+		{
+			MSG_WriteDeltaEntities (&msg, deltas + start, num);
+		}
+		else
+		{
+			for (i = start; i < start + num; i++)
+			{
+				if (method == DELTA_MASKS)
+				{
+					MSG_WriteDeltaEntity (&msg, deltas[i].from, deltas[i].to, deltas[i].force);
+				}
+				else
+				{
+					MSG_FieldChangesSlow (&entityStateMap, entityStateFields, numFields, deltas[i].from, deltas[i].to, &changes);
+					MSG_WriteEntityChanges (&msg, deltas[i].to, deltas[i].force, &changes);
+				}
+			}
+		}
+
+		if (msg.cursize > MAX_MSGLEN / 2)
+		{
+			checksum = checksum * 31 + Com_BlockChecksum (msg.data, (msg.bit + 7) >> 3);
+			MSG_Init (&msg, buf, MAX_MSGLEN);
+		}
+	}
+
+	return checksum * 31 + Com_BlockChecksum (msg.data, (msg.bit + 7) >> 3);
+}
+
+/*
+=================
+MSG_DeltaPlayers
+
+Each player state against the one before it, the first from nothing
+=================
+*/
+static unsigned MSG_DeltaPlayers (deltaMethod_t method, playerState_t *players, int count, byte *buf)
+{
+	playerState_t	dummy;
+	netChanges_t	changes;
+	msg_t			msg;
+	unsigned		checksum;
+	int				i;
+	int				numFields;
+
+	numFields = sizeof (playerStateFields) / sizeof (playerStateFields[0]);
+	checksum = 0;
+
+	Com_Memset (&dummy, 0, sizeof (dummy));
+	MSG_Init (&msg, buf, MAX_MSGLEN);
+
+	for (i = 0; i < count; i++)
+	{
+		if (method == DELTA_FIELDS)
+		{
+			MSG_FieldChangesSlow (&playerStateMap, playerStateFields, numFields, i ? &players[i - 1] : &dummy, &players[i], &changes);
+			MSG_WritePlayerChanges (&msg, &players[i], &changes);
+		}
+		else
+		{
+			MSG_WriteDeltaPlayerstate (&msg, i ? &players[i - 1] : NULL, &players[i]);
+		}
+
+		if (msg.cursize > MAX_MSGLEN / 2)
+		{
+			checksum = checksum * 31 + Com_BlockChecksum (msg.data, (msg.bit + 7) >> 3);
+			MSG_Init (&msg, buf, MAX_MSGLEN);
+		}
+	}
+
+	return checksum * 31 + Com_BlockChecksum (msg.data, (msg.bit + 7) >> 3);
+}
+
+/*
+=================
+MSG_DeltaBench
+
+Called with entity and player states in the order they were received.
+Each entity is delta'd from its previous appearance and from an empty
+baseline, the changes are checked against the field by field comparison, and
+the bitstreams of every method are checked against each other, first on the
+recorded states and then on copies with random words changed.  Then each
+method is timed.
+=================
+*/
+void MSG_DeltaBench (entityState_t *states, int numStates, playerState_t *players, int numPlayers)
+{
+	entityState_t	*baselines, *fuzzed;
+	entityDelta_t	*deltas, *check;
+	netChanges_t	fast, slow;
+	byte			*buf;
+	unsigned		checksums[3];
+	unsigned		seed;
+	int				numDeltas, numFields;
+	int				i, j, pass, word;
+	int				start, usec[3];
+	int				failed;
+	int				iterations;
+
+	if (!msgInit)
+	{
+		MSG_initHuffman ();
+	}
+
+	if (!numStates)
+	{
+		Com_Printf ("No entity states to delta.\n");
+		return;
+	}
+
+	numFields = sizeof (entityStateFields) / sizeof (entityStateFields[0]);
+
+	baselines = Z_Malloc (numStates * sizeof (*baselines));
+	fuzzed = Z_Malloc (numStates * sizeof (*fuzzed));
+	deltas = Z_Malloc (numStates * 2 * sizeof (*deltas));
+	check = Z_Malloc (numStates * 2 * sizeof (*check));
+	buf = Z_Malloc (MAX_MSGLEN);
+
+	numDeltas = 0;
+	for (i = 0; i < numStates; i++)
+	{
+		baselines[i].number = states[i].number;
+		deltas[numDeltas].from = &baselines[i];
+		deltas[numDeltas].to = &states[i];
+		deltas[numDeltas].force = qtrue;
+		numDeltas++;
+
+		for (j = i - 1; j >= 0; j--)
+		{
+			if (states[j].number == states[i].number)
+			{
+				deltas[numDeltas].from = &states[j];
+				deltas[numDeltas].to = &states[i];
+				deltas[numDeltas].force = qfalse;
+				numDeltas++;
+				break;
+			}
+		}
+	}
+
+	// conformance on the recorded states, then on randomly changed ones
+	failed = 0;
+	seed = 1;
+	for (pass = 0; pass <= DELTA_FUZZ_PASSES; pass++)
+	{
+		Com_Memcpy (check, deltas, numDeltas * sizeof (*check));
+
+		if (pass)
+		{
+			for (i = 0; i < numStates; i++)
+			{
+				fuzzed[i] = states[i];
+				for (j = MSG_BenchRandom (&seed) % 4; j >= 0; j--)
+				{
+					word = 1 + MSG_BenchRandom (&seed) % numFields;
+					switch (MSG_BenchRandom (&seed) & 3)
+					{
+					case 0:
+						((int *) &fuzzed[i])[word] = 0x80000000;		// -0.0f
+						break;
+					case 1:
+						((int *) &fuzzed[i])[word] = 0;
+						break;
+					default:
+						((int *) &fuzzed[i])[word] ^= 1 << (MSG_BenchRandom (&seed) & 31);
+						break;
+					}
+				}
+			}
+
+			// new entities get changed states, the rest changed old states
+			for (i = 0; i < numDeltas; i++)
+			{
+				if (check[i].force)
+				{
+					check[i].to = fuzzed + (deltas[i].to - states);
+				}
+				else
+				{
+					check[i].from = fuzzed + (deltas[i].from - states);
+				}
+			}
+		}
+
+		for (i = 0; i < numDeltas; i++)
+		{
+			MSG_FieldChanges (&entityStateMap, check[i].from, check[i].to, &fast);
+			MSG_FieldChangesSlow (&entityStateMap, entityStateFields, numFields, check[i].from, check[i].to, &slow);
+
+			if (fast.fields != slow.fields || fast.lc != slow.lc)
+			{
+				failed++;
+			}
+		}
+
+		checksums[0] = MSG_DeltaEntities (DELTA_FIELDS, check, numDeltas, buf);
+		checksums[1] = MSG_DeltaEntities (DELTA_MASKS, check, numDeltas, buf);
+		checksums[2] = MSG_DeltaEntities (DELTA_LIST, check, numDeltas, buf);
+
+		if (checksums[0] != checksums[1] || checksums[0] != checksums[2])
+		{
+			failed++;
+		}
+	}
+
+	if (numPlayers && MSG_DeltaPlayers (DELTA_FIELDS, players, numPlayers, buf) != MSG_DeltaPlayers (DELTA_MASKS, players, numPlayers, buf))
+	{
+		failed++;
+	}
+
+	Com_Printf ("%i entity deltas, %i player deltas, %i fuzz passes: %s\n", numDeltas, numPlayers, DELTA_FUZZ_PASSES,
+		failed ? "^1bitstreams differ" : "bitstreams identical");
+
+	// enough repeats for a few million deltas
+	iterations = 4000000 / numDeltas + 1;
+
+	for (i = DELTA_FIELDS; i <= DELTA_LIST; i++)
+	{
+		start = Sys_Microseconds ();
+		for (j = 0; j < iterations; j++)
+		{
+			MSG_DeltaEntities (i, deltas, numDeltas, buf);
+		}
+		usec[i] = Sys_Microseconds () - start;
+	}
+
+	Com_Printf ("entities: fields %.1f  masks %.1f  list %.1f nsec/delta\n",
+		usec[DELTA_FIELDS] * 1000.0f / (iterations * numDeltas),
+		usec[DELTA_MASKS] * 1000.0f / (iterations * numDeltas),
+		usec[DELTA_LIST] * 1000.0f / (iterations * numDeltas));
+
+	if (numPlayers)
+	{
+		iterations = 1000000 / numPlayers + 1;
+
+		for (i = DELTA_FIELDS; i <= DELTA_MASKS; i++)
+		{
+			start = Sys_Microseconds ();
+			for (j = 0; j < iterations; j++)
+			{
+				MSG_DeltaPlayers (i, players, numPlayers, buf);
+			}
+			usec[i] = Sys_Microseconds () - start;
+		}
+
+		Com_Printf ("players:  fields %.1f  masks %.1f nsec/delta\n",
+			usec[DELTA_FIELDS] * 1000.0f / (iterations * numPlayers),
+			usec[DELTA_MASKS] * 1000.0f / (iterations * numPlayers));
+	}
+
+	Z_Free (buf);
+	Z_Free (check);
+	Z_Free (deltas);
+	Z_Free (fuzzed);
+	Z_Free (baselines);
+}
@@ -1037,6 +1037,19 @@ typedef struct
 // trace->entityNum can also be 0 to (MAX_GENTITIES-1)
 // or ENTITYNUM_NONE, ENTITYNUM_WORLD
 
+// one sweep of a batched trace
+typedef struct
+{
+	vec3_t		start;
+	vec3_t		end;
+	vec3_t		mins;
+	vec3_t		maxs;
+	int			passEntityNum;	// only used at the server level
+	int			contentmask;
+} traceRequest_t;
+
+#define	MAX_TRACE_BATCH		1024	// most requests in one trap_TraceBatch
+
 
 // markfragments are returned by CM_MarkFragments()
 typedef struct
@@ -59,6 +59,7 @@ struct entityState_s;
 struct playerState_s;
 
 void MSG_WriteBits (msg_t *msg, int value, int bits);
+qboolean MSG_WriteBitString (msg_t *msg, const byte *data, int numBits);
 
 void MSG_WriteChar (msg_t *sb, int c);
 void MSG_WriteByte (msg_t *sb, int c);
@@ -93,6 +94,16 @@ void MSG_WriteDeltaUsercmdKey (msg_t *msg, int key, usercmd_t *from, usercmd_t *
 void MSG_ReadDeltaUsercmdKey (msg_t *msg, int key, usercmd_t *from, usercmd_t *to);
 
 void MSG_WriteDeltaEntity (msg_t *msg, struct entityState_s *from, struct entityState_s *to, qboolean force);
+
+typedef struct
+{
+	struct entityState_s	*from;
+	struct entityState_s	*to;		// NULL to remove from
+	qboolean				force;
+} entityDelta_t;
+
+void MSG_WriteDeltaEntities (msg_t *msg, const entityDelta_t *deltas, int count);
+
 void MSG_ReadDeltaEntity (msg_t *msg, entityState_t *from, entityState_t *to, int number);
 
 void MSG_WriteDeltaPlayerstate (msg_t *msg, struct playerState_s *from, struct playerState_s *to);
@@ -100,6 +111,8 @@ void MSG_ReadDeltaPlayerstate (msg_t *msg, struct playerState_s *from, struct pl
 
 
 void MSG_ReportChangeVectors_f (void);
+void MSG_HuffmanBench_f (void);
+void MSG_DeltaBench (struct entityState_s *states, int numStates, struct playerState_s *players, int numPlayers);
 
 //============================================================================
 
@@ -318,6 +331,9 @@ void	VM_Debug (int level);
 
 void	*VM_ArgPtr (int intValue);
 void	*VM_ExplicitArgPtr (vm_t *vm, int intValue);
+qboolean	VM_ArgRangeValid (int intValue, int size);
+
+unsigned long long	VM_InstructionsExecuted (vm_t *vm);
 
 /*
 ==============================================================
@@ -706,6 +722,12 @@ int			Com_FilterPath (char *filter, char *name, int casesensitive);
 int			Com_RealTime (qtime_t *qtime);
 qboolean	Com_SafeMode (void);
 
+// stage times of the last map load, shown by map_loadtime
+void		Com_ClearLoadStages (void);
+void		Com_BeginLoadStage (const char *name);
+void		Com_EndLoadStage (void);
+void		Com_AddLoadTime (const char *name, int usec);
+
 void		Com_StartupVariable (const char *match);
 // checks for and removes command line "+set var arg" constructs
 // if match is NULL, all set commands will be executed, otherwise
@@ -749,7 +771,8 @@ typedef enum
 	TAG_BOTLIB,
 	TAG_RENDERER,
 	TAG_SMALL,
-	TAG_STATIC
+	TAG_STATIC,
+	TAG_SLAB			// zone block holding slab slots, never passed to Z_TagMalloc
 } memtag_t;
 
 /*
@@ -790,6 +813,18 @@ int	Hunk_MemoryRemaining (void);
 void Hunk_Log (void);
 void Hunk_Trash (void);
 
+// per-thread scratch that lives until the end of the frame
+typedef struct
+{
+	int		used;
+	void	*overflow;
+} frameMark_t;
+
+void *Frame_Alloc (int size);		// NOT 0 filled memory
+frameMark_t Frame_Mark (void);
+void Frame_Release (frameMark_t mark);
+void Frame_Clear (void);
+
 void Com_TouchMemory (void);
 
 // commandLine should not include the executable name (argv[0])
@@ -948,6 +983,9 @@ void	Sys_Print (const char *msg);
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds (void);
 
+// high resolution counterpart for timing short intervals, wraps every half hour
+int		Sys_Microseconds (void);
+
 void	Sys_SnapVector (float *v);
 
 // the system console is shown when a dedicated server is running
@@ -985,12 +1023,45 @@ char	*Sys_DefaultHomePath (void);
 char **Sys_ListFiles (const char *directory, const char *extension, char *filter, int *numfiles, qboolean wantsubs);
 void	Sys_FreeFileList (char **list);
 
+// read only file mappings for pak reads; Sys_MapFileView returns a pointer to
+// offset and sets *view to the base that must go to Sys_UnmapFileView
+void	*Sys_OpenFileMapping (const char *osPath, int *length);
+void	Sys_CloseFileMapping (void *mapping);
+void	*Sys_MapFileView (void *mapping, int offset, int length, void **view);
+void	Sys_UnmapFileView (void *view);
+
 void	Sys_BeginProfiling (void);
 void	Sys_EndProfiling (void);
 
 qboolean Sys_LowPhysicalMemory ();
 unsigned int Sys_ProcessorCount ();
 
+// worker thread pool; Sys_RunJobs calls func once for every index in [0, count)
+// spread across the workers and the calling thread, and returns when all are done.
+// job functions must not touch shared engine state (no Com_Error/Com_Printf)
+typedef void (*jobFunc_t) (void *data, int index);
+
+#define	MAX_JOB_THREADS		16
+
+void	Sys_InitJobs (void);
+void	Sys_ShutdownJobs (void);
+int		Sys_NumJobThreads (void);
+int		Sys_ThreadIndex (void);		// 0 on the main thread, [1, MAX_JOB_THREADS] on workers
+int		Sys_ThreadCount (void);
+void	Sys_SetJobThreadLimit (int limit);
+void	Sys_RunJobs (jobFunc_t func, void *data, int count);
+
+// full barriers; Sys_AtomicAdd returns the new value, Sys_AtomicCompareExchange
+// stores exchange if *dest == comparand and returns what *dest held before
+int		Sys_AtomicAdd (volatile int *value, int add);
+int		Sys_AtomicCompareExchange (volatile int *dest, int exchange, int comparand);
+
+// calls func from its own thread every msec until stopped; one sampler at a time
+typedef void (*samplerFunc_t) (void);
+
+qboolean	Sys_StartSampler (samplerFunc_t func, int msec);
+void	Sys_StopSampler (void);
+
 int Sys_MonkeyShouldBeSpanked (void);
 
 /* This is based on the Adaptive Huffman algorithm described in Sayood's Data
@@ -1032,6 +1103,20 @@ typedef struct
 	huff_t		decompressor;
 } huffman_t;
 
+// a tree that has stopped adapting can be flattened so each symbol is written
+// with a single shift and read with a single lookup; the code for a symbol
+// holds its first bit (the one next to the root) in bit 0, the order the bits
+// appear in the stream
+#define	HUFF_LOOKUP_BITS	11
+
+typedef struct
+{
+	int				maxLength;							// longest code in the tree
+	unsigned int	code[HMAX + 1];
+	unsigned short	length[HMAX + 1];
+	unsigned short	lookup[1 << HUFF_LOOKUP_BITS];		// symbol | length << 9, by the next HUFF_LOOKUP_BITS bits
+} huffTable_t;
+
 void	Huff_Compress (msg_t *buf, int offset);
 void	Huff_Decompress (msg_t *buf, int offset);
 void	Huff_Init (huffman_t *huff);
@@ -1042,6 +1127,7 @@ void	Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset);
 void	Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset);
 void	Huff_putBit (int bit, byte *fout, int *offset);
 int		Huff_getBit (byte *fout, int *offset);
+void	Huff_BuildTable (huff_t *huff, huffTable_t *table);
 
 extern huffman_t clientHuffTables;
 
@@ -34,15 +34,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 typedef struct svEntity_s
 {
-	struct worldSector_s *worldSector;
-	struct svEntity_s *nextEntityInWorldSector;
-
 	entityState_t	baseline;		// for delta compression of initial sighting
 	int			numClusters;		// if -1, use headnode instead
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
-	int			snapshotCounter;	// used to prevent double adding from portal views
 } svEntity_t;
 
 typedef enum
@@ -62,7 +58,6 @@ typedef struct
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=475
 	// the serverId associated with the current checksumFeed (always <= serverId)
 	int       checksumFeedServerId;
-	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
 	int				nextFrameTime;		// when time > nextFrameTime, process world
 	struct cmodel_s	*models[MAX_MODELS];
@@ -80,6 +75,38 @@ typedef struct
 	int				gameClientSize;		// will be > sizeof(playerState_t) due to game private data
 
 	int				restartTime;
+
+	// linked entities for each PVS cluster, so snapshots only look at
+	// entities in the clusters the client can see
+	int				numEntityClusters;
+	unsigned		(*clusterEntities)[MAX_GENTITIES / 32];
+	int				*clusterEntityCounts;
+
+	// entities every snapshot has to consider whatever clusters are visible:
+	// broadcasts and those touching more clusters than clusternums holds.
+	// rebuilt before the snapshots each frame since svFlags can change
+	// without a relink
+	unsigned		snapshotAlwaysCandidates[MAX_GENTITIES / 32];
+
+	// culling statistics for clusterlist
+	int				snapshotsCulled;
+	int				snapshotCandidates;
+	int				snapshotEntitiesSent;
+
+	// delta cache statistics for sv_deltaCacheStats, added to from the job threads
+	int				deltaCacheHits;
+	int				deltaCacheMisses;
+	int				deltaCacheFallbacks;
+	int				deltaCacheFrames;
+	int				deltaCachePeakEntries;
+	int				deltaCacheRefused;		// adds dropped because the cache was full
+
+	// area cache statistics for sv_areaCacheStats
+	int				areaCacheHits;
+	int				areaCacheMisses;
+	int				areaCacheUncached;
+	int				areaCacheInvalidations;
+	int				areaCacheFlushes;
 } server_t;
 
 
@@ -251,6 +278,9 @@ extern	cvar_t	*sv_pure;
 extern	cvar_t	*sv_floodProtect;
 extern	cvar_t	*sv_lanForceRate;
 extern	cvar_t	*sv_strictAuth;
+extern	cvar_t	*sv_parallelSnapshots;
+extern	cvar_t	*sv_deltaCache;
+extern	cvar_t	*sv_areaCache;
 
 //===========================================================
 
@@ -305,7 +335,10 @@ void SV_UpdateServerCommandsToClient (client_t *client, msg_t *msg);
 void SV_WriteFrameToClient (client_t *client, msg_t *msg);
 void SV_SendMessageToClient (msg_t *msg, client_t *client);
 void SV_SendClientMessages (void);
+void SV_PrepareSnapshotEntities (void);
 void SV_SendClientSnapshot (client_t *client);
+void SV_SnapshotBench_f (void);
+void SV_DeltaCacheStats_f (void);
 
 // sv_game.c
 int	SV_NumForGentity (sharedEntity_t *ent);
@@ -317,9 +350,12 @@ void		SV_InitGameProgs (void);
 void		SV_ShutdownGameProgs (void);
 void		SV_RestartGameProgs (void);
 qboolean	SV_inPVS (const vec3_t p1, const vec3_t p2);
+void		SV_VMBench_f (void);
 
 // sv_bot.c
 void		SV_BotFrame (int time);
+void		SV_BotRoutingBenchmark_f (void);
+void		SV_BotWriteRouteTable_f (void);
 int			SV_BotAllocateClient (void);
 void		SV_BotFreeClient (int clientNum);
 
@@ -354,6 +390,10 @@ clipHandle_t SV_ClipHandleForEntity (const sharedEntity_t *ent);
 
 
 void SV_SectorList_f (void);
+void SV_SectorBench_f (void);
+void SV_AreaCacheStats_f (void);
+void SV_ClearAreaCache (void);
+void SV_ClusterList_f (void);
 
 
 int SV_AreaEntities (const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount);
@@ -380,6 +420,9 @@ void SV_Trace (trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 
 // passEntityNum is explicitly excluded from clipping checks (normally ENTITYNUM_NONE)
 
+void SV_TraceBatch (trace_t *results, const traceRequest_t *requests, int count, int capsule);
+// SV_Trace for each of the requests, with the world part spread over the job threads
+
 
 void SV_ClipToEntity (trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, int capsule);
 // clip to a specific entity
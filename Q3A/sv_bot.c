@@ -467,6 +467,45 @@ void SV_BotFrame (int time)
 	VM_Call (gvm, BOTAI_START_FRAME, time);
 }
 
+/*
+==================
+SV_BotRoutingBenchmark_f
+
+The bot library runs the benchmark at the start of its next frame
+==================
+*/
+void SV_BotRoutingBenchmark_f (void)
+{
+	if (!bot_enable || !botlib_export)
+	{
+		Com_Printf ("Bot library not loaded.\n");
+		return;
+	}
+
+	botlib_export->BotLibVarSet ("routingbenchmark", "1");
+}
+
+/*
+==================
+SV_BotWriteRouteTable_f
+
+Precomputes the routing for the current map so bots never have to
+flood a route at run time, and writes it to maps/<map>.rtb.  The botlib
+does the work at the start of its next frame, so the map has to be
+running with bots enabled.
+==================
+*/
+void SV_BotWriteRouteTable_f (void)
+{
+	if (!bot_enable || !botlib_export)
+	{
+		Com_Printf ("Bot library not loaded.\n");
+		return;
+	}
+
+	botlib_export->BotLibVarSet ("writeroutetable", "1");
+}
+
 /*
 ===============
 SV_BotLibSetup
@@ -485,6 +524,9 @@ int SV_BotLibSetup (void)
 		return -1;
 	}
 
+	// the game doesn't know about the route table
+	botlib_export->BotLibVarSet ("routetable", Cvar_VariableString ("bot_routetable"));
+
 	return botlib_export->BotLibSetup ();
 }
 
@@ -527,6 +569,7 @@ void SV_BotInitCvars (void)
 	Cvar_Get ("bot_forcewrite", "0", 0);					//force writing aas file
 	Cvar_Get ("bot_aasoptimize", "0", 0);				//no aas file optimisation
 	Cvar_Get ("bot_saveroutingcache", "0", 0);			//save routing cache
+	Cvar_Get ("bot_routetable", "1", 0);					//use (1) or create and use (2) the route table
 	Cvar_Get ("bot_thinktime", "100", CVAR_CHEAT);		//msec the bots thinks
 	Cvar_Get ("bot_reloadcharacters", "0", 0);			//reload the bot characters each time
 	Cvar_Get ("bot_testichat", "0", 0);					//test ichats
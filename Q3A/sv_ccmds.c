@@ -817,6 +817,16 @@ void SV_AddOperatorCommands (void)
 	Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
 	Cmd_AddCommand ("map_restart", SV_MapRestart_f);
 	Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+	Cmd_AddCommand ("sv_sectorbench", SV_SectorBench_f);
+	Cmd_AddCommand ("sv_areaCacheStats", SV_AreaCacheStats_f);
+	Cmd_AddCommand ("clusterlist", SV_ClusterList_f);
+	Cmd_AddCommand ("snapshotbench", SV_SnapshotBench_f);
+	Cmd_AddCommand ("sv_deltaCacheStats", SV_DeltaCacheStats_f);
+	Cmd_AddCommand ("vmbench", SV_VMBench_f);
+	Cmd_AddCommand ("bot_routingbenchmark", SV_BotRoutingBenchmark_f);
+	Cmd_AddCommand ("bot_writeroutetable", SV_BotWriteRouteTable_f);
+	Cmd_AddCommand ("cm_tracestress", CM_TraceStress_f);
+	Cmd_AddCommand ("cm_tracebench", CM_TraceBench_f);
 	Cmd_AddCommand ("map", SV_Map_f);
 #ifndef PRE_RELEASE_DEMO
 	Cmd_AddCommand ("devmap", SV_Map_f);
@@ -1220,6 +1220,7 @@ static void SV_VerifyPaks_f (client_t *cl)
 			cl->pureAuthentic = 0;
 			cl->nextSnapshotTime = -1;
 			cl->state = CS_ACTIVE;
+			SV_PrepareSnapshotEntities ();
 			SV_SendClientSnapshot (cl);
 			SV_DropClient (cl, "Unpure client detected. Invalid .PK3 files referenced!");
 		}
@@ -419,6 +419,28 @@ int SV_GameSystemCalls (int *args)
 	case G_TRACECAPSULE:
 		SV_Trace (VMA (1), VMA (2), VMA (3), VMA (4), VMA (5), args[6], args[7], /*int capsule*/ qtrue);
 		return 0;
+	case G_TRACEBATCH:
+		{
+			int		count;
+
+			count = args[3];
+			if (count <= 0)
+				return 0;
+			if (count > MAX_TRACE_BATCH)
+			{
+				Com_DPrintf ("G_TRACEBATCH: count %i clamped to %i\n", count, MAX_TRACE_BATCH);
+				count = MAX_TRACE_BATCH;
+			}
+#if !((defined __linux__) && (defined __powerpc__))
+			if (!VM_ArgRangeValid (args[1], count * sizeof (trace_t))
+				|| !VM_ArgRangeValid (args[2], count * sizeof (traceRequest_t)))
+			{
+				Com_Error (ERR_DROP, "G_TRACEBATCH: %i traces outside the data segment", count);
+			}
+#endif
+			SV_TraceBatch (VMA (1), VMA (2), count, args[4]);
+		}
+		return 0;
 	case G_POINT_CONTENTS:
 		return SV_PointContents (VMA (1), args[2]);
 	case G_SET_BRUSH_MODEL:
@@ -511,7 +533,14 @@ int SV_GameSystemCalls (int *args)
 	case BOTLIB_START_FRAME:
 		return botlib_export->BotLibStartFrame (VMF (1));
 	case BOTLIB_LOAD_MAP:
-		return botlib_export->BotLibLoadMap (VMA (1));
+	{
+		int		result;
+
+		Com_BeginLoadStage ("bot aas");
+		result = botlib_export->BotLibLoadMap (VMA (1));
+		Com_EndLoadStage ();
+		return result;
+	}
 	case BOTLIB_UPDATENTITY:
 		return botlib_export->BotLibUpdateEntity (args[1], VMA (2));
 	case BOTLIB_TEST:
@@ -1019,3 +1048,63 @@ qboolean SV_GameCommand (void)
 	return VM_Call (gvm, GAME_CONSOLE_COMMAND);
 }
 
+
+/*
+====================
+SV_VMBench_f
+
+vmbench [frames]
+
+Runs game frames back to back and reports how fast the QVM interpreter
+gets through them.  The game is really advanced, so the level time jumps
+forward by frames * frame msec.
+====================
+*/
+void SV_VMBench_f (void)
+{
+	int					numFrames;
+	int					frame, frameMsec;
+	int					start, usec;
+	unsigned long long	instructions;
+
+	if (sv.state != SS_GAME)
+	{
+		Com_Printf ("Server is not running.\n");
+		return;
+	}
+
+	numFrames = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : 1000;
+
+	if (numFrames < 1)
+	{
+		numFrames = 1;
+	}
+
+	frameMsec = 1000 / (sv_fps->integer > 0 ? sv_fps->integer : 20);
+
+	instructions = VM_InstructionsExecuted (gvm);
+
+	start = Sys_Microseconds ();
+	for (frame = 0; frame < numFrames; frame++)
+	{
+		svs.time += frameMsec;
+		VM_Call (gvm, GAME_RUN_FRAME, svs.time);
+	}
+	usec = Sys_Microseconds () - start;
+
+	instructions = VM_InstructionsExecuted (gvm) - instructions;
+
+	if (usec < 1)
+	{
+		usec = 1;
+	}
+
+	Com_Printf ("vm bench: %i frames, %8.3f msec/frame\n", numFrames, usec / (1000.0f * numFrames));
+
+	// compiled code doesn't count
+	if (instructions)
+	{
+		Com_Printf ("%.0f instructions, %.0f instructions/frame, %.2f M instructions/sec\n",
+			(double) instructions, (double) instructions / numFrames, (double) instructions / usec);
+	}
+}
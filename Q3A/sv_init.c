@@ -410,6 +410,9 @@ void SV_SpawnServer (char *server, qboolean killBots)
 	Com_Printf ("------ Server Initialization ------\n");
 	Com_Printf ("Server: %s\n", server);
 
+	Com_ClearLoadStages ();
+	Com_BeginLoadStage ("server spawn");
+
 	// if not running a dedicated server CL_MapLoading will connect the client to the server
 	// also print some status stuff
 	CL_MapLoading ();
@@ -466,9 +469,13 @@ void SV_SpawnServer (char *server, qboolean killBots)
 	// get a new checksum feed and restart the file system
 	srand (Com_Milliseconds ());
 	sv.checksumFeed = (((int) rand () << 16) ^ rand ()) ^ Com_Milliseconds ();
+	Com_BeginLoadStage ("filesystem restart");
 	FS_Restart (sv.checksumFeed);
+	Com_EndLoadStage ();
 
+	Com_BeginLoadStage ("collision map");
 	CM_LoadMap (va ("maps/%s.bsp", server), qfalse, &checksum);
+	Com_EndLoadStage ();
 
 	// set serverinfo visible name
 	Cvar_Set ("mapname", server);
@@ -490,18 +497,22 @@ void SV_SpawnServer (char *server, qboolean killBots)
 	sv.state = SS_LOADING;
 
 	// load and spawn all other entities
+	Com_BeginLoadStage ("game init");
 	SV_InitGameProgs ();
+	Com_EndLoadStage ();
 
 	// don't allow a map_restart if game is modified
 	sv_gametype->modified = qfalse;
 
 	// run a few frames to allow everything to settle
+	Com_BeginLoadStage ("settle frames");
 	for (i = 0; i < 3; i++)
 	{
 		VM_Call (gvm, GAME_RUN_FRAME, svs.time);
 		SV_BotFrame (svs.time);
 		svs.time += 100;
 	}
+	Com_EndLoadStage ();
 
 	// create a baseline for more efficient communications
 	SV_CreateBaseline ();
@@ -616,6 +627,8 @@ void SV_SpawnServer (char *server, qboolean killBots)
 	// send a heartbeat now so the master will get up to date info
 	SV_Heartbeat_f ();
 
+	Com_EndLoadStage ();
+
 	Hunk_SetMark ();
 
 	Com_Printf ("-----------------------------------\n");
@@ -685,6 +698,9 @@ void SV_Init (void)
 	sv_mapChecksum = Cvar_Get ("sv_mapChecksum", "", CVAR_ROM);
 	sv_lanForceRate = Cvar_Get ("sv_lanForceRate", "1", CVAR_ARCHIVE);
 	sv_strictAuth = Cvar_Get ("sv_strictAuth", "1", CVAR_ARCHIVE);
+	sv_parallelSnapshots = Cvar_Get ("sv_parallelSnapshots", "1", CVAR_ARCHIVE);
+	sv_deltaCache = Cvar_Get ("sv_deltaCache", "1", CVAR_ARCHIVE);
+	sv_areaCache = Cvar_Get ("sv_areaCache", "1", CVAR_ARCHIVE);
 
 	// initialize bot cvars so they are listed and can be set before loading the botlib
 	SV_BotInitCvars ();
@@ -709,6 +725,8 @@ void SV_FinalMessage (char *message)
 	int			i, j;
 	client_t	*cl;
 
+	SV_PrepareSnapshotEntities ();
+
 	// send it twice, ignoring rate
 	for (j = 0; j < 2; j++)
 	{
@@ -52,6 +52,9 @@ cvar_t	*sv_pure;
 cvar_t	*sv_floodProtect;
 cvar_t	*sv_lanForceRate; // dedicated 1 (LAN) server forces local client rates to 99999 (bug #491)
 cvar_t	*sv_strictAuth;
+cvar_t	*sv_parallelSnapshots;	// build and encode client snapshots on the job threads
+cvar_t	*sv_deltaCache;			// share entity delta encodings between clients
+cvar_t	*sv_areaCache;			// keep area query candidates for the rest of the frame
 
 /*
 =============================================================================
@@ -177,17 +180,22 @@ A NULL client will broadcast to all clients
 void QDECL SV_SendServerCommand (client_t *cl, const char *fmt, ...)
 {
 	va_list		argptr;
-	byte		message[MAX_MSGLEN];
+	byte		*message;
 	client_t	*client;
 	int			j;
+	frameMark_t	mark;
+
+	mark = Frame_Mark ();
+	message = Frame_Alloc (MAX_MSGLEN);
 
 	va_start (argptr, fmt);
-	Q_vsnprintf ((char *) message, sizeof (message), fmt, argptr);
+	Q_vsnprintf ((char *) message, MAX_MSGLEN, fmt, argptr);
 	va_end (argptr);
 
 	if (cl != NULL)
 	{
 		SV_AddServerCommand (cl, (char *) message);
+		Frame_Release (mark);
 		return;
 	}
 
@@ -206,6 +214,8 @@ void QDECL SV_SendServerCommand (client_t *cl, const char *fmt, ...)
 		}
 		SV_AddServerCommand (client, (char *) message);
 	}
+
+	Frame_Release (mark);
 }
 
 
@@ -947,6 +957,9 @@ void SV_Frame (int msec)
 		sv.timeResidual -= frameMsec;
 		svs.time += frameMsec;
 
+		// area queries are only kept for a frame
+		SV_ClearAreaCache ();
+
 		// let everything in the world think and move
 		VM_Call (gvm, GAME_RUN_FRAME, svs.time);
 	}
@@ -45,6 +45,240 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============================================================================
+
+Delta cache
+
+Most entities go out to many clients in the same frame, and the clients that
+have acknowledged the same frame delta them from the same old state, so the
+bits MSG_WriteDeltaEntity produces for an (old state, new state) pair are
+encoded once and copied into every other message that needs them.  The keys
+are the states themselves rather than buffer slots, so an entry can never go
+stale; the cache is only cleared each frame to bound its size.
+
+Entries are filled in before they are published with a compare-exchange on
+the entity's list head and never change afterwards, so the writers on the job
+threads share the cache without locks.  Two threads missing the same pair at
+once both add it, which is harmless.
+
+=============================================================================
+*/
+
+#define	MAX_DELTA_CACHE_ENTRIES		4096
+#define	MAX_DELTA_CACHE_BYTES		0x40000
+#define	MAX_DELTA_BYTES				512			// a full entity from the baseline fits easily
+
+typedef struct
+{
+	entityState_t	from;
+	entityState_t	to;
+	qboolean		force;
+	int				numBits;
+	int				ofs;			// into deltaCache.bits
+	int				next;			// next entry for the same entity + 1, 0 at the end
+} deltaCacheEntry_t;
+
+typedef struct
+{
+	volatile int		heads[MAX_GENTITIES];	// first entry + 1, 0 if none
+	volatile int		numEntries;		// can run past MAX_DELTA_CACHE_ENTRIES once full
+	volatile int		numBytes;		// same for MAX_DELTA_CACHE_BYTES
+	volatile int		numRefused;		// adds that didn't fit
+	deltaCacheEntry_t	entries[MAX_DELTA_CACHE_ENTRIES];
+	byte				bits[MAX_DELTA_CACHE_BYTES];
+} deltaCache_t;
+
+typedef struct
+{
+	int		hits;
+	int		misses;
+	int		fallbacks;
+} deltaCacheStats_t;
+
+static deltaCache_t	sv_deltaCacheData;
+
+/*
+==================
+SV_ClearDeltaCache
+==================
+*/
+static void SV_ClearDeltaCache (void)
+{
+	deltaCache_t	*dc = &sv_deltaCacheData;
+	int				numEntries;
+
+	if (dc->numEntries)
+	{
+		sv.deltaCacheFrames++;
+
+		// refused adds still bump the counter
+		numEntries = dc->numEntries;
+		if (numEntries > MAX_DELTA_CACHE_ENTRIES)
+		{
+			numEntries = MAX_DELTA_CACHE_ENTRIES;
+		}
+		if (numEntries > sv.deltaCachePeakEntries)
+		{
+			sv.deltaCachePeakEntries = numEntries;
+		}
+	}
+
+	sv.deltaCacheRefused += dc->numRefused;
+
+	Com_Memset ((void *) dc->heads, 0, sizeof (dc->heads));
+	dc->numEntries = 0;
+	dc->numBytes = 0;
+	dc->numRefused = 0;
+}
+
+/*
+==================
+SV_AddDeltaCacheEntry
+
+The bits are copied before the entry is linked in, so a reader can't see it
+half written.  Once the cache is full the add is only counted in
+numRefused.
+==================
+*/
+static void SV_AddDeltaCacheEntry (entityState_t *from, entityState_t *to, qboolean force, const byte *bits, int numBits)
+{
+	deltaCache_t		*dc = &sv_deltaCacheData;
+	deltaCacheEntry_t	*entry;
+	int					index, ofs, bytes, head;
+
+	bytes = (numBits + 7) >> 3;
+
+	ofs = Sys_AtomicAdd (&dc->numBytes, bytes) - bytes;
+	if (ofs + bytes > MAX_DELTA_CACHE_BYTES)
+	{
+		Sys_AtomicAdd (&dc->numRefused, 1);
+		return;
+	}
+
+	index = Sys_AtomicAdd (&dc->numEntries, 1) - 1;
+	if (index >= MAX_DELTA_CACHE_ENTRIES)
+	{
+		Sys_AtomicAdd (&dc->numRefused, 1);
+		return;
+	}
+
+	entry = &dc->entries[index];
+	entry->from = *from;
+	entry->to = *to;
+	entry->force = force;
+	entry->numBits = numBits;
+	entry->ofs = ofs;
+	Com_Memcpy (dc->bits + ofs, bits, bytes);
+
+	do
+	{
+		head = dc->heads[to->number];
+		entry->next = head;
+	} while (Sys_AtomicCompareExchange (&dc->heads[to->number], index + 1, head) != head);
+}
+
+/*
+==================
+SV_WriteDeltaEntity
+
+MSG_WriteDeltaEntity through the delta cache.  Removals are only a few bits
+and go straight out, as does anything that might not fit in the message, so
+the overflow behaviour is left to the normal writes.
+==================
+*/
+static void SV_WriteDeltaEntity (msg_t *msg, entityState_t *from, entityState_t *to, qboolean force, deltaCacheStats_t *stats)
+{
+	deltaCache_t		*dc = &sv_deltaCacheData;
+	deltaCacheEntry_t	*entry;
+	byte				buf[MAX_DELTA_BYTES];
+	msg_t				delta;
+	int					index;
+
+	if (!to || !sv_deltaCache->integer || to->number < 0 || to->number >= MAX_GENTITIES)
+	{
+		MSG_WriteDeltaEntity (msg, from, to, force);
+		return;
+	}
+
+	for (index = dc->heads[to->number]; index; index = entry->next)
+	{
+		entry = &dc->entries[index - 1];
+
+		if (entry->force != force || memcmp (&entry->to, to, sizeof (*to)) || memcmp (&entry->from, from, sizeof (*from)))
+		{
+			continue;
+		}
+
+		if (MSG_WriteBitString (msg, dc->bits + entry->ofs, entry->numBits))
+		{
+			stats->hits++;
+		}
+		else
+		{
+			stats->fallbacks++;
+			MSG_WriteDeltaEntity (msg, from, to, force);
+		}
+		return;
+	}
+
+	// encode it on its own so the bits can be kept
+	MSG_Init (&delta, buf, sizeof (buf));
+	MSG_WriteDeltaEntity (&delta, from, to, force);
+
+	if (delta.overflowed)
+	{
+		stats->fallbacks++;
+		MSG_WriteDeltaEntity (msg, from, to, force);
+		return;
+	}
+
+	stats->misses++;
+	SV_AddDeltaCacheEntry (from, to, force, buf, delta.bit);
+
+	if (!MSG_WriteBitString (msg, buf, delta.bit))
+	{
+		stats->fallbacks++;
+		MSG_WriteDeltaEntity (msg, from, to, force);
+	}
+}
+
+/*
+==================
+SV_DeltaCacheStats_f
+==================
+*/
+void SV_DeltaCacheStats_f (void)
+{
+	int		total;
+
+	if (sv.state != SS_GAME)
+	{
+		Com_Printf ("Server is not running.\n");
+		return;
+	}
+
+	total = sv.deltaCacheHits + sv.deltaCacheMisses;
+
+	Com_Printf ("%i frames, %i deltas: %i hits, %i misses, %i fallbacks\n",
+		sv.deltaCacheFrames, total, sv.deltaCacheHits, sv.deltaCacheMisses, sv.deltaCacheFallbacks);
+
+	if (total)
+	{
+		Com_Printf ("%.1f%% hit rate, peak %i entries of %i, %i adds refused with the cache full\n",
+			100.0f * sv.deltaCacheHits / total, sv.deltaCachePeakEntries, MAX_DELTA_CACHE_ENTRIES,
+			sv.deltaCacheRefused);
+	}
+
+	sv.deltaCacheHits = 0;
+	sv.deltaCacheMisses = 0;
+	sv.deltaCacheFallbacks = 0;
+	sv.deltaCacheFrames = 0;
+	sv.deltaCachePeakEntries = 0;
+	sv.deltaCacheRefused = 0;
+}
+
+
 /*
 =============
 SV_EmitPacketEntities
@@ -58,6 +292,7 @@ static void SV_EmitPacketEntities (clientSnapshot_t *from, clientSnapshot_t *to,
 	int		oldindex, newindex;
 	int		oldnum, newnum;
 	int		from_num_entities;
+	deltaCacheStats_t	stats;
 
 	// generate the delta update
 	if (!from)
@@ -69,6 +304,8 @@ static void SV_EmitPacketEntities (clientSnapshot_t *from, clientSnapshot_t *to,
 		from_num_entities = from->num_entities;
 	}
 
+	Com_Memset (&stats, 0, sizeof (stats));
+
 	newent = NULL;
 	oldent = NULL;
 	newindex = 0;
@@ -100,7 +337,7 @@ static void SV_EmitPacketEntities (clientSnapshot_t *from, clientSnapshot_t *to,
 			// delta update from old position
 			// because the force parm is qfalse, this will not result
 			// in any bytes being emited if the entity has not changed at all
-			MSG_WriteDeltaEntity (msg, oldent, newent, qfalse);
+			SV_WriteDeltaEntity (msg, oldent, newent, qfalse, &stats);
 			oldindex++;
 			newindex++;
 			continue;
@@ -109,7 +346,7 @@ static void SV_EmitPacketEntities (clientSnapshot_t *from, clientSnapshot_t *to,
 		if (newnum < oldnum)
 		{
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity (msg, &sv.svEntities[newnum].baseline, newent, qtrue);
+			SV_WriteDeltaEntity (msg, &sv.svEntities[newnum].baseline, newent, qtrue, &stats);
 			newindex++;
 			continue;
 		}
@@ -124,54 +361,70 @@ static void SV_EmitPacketEntities (clientSnapshot_t *from, clientSnapshot_t *to,
 	}
 
 	MSG_WriteBits (msg, (MAX_GENTITIES - 1), GENTITYNUM_BITS);	// end of packetentities
+
+	Sys_AtomicAdd (&sv.deltaCacheHits, stats.hits);
+	Sys_AtomicAdd (&sv.deltaCacheMisses, stats.misses);
+	Sys_AtomicAdd (&sv.deltaCacheFallbacks, stats.fallbacks);
 }
 
 
 
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_SelectDeltaFrame
+
+Picks the previous frame the new snapshot will be delta compressed against
 ==================
 */
-static void SV_WriteSnapshotToClient (client_t *client, msg_t *msg)
+static void SV_SelectDeltaFrame (client_t *client, clientSnapshot_t **oldframe, int *lastframe)
 {
-	clientSnapshot_t	*frame, *oldframe;
-	int					lastframe;
-	int					i;
-	int					snapFlags;
-
-	// this is the snapshot we are creating
-	frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
-
 	// try to use a previous frame as the source for delta compressing the snapshot
 	if (client->deltaMessage <= 0 || client->state != CS_ACTIVE)
 	{
 		// client is asking for a retransmit
-		oldframe = NULL;
-		lastframe = 0;
+		*oldframe = NULL;
+		*lastframe = 0;
 	}
 	else if (client->netchan.outgoingSequence - client->deltaMessage
 		>= (PACKET_BACKUP - 3))
 	{
 		// client hasn't gotten a good message through in a long time
 		Com_DPrintf ("%s: Delta request from out of date packet.\n", client->name);
-		oldframe = NULL;
-		lastframe = 0;
+		*oldframe = NULL;
+		*lastframe = 0;
 	}
 	else
 	{
 		// we have a valid snapshot to delta from
-		oldframe = &client->frames[client->deltaMessage & PACKET_MASK];
-		lastframe = client->netchan.outgoingSequence - client->deltaMessage;
+		*oldframe = &client->frames[client->deltaMessage & PACKET_MASK];
+		*lastframe = client->netchan.outgoingSequence - client->deltaMessage;
 
 		// the snapshot's entities may still have rolled off the buffer, though
-		if (oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities)
+		if ((*oldframe)->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities)
 		{
 			Com_DPrintf ("%s: Delta request from out of date entities.\n", client->name);
-			oldframe = NULL;
-			lastframe = 0;
+			*oldframe = NULL;
+			*lastframe = 0;
 		}
 	}
+}
+
+
+/*
+==================
+SV_WriteSnapshotToClient
+
+Safe to run on a job thread once the delta frame has been selected
+==================
+*/
+static void SV_WriteSnapshotToClient (client_t *client, msg_t *msg, clientSnapshot_t *oldframe, int lastframe)
+{
+	clientSnapshot_t	*frame;
+	int					i;
+	int					snapFlags;
+
+	// this is the snapshot we are creating
+	frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
 
 	MSG_WriteByte (msg, svc_snapshot);
 
@@ -260,31 +513,63 @@ typedef struct
 {
 	int		numSnapshotEntities;
 	int		snapshotEntities[MAX_SNAPSHOT_ENTITIES];
+
+	// entities already considered for this snapshot, so portal views can't
+	// add them twice.  this is per snapshot rather than stamped into the
+	// svEntity_t so several snapshots can be built at the same time
+	byte	added[MAX_GENTITIES / 8];
+
+	// the subset of added that fit and will be sent
+	byte	visible[MAX_GENTITIES / 8];
+
+	// entities that got past the cluster index, for clusterlist
+	int		numCandidates;
+
+	// jobs can't Com_Error, so problems are reported after the build
+	const char	*error;
 } snapshotEntityNumbers_t;
 
+
 /*
-=======================
-SV_QsortEntityNumbers
-=======================
+===============
+SV_GatherSnapshotCandidates
+
+Unions the entity sets of every cluster in the pvs.  Any entity that can
+pass the visibility tests in SV_AddEntitiesVisibleFromPoint is in the
+result, so only those need to be looked at.
+===============
 */
-static int QDECL SV_QsortEntityNumbers (const void *a, const void *b)
+static void SV_GatherSnapshotCandidates (const byte *pvs, unsigned *candidates)
 {
-	int	*ea, *eb;
+	int			i, j, c;
+	int			numBytes;
+	unsigned	*set;
 
-	ea = (int *) a;
-	eb = (int *) b;
+	Com_Memcpy (candidates, sv.snapshotAlwaysCandidates, sizeof (sv.snapshotAlwaysCandidates));
 
-	if (*ea == *eb)
-	{
-		Com_Error (ERR_DROP, "SV_QsortEntityStates: duplicated entity");
-	}
+	numBytes = (sv.numEntityClusters + 7) >> 3;
 
-	if (*ea < *eb)
+	for (i = 0; i < numBytes; i++)
 	{
-		return -1;
-	}
+		if (!pvs[i])
+		{
+			continue;
+		}
+
+		for (c = i << 3; c < (i << 3) + 8 && c < sv.numEntityClusters; c++)
+		{
+			if (!(pvs[i] & (1 << (c & 7))) || !sv.clusterEntityCounts[c])
+			{
+				continue;
+			}
 
-	return 1;
+			set = sv.clusterEntities[c];
+			for (j = 0; j < MAX_GENTITIES / 32; j++)
+			{
+				candidates[j] |= set[j];
+			}
+		}
+	}
 }
 
 
@@ -293,14 +578,16 @@ static int QDECL SV_QsortEntityNumbers (const void *a, const void *b)
 SV_AddEntToSnapshot
 ===============
 */
-static void SV_AddEntToSnapshot (svEntity_t *svEnt, sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums)
+static void SV_AddEntToSnapshot (sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums)
 {
+	int		num = gEnt->s.number;
+
 	// if we have already added this entity to this snapshot, don't add again
-	if (svEnt->snapshotCounter == sv.snapshotCounter)
+	if (eNums->added[num >> 3] & (1 << (num & 7)))
 	{
 		return;
 	}
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[num >> 3] |= (1 << (num & 7));
 
 	// if we are full, silently discard entities
 	if (eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES)
@@ -308,7 +595,7 @@ static void SV_AddEntToSnapshot (svEntity_t *svEnt, sharedEntity_t *gEnt, snapsh
 		return;
 	}
 
-	eNums->snapshotEntities[eNums->numSnapshotEntities] = gEnt->s.number;
+	eNums->visible[num >> 3] |= (1 << (num & 7));
 	eNums->numSnapshotEntities++;
 }
 
@@ -329,6 +616,7 @@ static void SV_AddEntitiesVisibleFromPoint (vec3_t origin, clientSnapshot_t *fra
 	int		c_fullsend;
 	byte	*clientpvs;
 	byte	*bitvector;
+	unsigned	candidates[MAX_GENTITIES / 32];
 
 	// during an error shutdown message we may need to transmit
 	// the shutdown message after the server has shutdown, so
@@ -347,10 +635,25 @@ static void SV_AddEntitiesVisibleFromPoint (vec3_t origin, clientSnapshot_t *fra
 
 	clientpvs = CM_ClusterPVS (clientcluster);
 
+	SV_GatherSnapshotCandidates (clientpvs, candidates);
+
 	c_fullsend = 0;
 
 	for (e = 0; e < sv.num_entities; e++)
 	{
+		// skip anything not linked into a visible cluster
+		if (!candidates[e >> 5])
+		{
+			e |= 31;
+			continue;
+		}
+		if (!(candidates[e >> 5] & (1 << (e & 31))))
+		{
+			continue;
+		}
+
+		eNums->numCandidates++;
+
 		ent = SV_GentityNum (e);
 
 		// never send entities that aren't linked in
@@ -359,12 +662,6 @@ static void SV_AddEntitiesVisibleFromPoint (vec3_t origin, clientSnapshot_t *fra
 			continue;
 		}
 
-		if (ent->s.number != e)
-		{
-			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
-			ent->s.number = e;
-		}
-
 		// entities can be flagged to explicitly not be sent to the client
 		if (ent->r.svFlags & SVF_NOCLIENT)
 		{
@@ -391,7 +688,10 @@ static void SV_AddEntitiesVisibleFromPoint (vec3_t origin, clientSnapshot_t *fra
 		if (ent->r.svFlags & SVF_CLIENTMASK)
 		{
 			if (frame->ps.clientNum >= 32)
-				Com_Error (ERR_DROP, "SVF_CLIENTMASK: cientNum > 32\n");
+			{
+				eNums->error = "SVF_CLIENTMASK: cientNum > 32\n";
+				return;
+			}
 			if (~ent->r.singleClient & (1 << frame->ps.clientNum))
 				continue;
 		}
@@ -399,7 +699,7 @@ static void SV_AddEntitiesVisibleFromPoint (vec3_t origin, clientSnapshot_t *fra
 		svEnt = SV_SvEntityForGentity (ent);
 
 		// don't double add an entity through portals
-		if (svEnt->snapshotCounter == sv.snapshotCounter)
+		if (eNums->added[e >> 3] & (1 << (e & 7)))
 		{
 			continue;
 		}
@@ -407,7 +707,7 @@ static void SV_AddEntitiesVisibleFromPoint (vec3_t origin, clientSnapshot_t *fra
 		// broadcast entities are always sent
 		if (ent->r.svFlags & SVF_BROADCAST)
 		{
-			SV_AddEntToSnapshot (svEnt, ent, eNums);
+			SV_AddEntToSnapshot (ent, eNums);
 			continue;
 		}
 
@@ -465,7 +765,7 @@ static void SV_AddEntitiesVisibleFromPoint (vec3_t origin, clientSnapshot_t *fra
 		}
 
 		// add it
-		SV_AddEntToSnapshot (svEnt, ent, eNums);
+		SV_AddEntToSnapshot (ent, eNums);
 
 		// if its a portal entity, add everything visible from its camera position
 		if (ent->r.svFlags & SVF_PORTAL)
@@ -480,6 +780,11 @@ static void SV_AddEntitiesVisibleFromPoint (vec3_t origin, clientSnapshot_t *fra
 				}
 			}
 			SV_AddEntitiesVisibleFromPoint (ent->s.origin2, frame, eNums, qtrue);
+
+			if (eNums->error)
+			{
+				return;
+			}
 		}
 
 	}
@@ -487,7 +792,118 @@ static void SV_AddEntitiesVisibleFromPoint (vec3_t origin, clientSnapshot_t *fra
 
 /*
 =============
-SV_BuildClientSnapshot
+SV_PrepareSnapshotEntities
+
+Done once before any snapshots are built, by whoever calls
+SV_SendClientSnapshot or SV_SendClientSnapshots.
+
+The game should always keep s.number in step with the entity slot, but
+the snapshot code depends on it, so make sure.
+
+Also collects the entities that can't be found through the cluster index.
+=============
+*/
+void SV_PrepareSnapshotEntities (void)
+{
+	int				e;
+	sharedEntity_t	*ent;
+	svEntity_t		*svEnt;
+
+	Com_Memset (sv.snapshotAlwaysCandidates, 0, sizeof (sv.snapshotAlwaysCandidates));
+
+	for (e = 0; e < sv.num_entities; e++)
+	{
+		ent = SV_GentityNum (e);
+
+		if (!ent->r.linked)
+		{
+			continue;
+		}
+
+		if (ent->s.number != e)
+		{
+			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
+			ent->s.number = e;
+		}
+
+		svEnt = &sv.svEntities[e];
+
+		if ((ent->r.svFlags & SVF_BROADCAST) || svEnt->lastCluster)
+		{
+			sv.snapshotAlwaysCandidates[e >> 5] |= (1 << (e & 31));
+		}
+	}
+}
+
+/*
+=============
+SV_BeginEntityNumbers
+=============
+*/
+static void SV_BeginEntityNumbers (snapshotEntityNumbers_t *eNums)
+{
+	eNums->numSnapshotEntities = 0;
+	eNums->numCandidates = 0;
+	eNums->error = NULL;
+	Com_Memset (eNums->added, 0, sizeof (eNums->added));
+	Com_Memset (eNums->visible, 0, sizeof (eNums->visible));
+}
+
+/*
+=============
+SV_EndEntityNumbers
+
+Turns the visible bits into the list of entity numbers, which comes out in
+increasing order as the delta compression needs, even when portals added
+entities out of order
+=============
+*/
+static void SV_EndEntityNumbers (snapshotEntityNumbers_t *eNums)
+{
+	int		i, bits, e;
+	int		count;
+
+	count = 0;
+	for (i = 0; i < MAX_GENTITIES / 8; i++)
+	{
+		if (!(bits = eNums->visible[i]))
+		{
+			continue;
+		}
+
+		for (e = i << 3; bits; bits >>= 1, e++)
+		{
+			if (bits & 1)
+			{
+				eNums->snapshotEntities[count++] = e;
+			}
+		}
+	}
+
+	eNums->numSnapshotEntities = count;
+}
+
+/*
+=============
+SV_FinishAreaBits
+
+now that all viewpoint's areabits have been OR'd together, invert
+all of them to make it a mask vector, which is what the renderer wants
+=============
+*/
+static void SV_FinishAreaBits (clientSnapshot_t *frame)
+{
+	int		i;
+
+	for (i = 0; i < MAX_MAP_AREA_BYTES / 4; i++)
+	{
+		((int *) frame->areabits)[i] = ((int *) frame->areabits)[i] ^ -1;
+	}
+}
+
+/*
+=============
+SV_CullClientSnapshot
 
 Decides which entities are going to be visible to the client, and
 copies off the playerstate and areabits.
@@ -496,29 +912,24 @@ This properly handles multiple recursive portals, but the render
 currently doesn't.
 
 For viewing through other player's eyes, clent can be something other than client->gentity
+
+This only touches the client's own frame and eNums, so snapshots for
+different clients can be culled at the same time on the job threads
 =============
 */
-static void SV_BuildClientSnapshot (client_t *client)
+static void SV_CullClientSnapshot (client_t *client, snapshotEntityNumbers_t *eNums)
 {
 	vec3_t						org;
 	clientSnapshot_t			*frame;
-	snapshotEntityNumbers_t		entityNumbers;
-	int							i;
-	sharedEntity_t				*ent;
-	entityState_t				*state;
-	svEntity_t					*svEnt;
 	sharedEntity_t				*clent;
 	int							clientNum;
 	playerState_t				*ps;
 
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
-
 	// this is the frame we are creating
 	frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
 
 	// clear everything in this snapshot
-	entityNumbers.numSnapshotEntities = 0;
+	SV_BeginEntityNumbers (eNums);
 	Com_Memset (frame->areabits, 0, sizeof (frame->areabits));
 
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=62
@@ -539,11 +950,11 @@ static void SV_BuildClientSnapshot (client_t *client)
 	clientNum = frame->ps.clientNum;
 	if (clientNum < 0 || clientNum >= MAX_GENTITIES)
 	{
-		Com_Error (ERR_DROP, "SV_SvEntityForGentity: bad gEnt");
+		eNums->error = "SV_SvEntityForGentity: bad gEnt";
+		return;
 	}
-	svEnt = &sv.svEntities[clientNum];
 
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[clientNum >> 3] |= (1 << (clientNum & 7));
 
 	// find the client's viewpoint
 	VectorCopy (ps->origin, org);
@@ -551,28 +962,51 @@ static void SV_BuildClientSnapshot (client_t *client)
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	SV_AddEntitiesVisibleFromPoint (org, frame, &entityNumbers, qfalse);
+	SV_AddEntitiesVisibleFromPoint (org, frame, eNums, qfalse);
 
-	// if there were portals visible, there may be out of order entities
-	// in the list which will need to be resorted for the delta compression
-	// to work correctly.  This also catches the error condition
-	// of an entity being included twice.
-	qsort (entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities,
-		sizeof (entityNumbers.snapshotEntities[0]), SV_QsortEntityNumbers);
+	SV_EndEntityNumbers (eNums);
 
-	// now that all viewpoint's areabits have been OR'd together, invert
-	// all of them to make it a mask vector, which is what the renderer wants
-	for (i = 0; i < MAX_MAP_AREA_BYTES / 4; i++)
+	SV_FinishAreaBits (frame);
+}
+
+/*
+=============
+SV_CopySnapshotEntities
+
+Copies the visible entity states into the circular snapshot entity buffer.
+This must be done one client at a time, in client order.
+=============
+*/
+static void SV_CopySnapshotEntities (client_t *client, snapshotEntityNumbers_t *eNums)
+{
+	clientSnapshot_t			*frame;
+	int							i;
+	sharedEntity_t				*ent;
+	entityState_t				*state;
+
+	if (eNums->error)
 	{
-		((int *) frame->areabits)[i] = ((int *) frame->areabits)[i] ^ -1;
+		Com_Error (ERR_DROP, "%s", eNums->error);
 	}
 
+	// the frame was left empty
+	if (!client->gentity || client->state == CS_ZOMBIE)
+	{
+		return;
+	}
+
+	sv.snapshotsCulled++;
+	sv.snapshotCandidates += eNums->numCandidates;
+	sv.snapshotEntitiesSent += eNums->numSnapshotEntities;
+
+	frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
+
 	// copy the entity states out
 	frame->num_entities = 0;
 	frame->first_entity = svs.nextSnapshotEntities;
-	for (i = 0; i < entityNumbers.numSnapshotEntities; i++)
+	for (i = 0; i < eNums->numSnapshotEntities; i++)
 	{
-		ent = SV_GentityNum (entityNumbers.snapshotEntities[i]);
+		ent = SV_GentityNum (eNums->snapshotEntities[i]);
 		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
 		*state = ent->s;
 		svs.nextSnapshotEntities++;
@@ -585,6 +1019,25 @@ static void SV_BuildClientSnapshot (client_t *client)
 	}
 }
 
+/*
+=============
+SV_BuildClientSnapshot
+=============
+*/
+static void SV_BuildClientSnapshot (client_t *client)
+{
+	snapshotEntityNumbers_t		*entityNumbers;
+	frameMark_t					mark;
+
+	mark = Frame_Mark ();
+	entityNumbers = Frame_Alloc (sizeof (*entityNumbers));
+
+	SV_CullClientSnapshot (client, entityNumbers);
+	SV_CopySnapshotEntities (client, entityNumbers);
+
+	Frame_Release (mark);
+}
+
 
 /*
 ====================
@@ -682,18 +1135,64 @@ void SV_SendMessageToClient (msg_t *msg, client_t *client)
 }
 
 
+/*
+=======================
+SV_BeginClientMessage
+=======================
+*/
+static void SV_BeginClientMessage (client_t *client, msg_t *msg, byte *buf, int size)
+{
+	MSG_Init (msg, buf, size);
+	msg->allowoverflow = qtrue;
+
+	// NOTE, MRE: all server->client messages now acknowledge
+	// let the client know which reliable clientCommands we have received
+	MSG_WriteLong (msg, client->lastClientCommand);
+
+	// (re)send any reliable server commands
+	SV_UpdateServerCommandsToClient (client, msg);
+}
+
+
+/*
+=======================
+SV_EndClientMessage
+=======================
+*/
+static void SV_EndClientMessage (client_t *client, msg_t *msg)
+{
+	// Add any download data if the client is downloading
+	SV_WriteDownloadToClient (client, msg);
+
+	// check for overflow
+	if (msg->overflowed)
+	{
+		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
+		MSG_Clear (msg);
+	}
+
+	SV_SendMessageToClient (msg, client);
+}
+
+
 /*
 =======================
 SV_SendClientSnapshot
 
 Also called by SV_FinalMessage
 
+SV_PrepareSnapshotEntities must have been run since the game last moved
+anything
+
 =======================
 */
 void SV_SendClientSnapshot (client_t *client)
 {
-	byte		msg_buf[MAX_MSGLEN];
-	msg_t		msg;
+	byte				*msg_buf;
+	msg_t				msg;
+	clientSnapshot_t	*oldframe;
+	int					lastframe;
+	frameMark_t			mark;
 
 	// build the snapshot
 	SV_BuildClientSnapshot (client);
@@ -705,31 +1204,175 @@ void SV_SendClientSnapshot (client_t *client)
 		return;
 	}
 
-	MSG_Init (&msg, msg_buf, sizeof (msg_buf));
-	msg.allowoverflow = qtrue;
-
-	// NOTE, MRE: all server->client messages now acknowledge
-	// let the client know which reliable clientCommands we have received
-	MSG_WriteLong (&msg, client->lastClientCommand);
+	mark = Frame_Mark ();
+	msg_buf = Frame_Alloc (MAX_MSGLEN);
 
-	// (re)send any reliable server commands
-	SV_UpdateServerCommandsToClient (client, &msg);
+	SV_BeginClientMessage (client, &msg, msg_buf, MAX_MSGLEN);
 
 	// send over all the relevant entityState_t
 	// and the playerState_t
-	SV_WriteSnapshotToClient (client, &msg);
+	SV_SelectDeltaFrame (client, &oldframe, &lastframe);
+	SV_WriteSnapshotToClient (client, &msg, oldframe, lastframe);
 
-	// Add any download data if the client is downloading
-	SV_WriteDownloadToClient (client, &msg);
+	SV_EndClientMessage (client, &msg);
 
-	// check for overflow
-	if (msg.overflowed)
+	Frame_Release (mark);
+}
+
+
+/*
+=============================================================================
+
+Parallel snapshots
+
+The culling and the delta encoding for each client only read the world and
+write to that client's own frame and message, so they run on the job threads.
+Everything with an ordering dependency - copying states into the shared
+snapshot entity buffer, reliable commands, downloads and the netchan - stays
+on the main thread in client order, so the messages come out exactly as the
+serial path would have written them.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	client_t				*client;
+	snapshotEntityNumbers_t	entityNumbers;
+
+	clientSnapshot_t		*oldframe;
+	int						lastframe;
+	qboolean				deferred;		// snapshot is written on the job threads
+
+	msg_t					msg;
+	byte					msgBuf[MAX_MSGLEN];
+} snapshotJob_t;
+
+static snapshotJob_t	sv_snapshotJobs[MAX_CLIENTS];
+static snapshotJob_t	*sv_deferredJobs[MAX_CLIENTS];
+
+/*
+=======================
+SV_CullSnapshotJob
+=======================
+*/
+static void SV_CullSnapshotJob (void *data, int index)
+{
+	snapshotJob_t	*job = &((snapshotJob_t *) data)[index];
+
+	SV_CullClientSnapshot (job->client, &job->entityNumbers);
+}
+
+
+/*
+=======================
+SV_WriteSnapshotJob
+=======================
+*/
+static void SV_WriteSnapshotJob (void *data, int index)
+{
+	snapshotJob_t	*job = ((snapshotJob_t **) data)[index];
+
+	SV_WriteSnapshotToClient (job->client, &job->msg, job->oldframe, job->lastframe);
+}
+
+
+/*
+=======================
+SV_SnapshotCanBeDeferred
+
+Writing the snapshot is put off until every client has copied its entities,
+so make sure none of the states it reads can have been overwritten by then
+=======================
+*/
+static qboolean SV_SnapshotCanBeDeferred (snapshotJob_t *job, int finalSnapshotEntities)
+{
+	clientSnapshot_t	*frame;
+	int					oldest;
+
+	frame = &job->client->frames[job->client->netchan.outgoingSequence & PACKET_MASK];
+	oldest = finalSnapshotEntities - svs.numSnapshotEntities;
+
+	if (frame->num_entities && frame->first_entity < oldest)
 	{
-		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		MSG_Clear (&msg);
+		return qfalse;
 	}
 
-	SV_SendMessageToClient (&msg, client);
+	if (job->oldframe && job->oldframe->num_entities && job->oldframe->first_entity < oldest)
+	{
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+
+/*
+=======================
+SV_SendClientSnapshots
+=======================
+*/
+static void SV_SendClientSnapshots (snapshotJob_t *jobs, int numJobs)
+{
+	int				i;
+	int				numDeferred;
+	int				finalSnapshotEntities;
+	snapshotJob_t	*job;
+	client_t		*c;
+
+	SV_PrepareSnapshotEntities ();
+
+	Sys_RunJobs (SV_CullSnapshotJob, jobs, numJobs);
+
+	// where the snapshot entity buffer will be once everyone has copied
+	finalSnapshotEntities = svs.nextSnapshotEntities;
+	for (i = 0; i < numJobs; i++)
+	{
+		finalSnapshotEntities += jobs[i].entityNumbers.numSnapshotEntities;
+	}
+
+	numDeferred = 0;
+	for (i = 0, job = jobs; i < numJobs; i++, job++)
+	{
+		c = job->client;
+		job->deferred = qfalse;
+
+		SV_CopySnapshotEntities (c, &job->entityNumbers);
+
+		// bots need to have their snapshots build, but
+		// the query them directly without needing to be sent
+		if (c->gentity && c->gentity->r.svFlags & SVF_BOT)
+		{
+			continue;
+		}
+
+		SV_BeginClientMessage (c, &job->msg, job->msgBuf, sizeof (job->msgBuf));
+		SV_SelectDeltaFrame (c, &job->oldframe, &job->lastframe);
+
+		if (SV_SnapshotCanBeDeferred (job, finalSnapshotEntities))
+		{
+			job->deferred = qtrue;
+			sv_deferredJobs[numDeferred++] = job;
+		}
+		else
+		{
+			SV_WriteSnapshotToClient (c, &job->msg, job->oldframe, job->lastframe);
+		}
+	}
+
+	Sys_RunJobs (SV_WriteSnapshotJob, sv_deferredJobs, numDeferred);
+
+	for (i = 0, job = jobs; i < numJobs; i++, job++)
+	{
+		c = job->client;
+
+		if (c->gentity && c->gentity->r.svFlags & SVF_BOT)
+		{
+			continue;
+		}
+
+		SV_EndClientMessage (c, &job->msg);
+	}
 }
 
 
@@ -741,8 +1384,15 @@ SV_SendClientMessages
 void SV_SendClientMessages (void)
 {
 	int			i;
+	int			numJobs;
+	qboolean	prepared;
 	client_t	*c;
 
+	SV_ClearDeltaCache ();
+
+	numJobs = 0;
+	prepared = qfalse;
+
 	// send a message to each connected client
 	for (i = 0, c = svs.clients; i < sv_maxclients->integer; i++, c++)
 	{
@@ -767,7 +1417,190 @@ void SV_SendClientMessages (void)
 		}
 
 		// generate and send a new message
-		SV_SendClientSnapshot (c);
+		if (sv_parallelSnapshots->integer)
+		{
+			sv_snapshotJobs[numJobs++].client = c;
+		}
+		else
+		{
+			if (!prepared)
+			{
+				SV_PrepareSnapshotEntities ();
+				prepared = qtrue;
+			}
+			SV_SendClientSnapshot (c);
+		}
+	}
+
+	if (numJobs)
+	{
+		SV_SendClientSnapshots (sv_snapshotJobs, numJobs);
+	}
+}
+
+
+/*
+=============================================================================
+
+Snapshot benchmark
+
+Builds and encodes full snapshots for a number of synthetic clients placed at
+the entities of the running map, so culling and encoding cost can be
+measured against the thread count without any real clients connected.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	vec3_t					origin;
+	int						clientNum;
+	clientSnapshot_t		frame;
+	snapshotEntityNumbers_t	entityNumbers;
+	entityDelta_t			deltas[MAX_SNAPSHOT_ENTITIES];
+	msg_t					msg;
+} benchClient_t;
+
+static benchClient_t	sv_benchClients[MAX_CLIENTS];
+
+/*
+=======================
+SV_SnapshotBenchJob
+=======================
+*/
+static void SV_SnapshotBenchJob (void *data, int index)
+{
+	benchClient_t	*bc = &((benchClient_t *) data)[index];
+	sharedEntity_t	*ent;
+	int				i, num;
+
+	SV_BeginEntityNumbers (&bc->entityNumbers);
+	Com_Memset (bc->frame.areabits, 0, sizeof (bc->frame.areabits));
+	bc->frame.ps.clientNum = bc->clientNum;
+
+	SV_AddEntitiesVisibleFromPoint (bc->origin, &bc->frame, &bc->entityNumbers, qfalse);
+	SV_EndEntityNumbers (&bc->entityNumbers);
+	SV_FinishAreaBits (&bc->frame);
+
+	// encode everything from the baselines, as for a client without a delta frame
+	MSG_Init (&bc->msg, sv_snapshotJobs[index].msgBuf, sizeof (sv_snapshotJobs[index].msgBuf));
+	bc->msg.allowoverflow = qtrue;
+
+	MSG_WriteByte (&bc->msg, bc->frame.areabytes);
+	MSG_WriteData (&bc->msg, bc->frame.areabits, bc->frame.areabytes);
+
+	for (i = 0; i < bc->entityNumbers.numSnapshotEntities; i++)
+	{
+		num = bc->entityNumbers.snapshotEntities[i];
+		ent = SV_GentityNum (num);
+		bc->deltas[i].from = &sv.svEntities[num].baseline;
+		bc->deltas[i].to = &ent->s;
+		bc->deltas[i].force = qtrue;
 	}
+	MSG_WriteDeltaEntities (&bc->msg, bc->deltas, bc->entityNumbers.numSnapshotEntities);
+
+	MSG_WriteBits (&bc->msg, (MAX_GENTITIES - 1), GENTITYNUM_BITS);
 }
 
+
+/*
+=======================
+SV_SnapshotBench_f
+
+snapshotbench [clients] [frames]
+=======================
+*/
+void SV_SnapshotBench_f (void)
+{
+	int				numClients, numFrames;
+	int				i, e, frame;
+	int				threads, maxThreads;
+	int				start, usec;
+	unsigned		checksum;
+	sharedEntity_t	*ent;
+	benchClient_t	*bc;
+
+	if (sv.state != SS_GAME)
+	{
+		Com_Printf ("Server is not running.\n");
+		return;
+	}
+
+	numClients = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : 32;
+	numFrames = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 100;
+
+	if (numClients < 1)
+	{
+		numClients = 1;
+	}
+	else if (numClients > MAX_CLIENTS)
+	{
+		numClients = MAX_CLIENTS;
+	}
+
+	if (numFrames < 1)
+	{
+		numFrames = 1;
+	}
+
+	SV_PrepareSnapshotEntities ();
+
+	// spread the viewpoints over whatever is linked into the world
+	Com_Memset (sv_benchClients, 0, sizeof (sv_benchClients));
+	for (i = 0, e = 0; i < numClients; i++)
+	{
+		bc = &sv_benchClients[i];
+		bc->clientNum = i & 31;
+
+		for (; e < sv.num_entities * 2; e++)
+		{
+			ent = SV_GentityNum (e % sv.num_entities);
+
+			if (ent->r.linked && !(ent->r.svFlags & SVF_NOCLIENT) && ent->s.number)
+			{
+				VectorCopy (ent->r.currentOrigin, bc->origin);
+				bc->origin[2] += DEFAULT_VIEWHEIGHT;
+				e++;
+				break;
+			}
+		}
+	}
+
+	Com_Printf ("snapshot bench: %i clients, %i frames, %i entities\n", numClients, numFrames, sv.num_entities);
+
+	maxThreads = Sys_NumJobThreads ();
+
+	for (threads = 1; ; threads *= 2)
+	{
+		if (threads > maxThreads)
+		{
+			threads = maxThreads;
+		}
+
+		Sys_SetJobThreadLimit (threads);
+
+		start = Sys_Microseconds ();
+		for (frame = 0; frame < numFrames; frame++)
+		{
+			Sys_RunJobs (SV_SnapshotBenchJob, sv_benchClients, numClients);
+		}
+		usec = Sys_Microseconds () - start;
+
+		// the output must not depend on the thread count
+		checksum = 0;
+		for (i = 0; i < numClients; i++)
+		{
+			bc = &sv_benchClients[i];
+			checksum = checksum * 31 + Com_BlockChecksum (bc->msg.data, bc->msg.cursize);
+		}
+
+		Com_Printf ("%2i threads: %8.3f msec/frame  checksum %08x\n", threads, usec / (1000.0f * numFrames), checksum);
+
+		if (threads == maxThreads)
+		{
+			break;
+		}
+	}
+
+	Sys_SetJobThreadLimit (0);
+}
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // world.c -- world query functions
 
 #include "server.h"
+#include <emmintrin.h>
 
 /*
 ================
@@ -57,26 +58,237 @@ clipHandle_t SV_ClipHandleForEntity (const sharedEntity_t *ent)
 ENTITY CHECKING
 
 To avoid linearly searching through lists of entities during environment testing,
-the world is carved up with an evenly spaced, axially aligned bsp tree.  Entities
-are kept in chains either at the final leafs, or at the first node that splits
-them, which prevents having to deal with multiple fragments of a single entity.
+the world is covered with loose grids of doubling cell sizes, hashed so only the
+occupied cells cost memory.  Each entity goes in the grid whose cells are at least
+its size, in the cell holding its center, and never overlaps more than half a cell
+past it, so an area query only has to visit the cells within half a cell of the
+area on each grid.  The cells keep their entities' bounds packed four to a block so
+they can be tested four at a time, and an entity is relinked by swapping the last
+entry of its cell into its place.
 
 ===============================================================================
 */
 
+#define	SECTOR_CELL_SIZE	128		// cell size of the finest grid
+#define	SECTOR_LEVELS		10		// each doubling the cell size
+#define	SECTOR_HASH			1024	// cells of each grid share this many sectors
+#define	SECTOR_BLOCK		4
+
+typedef struct worldBlock_s
+{
+	float	bounds[6][SECTOR_BLOCK];	// absmin x, y, z then absmax x, y, z
+	int		entityNums[SECTOR_BLOCK];
+	struct worldBlock_s	*next;
+} worldBlock_t;
+
 typedef struct worldSector_s
 {
-	int		axis;		// -1 = leaf node
-	float	dist;
-	struct worldSector_s	*children[2];
-	svEntity_t	*entities;
+	worldBlock_t	*blocks;		// only the first block can be partly filled
+	int				count;
 } worldSector_t;
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	64
+typedef struct
+{
+	worldSector_t	*sector;		// NULL if not linked
+	worldBlock_t	*block;
+	int				slot;
+	int				level;
+} worldLink_t;
+
+typedef struct
+{
+	vec3_t			origin;			// the cells count from here
+	int				numLevels;		// grids the map size needs
+	int				levelCounts[SECTOR_LEVELS + 1];
+	worldSector_t	sectors[SECTOR_LEVELS][SECTOR_HASH];
+	worldSector_t	oversize;		// anything bigger than the coarsest grid's cells
+	worldBlock_t	blocks[MAX_GENTITIES];
+	worldBlock_t	*freeBlocks;
+	worldLink_t		links[MAX_GENTITIES];
+} worldIndex_t;
+
+static worldIndex_t	sv_worldIndex;
+
+
+/*
+===============
+SV_InitWorldIndex
+
+Sizes the grids for a map with the given bounds
+===============
+*/
+static void SV_InitWorldIndex (worldIndex_t *wi, const vec3_t mins, const vec3_t maxs)
+{
+	int		i;
+	float	size;
+
+	Com_Memset (wi, 0, sizeof (*wi));
+
+	VectorCopy (mins, wi->origin);
+
+	size = maxs[0] - mins[0];
+	if (maxs[1] - mins[1] > size)
+	{
+		size = maxs[1] - mins[1];
+	}
+	if (maxs[2] - mins[2] > size)
+	{
+		size = maxs[2] - mins[2];
+	}
+
+	// the coarsest grid needs cells about the size of the map
+	wi->numLevels = 1;
+	while (wi->numLevels < SECTOR_LEVELS && (SECTOR_CELL_SIZE << (wi->numLevels - 1)) < size)
+	{
+		wi->numLevels++;
+	}
+
+	for (i = 0; i < MAX_GENTITIES - 1; i++)
+	{
+		wi->blocks[i].next = &wi->blocks[i + 1];
+	}
+	wi->freeBlocks = wi->blocks;
+}
+
+/*
+===============
+SV_SectorHash
+===============
+*/
+static int SV_SectorHash (int x, int y, int z)
+{
+	return ((x * 73856093) ^ (y * 19349663) ^ (z * 83492791)) & (SECTOR_HASH - 1);
+}
+
+/*
+===============
+SV_IndexUnlink
 
-worldSector_t	sv_worldSectors[AREA_NODES];
-int			sv_numworldSectors;
+Returns qfalse if the entity wasn't linked
+===============
+*/
+static qboolean SV_IndexUnlink (worldIndex_t *wi, int num)
+{
+	worldLink_t		*link;
+	worldSector_t	*sector;
+	worldBlock_t	*last;
+	int				lastSlot, lastNum;
+	int				i;
+
+	link = &wi->links[num];
+	sector = link->sector;
+	if (!sector)
+	{
+		return qfalse;
+	}
+
+	// move the sector's last entity into the hole
+	last = sector->blocks;
+	lastSlot = (sector->count - 1) % SECTOR_BLOCK;
+	lastNum = last->entityNums[lastSlot];
+
+	if (lastNum != num)
+	{
+		for (i = 0; i < 6; i++)
+		{
+			link->block->bounds[i][link->slot] = last->bounds[i][lastSlot];
+		}
+		link->block->entityNums[link->slot] = lastNum;
+
+		wi->links[lastNum].block = link->block;
+		wi->links[lastNum].slot = link->slot;
+	}
+
+	sector->count--;
+	if (!lastSlot)
+	{
+		sector->blocks = last->next;
+		last->next = wi->freeBlocks;
+		wi->freeBlocks = last;
+	}
+
+	wi->levelCounts[link->level]--;
+	link->sector = NULL;
+
+	return qtrue;
+}
+
+/*
+===============
+SV_IndexLink
+===============
+*/
+static void SV_IndexLink (worldIndex_t *wi, int num, const vec3_t absmin, const vec3_t absmax)
+{
+	worldLink_t		*link;
+	worldSector_t	*sector;
+	worldBlock_t	*block;
+	int				level, slot;
+	int				i, cell[3];
+	float			size, cellSize;
+
+	SV_IndexUnlink (wi, num);
+
+	size = absmax[0] - absmin[0];
+	if (absmax[1] - absmin[1] > size)
+	{
+		size = absmax[1] - absmin[1];
+	}
+	if (absmax[2] - absmin[2] > size)
+	{
+		size = absmax[2] - absmin[2];
+	}
+
+	// the finest grid with cells at least the entity's size
+	for (level = 0; level < wi->numLevels; level++)
+	{
+		if (size <= (SECTOR_CELL_SIZE << level))
+		{
+			break;
+		}
+	}
+
+	if (level == wi->numLevels)
+	{
+		sector = &wi->oversize;
+		level = SECTOR_LEVELS;
+	}
+	else
+	{
+		cellSize = SECTOR_CELL_SIZE << level;
+		for (i = 0; i < 3; i++)
+		{
+			cell[i] = (int) floor ((0.5f * (absmin[i] + absmax[i]) - wi->origin[i]) / cellSize);
+		}
+		sector = &wi->sectors[level][SV_SectorHash (cell[0], cell[1], cell[2])];
+	}
+
+	slot = sector->count % SECTOR_BLOCK;
+	if (!slot)
+	{
+		block = wi->freeBlocks;
+		wi->freeBlocks = block->next;
+		block->next = sector->blocks;
+		sector->blocks = block;
+	}
+	block = sector->blocks;
+
+	for (i = 0; i < 3; i++)
+	{
+		block->bounds[i][slot] = absmin[i];
+		block->bounds[3 + i][slot] = absmax[i];
+	}
+	block->entityNums[slot] = num;
+	sector->count++;
+
+	link = &wi->links[num];
+	link->sector = sector;
+	link->block = block;
+	link->slot = slot;
+	link->level = level;
+
+	wi->levelCounts[level]++;
+}
 
 
 /*
@@ -86,70 +298,204 @@ SV_SectorList_f
 */
 void SV_SectorList_f (void)
 {
-	int				i, c;
-	worldSector_t	*sec;
-	svEntity_t		*ent;
+	int		i, level;
+	int		used, most;
+	worldSector_t	*sector;
 
-	for (i = 0; i < AREA_NODES; i++)
+	for (level = 0; level < sv_worldIndex.numLevels; level++)
 	{
-		sec = &sv_worldSectors[i];
-
-		c = 0;
-		for (ent = sec->entities; ent; ent = ent->nextEntityInWorldSector)
+		used = most = 0;
+		for (i = 0; i < SECTOR_HASH; i++)
 		{
-			c++;
+			sector = &sv_worldIndex.sectors[level][i];
+			if (sector->count)
+			{
+				used++;
+			}
+			if (sector->count > most)
+			{
+				most = sector->count;
+			}
 		}
-		Com_Printf ("sector %i: %i entities\n", i, c);
+		Com_Printf ("grid %i (%5i units): %i entities in %i sectors, at most %i in one\n",
+			level, SECTOR_CELL_SIZE << level, sv_worldIndex.levelCounts[level], used, most);
 	}
+	Com_Printf ("oversize: %i entities\n", sv_worldIndex.oversize.count);
 }
 
 /*
 ===============
-SV_CreateworldSector
+SV_ClusterList_f
 
-Builds a uniformly subdivided tree for the given world size
+Shows how entities are spread over the PVS clusters, and how well
+snapshot culling has been doing since the last time this was run
 ===============
 */
-worldSector_t *SV_CreateworldSector (int depth, vec3_t mins, vec3_t maxs)
+void SV_ClusterList_f (void)
 {
-	worldSector_t	*anode;
-	vec3_t		size;
-	vec3_t		mins1, maxs1, mins2, maxs2;
+	int		i;
+	int		used;
 
-	anode = &sv_worldSectors[sv_numworldSectors];
-	sv_numworldSectors++;
+	if (!sv.clusterEntityCounts)
+	{
+		Com_Printf ("Server is not running.\n");
+		return;
+	}
 
-	if (depth == AREA_DEPTH)
+	used = 0;
+	for (i = 0; i < sv.numEntityClusters; i++)
 	{
-		anode->axis = -1;
-		anode->children[0] = anode->children[1] = NULL;
-		return anode;
+		if (sv.clusterEntityCounts[i])
+		{
+			Com_Printf ("cluster %i: %i entities\n", i, sv.clusterEntityCounts[i]);
+			used++;
+		}
 	}
+	Com_Printf ("%i of %i clusters hold entities\n", used, sv.numEntityClusters);
 
-	VectorSubtract (maxs, mins, size);
-	if (size[0] > size[1])
+	if (sv.snapshotsCulled)
 	{
-		anode->axis = 0;
+		Com_Printf ("%i snapshots: %.1f candidates examined, %.1f entities sent per snapshot\n",
+			sv.snapshotsCulled,
+			(float) sv.snapshotCandidates / sv.snapshotsCulled,
+			(float) sv.snapshotEntitiesSent / sv.snapshotsCulled);
 	}
-	else
+
+	sv.snapshotsCulled = 0;
+	sv.snapshotCandidates = 0;
+	sv.snapshotEntitiesSent = 0;
+}
+
+/*
+===============================================================================
+
+AREA CACHE
+
+Most of a frame's area queries come from players and missiles moving through
+the same few spots, so the candidates of each query are kept for the rest of
+the frame under its bounds rounded out to a coarse grid.  A later query rounding
+to the same box filters the kept candidates against its own bounds instead of
+walking the grids again.  Linking or unlinking an entity drops every kept box
+its old or new bounds touch, so the results are always the same as an uncached
+query.
+
+===============================================================================
+*/
+
+#define	AREA_CACHE_GRID		64		// query bounds are rounded out to this
+#define	AREA_CACHE_MAX		1024	// bigger queries aren't worth keeping
+#define	AREA_CACHE_ENTRIES	256
+#define	AREA_CACHE_POOL		8192
+
+typedef struct
+{
+	qboolean	valid;
+	int			box[6];		// rounded mins then maxs, in grid units
+	int			first;		// into areaCache.pool
+	int			count;
+} areaCacheEntry_t;
+
+typedef struct
+{
+	int					numValid;
+	int					poolUsed;
+	areaCacheEntry_t	entries[AREA_CACHE_ENTRIES];
+	int					pool[AREA_CACHE_POOL];
+} areaCache_t;
+
+static areaCache_t	sv_areaCacheData;
+
+
+/*
+===============
+SV_ClearAreaCache
+
+Called at the start of every server frame and whenever the world is cleared
+===============
+*/
+void SV_ClearAreaCache (void)
+{
+	areaCache_t	*ac = &sv_areaCacheData;
+	int			i;
+
+	if (ac->numValid)
 	{
-		anode->axis = 1;
+		for (i = 0; i < AREA_CACHE_ENTRIES; i++)
+		{
+			ac->entries[i].valid = qfalse;
+		}
+		ac->numValid = 0;
+	}
+	ac->poolUsed = 0;
+}
+
+/*
+===============
+SV_InvalidateAreaCache
+
+Drops the kept queries that the given bounds touch
+===============
+*/
+static void SV_InvalidateAreaCache (const vec3_t absmin, const vec3_t absmax)
+{
+	areaCache_t			*ac = &sv_areaCacheData;
+	areaCacheEntry_t	*e;
+	int					i, j;
+
+	if (!ac->numValid)
+	{
+		return;
+	}
+
+	for (i = 0, e = ac->entries; i < AREA_CACHE_ENTRIES; i++, e++)
+	{
+		if (!e->valid)
+		{
+			continue;
+		}
+		for (j = 0; j < 3; j++)
+		{
+			if (absmin[j] > e->box[3 + j] * AREA_CACHE_GRID || absmax[j] < e->box[j] * AREA_CACHE_GRID)
+			{
+				break;
+			}
+		}
+		if (j == 3)
+		{
+			e->valid = qfalse;
+			ac->numValid--;
+			sv.areaCacheInvalidations++;
+		}
 	}
+}
 
-	anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
-	VectorCopy (mins, mins1);
-	VectorCopy (mins, mins2);
-	VectorCopy (maxs, maxs1);
-	VectorCopy (maxs, maxs2);
+/*
+===============
+SV_IndexBounds
 
-	maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
+The bounds the entity was linked with, returns qfalse if it isn't linked
+===============
+*/
+static qboolean SV_IndexBounds (const worldIndex_t *wi, int num, vec3_t absmin, vec3_t absmax)
+{
+	const worldLink_t	*link;
+	int					i;
 
-	anode->children[0] = SV_CreateworldSector (depth + 1, mins2, maxs2);
-	anode->children[1] = SV_CreateworldSector (depth + 1, mins1, maxs1);
+	link = &wi->links[num];
+	if (!link->sector)
+	{
+		return qfalse;
+	}
 
-	return anode;
+	for (i = 0; i < 3; i++)
+	{
+		absmin[i] = link->block->bounds[i][link->slot];
+		absmax[i] = link->block->bounds[3 + i][link->slot];
+	}
+	return qtrue;
 }
 
+
 /*
 ===============
 SV_ClearWorld
@@ -161,13 +507,81 @@ void SV_ClearWorld (void)
 	clipHandle_t	h;
 	vec3_t			mins, maxs;
 
-	Com_Memset (sv_worldSectors, 0, sizeof (sv_worldSectors));
-	sv_numworldSectors = 0;
-
 	// get world map bounds
 	h = CM_InlineModel (0);
 	CM_ModelBounds (h, mins, maxs);
-	SV_CreateworldSector (0, mins, maxs);
+	SV_InitWorldIndex (&sv_worldIndex, mins, maxs);
+	SV_ClearAreaCache ();
+
+	// the cluster index for snapshots lives as long as the map
+	sv.numEntityClusters = CM_NumClusters ();
+	sv.clusterEntities = Hunk_Alloc (sv.numEntityClusters * sizeof (*sv.clusterEntities), h_high);
+	sv.clusterEntityCounts = Hunk_Alloc (sv.numEntityClusters * sizeof (*sv.clusterEntityCounts), h_high);
+}
+
+
+/*
+===============
+SV_LinkEntityClusters
+
+Adds the entity to the sets of every cluster it touches
+===============
+*/
+static void SV_LinkEntityClusters (svEntity_t *ent)
+{
+	int			i, c;
+	int			num;
+	unsigned	bit;
+
+	num = ent - sv.svEntities;
+	bit = 1 << (num & 31);
+
+	for (i = 0; i < ent->numClusters; i++)
+	{
+		c = ent->clusternums[i];
+		if (c < 0 || c >= sv.numEntityClusters)
+		{
+			continue;
+		}
+
+		// the same cluster can be listed more than once
+		if (!(sv.clusterEntities[c][num >> 5] & bit))
+		{
+			sv.clusterEntities[c][num >> 5] |= bit;
+			sv.clusterEntityCounts[c]++;
+		}
+	}
+}
+
+
+/*
+===============
+SV_UnlinkEntityClusters
+===============
+*/
+static void SV_UnlinkEntityClusters (svEntity_t *ent)
+{
+	int			i, c;
+	int			num;
+	unsigned	bit;
+
+	num = ent - sv.svEntities;
+	bit = 1 << (num & 31);
+
+	for (i = 0; i < ent->numClusters; i++)
+	{
+		c = ent->clusternums[i];
+		if (c < 0 || c >= sv.numEntityClusters)
+		{
+			continue;
+		}
+
+		if (sv.clusterEntities[c][num >> 5] & bit)
+		{
+			sv.clusterEntities[c][num >> 5] &= ~bit;
+			sv.clusterEntityCounts[c]--;
+		}
+	}
 }
 
 
@@ -180,36 +594,21 @@ SV_UnlinkEntity
 void SV_UnlinkEntity (sharedEntity_t *gEnt)
 {
 	svEntity_t		*ent;
-	svEntity_t		*scan;
-	worldSector_t	*ws;
+	vec3_t			absmin, absmax;
 
 	ent = SV_SvEntityForGentity (gEnt);
 
 	gEnt->r.linked = qfalse;
 
-	ws = ent->worldSector;
-	if (!ws)
+	if (!SV_IndexBounds (&sv_worldIndex, ent - sv.svEntities, absmin, absmax))
 	{
 		return;		// not linked in anywhere
 	}
-	ent->worldSector = NULL;
 
-	if (ws->entities == ent)
-	{
-		ws->entities = ent->nextEntityInWorldSector;
-		return;
-	}
+	SV_InvalidateAreaCache (absmin, absmax);
+	SV_IndexUnlink (&sv_worldIndex, ent - sv.svEntities);
 
-	for (scan = ws->entities; scan; scan = scan->nextEntityInWorldSector)
-	{
-		if (scan->nextEntityInWorldSector == ent)
-		{
-			scan->nextEntityInWorldSector = ent->nextEntityInWorldSector;
-			return;
-		}
-	}
-
-	Com_Printf ("WARNING: SV_UnlinkEntity: not found in worldSector\n");
+	SV_UnlinkEntityClusters (ent);
 }
 
 
@@ -222,7 +621,6 @@ SV_LinkEntity
 #define MAX_TOTAL_ENT_LEAFS		128
 void SV_LinkEntity (sharedEntity_t *gEnt)
 {
-	worldSector_t	*node;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			cluster;
 	int			num_leafs;
@@ -234,7 +632,7 @@ void SV_LinkEntity (sharedEntity_t *gEnt)
 
 	ent = SV_SvEntityForGentity (gEnt);
 
-	if (ent->worldSector)
+	if (sv_worldIndex.links[ent - sv.svEntities].sector)
 	{
 		SV_UnlinkEntity (gEnt);	// unlink from old position
 	}
@@ -373,24 +771,13 @@ void SV_LinkEntity (sharedEntity_t *gEnt)
 
 	gEnt->r.linkcount++;
 
-	// find the first world sector node that the ent's box crosses
-	node = sv_worldSectors;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if (gEnt->r.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if (gEnt->r.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
-	}
+	// unlinking already dropped the kept area queries around the old spot
+	SV_InvalidateAreaCache (gEnt->r.absmin, gEnt->r.absmax);
 
 	// link it in
-	ent->worldSector = node;
-	ent->nextEntityInWorldSector = node->entities;
-	node->entities = ent;
+	SV_IndexLink (&sv_worldIndex, ent - sv.svEntities, gEnt->r.absmin, gEnt->r.absmax);
+
+	SV_LinkEntityClusters (ent);
 
 	gEnt->r.linked = qtrue;
 }
@@ -407,87 +794,538 @@ bounds.  This does NOT mean that they actually touch in the case of bmodels.
 
 typedef struct
 {
-	const float	*mins;
-	const float	*maxs;
-	int			*list;
-	int			count, maxcount;
+	__m128		mins[3];
+	__m128		maxs[3];
+	unsigned	found[MAX_GENTITIES / 32];	// entity bits, so they come out in order
 } areaParms_t;
 
 
 /*
 ====================
-SV_AreaEntities_r
+SV_AreaSector
+
+Marks the entities in the sector that touch the area
+====================
+*/
+static void SV_AreaSector (const worldSector_t *sector, areaParms_t *ap)
+{
+	const worldBlock_t	*block;
+	int			n, valid, hit;
+	int			slot, num;
+	__m128		out;
+
+	n = sector->count;
+	for (block = sector->blocks; block; block = block->next)
+	{
+		// the first block holds the odd ones
+		valid = (1 << ((n - 1) % SECTOR_BLOCK + 1)) - 1;
+		n -= (n - 1) % SECTOR_BLOCK + 1;
+
+		out = _mm_cmpgt_ps (_mm_loadu_ps (block->bounds[0]), ap->maxs[0]);
+		out = _mm_or_ps (out, _mm_cmpgt_ps (_mm_loadu_ps (block->bounds[1]), ap->maxs[1]));
+		out = _mm_or_ps (out, _mm_cmpgt_ps (_mm_loadu_ps (block->bounds[2]), ap->maxs[2]));
+		out = _mm_or_ps (out, _mm_cmplt_ps (_mm_loadu_ps (block->bounds[3]), ap->mins[0]));
+		out = _mm_or_ps (out, _mm_cmplt_ps (_mm_loadu_ps (block->bounds[4]), ap->mins[1]));
+		out = _mm_or_ps (out, _mm_cmplt_ps (_mm_loadu_ps (block->bounds[5]), ap->mins[2]));
+
+		hit = valid & ~_mm_movemask_ps (out);
+		for (slot = 0; hit; slot++, hit >>= 1)
+		{
+			if (hit & 1)
+			{
+				num = block->entityNums[slot];
+				ap->found[num >> 5] |= 1 << (num & 31);
+			}
+		}
+	}
+}
+
+/*
+====================
+SV_IndexQuery
 
+The entities touching mins/maxs, in entity number order
 ====================
 */
-void SV_AreaEntities_r (worldSector_t *node, areaParms_t *ap)
+static int SV_IndexQuery (const worldIndex_t *wi, const vec3_t mins, const vec3_t maxs, int *list, int maxcount)
 {
-	svEntity_t	*check, *next;
-	sharedEntity_t *gcheck;
+	areaParms_t	ap;
+	unsigned	visited[SECTOR_HASH / 32];
+	int			level, i, h;
+	int			lo[3], hi[3];
+	int			x, y, z;
 	int			count;
+	float		cellSize, margin;
+	unsigned	bits;
 
-	count = 0;
+	for (i = 0; i < 3; i++)
+	{
+		ap.mins[i] = _mm_set1_ps (mins[i]);
+		ap.maxs[i] = _mm_set1_ps (maxs[i]);
+	}
+	Com_Memset (ap.found, 0, sizeof (ap.found));
 
-	for (check = node->entities; check; check = next)
+	for (level = 0; level < wi->numLevels; level++)
 	{
-		next = check->nextEntityInWorldSector;
+		if (!wi->levelCounts[level])
+		{
+			continue;
+		}
 
-		gcheck = SV_GEntityForSvEntity (check);
+		// centers up to half a cell outside the area can still reach it,
+		// plus a unit for the rounding of the centers
+		cellSize = SECTOR_CELL_SIZE << level;
+		margin = 0.5f * cellSize + 1;
+		for (i = 0; i < 3; i++)
+		{
+			lo[i] = (int) floor ((mins[i] - margin - wi->origin[i]) / cellSize);
+			hi[i] = (int) floor ((maxs[i] + margin - wi->origin[i]) / cellSize);
+		}
 
-		if (gcheck->r.absmin[0] > ap->maxs[0]
-			|| gcheck->r.absmin[1] > ap->maxs[1]
-			|| gcheck->r.absmin[2] > ap->maxs[2]
-			|| gcheck->r.absmax[0] < ap->mins[0]
-			|| gcheck->r.absmax[1] < ap->mins[1]
-			|| gcheck->r.absmax[2] < ap->mins[2])
+		// an area covering more cells than there are sectors just checks them all
+		if ((float) (hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1) >= SECTOR_HASH)
 		{
+			for (h = 0; h < SECTOR_HASH; h++)
+			{
+				if (wi->sectors[level][h].count)
+				{
+					SV_AreaSector (&wi->sectors[level][h], &ap);
+				}
+			}
 			continue;
 		}
 
-		if (ap->count == ap->maxcount)
+		// cells sharing a sector only check it once
+		Com_Memset (visited, 0, sizeof (visited));
+		for (x = lo[0]; x <= hi[0]; x++)
 		{
-			Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
-			return;
+			for (y = lo[1]; y <= hi[1]; y++)
+			{
+				for (z = lo[2]; z <= hi[2]; z++)
+				{
+					h = SV_SectorHash (x, y, z);
+					if (visited[h >> 5] & (1 << (h & 31)))
+					{
+						continue;
+					}
+					visited[h >> 5] |= 1 << (h & 31);
+
+					if (wi->sectors[level][h].count)
+					{
+						SV_AreaSector (&wi->sectors[level][h], &ap);
+					}
+				}
+			}
 		}
+	}
+
+	if (wi->oversize.count)
+	{
+		SV_AreaSector (&wi->oversize, &ap);
+	}
+
+	count = 0;
+	for (i = 0; i < MAX_GENTITIES / 32; i++)
+	{
+		for (bits = ap.found[i], h = 0; bits; bits >>= 1, h++)
+		{
+			if (!(bits & 1))
+			{
+				continue;
+			}
+			if (count == maxcount)
+			{
+				Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+				return count;
+			}
+			list[count++] = i * 32 + h;
+		}
+	}
+
+	return count;
+}
 
-		ap->list[ap->count] = check - sv.svEntities;
-		ap->count++;
+/*
+================
+SV_AreaEntities
+================
+*/
+int SV_AreaEntities (const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount)
+{
+	areaCache_t			*ac = &sv_areaCacheData;
+	areaCacheEntry_t	*e;
+	const worldLink_t	*link;
+	int					box[6];
+	int					list[MAX_GENTITIES];
+	vec3_t				boxmins, boxmaxs;
+	int					i, j, h, num, count;
+	float				b;
+
+	if (!sv_areaCache->integer)
+	{
+		return SV_IndexQuery (&sv_worldIndex, mins, maxs, entityList, maxcount);
 	}
 
-	if (node->axis == -1)
+	for (i = 0; i < 3; i++)
 	{
-		return;		// terminal node
+		if (maxs[i] - mins[i] > AREA_CACHE_MAX || !(maxs[i] >= mins[i]))
+		{
+			sv.areaCacheUncached++;
+			return SV_IndexQuery (&sv_worldIndex, mins, maxs, entityList, maxcount);
+		}
+		box[i] = (int) floor (mins[i] / AREA_CACHE_GRID);
+		box[3 + i] = (int) ceil (maxs[i] / AREA_CACHE_GRID);
 	}
 
-	// recurse down both sides
-	if (ap->maxs[node->axis] > node->dist)
+	h = 0;
+	for (i = 0; i < 6; i++)
 	{
-		SV_AreaEntities_r (node->children[0], ap);
+		h = h * 31 + box[i];
 	}
-	if (ap->mins[node->axis] < node->dist)
+	e = &ac->entries[(h ^ (h >> 8) ^ (h >> 16)) & (AREA_CACHE_ENTRIES - 1)];
+
+	if (e->valid && !memcmp (e->box, box, sizeof (box)))
 	{
-		SV_AreaEntities_r (node->children[1], ap);
+		sv.areaCacheHits++;
 	}
+	else
+	{
+		sv.areaCacheMisses++;
+
+		for (i = 0; i < 3; i++)
+		{
+			boxmins[i] = box[i] * AREA_CACHE_GRID;
+			boxmaxs[i] = box[3 + i] * AREA_CACHE_GRID;
+		}
+		count = SV_IndexQuery (&sv_worldIndex, boxmins, boxmaxs, list, MAX_GENTITIES);
+
+		if (count > AREA_CACHE_POOL / 4)
+		{
+			// would crowd everything else out
+			sv.areaCacheUncached++;
+			return SV_IndexQuery (&sv_worldIndex, mins, maxs, entityList, maxcount);
+		}
+		if (ac->poolUsed + count > AREA_CACHE_POOL)
+		{
+			SV_ClearAreaCache ();
+			sv.areaCacheFlushes++;
+		}
+
+		if (!e->valid)
+		{
+			ac->numValid++;
+		}
+		e->valid = qtrue;
+		Com_Memcpy (e->box, box, sizeof (box));
+		e->first = ac->poolUsed;
+		e->count = count;
+		Com_Memcpy (ac->pool + e->first, list, count * sizeof (int));
+		ac->poolUsed += count;
+	}
+
+	// the kept candidates are in entity number order, so the
+	// survivors come out in the same order as an uncached query
+	count = 0;
+	for (i = 0; i < e->count; i++)
+	{
+		num = ac->pool[e->first + i];
+		link = &sv_worldIndex.links[num];
+
+		for (j = 0; j < 3; j++)
+		{
+			b = link->block->bounds[j][link->slot];
+			if (b > maxs[j])
+			{
+				break;
+			}
+			b = link->block->bounds[3 + j][link->slot];
+			if (b < mins[j])
+			{
+				break;
+			}
+		}
+		if (j != 3)
+		{
+			continue;
+		}
+
+		if (count == maxcount)
+		{
+			Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+			return count;
+		}
+		entityList[count++] = num;
+	}
+
+	return count;
 }
 
 /*
 ================
-SV_AreaEntities
+SV_AreaCacheStats_f
 ================
 */
-int SV_AreaEntities (const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount)
+void SV_AreaCacheStats_f (void)
 {
-	areaParms_t		ap;
+	int		total;
+
+	if (sv.state != SS_GAME)
+	{
+		Com_Printf ("Server is not running.\n");
+		return;
+	}
 
-	ap.mins = mins;
-	ap.maxs = maxs;
-	ap.list = entityList;
-	ap.count = 0;
-	ap.maxcount = maxcount;
+	total = sv.areaCacheHits + sv.areaCacheMisses;
 
-	SV_AreaEntities_r (sv_worldSectors, &ap);
+	Com_Printf ("%i area queries: %i hits, %i misses, %i uncached\n",
+		total + sv.areaCacheUncached, sv.areaCacheHits, sv.areaCacheMisses, sv.areaCacheUncached);
+	Com_Printf ("%i invalidations, %i flushes\n", sv.areaCacheInvalidations, sv.areaCacheFlushes);
 
-	return ap.count;
+	if (total)
+	{
+		Com_Printf ("%.1f%% hit rate\n", 100.0f * sv.areaCacheHits / total);
+	}
+
+	sv.areaCacheHits = 0;
+	sv.areaCacheMisses = 0;
+	sv.areaCacheUncached = 0;
+	sv.areaCacheInvalidations = 0;
+	sv.areaCacheFlushes = 0;
+}
+
+/*
+================
+SV_SectorBench_f
+
+sv_sectorbench [entities] [frames]
+
+Runs the area queries of a busy frame against a private index filled with
+made up entities: players and projectiles moving and relinking every frame,
+items and triggers standing still and a few big movers.  Every query is
+checked against a linear scan of all the boxes.
+================
+*/
+typedef struct
+{
+	vec3_t		mins, maxs;
+	vec3_t		origin;
+	vec3_t		velocity;
+} benchEntity_t;
+
+static float SV_BenchRandom (int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return ((*seed >> 8) & 0xffff) / 65535.0f;
+}
+
+static int SV_BenchLinear (const benchEntity_t *ents, int num, const vec3_t mins, const vec3_t maxs, int *list)
+{
+	int		i, count;
+	vec3_t	absmin, absmax;
+
+	count = 0;
+	for (i = 0; i < num; i++)
+	{
+		VectorAdd (ents[i].origin, ents[i].mins, absmin);
+		VectorAdd (ents[i].origin, ents[i].maxs, absmax);
+		if (absmin[0] > maxs[0] || absmin[1] > maxs[1] || absmin[2] > maxs[2]
+			|| absmax[0] < mins[0] || absmax[1] < mins[1] || absmax[2] < mins[2])
+		{
+			continue;
+		}
+		list[count++] = i;
+	}
+
+	return count;
+}
+
+void SV_SectorBench_f (void)
+{
+	worldIndex_t	*wi;
+	benchEntity_t	*ents, *ent;
+	int				numEnts, frames, frame;
+	int				i, j, q, seed;
+	int				list[MAX_GENTITIES], check[MAX_GENTITIES];
+	int				count, checkCount;
+	int				queries, found, mismatches;
+	int				start, linkUsec, queryUsec, linearUsec;
+	vec3_t			worldMins, worldMaxs;
+	vec3_t			absmin, absmax, mins, maxs, end;
+	float			r;
+
+	if (!com_sv_running->integer)
+	{
+		Com_Printf ("Server is not running.\n");
+		return;
+	}
+
+	numEnts = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : 600;
+	frames = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 200;
+	if (numEnts < 16)
+	{
+		numEnts = 16;
+	}
+	if (numEnts > MAX_GENTITIES)
+	{
+		numEnts = MAX_GENTITIES;
+	}
+	if (frames < 1)
+	{
+		frames = 1;
+	}
+
+	CM_ModelBounds (CM_InlineModel (0), worldMins, worldMaxs);
+
+	wi = Z_Malloc (sizeof (*wi));
+	ents = Z_Malloc (numEnts * sizeof (*ents));
+	SV_InitWorldIndex (wi, worldMins, worldMaxs);
+
+	// 16 players, a few movers and triggers, then half items and half projectiles
+	seed = 0x5ec7;
+	for (i = 0; i < numEnts; i++)
+	{
+		ent = &ents[i];
+		for (j = 0; j < 3; j++)
+		{
+			ent->origin[j] = worldMins[j] + SV_BenchRandom (&seed) * (worldMaxs[j] - worldMins[j]);
+		}
+
+		if (i < 16)
+		{
+			VectorSet (ent->mins, -15, -15, -24);
+			VectorSet (ent->maxs, 15, 15, 32);
+			VectorSet (ent->velocity, 320 * (SV_BenchRandom (&seed) - 0.5f), 320 * (SV_BenchRandom (&seed) - 0.5f), 0);
+		}
+		else if (i < 24)
+		{
+			r = 64 + SV_BenchRandom (&seed) * 448;
+			VectorSet (ent->mins, -r, -r, -32);
+			VectorSet (ent->maxs, r, r, 32);
+			VectorClear (ent->velocity);
+		}
+		else if (i < 40)
+		{
+			r = 32 + SV_BenchRandom (&seed) * 1024;
+			VectorSet (ent->mins, -r, -r, -r);
+			VectorSet (ent->maxs, r, r, r);
+			VectorClear (ent->velocity);
+		}
+		else if (i & 1)
+		{
+			VectorSet (ent->mins, -15, -15, -15);
+			VectorSet (ent->maxs, 15, 15, 15);
+			VectorClear (ent->velocity);
+		}
+		else
+		{
+			VectorClear (ent->mins);
+			VectorClear (ent->maxs);
+			for (j = 0; j < 3; j++)
+			{
+				ent->velocity[j] = 1800 * (SV_BenchRandom (&seed) - 0.5f);
+			}
+		}
+
+		VectorAdd (ent->origin, ent->mins, absmin);
+		VectorAdd (ent->origin, ent->maxs, absmax);
+		SV_IndexLink (wi, i, absmin, absmax);
+	}
+
+	linkUsec = queryUsec = linearUsec = 0;
+	queries = found = mismatches = 0;
+
+	for (frame = 0; frame < frames; frame++)
+	{
+		// everything that moves relinks, like the game does at 20Hz
+		start = Sys_Microseconds ();
+		for (i = 0; i < numEnts; i++)
+		{
+			ent = &ents[i];
+			if (!ent->velocity[0] && !ent->velocity[1] && !ent->velocity[2])
+			{
+				continue;
+			}
+			for (j = 0; j < 3; j++)
+			{
+				ent->origin[j] += ent->velocity[j] * 0.05f;
+				if (ent->origin[j] < worldMins[j] || ent->origin[j] > worldMaxs[j])
+				{
+					ent->velocity[j] = -ent->velocity[j];
+				}
+			}
+			VectorAdd (ent->origin, ent->mins, absmin);
+			VectorAdd (ent->origin, ent->maxs, absmax);
+			SV_IndexLink (wi, i, absmin, absmax);
+		}
+		linkUsec += Sys_Microseconds () - start;
+
+		// each player: a move, triggers touched, a long shot and three
+		// sight checks; each projectile: its move
+		for (i = 0; i < numEnts; i++)
+		{
+			ent = &ents[i];
+			if (i >= 16 && (i < 40 || (i & 1)))
+			{
+				continue;
+			}
+
+			for (q = 0; q < (i < 16 ? 6 : 1); q++)
+			{
+				if (q < 2)
+				{
+					VectorMA (ent->origin, 0.05f, ent->velocity, end);
+					VectorCopy (ent->mins, mins);
+					VectorCopy (ent->maxs, maxs);
+				}
+				else
+				{
+					for (j = 0; j < 3; j++)
+					{
+						end[j] = ent->origin[j] + 8192 * (SV_BenchRandom (&seed) - 0.5f);
+					}
+					VectorClear (mins);
+					VectorClear (maxs);
+				}
+				for (j = 0; j < 3; j++)
+				{
+					absmin[j] = (ent->origin[j] < end[j] ? ent->origin[j] : end[j]) + mins[j] - 1;
+					absmax[j] = (ent->origin[j] < end[j] ? end[j] : ent->origin[j]) + maxs[j] + 1;
+				}
+
+				start = Sys_Microseconds ();
+				count = SV_IndexQuery (wi, absmin, absmax, list, MAX_GENTITIES);
+				queryUsec += Sys_Microseconds () - start;
+
+				start = Sys_Microseconds ();
+				checkCount = SV_BenchLinear (ents, numEnts, absmin, absmax, check);
+				linearUsec += Sys_Microseconds () - start;
+
+				if (count != checkCount || memcmp (list, check, count * sizeof (int)))
+				{
+					mismatches++;
+				}
+				queries++;
+				found += count;
+			}
+		}
+	}
+
+	Com_Printf ("%i entities, %i frames, %i queries finding %.1f entities each\n",
+		numEnts, frames, queries, (float) found / queries);
+	Com_Printf ("relinking : %7.1f usec/frame\n", (float) linkUsec / frames);
+	Com_Printf ("queries   : %7.1f usec/frame\n", (float) queryUsec / frames);
+	Com_Printf ("linear    : %7.1f usec/frame\n", (float) linearUsec / frames);
+	if (mismatches)
+	{
+		Com_Printf (S_COLOR_RED "%i queries differ from the linear scan\n", mismatches);
+	}
+	else
+	{
+		Com_Printf ("all queries match\n");
+	}
+
+	Z_Free (ents);
+	Z_Free (wi);
 }
 
 
@@ -662,30 +1500,21 @@ void SV_ClipMoveToEntities (moveclip_t *clip)
 
 /*
 ==================
-SV_Trace
+SV_TraceEntities
 
-Moves the given mins/maxs volume through the world from start to end.
-passEntityNum and entities owned by passEntityNum are explicitly not checked.
+Clips a move that has already been traced against the world against
+the solid entities
 ==================
 */
-void SV_Trace (trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule)
+static void SV_TraceEntities (trace_t *results, const trace_t *worldTrace, const vec3_t start, const vec3_t mins, const vec3_t maxs,
+	const vec3_t end, int passEntityNum, int contentmask, int capsule)
 {
 	moveclip_t	clip;
 	int			i;
 
-	if (!mins)
-	{
-		mins = vec3_origin;
-	}
-	if (!maxs)
-	{
-		maxs = vec3_origin;
-	}
-
 	Com_Memset (&clip, 0, sizeof (moveclip_t));
 
-	// clip to world
-	CM_BoxTrace (&clip.trace, start, end, mins, maxs, 0, contentmask, capsule);
+	clip.trace = *worldTrace;
 	clip.trace.entityNum = clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
 	if (clip.trace.fraction == 0)
 	{
@@ -727,6 +1556,67 @@ void SV_Trace (trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 }
 
 
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+passEntityNum and entities owned by passEntityNum are explicitly not checked.
+==================
+*/
+void SV_Trace (trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule)
+{
+	trace_t		trace;
+
+	if (!mins)
+	{
+		mins = vec3_origin;
+	}
+	if (!maxs)
+	{
+		maxs = vec3_origin;
+	}
+
+	// clip to world
+	CM_BoxTrace (&trace, start, end, mins, maxs, 0, contentmask, capsule);
+
+	SV_TraceEntities (results, &trace, start, mins, maxs, end, passEntityNum, contentmask, capsule);
+}
+
+
+/*
+==================
+SV_TraceBatch
+
+SV_Trace for count independent moves.  The world part of all of them is
+done by CM_TraceBatch, which spreads them over the job threads.
+==================
+*/
+void SV_TraceBatch (trace_t *results, const traceRequest_t *requests, int count, int capsule)
+{
+	const traceRequest_t	*req;
+	int			i;
+
+	if (count <= 0)
+	{
+		return;
+	}
+	if (count > MAX_TRACE_BATCH)
+	{
+		count = MAX_TRACE_BATCH;
+	}
+
+	CM_TraceBatch (results, requests, count, capsule);
+
+	for (i = 0; i < count; i++)
+	{
+		req = &requests[i];
+		SV_TraceEntities (&results[i], &results[i], req->start, req->mins, req->maxs, req->end,
+			req->passEntityNum, req->contentmask, capsule);
+	}
+}
+
+
 
 /*
 =============
@@ -23,7 +23,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "tr_local.h"
 #include "tr_program.h"
 
-backEndData_t	backEndData;
+backEndData_t	backEndData[SMP_FRAMES];
 backEndState_t	backEnd;
 
 
@@ -44,13 +44,19 @@ void GL_BindTexture (int tmu, image_t *image)
 {
 	if (!image && tr.defaultImage)
 	{
-		ri.Printf (PRINT_WARNING, "GL_Bind: NULL image\n");
+		RB_Printf (PRINT_WARNING, "GL_Bind: NULL image\n");
 		GL_BindTexture (tmu, tr.defaultImage);
 		return;
 	}
 	else if (!image)
 		return;
 
+	if (r_nullBackend->integer)
+	{
+		image->frameUsed = tr.frameCount;
+		return;
+	}
+
 	IDirect3DTexture9 *texnum = image->texnum;
 
 	if (r_nobind->integer && tr.dlightImage)
@@ -85,6 +91,9 @@ void GL_Cull (int cullType)
 
 	glState.faceCulling = cullType;
 
+	if (r_nullBackend->integer)
+		return;
+
 	if (cullType == CT_TWO_SIDED)
 		d3d_Device->lpVtbl->SetRenderState (d3d_Device, D3DRS_CULLMODE, D3DCULL_NONE);
 	else
@@ -119,6 +128,12 @@ void GL_State (unsigned long stateBits)
 	if (!diff)
 		return;
 
+	if (r_nullBackend->integer)
+	{
+		glState.glStateBits = stateBits;
+		return;
+	}
+
 	// check depthFunc bits
 	if (diff & GLS_DEPTHFUNC_EQUAL)
 	{
@@ -286,6 +301,9 @@ void GL_State (unsigned long stateBits)
 
 void RB_SetViewportAndHalfPixelCorrection (D3DVIEWPORT9 *vp)
 {
+	if (r_nullBackend->integer)
+		return;
+
 	// this is the only place that SetViewport should be called so that we can also do our half-pixel correction here
 	float inverseRT[4] = {-1.0f / glConfig.vidWidth, 1.0f / glConfig.vidHeight, 0, 0};
 	d3d_Device->lpVtbl->SetPixelShaderConstantF (d3d_Device, VSREG_INVERSERT, inverseRT, 1);
@@ -349,6 +367,9 @@ void RB_SetupObliqueNearPlane (float *matrix, float *clipPlane)
 
 void RB_SetGammaAndBrightness (void)
 {
+	if (r_nullBackend->integer)
+		return;
+
 	// rather than doing a separate brightpass we'll setup gamma and brightness in our shaders
 	float gamma[4] = { r_gamma->value, r_gamma->value, r_gamma->value, r_gamma->value };
 	float brightness[4] = { r_brightness->value, r_brightness->value, r_brightness->value, r_brightness->value };
@@ -399,7 +420,11 @@ void RB_BeginDrawingView (void)
 	// clear relevant buffers
 	// clearing z and stencil because they're going to be interleaved so this will give a faster clear
 	// color is always cleared too but that happens at the beginning of the frame, not of the scene
-	if (backEnd.viewParms.viewportX == 0 && backEnd.viewParms.viewportWidth == glConfig.vidWidth &&
+	if (r_nullBackend->integer)
+	{
+		// nothing to clear
+	}
+	else if (backEnd.viewParms.viewportX == 0 && backEnd.viewParms.viewportWidth == glConfig.vidWidth &&
 		backEnd.viewParms.viewportY == 0 && backEnd.viewParms.viewportHeight == glConfig.vidHeight)
 	{
 		// ???? this might give us a faster clear ????
@@ -416,7 +441,11 @@ void RB_BeginDrawingView (void)
 
 		byte c = (backEnd.refdef.time & 255);
 
-		if (backEnd.viewParms.viewportX == 0 && backEnd.viewParms.viewportWidth == glConfig.vidWidth &&
+		if (r_nullBackend->integer)
+		{
+			// nothing to clear
+		}
+		else if (backEnd.viewParms.viewportX == 0 && backEnd.viewParms.viewportWidth == glConfig.vidWidth &&
 			backEnd.viewParms.viewportY == 0 && backEnd.viewParms.viewportHeight == glConfig.vidHeight)
 		{
 			// ???? this might give us a faster clear ????
@@ -664,8 +693,8 @@ void RE_StretchRaw (int x, int y, int w, int h, int cols, int rows, const byte *
 {
 	if (!QGL_CheckScene ()) return;
 
-	RB_SetGammaAndBrightness ();
 	R_SyncRenderThread ();
+	RB_SetGammaAndBrightness ();
 
 	int start = 0;
 	int end = 0;
@@ -871,6 +900,9 @@ void RB_ShowImages (void)
 	float	x, y, w, h;
 	int		start, end;
 
+	if (r_nullBackend->integer)
+		return;
+
 	if (!backEnd.projection2D)
 		RB_SetGL2D ();
 
@@ -912,7 +944,32 @@ void RB_ShowImages (void)
 	RB_EmulateGLFinish ();
 
 	end = ri.Milliseconds ();
-	ri.Printf (PRINT_ALL, "%i msec to draw all images\n", end - start);
+	RB_Printf (PRINT_ALL, "%i msec to draw all images\n", end - start);
+}
+
+
+/*
+=============
+R_WriteScreenshot
+
+Saves the image RB_SwapBuffers copied out.  Called on the main thread
+while the back end is idle.
+=============
+*/
+void R_WriteScreenshot (void)
+{
+	byte buffer[4] = {0, 0, 0, 0};
+
+	if (!tr.screenshotSurface)
+		return;
+
+	// create path
+	ri.FS_WriteFile (tr.screenshotName, buffer, 1);
+
+	D3DXSaveSurfaceToFile (ri.FS_GetOSPath (tr.screenshotName), D3DXIFF_JPG, tr.screenshotSurface, NULL, NULL);
+
+	tr.screenshotSurface->lpVtbl->Release (tr.screenshotSurface);
+	tr.screenshotSurface = NULL;
 }
 
 
@@ -939,7 +996,9 @@ const void	*RB_SwapBuffers (const void *data)
 	}
 
 	// if a cinematic was requested draw it now
-	if (tr.hasStretchRaw)
+	if (tr.hasStretchRaw && r_nullBackend->integer)
+		tr.hasStretchRaw = qfalse;
+	else if (tr.hasStretchRaw)
 	{
 		DWORD color = D3DCOLOR_ARGB (255, tr.identityLightByte, tr.identityLightByte, tr.identityLightByte);
 
@@ -965,20 +1024,34 @@ const void	*RB_SwapBuffers (const void *data)
 		tr.hasStretchRaw = qfalse;
 	}
 
-	if (tr.screenshotRequested)
+	if (tr.screenshotRequested && r_nullBackend->integer)
+	{
+		RB_Printf (PRINT_WARNING, "No screenshots with r_nullBackend\n");
+		tr.screenshotRequested = qfalse;
+	}
+	else if (tr.screenshotRequested)
 	{
 		RB_EmulateGLFinish ();
 		glState.finishCalled = qtrue;
 
 		IDirect3DSurface9 *surf = NULL;
-		byte buffer[4] = {0, 0, 0, 0};
-
-		// create path
-		ri.FS_WriteFile (tr.screenshotName, buffer, 1);
+		D3DSURFACE_DESC desc;
 
-		if (SUCCEEDED (d3d_Device->lpVtbl->GetRenderTarget (d3d_Device, 0, &surf)))
+		// this may be the render thread, which can't use the file system, so the
+		// image is only copied out here and R_WriteScreenshot saves it
+		if (!tr.screenshotSurface && SUCCEEDED (d3d_Device->lpVtbl->GetRenderTarget (d3d_Device, 0, &surf)))
 		{
-			D3DXSaveSurfaceToFile (ri.FS_GetOSPath (tr.screenshotName), D3DXIFF_JPG, surf, NULL, NULL);
+			surf->lpVtbl->GetDesc (surf, &desc);
+
+			if (SUCCEEDED (d3d_Device->lpVtbl->CreateOffscreenPlainSurface (d3d_Device, desc.Width, desc.Height, desc.Format, D3DPOOL_SYSTEMMEM, &tr.screenshotSurface, NULL)))
+			{
+				if (FAILED (d3d_Device->lpVtbl->GetRenderTargetData (d3d_Device, surf, tr.screenshotSurface)))
+				{
+					tr.screenshotSurface->lpVtbl->Release (tr.screenshotSurface);
+					tr.screenshotSurface = NULL;
+				}
+			}
+
 			surf->lpVtbl->Release (surf);
 		}
 
@@ -990,8 +1063,10 @@ const void	*RB_SwapBuffers (const void *data)
 
 	cmd = (const swapBuffersCommand_t *) data;
 
-	GLimp_EndFrame ();
+	if (!r_nullBackend->integer)
+		GLimp_EndFrame ();
 
+	glState.finishCalled = qfalse;
 	backEnd.projection2D = qfalse;
 
 	return (const void *) (cmd + 1);
@@ -1008,6 +1083,24 @@ smp extensions, or asynchronously by another thread.
 void RB_ExecuteRenderCommands (const void *data)
 {
 	int t1 = ri.Milliseconds ();
+	int u1 = ri.Microseconds ();
+
+	if (!r_smp->integer || data == backEndData[0].commands.cmds)
+		backEnd.smpFrame = 0;
+	else backEnd.smpFrame = 1;
+
+	// issue a beginscene call if we haven't had one yet; this is done here rather
+	// than by the front end so the device is only used from the thread that draws
+	if (!r_nullBackend->integer && !glState.inBeginScene)
+	{
+		// always clear the rendertarget every frame
+		d3d_Device->lpVtbl->Clear (d3d_Device, 0, NULL, D3DCLEAR_TARGET, 0, 1.0f, 0);
+
+		if (FAILED (d3d_Device->lpVtbl->BeginScene (d3d_Device)))
+			return;
+
+		glState.inBeginScene = qtrue;
+	}
 
 	while (1)
 	{
@@ -1040,13 +1133,123 @@ void RB_ExecuteRenderCommands (const void *data)
 		case RC_END_OF_LIST:
 		default:
 			// stop rendering on this thread
-			backEnd.pc.msec = ri.Milliseconds () - t1;
+			backEnd.msec += ri.Milliseconds () - t1;
+			backEnd.usec += ri.Microseconds () - u1;
 			return;
 		}
 	}
 }
 
 
+/*
+================
+RB_RenderThread
+================
+*/
+volatile qboolean	renderThreadActive;
+
+void RB_RenderThread (void)
+{
+	const void	*data;
+
+	// wait for either a rendering command or a quit command
+	while (1)
+	{
+		// sleep until we have work to do
+		data = GLimp_RendererSleep ();
+
+		if (!data)
+		{
+			return;	// all done, renderer is shutting down
+		}
+
+		renderThreadActive = qtrue;
+
+		if (!setjmp (backEnd.abortCommands))
+		{
+			RB_ExecuteRenderCommands (data);
+		}
+		else
+		{
+			// RB_Error gave up on the rest of the list, R_WaitRenderThread
+			// raises the error; drop whatever was half tesselated
+			tess.numIndexes = 0;
+			tess.numVertexes = 0;
+			backEnd.vertexes2D = qfalse;
+		}
+
+		renderThreadActive = qfalse;
+	}
+}
+
+
+/*
+================
+RB_Printf
+
+Prints straight away on the main thread.  On the render thread the
+console and log file aren't ours to touch, so the message is kept for
+R_WaitRenderThread to print.
+================
+*/
+void QDECL RB_Printf (int printLevel, const char *fmt, ...)
+{
+	va_list		argptr;
+	char		text[MAX_BACKEND_MESSAGE];
+
+	va_start (argptr, fmt);
+	vsnprintf (text, sizeof (text), fmt, argptr);
+	va_end (argptr);
+	text[sizeof (text) - 1] = 0;
+
+	if (!renderThreadActive)
+	{
+		ri.Printf (printLevel, "%s", text);
+		return;
+	}
+
+	if (backEnd.numMessages < MAX_BACKEND_MESSAGES)
+	{
+		backEnd.messageLevels[backEnd.numMessages] = printLevel;
+		Q_strncpyz (backEnd.messages[backEnd.numMessages], text, MAX_BACKEND_MESSAGE);
+	}
+	backEnd.numMessages++;
+}
+
+
+/*
+================
+RB_Error
+
+ri.Error on the main thread.  On the render thread it would longjmp
+across threads, so the error is kept for R_WaitRenderThread to raise
+and the rest of the command list is abandoned.
+================
+*/
+void QDECL RB_Error (int code, const char *fmt, ...)
+{
+	va_list		argptr;
+	char		text[MAX_STRING_CHARS];
+
+	va_start (argptr, fmt);
+	vsnprintf (text, sizeof (text), fmt, argptr);
+	va_end (argptr);
+	text[sizeof (text) - 1] = 0;
+
+	if (!renderThreadActive)
+	{
+		ri.Error (code, "%s", text);
+		return;
+	}
+
+	backEnd.aborted = qtrue;
+	backEnd.errorCode = code;
+	Q_strncpyz (backEnd.errorMessage, text, sizeof (backEnd.errorMessage));
+
+	longjmp (backEnd.abortCommands, 1);
+}
+
+
 void RB_EmulateGLFinish (void)
 {
 	if (d3d_Event)
@@ -64,14 +64,45 @@ R_LoadLightmaps
 */
 #define	LIGHTMAP_SIZE	128
 
+typedef struct
+{
+	const byte	*in;
+	byte		*out;
+} lightmapBatch_t;
+
+/*
+===============
+R_ExpandLightmapJob
+
+Expands the 24 bit on-disk lightmap to 32 bit
+===============
+*/
+static void R_ExpandLightmapJob (void *data, int index)
+{
+	lightmapBatch_t	*batch;
+	byte			*in, *out;
+	int				j;
+
+	batch = (lightmapBatch_t *) data;
+	in = (byte *) batch->in + index * LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3;
+	out = batch->out + index * LIGHTMAP_SIZE * LIGHTMAP_SIZE * 4;
+
+	for (j = 0; j < LIGHTMAP_SIZE * LIGHTMAP_SIZE; j++)
+	{
+		R_ColorShiftLightingBytes (&in[j * 3], &out[j * 4]);
+		out[j * 4 + 3] = 255;
+	}
+}
+
 static	void R_LoadLightmaps (lump_t *l)
 {
-	byte		*buf, *buf_p;
+	byte		*buf;
 	int			len;
-	MAC_STATIC byte		image[LIGHTMAP_SIZE*LIGHTMAP_SIZE * 4];
-	int			i, j;
+	byte		*images;
+	int			i;
 	float maxIntensity = 0;
 	double sumIntensity = 0;
+	lightmapBatch_t	batch;
 
 	len = l->filelen;
 	if (!len)
@@ -92,20 +123,21 @@ static	void R_LoadLightmaps (lump_t *l)
 		tr.numLightmaps++;
 	}
 
-	for (i = 0; i < tr.numLightmaps; i++)
-	{
-		// expand the 24 bit on-disk to 32 bit
-		buf_p = buf + i * LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3;
+	// expand them all on the job threads, then upload in order
+	images = ri.Hunk_AllocateTempMemory (tr.numLightmaps * LIGHTMAP_SIZE * LIGHTMAP_SIZE * 4);
 
-		for (j = 0; j < LIGHTMAP_SIZE * LIGHTMAP_SIZE; j++)
-		{
-			R_ColorShiftLightingBytes (&buf_p[j * 3], &image[j * 4]);
-			image[j * 4 + 3] = 255;
-		}
+	batch.in = buf;
+	batch.out = images;
+	ri.RunJobs (R_ExpandLightmapJob, &batch, tr.numLightmaps);
 
-		tr.lightmaps[i] = R_CreateImage (va ("*lightmap%d", i), image, LIGHTMAP_SIZE, LIGHTMAP_SIZE, qfalse, qfalse, D3DTADDRESS_CLAMP);
+	for (i = 0; i < tr.numLightmaps; i++)
+	{
+		tr.lightmaps[i] = R_CreateImage (va ("*lightmap%d", i), images + i * LIGHTMAP_SIZE * LIGHTMAP_SIZE * 4,
+			LIGHTMAP_SIZE, LIGHTMAP_SIZE, qfalse, qfalse, D3DTADDRESS_CLAMP);
 	}
 
+	ri.Hunk_FreeTempMemory (images);
+
 	if (r_lightmap->integer == 2)
 	{
 		ri.Printf (PRINT_ALL, "Brightest lightmap value: %d\n", (int) (maxIntensity * 255));
@@ -286,17 +318,13 @@ static void ParseFace (dsurface_t *ds, drawVert_t *verts, msurface_t *surf, int
 /*
 ===============
 ParseMesh
+
+Returns qtrue if the patch needs to be subdivided by R_SubdivideMeshes
 ===============
 */
-static void ParseMesh (dsurface_t *ds, drawVert_t *verts, msurface_t *surf)
+static qboolean ParseMesh (dsurface_t *ds, msurface_t *surf)
 {
-	srfGridMesh_t	*grid;
-	int				i, j;
-	int				width, height, numPoints;
-	MAC_STATIC drawVert_t points[MAX_PATCH_SIZE*MAX_PATCH_SIZE];
 	int				lightmapNum;
-	vec3_t			bounds[2];
-	vec3_t			tmpVec;
 	static surfaceType_t	skipData = SF_SKIP;
 
 	lightmapNum = LittleLong (ds->lightmapNum);
@@ -316,13 +344,41 @@ static void ParseMesh (dsurface_t *ds, drawVert_t *verts, msurface_t *surf)
 	if (s_worldData.shaders[LittleLong (ds->shaderNum)].surfaceFlags & SURF_NODRAW)
 	{
 		surf->data = &skipData;
-		return;
+		return qfalse;
 	}
 
+	return qtrue;
+}
+
+typedef struct
+{
+	dsurface_t	*surfaces;
+	drawVert_t	*verts;
+	int			*surfaceNums;
+	gridWork_t	*work;
+} meshBatch_t;
+
+/*
+===============
+R_SubdivideMeshJob
+===============
+*/
+static void R_SubdivideMeshJob (void *data, int index)
+{
+	meshBatch_t		*batch;
+	dsurface_t		*ds;
+	drawVert_t		*verts;
+	drawVert_t		points[MAX_PATCH_SIZE*MAX_PATCH_SIZE];
+	int				width, height, numPoints;
+	int				i, j;
+
+	batch = (meshBatch_t *) data;
+	ds = batch->surfaces + batch->surfaceNums[index];
+
 	width = LittleLong (ds->patchWidth);
 	height = LittleLong (ds->patchHeight);
 
-	verts += LittleLong (ds->firstVert);
+	verts = batch->verts + LittleLong (ds->firstVert);
 	numPoints = width * height;
 	for (i = 0; i < numPoints; i++)
 	{
@@ -340,21 +396,78 @@ static void ParseMesh (dsurface_t *ds, drawVert_t *verts, msurface_t *surf)
 	}
 
 	// pre-tesseleate
-	grid = R_SubdividePatchToGrid (width, height, points);
-	surf->data = (surfaceType_t *) grid;
+	R_SubdividePatch (width, height, points, &batch->work[index]);
+}
 
-	// copy the level of detail origin, which is the center
-	// of the group of all curves that must subdivide the same
-	// to avoid cracking
-	for (i = 0; i < 3; i++)
+/*
+===============
+R_SubdivideMeshes
+
+Subdivides a batch of patches on the job threads at a time, each into its
+own work area, then creates their grids in surface order on this thread
+===============
+*/
+static void R_SubdivideMeshes (dsurface_t *surfaces, drawVert_t *verts, int *surfaceNums, int numMeshes)
+{
+	meshBatch_t		batch;
+	gridWork_t		*work;
+	srfGridMesh_t	*grid;
+	dsurface_t		*ds;
+	vec3_t			bounds[2];
+	vec3_t			tmpVec;
+	int				numSlots;
+	int				first, n, i, j;
+
+	if (!numMeshes)
+	{
+		return;
+	}
+
+	numSlots = ri.ThreadCount ();
+	if (numSlots > numMeshes)
+	{
+		numSlots = numMeshes;
+	}
+	work = ri.Hunk_AllocateTempMemory (numSlots * sizeof (*work));
+
+	batch.surfaces = surfaces;
+	batch.verts = verts;
+	batch.work = work;
+
+	for (first = 0; first < numMeshes; first += n)
 	{
-		bounds[0][i] = LittleFloat (ds->lightmapVecs[0][i]);
-		bounds[1][i] = LittleFloat (ds->lightmapVecs[1][i]);
+		n = numMeshes - first;
+		if (n > numSlots)
+		{
+			n = numSlots;
+		}
+
+		batch.surfaceNums = surfaceNums + first;
+		ri.RunJobs (R_SubdivideMeshJob, &batch, n);
+
+		for (i = 0; i < n; i++)
+		{
+			ds = surfaces + surfaceNums[first + i];
+
+			grid = R_CreateSurfaceGridMesh (work[i].width, work[i].height, work[i].ctrl, work[i].errorTable);
+			s_worldData.surfaces[surfaceNums[first + i]].data = (surfaceType_t *) grid;
+
+			// copy the level of detail origin, which is the center
+			// of the group of all curves that must subdivide the same
+			// to avoid cracking
+			for (j = 0; j < 3; j++)
+			{
+				bounds[0][j] = LittleFloat (ds->lightmapVecs[0][j]);
+				bounds[1][j] = LittleFloat (ds->lightmapVecs[1][j]);
+			}
+			VectorAdd (bounds[0], bounds[1], bounds[1]);
+			VectorScale (bounds[1], 0.5f, grid->lodOrigin);
+			VectorSubtract (bounds[0], grid->lodOrigin, tmpVec);
+			grid->lodRadius = VectorLength (tmpVec);
+		}
 	}
-	VectorAdd (bounds[0], bounds[1], bounds[1]);
-	VectorScale (bounds[1], 0.5f, grid->lodOrigin);
-	VectorSubtract (bounds[0], grid->lodOrigin, tmpVec);
-	grid->lodRadius = VectorLength (tmpVec);
+
+	ri.Hunk_FreeTempMemory (work);
 }
 
 /*
@@ -1205,6 +1318,52 @@ void R_MovePatchSurfacesToHunk (void)
 	}
 }
 
+/*
+=================
+R_SetSurfaceBounds
+
+The world walk frustum culls surfaces by these before looking at the
+surfaces themselves.  Must be called once the patches are final.
+=================
+*/
+static	void R_SetSurfaceBounds (void)
+{
+	msurface_t	*surf;
+	vec3_t		*bounds;
+	int			i, j;
+
+	bounds = ri.Hunk_Alloc (s_worldData.numsurfaces * 2 * sizeof (vec3_t), h_low);
+	s_worldData.surfaceBounds = bounds;
+
+	for (i = 0, surf = s_worldData.surfaces; i < s_worldData.numsurfaces; i++, surf++, bounds += 2)
+	{
+		switch (*surf->data)
+		{
+		case SF_FACE:
+			{
+				srfSurfaceFace_t	*face = (srfSurfaceFace_t *) surf->data;
+
+				ClearBounds (bounds[0], bounds[1]);
+				for (j = 0; j < face->numPoints; j++)
+				{
+					AddPointToBounds (face->points[j], bounds[0], bounds[1]);
+				}
+			}
+			break;
+		case SF_GRID:
+			VectorCopy (((srfGridMesh_t *) surf->data)->meshBounds[0], bounds[0]);
+			VectorCopy (((srfGridMesh_t *) surf->data)->meshBounds[1], bounds[1]);
+			break;
+		case SF_TRIANGLES:
+			VectorCopy (((srfTriangles_t *) surf->data)->bounds[0], bounds[0]);
+			VectorCopy (((srfTriangles_t *) surf->data)->bounds[1], bounds[1]);
+			break;
+		default:
+			break;		// flares and skipped patches are never culled
+		}
+	}
+}
+
 /*
 ===============
 R_LoadSurfaces
@@ -1218,6 +1377,7 @@ static	void R_LoadSurfaces (lump_t *surfs, lump_t *verts, lump_t *indexLump)
 	int			*indexes;
 	int			count;
 	int			numFaces, numMeshes, numTriSurfs, numFlares;
+	int			*meshNums, numSubdivided;
 	int			i;
 
 	numFaces = 0;
@@ -1243,12 +1403,19 @@ static	void R_LoadSurfaces (lump_t *surfs, lump_t *verts, lump_t *indexLump)
 	s_worldData.surfaces = out;
 	s_worldData.numsurfaces = count;
 
+	// the patches are subdivided together after all the surfaces are read
+	meshNums = ri.Hunk_AllocateTempMemory (count * sizeof (*meshNums));
+	numSubdivided = 0;
+
 	for (i = 0; i < count; i++, in++, out++)
 	{
 		switch (LittleLong (in->surfaceType))
 		{
 		case MST_PATCH:
-			ParseMesh (in, dv, out);
+			if (ParseMesh (in, out))
+			{
+				meshNums[numSubdivided++] = i;
+			}
 			numMeshes++;
 			break;
 		case MST_TRIANGLE_SOUP:
@@ -1268,6 +1435,14 @@ static	void R_LoadSurfaces (lump_t *surfs, lump_t *verts, lump_t *indexLump)
 		}
 	}
 
+	ri.BeginLoadStage ("patch subdivision");
+	R_SubdivideMeshes (in - count, dv, meshNums, numSubdivided);
+	ri.EndLoadStage ();
+
+	ri.Hunk_FreeTempMemory (meshNums);
+
+	ri.BeginLoadStage ("patch stitching");
+
 #ifdef PATCH_STITCHING
 	R_StitchAllPatches ();
 #endif
@@ -1278,6 +1453,10 @@ static	void R_LoadSurfaces (lump_t *surfs, lump_t *verts, lump_t *indexLump)
 	R_MovePatchSurfacesToHunk ();
 #endif
 
+	ri.EndLoadStage ();
+
+	R_SetSurfaceBounds ();
+
 	ri.Printf (PRINT_ALL, "...loaded %d faces, %i meshes, %i trisurfs, %i flares\n",
 		numFaces, numMeshes, numTriSurfs, numFlares);
 }
@@ -1338,9 +1517,43 @@ static	void R_SetParent (mnode_t *node, mnode_t *parent)
 {
 	node->parent = parent;
 	if (node->contents != -1)
+	{
+		node->numLeafs = 1;
 		return;
+	}
 	R_SetParent (node->children[0], node);
 	R_SetParent (node->children[1], node);
+	node->numLeafs = node->children[0]->numLeafs + node->children[1]->numLeafs;
+}
+
+/*
+=================
+R_FlattenNodes
+
+Copies the tree below node into s_worldData.cullNodes in depth first
+order, front side first, and returns the next free cull node
+=================
+*/
+static	int R_FlattenNodes (mnode_t *node, int num)
+{
+	mcullnode_t	*cull = &s_worldData.cullNodes[num];
+
+	node->cullNum = num;
+	s_worldData.cullNodeSources[num] = node;
+
+	VectorCopy (node->mins, cull->mins);
+	VectorCopy (node->maxs, cull->maxs);
+	cull->visframe = 0;
+	num++;
+
+	if (node->contents == -1)
+	{
+		num = R_FlattenNodes (node->children[0], num);
+		num = R_FlattenNodes (node->children[1], num);
+	}
+
+	cull->next = num;
+	return num;
 }
 
 /*
@@ -1420,6 +1633,17 @@ static	void R_LoadNodesAndLeafs (lump_t *nodeLump, lump_t *leafLump)
 
 	// chain decendants
 	R_SetParent (s_worldData.nodes, NULL);
+
+	// and lay them out for the frustum walk
+	s_worldData.cullNodes = ri.Hunk_Alloc (s_worldData.numnodes * sizeof (*s_worldData.cullNodes), h_low);
+	s_worldData.cullNodeSources = ri.Hunk_Alloc (s_worldData.numnodes * sizeof (*s_worldData.cullNodeSources), h_low);
+	s_worldData.numCullNodes = R_FlattenNodes (s_worldData.nodes, 0);
+
+	for (i = 0; i < VIS_CACHE_SIZE; i++)
+	{
+		s_worldData.visCache[i].cluster = -1;
+		s_worldData.visCache[i].nodes = ri.Hunk_Alloc (s_worldData.numCullNodes * sizeof (int), h_low);
+	}
 }
 
 //=============================================================================
@@ -1840,7 +2064,9 @@ void RE_LoadWorldMap (const char *name)
 	tr.worldMapLoaded = qtrue;
 
 	// load it
+	ri.BeginLoadStage ("read bsp");
 	ri.FS_ReadFile (name, (void **) &buffer);
+	ri.EndLoadStage ();
 	if (!buffer)
 	{
 		ri.Error (ERR_DROP, "RE_LoadWorldMap: %s not found", name);
@@ -1877,10 +2103,18 @@ void RE_LoadWorldMap (const char *name)
 
 	// load into heap
 	R_LoadShaders (&header->lumps[LUMP_SHADERS]);
+
+	ri.BeginLoadStage ("lightmaps");
 	R_LoadLightmaps (&header->lumps[LUMP_LIGHTMAPS]);
+	ri.EndLoadStage ();
+
 	R_LoadPlanes (&header->lumps[LUMP_PLANES]);
 	R_LoadFogs (&header->lumps[LUMP_FOGS], &header->lumps[LUMP_BRUSHES], &header->lumps[LUMP_BRUSHSIDES]);
+
+	ri.BeginLoadStage ("surfaces");
 	R_LoadSurfaces (&header->lumps[LUMP_SURFACES], &header->lumps[LUMP_DRAWVERTS], &header->lumps[LUMP_DRAWINDEXES]);
+	ri.EndLoadStage ();
+
 	R_LoadMarksurfaces (&header->lumps[LUMP_LEAFSURFACES]);
 	R_LoadNodesAndLeafs (&header->lumps[LUMP_NODES], &header->lumps[LUMP_LEAFS]);
 	R_LoadSubmodels (&header->lumps[LUMP_MODELS]);
@@ -55,7 +55,11 @@ void R_PerformanceCounters (void)
 	}
 	else if (r_speeds->integer == 3)
 	{
-		ri.Printf (PRINT_ALL, "viewcluster: %i\n", tr.viewCluster);
+		int total = tr.world ? tr.world->visCacheHits + tr.world->visCacheMisses : 0;
+
+		ri.Printf (PRINT_ALL, "viewcluster: %i  %i leafs  vis cache %i hits %i misses (%.1f%% of %i since load)\n",
+			tr.viewCluster, tr.pc.c_leafs, tr.pc.c_visCacheHits, tr.pc.c_visCacheMisses,
+			total ? 100.0f * tr.world->visCacheHits / total : 0.0f, total);
 	}
 	else if (r_speeds->integer == 4)
 	{
@@ -77,6 +81,176 @@ void R_PerformanceCounters (void)
 }
 
 
+/*
+=====================
+R_FrameTimes
+
+With r_frameTimes set every frame's front end (RE_RenderScene) and
+back end (RB_ExecuteRenderCommands) CPU time is collected until the
+frametimes command reports and clears it, along with the time between
+RE_EndFrame calls and the time the main thread spent blocked on the
+render thread.  With r_smp the back end time is for the frame before,
+which was being drawn while this one was built.  Timedemo runs report
+and clear on their own.  Pair with r_nullBackend to leave the driver
+and the GPU out of the back end number.
+=====================
+*/
+static int		ft_frames;
+static int		ft_intervals;
+static int		ft_lastEndFrame;
+static double	ft_frontEndTotal, ft_backEndTotal, ft_waitTotal, ft_frameTotal;
+static int		ft_frontEndMax, ft_backEndMax, ft_waitMax, ft_frameMax;
+
+static void R_FrameTimes (int frontEndUsec, int backEndUsec, int waitUsec)
+{
+	int		now, frameUsec;
+
+	if (!r_frameTimes->integer)
+	{
+		ft_lastEndFrame = 0;
+		return;
+	}
+
+	now = ri.Microseconds ();
+	frameUsec = ft_lastEndFrame ? now - ft_lastEndFrame : 0;
+	ft_lastEndFrame = now;
+
+	if (r_frameTimes->integer == 2)
+	{
+		ri.Printf (PRINT_ALL, "frame %i: %i usec front end, %i usec back end, %i usec waiting, %i usec total\n",
+			ft_frames, frontEndUsec, backEndUsec, waitUsec, frameUsec);
+	}
+
+	ft_frames++;
+	ft_frontEndTotal += frontEndUsec;
+	ft_backEndTotal += backEndUsec;
+	ft_waitTotal += waitUsec;
+
+	if (frontEndUsec > ft_frontEndMax) ft_frontEndMax = frontEndUsec;
+	if (backEndUsec > ft_backEndMax) ft_backEndMax = backEndUsec;
+	if (waitUsec > ft_waitMax) ft_waitMax = waitUsec;
+
+	if (frameUsec)
+	{
+		ft_intervals++;
+		ft_frameTotal += frameUsec;
+
+		if (frameUsec > ft_frameMax) ft_frameMax = frameUsec;
+	}
+}
+
+
+void R_FrameTimes_f (void)
+{
+	if (ri.Cmd_Argc () < 2 || Q_stricmp (ri.Cmd_Argv (1), "reset"))
+	{
+		if (!ft_frames)
+		{
+			ri.Printf (PRINT_ALL, "no frame times collected, set r_frameTimes 1 first\n");
+			return;
+		}
+
+		ri.Printf (PRINT_ALL, "%i frames%s%s\n", ft_frames,
+			glConfig.smpActive ? " (render thread)" : "",
+			r_nullBackend->integer ? " (null back end)" : "");
+		ri.Printf (PRINT_ALL, "front end: %.3f msec avg, %.3f msec max\n", ft_frontEndTotal / ft_frames * 0.001, ft_frontEndMax * 0.001);
+		ri.Printf (PRINT_ALL, "back end:  %.3f msec avg, %.3f msec max\n", ft_backEndTotal / ft_frames * 0.001, ft_backEndMax * 0.001);
+		ri.Printf (PRINT_ALL, "waiting:   %.3f msec avg, %.3f msec max\n", ft_waitTotal / ft_frames * 0.001, ft_waitMax * 0.001);
+
+		if (ft_intervals)
+			ri.Printf (PRINT_ALL, "frame:     %.3f msec avg, %.3f msec max\n", ft_frameTotal / ft_intervals * 0.001, ft_frameMax * 0.001);
+
+		// whatever part of the back end the main thread didn't wait for ran alongside it
+		if (glConfig.smpActive && ft_backEndTotal > 0)
+		{
+			double overlap = (ft_backEndTotal - ft_waitTotal) / ft_backEndTotal;
+
+			ri.Printf (PRINT_ALL, "overlap:   %.1f%% of the back end, %i syncs blocked on render, %i on main\n",
+				(overlap > 0 ? overlap : 0) * 100.0, c_blockedOnRender, c_blockedOnMain);
+		}
+	}
+
+	ft_frames = ft_intervals = 0;
+	ft_lastEndFrame = 0;
+	ft_frontEndTotal = ft_backEndTotal = ft_waitTotal = ft_frameTotal = 0;
+	ft_frontEndMax = ft_backEndMax = ft_waitMax = ft_frameMax = 0;
+
+	c_blockedOnRender = c_blockedOnMain = 0;
+}
+
+
+/*
+====================
+R_InitCommandBuffers
+====================
+*/
+void R_InitCommandBuffers (void)
+{
+	glConfig.smpActive = qfalse;
+
+	if (r_smp->integer)
+	{
+		ri.Printf (PRINT_ALL, "Trying SMP acceleration...\n");
+
+		if (GLimp_SpawnRenderThread (RB_RenderThread))
+		{
+			ri.Printf (PRINT_ALL, "...succeeded.\n");
+			glConfig.smpActive = qtrue;
+		}
+		else
+		{
+			ri.Printf (PRINT_ALL, "...failed.\n");
+		}
+	}
+}
+
+
+/*
+====================
+R_ShutdownCommandBuffers
+====================
+*/
+void R_ShutdownCommandBuffers (void)
+{
+	// kill the rendering thread
+	if (glConfig.smpActive)
+	{
+		GLimp_FrontEndSleep ();
+		GLimp_WakeRenderer (NULL);
+		glConfig.smpActive = qfalse;
+	}
+
+	R_WriteScreenshot ();
+}
+
+
+/*
+====================
+R_BackEndRequests
+
+Does what the back end leaves to the main thread, because the render
+thread can't use the file system or allocate.  Called while the back end
+is idle, between running one command list and the next.
+====================
+*/
+static void R_BackEndRequests (void)
+{
+	int		i, drawn;
+
+	// advance the cinematics the render thread drew, ready for the next frame
+	drawn = backEnd.cinematicsDrawn;
+	backEnd.cinematicsDrawn = 0;
+
+	for (i = 0; drawn; i++, drawn >>= 1)
+	{
+		if (drawn & 1)
+			ri.CIN_RunCinematic (i);
+	}
+
+	R_WriteScreenshot ();
+}
+
+
 /*
 ====================
 R_IssueRenderCommands
@@ -85,9 +259,13 @@ R_IssueRenderCommands
 int	c_blockedOnRender;
 int	c_blockedOnMain;
 
+static int	r_backEndMsec;		// the last back end run collected by R_IssueRenderCommands
+static int	r_backEndUsec;
+static int	r_waitUsec;			// main thread time blocked on the render thread this frame
+
 void R_IssueRenderCommands (qboolean runPerformanceCounters)
 {
-	renderCommandList_t	*cmdList = &backEndData.commands;
+	renderCommandList_t	*cmdList = &backEndData[tr.smpFrame].commands;
 
 	assert (cmdList); // bk001205
 
@@ -97,6 +275,28 @@ void R_IssueRenderCommands (qboolean runPerformanceCounters)
 	// clear it out, in case this is a sync and not a buffer flip
 	cmdList->used = 0;
 
+	if (glConfig.smpActive)
+	{
+		// if the render thread is not idle, wait for it
+		if (renderThreadActive)
+		{
+			c_blockedOnRender++;
+
+			if (r_showSmp->integer)
+				ri.Printf (PRINT_ALL, "R");
+		}
+		else
+		{
+			c_blockedOnMain++;
+
+			if (r_showSmp->integer)
+				ri.Printf (PRINT_ALL, ".");
+		}
+
+		// sleep until the renderer has completed
+		R_WaitRenderThread ();
+	}
+
 	// at this point, the back end thread is idle, so it is ok
 	// to look at it's performance counters
 	if (runPerformanceCounters)
@@ -105,10 +305,83 @@ void R_IssueRenderCommands (qboolean runPerformanceCounters)
 	}
 
 	// actually start the commands going
-	if (!r_skipBackEnd->integer)
+	if (!r_skipBackEnd->integer && !glConfig.smpActive)
 	{
 		RB_ExecuteRenderCommands (cmdList->cmds);
 	}
+
+	// still idle, so collect the back end times before it starts on
+	// the new batch; with the render thread they're the last frame's
+	if (runPerformanceCounters)
+	{
+		r_backEndMsec = backEnd.msec;
+		r_backEndUsec = backEnd.usec;
+		backEnd.msec = backEnd.usec = 0;
+	}
+
+	R_BackEndRequests ();
+
+	// let it start on the new batch
+	if (!r_skipBackEnd->integer && glConfig.smpActive)
+	{
+		GLimp_WakeRenderer (cmdList->cmds);
+	}
+}
+
+
+/*
+====================
+R_BackEndMessages
+
+Prints what the render thread left with RB_Printf, and raises the error
+it stopped on with RB_Error, if any.  The render thread has to be idle.
+====================
+*/
+static void R_BackEndMessages (void)
+{
+	int		i;
+	char	text[MAX_STRING_CHARS];
+
+	for (i = 0; i < backEnd.numMessages && i < MAX_BACKEND_MESSAGES; i++)
+	{
+		ri.Printf (backEnd.messageLevels[i], "%s", backEnd.messages[i]);
+	}
+	if (backEnd.numMessages > MAX_BACKEND_MESSAGES)
+	{
+		ri.Printf (PRINT_WARNING, "...%i more back end messages\n", backEnd.numMessages - MAX_BACKEND_MESSAGES);
+	}
+	backEnd.numMessages = 0;
+
+	if (backEnd.aborted)
+	{
+		backEnd.aborted = qfalse;
+		Q_strncpyz (text, backEnd.errorMessage, sizeof (text));
+
+		ri.Error (backEnd.errorCode, "%s", text);
+	}
+}
+
+
+/*
+====================
+R_WaitRenderThread
+
+Wait for the render thread to go idle without giving it anything new,
+for front end code that needs the device or the tesselator for itself
+====================
+*/
+void R_WaitRenderThread (void)
+{
+	int start;
+
+	if (!glConfig.smpActive)
+		return;
+
+	start = ri.Microseconds ();
+	GLimp_FrontEndSleep ();
+	r_waitUsec += ri.Microseconds () - start;
+
+	R_BackEndMessages ();
 }
 
 
@@ -129,6 +402,7 @@ void R_SyncRenderThread (void)
 		return;
 
 	R_IssueRenderCommands (qfalse);
+	R_WaitRenderThread ();
 	RB_EmulateGLFinish ();
 }
 
@@ -142,7 +416,7 @@ render thread if needed.
 */
 void *R_GetCommandBuffer (int bytes)
 {
-	renderCommandList_t	*cmdList = &backEndData.commands;
+	renderCommandList_t	*cmdList = &backEndData[tr.smpFrame].commands;
 
 	// always leave room for the end of list command
 	if (cmdList->used + bytes + 4 > MAX_RENDER_COMMANDS)
@@ -265,8 +539,6 @@ void RE_BeginFrame (stereoFrame_t stereoFrame)
 {
 	if (!QGL_CheckScene ()) return;
 
-	glState.finishCalled = qfalse;
-
 	tr.frameCount++;
 	tr.frameSceneNum = 0;
 
@@ -313,14 +585,21 @@ void RE_EndFrame (int *frontEndMsec, int *backEndMsec)
 	// may still be rendering into the current ones
 	R_ToggleSmpFrame ();
 
+	R_FrameTimes (tr.frontEndUsec, r_backEndUsec, r_waitUsec);
+	tr.frontEndUsec = 0;
+	r_waitUsec = 0;
+
+	R_EndSortCapture ();
+
 	if (frontEndMsec)
 		*frontEndMsec = tr.frontEndMsec;
 
 	tr.frontEndMsec = 0;
 
 	if (backEndMsec)
-		*backEndMsec = backEnd.pc.msec;
+		*backEndMsec = r_backEndMsec;
 
-	backEnd.pc.msec = 0;
+	r_backEndMsec = 0;
+	r_backEndUsec = 0;
 }
 
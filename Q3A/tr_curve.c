@@ -411,19 +411,25 @@ void R_FreeSurfaceGridMesh (srfGridMesh_t *grid)
 
 /*
 =================
-R_SubdividePatchToGrid
+R_SubdividePatch
+
+Subdivides into work without allocating anything or touching
+any other state, so it can run on the job threads
 =================
 */
-srfGridMesh_t *R_SubdividePatchToGrid (int width, int height,
-	drawVert_t points[MAX_PATCH_SIZE*MAX_PATCH_SIZE])
+void R_SubdividePatch (int width, int height,
+	drawVert_t points[MAX_PATCH_SIZE*MAX_PATCH_SIZE], gridWork_t *work)
 {
 	int			i, j, k, l;
 	drawVert_t	prev, next, mid;
 	float		len, maxLen;
 	int			dir;
 	int			t;
-	MAC_STATIC drawVert_t	ctrl[MAX_GRID_SIZE][MAX_GRID_SIZE];
-	float		errorTable[2][MAX_GRID_SIZE];
+	drawVert_t	(*ctrl)[MAX_GRID_SIZE];
+	float		(*errorTable)[MAX_GRID_SIZE];
+
+	ctrl = work->ctrl;
+	errorTable = work->errorTable;
 
 	for (i = 0; i < width; i++)
 	{
@@ -592,7 +598,23 @@ srfGridMesh_t *R_SubdividePatchToGrid (int width, int height,
 	// calculate normals
 	MakeMeshNormals (width, height, ctrl);
 
-	return R_CreateSurfaceGridMesh (width, height, ctrl, errorTable);
+	work->width = width;
+	work->height = height;
+}
+
+/*
+=================
+R_SubdividePatchToGrid
+=================
+*/
+srfGridMesh_t *R_SubdividePatchToGrid (int width, int height,
+	drawVert_t points[MAX_PATCH_SIZE*MAX_PATCH_SIZE])
+{
+	static gridWork_t	work;
+
+	R_SubdividePatch (width, height, points, &work);
+
+	return R_CreateSurfaceGridMesh (work.width, work.height, work.ctrl, work.errorTable);
 }
 
 /*
@@ -104,6 +104,9 @@ void GL_TextureMode (const char *string)
 	{
 		if (!Q_stricmp (modes[i].name, string))
 		{
+			if (r_nullBackend->integer)
+				return;
+
 			for (int stage = 0; stage < MAX_SHADER_STAGES; stage++)
 			{
 				if (stage == 2)
@@ -561,7 +564,7 @@ IDirect3DTexture9 *R_CreateTexture (int width, int height, qboolean mipmap)
 		&texture,
 		NULL)))
 	{
-		ri.Error (ERR_FATAL, "R_CreateTexture : unable to create texture at %i x %i", scaled_width, scaled_height);
+		RB_Error (ERR_FATAL, "R_CreateTexture : unable to create texture at %i x %i", scaled_width, scaled_height);
 		return NULL;
 	}
 
@@ -673,6 +676,16 @@ void R_FillTexture (IDirect3DTexture9 *tex, const unsigned *data, int width, int
 
 void R_Upload32 (image_t *image, const unsigned *data)
 {
+	if (r_nullBackend->integer)
+	{
+		// keep the image for shader and lookup purposes but there is nothing to upload to
+		image->uploadWidth = image->width;
+		image->uploadHeight = image->height;
+		image->internalFormat = D3DFMT_A8R8G8B8;
+		image->texnum = NULL;
+		return;
+	}
+
 	IDirect3DTexture9 *texture = R_CreateTexture (image->width, image->height, image->mipmap);
 	D3DSURFACE_DESC sd;
 
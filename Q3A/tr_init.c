@@ -44,8 +44,11 @@ cvar_t	*r_detailTextures;
 
 cvar_t	*r_znear;
 
+cvar_t	*r_smp;
 cvar_t	*r_showSmp;
 cvar_t	*r_skipBackEnd;
+cvar_t	*r_nullBackend;
+cvar_t	*r_frameTimes;
 
 cvar_t	*r_ignorehwgamma;
 
@@ -67,6 +70,8 @@ cvar_t	*r_nocull;
 cvar_t	*r_facePlaneCull;
 cvar_t	*r_showcluster;
 cvar_t	*r_nocurves;
+cvar_t	*r_parallelSurfaces;
+cvar_t	*r_visCache;
 
 cvar_t	*r_allowExtensions;
 
@@ -176,7 +181,23 @@ static void InitOpenGL (void)
 	//		- r_ignorehwgamma
 	//		- r_gamma
 
-	if (glConfig.vidWidth == 0)
+	if (glConfig.vidWidth == 0 && r_nullBackend->integer)
+	{
+		// no window and no device; the back end still runs but discards every draw
+		if (!R_GetModeInfo (&glConfig.vidWidth, &glConfig.vidHeight, &glConfig.windowAspect, r_mode->integer))
+			R_GetModeInfo (&glConfig.vidWidth, &glConfig.vidHeight, &glConfig.windowAspect, 3);
+
+		Q_strncpyz (glConfig.vendor_string, "none", sizeof (glConfig.vendor_string));
+		Q_strncpyz (glConfig.renderer_string, "null back end", sizeof (glConfig.renderer_string));
+		Q_strncpyz (glConfig.version_string, "none", sizeof (glConfig.version_string));
+
+		glConfig.maxTextureSize = 2048;
+		glConfig.maxActiveTextures = 8;
+		glConfig.colorBits = 32;
+		glConfig.depthBits = 24;
+		glConfig.stencilBits = 8;
+	}
+	else if (glConfig.vidWidth == 0)
 	{
 		GLimp_Init ();
 
@@ -193,6 +214,9 @@ static void InitOpenGL (void)
 		}
 	}
 
+	// init command buffers and SMP
+	R_InitCommandBuffers ();
+
 	// print info
 	GfxInfo_f ();
 
@@ -509,9 +533,12 @@ void GL_SetDefaultState (void)
 	for (int i = 0; i < MAX_SHADER_STAGES; i++)
 	{
 		// set all shader stages to trilinear
-		d3d_Device->lpVtbl->SetSamplerState (d3d_Device, i, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
-		d3d_Device->lpVtbl->SetSamplerState (d3d_Device, i, D3DSAMP_MIPFILTER, D3DTEXF_LINEAR);
-		d3d_Device->lpVtbl->SetSamplerState (d3d_Device, i, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+		if (!r_nullBackend->integer)
+		{
+			d3d_Device->lpVtbl->SetSamplerState (d3d_Device, i, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+			d3d_Device->lpVtbl->SetSamplerState (d3d_Device, i, D3DSAMP_MIPFILTER, D3DTEXF_LINEAR);
+			d3d_Device->lpVtbl->SetSamplerState (d3d_Device, i, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+		}
 
 		// these must also recache
 		glState.currenttextures[i] = NULL;
@@ -592,6 +619,9 @@ void GfxInfo_f (void)
 	ri.Printf (PRINT_ALL, "texturemode: %s\n", r_textureMode->string);
 	ri.Printf (PRINT_ALL, "texture bits: %d\n", r_texturebits->integer);
 
+	if (glConfig.smpActive)
+		ri.Printf (PRINT_ALL, "Using dual processor acceleration\n");
+
 	if (r_finish->integer)
 		ri.Printf (PRINT_ALL, "Forcing glFinish\n");
 }
@@ -673,6 +703,8 @@ void R_Register (void)
 	r_desaturate_lightmaps = ri.Cvar_Get ("r_desaturate_lightmaps", "1", CVAR_ARCHIVE);
 
 	r_facePlaneCull = ri.Cvar_Get ("r_facePlaneCull", "1", CVAR_ARCHIVE);
+	r_parallelSurfaces = ri.Cvar_Get ("r_parallelSurfaces", "1", CVAR_ARCHIVE);
+	r_visCache = ri.Cvar_Get ("r_visCache", "1", CVAR_ARCHIVE);
 
 	r_railWidth = ri.Cvar_Get ("r_railWidth", "16", CVAR_ARCHIVE);
 	r_railCoreWidth = ri.Cvar_Get ("r_railCoreWidth", "6", CVAR_ARCHIVE);
@@ -696,8 +728,11 @@ void R_Register (void)
 	r_lightmap = ri.Cvar_Get ("r_lightmap", "0", 0);
 	r_portalOnly = ri.Cvar_Get ("r_portalOnly", "0", CVAR_CHEAT);
 
+	r_smp = ri.Cvar_Get ("r_smp", "0", CVAR_ARCHIVE | CVAR_LATCH);
 	r_showSmp = ri.Cvar_Get ("r_showSmp", "0", CVAR_CHEAT);
 	r_skipBackEnd = ri.Cvar_Get ("r_skipBackEnd", "0", CVAR_CHEAT);
+	r_nullBackend = ri.Cvar_Get ("r_nullBackend", "0", CVAR_LATCH);
+	r_frameTimes = ri.Cvar_Get ("r_frameTimes", "0", 0);
 
 	r_lodscale = ri.Cvar_Get ("r_lodscale", "5", CVAR_CHEAT);
 	r_norefresh = ri.Cvar_Get ("r_norefresh", "0", CVAR_CHEAT);
@@ -726,6 +761,9 @@ void R_Register (void)
 	ri.Cmd_AddCommand ("modelist", R_ModeList_f);
 	ri.Cmd_AddCommand ("screenshot", R_ScreenShot_f);
 	ri.Cmd_AddCommand ("gfxinfo", GfxInfo_f);
+	ri.Cmd_AddCommand ("frametimes", R_FrameTimes_f);
+	ri.Cmd_AddCommand ("sortcapture", R_SortCapture_f);
+	ri.Cmd_AddCommand ("sortbench", R_SortBench_f);
 }
 
 /*
@@ -800,6 +838,9 @@ void RE_Shutdown (qboolean destroyWindow)
 	ri.Cmd_RemoveCommand ("gfxinfo");
 	ri.Cmd_RemoveCommand ("modelist");
 	ri.Cmd_RemoveCommand ("shaderstate");
+	ri.Cmd_RemoveCommand ("frametimes");
+	ri.Cmd_RemoveCommand ("sortcapture");
+	ri.Cmd_RemoveCommand ("sortbench");
 
 	if (tr.registered)
 	{
@@ -808,6 +849,9 @@ void RE_Shutdown (qboolean destroyWindow)
 		GL_ShutdownPrograms ();
 	}
 
+	// stop the render thread even if we never got registered
+	R_ShutdownCommandBuffers ();
+
 	R_DoneFreeType ();
 
 	// shut down platform specific OpenGL stuff
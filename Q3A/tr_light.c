@@ -98,11 +98,11 @@ void R_DlightBmodel (bmodel_t *bmodel)
 		surf = bmodel->firstSurface + i;
 
 		if (*surf->data == SF_FACE)
-			((srfSurfaceFace_t *) surf->data)->dlightBits = mask;
+			((srfSurfaceFace_t *) surf->data)->dlightBits[tr.smpFrame] = mask;
 		else if (*surf->data == SF_GRID)
-			((srfGridMesh_t *) surf->data)->dlightBits = mask;
+			((srfGridMesh_t *) surf->data)->dlightBits[tr.smpFrame] = mask;
 		else if (*surf->data == SF_TRIANGLES)
-			((srfTriangles_t *) surf->data)->dlightBits = mask;
+			((srfTriangles_t *) surf->data)->dlightBits[tr.smpFrame] = mask;
 	}
 }
 
@@ -359,6 +359,85 @@ void R_SetupEntityLighting (const trRefdef_t *refdef, trRefEntity_t *ent)
 }
 
 
+/*
+=================
+R_PrelightEntities
+
+Lights the md3 entities that are likely to be drawn on the job threads,
+before R_AddEntitySurfaces adds them in order.  The cull here is a loose
+sphere test on the full detail model; anything it gets wrong is still
+lit by R_AddMD3Surfaces as before.
+=================
+*/
+#define	PRELIGHT_ENTITIES_PER_JOB	16
+
+static qboolean R_CullEntityFrame (trRefEntity_t *ent, md3Header_t *header, int frameNum)
+{
+	md3Frame_t	*frame;
+	vec3_t		origin;
+
+	// R_AddMD3Surfaces validates the frames later
+	if (frameNum < 0 || frameNum >= header->numFrames)
+		return qfalse;
+
+	frame = (md3Frame_t *) ((byte *) header + header->ofsFrames) + frameNum;
+
+	VectorCopy (ent->e.origin, origin);
+	VectorMA (origin, frame->localOrigin[0], ent->e.axis[0], origin);
+	VectorMA (origin, frame->localOrigin[1], ent->e.axis[1], origin);
+	VectorMA (origin, frame->localOrigin[2], ent->e.axis[2], origin);
+
+	return (R_CullPointAndRadius (origin, frame->radius) == CULL_OUT);
+}
+
+static void R_PrelightEntityJob (void *data, int index)
+{
+	int first = index * PRELIGHT_ENTITIES_PER_JOB;
+
+	for (int i = first; i < first + PRELIGHT_ENTITIES_PER_JOB && i < tr.refdef.num_entities; i++)
+	{
+		trRefEntity_t	*ent = &tr.refdef.entities[i];
+		model_t			*model;
+		md3Header_t		*header;
+
+		if (ent->lightingCalculated || ent->e.reType != RT_MODEL)
+			continue;
+
+		// the same entities R_AddEntitySurfaces and R_AddMD3Surfaces skip
+		if ((ent->e.renderfx & RF_FIRST_PERSON) && tr.viewParms.isPortal)
+			continue;
+
+		if ((ent->e.renderfx & RF_THIRD_PERSON) && !tr.viewParms.isPortal && r_shadows->integer <= 1)
+			continue;
+
+		model = R_GetModelByHandle (ent->e.hModel);
+
+		if (!model || model->type != MOD_MESH)
+			continue;
+
+		header = model->md3[0];
+
+		// upscaled entities are never sphere culled
+		if (!ent->e.nonNormalizedAxes &&
+			R_CullEntityFrame (ent, header, ent->e.frame) && R_CullEntityFrame (ent, header, ent->e.oldframe))
+			continue;
+
+		R_SetupEntityLighting (&tr.refdef, ent);
+	}
+}
+
+void R_PrelightEntities (void)
+{
+	int numJobs = (tr.refdef.num_entities + PRELIGHT_ENTITIES_PER_JOB - 1) / PRELIGHT_ENTITIES_PER_JOB;
+
+	// LogLight prints, which the job threads can't do
+	if (!r_parallelSurfaces->integer || r_debugLight->integer || numJobs < 2)
+		return;
+
+	ri.RunJobs (R_PrelightEntityJob, NULL, numJobs);
+}
+
+
 /*
 =================
 R_LightForPoint
@@ -30,6 +30,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "tr_public.h"
 #include "qgl.h"
 #include "tr_matrix.h"
+#include <setjmp.h>
 
 #define GL_INDEX_TYPE		GL_UNSIGNED_INT
 typedef unsigned int glIndex_t;
@@ -41,6 +42,11 @@ long myftol (float f);
 #define	myftol(x) ((int)(x))
 #endif
 
+// everything that is needed by the backend needs
+// to be double buffered to allow it to run in
+// parallel on a dual cpu machine
+#define	SMP_FRAMES		2
+
 // 12 bits
 // see QSORT_SHADERNUM_SHIFT
 #define	MAX_SHADERS				16384
@@ -601,7 +607,7 @@ typedef struct srfGridMesh_s
 	surfaceType_t	surfaceType;
 
 	// dynamic lighting information
-	int				dlightBits;
+	int				dlightBits[SMP_FRAMES];
 
 	// culling information
 	vec3_t			meshBounds[2];
@@ -632,7 +638,7 @@ typedef struct srfSurfaceFace_s
 	cplane_t	plane;
 
 	// dynamic lighting information
-	int			dlightBits;
+	int			dlightBits[SMP_FRAMES];
 
 	// triangle definitions (no normals at points)
 	int			numPoints;
@@ -649,7 +655,7 @@ typedef struct
 	surfaceType_t	surfaceType;
 
 	// dynamic lighting information
-	int				dlightBits;
+	int				dlightBits[SMP_FRAMES];
 
 	// culling information (FIXME: use this!)
 	vec3_t			bounds[2];
@@ -700,9 +706,10 @@ typedef struct mnode_s
 {
 	// common with leaf and node
 	int			contents;		// -1 for nodes, to differentiate from leafs
-	int			visframe;		// node needs to be traversed if current
+	int			cullNum;		// into tr.world->cullNodes
 	vec3_t		mins, maxs;		// for bounding box culling
 	struct mnode_s	*parent;
+	int			numLeafs;		// in this subtree, for splitting the world walk into jobs
 
 	// node specific
 	cplane_t	*plane;
@@ -716,6 +723,36 @@ typedef struct mnode_s
 	int			nummarksurfaces;
 } mnode_t;
 
+/*
+** mcullnode_t
+** The world nodes in depth first order, packed for the frustum walk.
+** children[0] is always the next cull node and children[1] is where the
+** subtree of children[0] ends, so a leaf is a node whose own subtree ends
+** right after it.
+*/
+typedef struct
+{
+	vec3_t		mins;
+	int			visframe;		// node needs to be traversed if current
+	vec3_t		maxs;
+	int			next;			// first cull node past this subtree
+} mcullnode_t;
+
+/*
+** visCacheEntry_t
+** The cull nodes R_MarkLeaves marked for one view cluster and area mask
+*/
+#define	VIS_CACHE_SIZE		8
+
+typedef struct
+{
+	int			cluster;		// -1 while unused
+	byte		areamask[MAX_MAP_AREA_BYTES];
+	int			lastUsed;		// tr.visCount when last marked, for finding the oldest
+	int			numNodes;
+	int			*nodes;			// room for numCullNodes
+} visCacheEntry_t;
+
 typedef struct
 {
 	vec3_t		bounds[2];		// for culling
@@ -742,8 +779,16 @@ typedef struct
 	int			numDecisionNodes;
 	mnode_t		*nodes;
 
+	int			numCullNodes;
+	mcullnode_t	*cullNodes;
+	mnode_t		**cullNodeSources;	// the node behind each cull node
+
+	visCacheEntry_t	visCache[VIS_CACHE_SIZE];
+	int			visCacheHits, visCacheMisses;	// since the map was loaded
+
 	int			numsurfaces;
 	msurface_t	*surfaces;
+	vec3_t		*surfaceBounds;		// mins and maxs, two per surface, of the faces, grids and triangle surfaces
 
 	int			nummarksurfaces;
 	msurface_t	**marksurfaces;
@@ -849,6 +894,7 @@ typedef struct
 	int		c_box_cull_md3_in, c_box_cull_md3_clip, c_box_cull_md3_out;
 
 	int		c_leafs;
+	int		c_visCacheHits, c_visCacheMisses;
 	int		c_dlightSurfaces;
 	int		c_dlightSurfacesCulled;
 } frontEndCounters_t;
@@ -888,18 +934,33 @@ typedef struct
 	int		c_flareAdds;
 	int		c_flareTests;
 	int		c_flareRenders;
-
-	int		msec;			// total msec for backend run
 } backEndCounters_t;
 
+#define	MAX_BACKEND_MESSAGES	8
+#define	MAX_BACKEND_MESSAGE		256
+
 // all state modified by the back end is seperated
 // from the front end state
 typedef struct
 {
+	int			smpFrame;
 	trRefdef_t	refdef;
 	viewParms_t	viewParms;
 	orientationr_t	or;
 	backEndCounters_t	pc;
+	int			msec;			// total msec for backend runs since RE_EndFrame
+	int			usec;			// same, for r_frameTimes; not in pc due to clearing issue
+	int			cinematicsDrawn;	// videoMap handles the render thread drew, for R_BackEndRequests
+
+	// the render thread can't print or raise errors, RB_Printf and RB_Error
+	// leave them here for R_WaitRenderThread
+	int			numMessages;		// can be more than MAX_BACKEND_MESSAGES, the rest are dropped
+	int			messageLevels[MAX_BACKEND_MESSAGES];
+	char		messages[MAX_BACKEND_MESSAGES][MAX_BACKEND_MESSAGE];
+	qboolean	aborted;			// the last command list stopped on an error
+	int			errorCode;
+	char		errorMessage[MAX_STRING_CHARS];
+	jmp_buf		abortCommands;		// RB_Error on the render thread comes back here
 	qboolean	isHyperspace;
 	trRefEntity_t	*currentEntity;
 	qboolean	skyRenderedThisView;	// flag for drawing sun
@@ -930,6 +991,8 @@ typedef struct
 
 	int						frameSceneNum;	// zeroed at RE_BeginFrame
 
+	int						smpFrame;		// toggles from 0 to 1 every RE_EndFrame with r_smp
+
 	qboolean				worldMapLoaded;
 	world_t					*world;
 
@@ -968,6 +1031,7 @@ typedef struct
 	qboolean				hasStretchRaw;
 	qboolean				screenshotRequested;
 	char					screenshotName[256];
+	IDirect3DSurface9		*screenshotSurface;		// copied out by RB_SwapBuffers for R_WriteScreenshot
 
 	orientationr_t			or;					// for current entity
 
@@ -980,6 +1044,7 @@ typedef struct
 
 	frontEndCounters_t		pc;
 	int						frontEndMsec;		// not in pc due to clearing issue
+	int						frontEndUsec;
 
 	// put large tables at the end, so most elements will be
 	// within the +/32K indexed range on risc processors
@@ -1057,6 +1122,8 @@ extern	cvar_t	*r_nocull;
 extern	cvar_t	*r_facePlaneCull;		// enables culling of planar surfaces with back side test
 extern	cvar_t	*r_nocurves;
 extern	cvar_t	*r_showcluster;
+extern	cvar_t	*r_parallelSurfaces;	// generate world surfaces and entity lighting on the job threads
+extern	cvar_t	*r_visCache;			// reuse the nodes marked for recently seen view clusters
 
 extern cvar_t	*r_mode;				// video mode
 extern cvar_t	*r_fullscreen;
@@ -1104,8 +1171,11 @@ extern	cvar_t	*r_portalOnly;
 
 extern	cvar_t	*r_subdivisions;
 extern	cvar_t	*r_lodCurveError;
+extern	cvar_t	*r_smp;
 extern	cvar_t	*r_showSmp;
 extern	cvar_t	*r_skipBackEnd;
+extern	cvar_t	*r_nullBackend;			// run the back end without a device, nothing is drawn
+extern	cvar_t	*r_frameTimes;			// 1 = collect front and back end times, 2 = also print each frame
 
 extern	cvar_t	*r_ignoreGLErrors;
 
@@ -1224,6 +1294,10 @@ void	R_SkinList_f (void);
 // https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=516
 const void *RB_TakeScreenshotCmd (const void *data);
 void	R_ScreenShot_f (void);
+void	R_FrameTimes_f (void);
+void	R_SortCapture_f (void);
+void	R_SortBench_f (void);
+void	R_EndSortCapture (void);
 
 void	R_InitFogTable (void);
 float	R_FogFactor (float s, float t);
@@ -1262,6 +1336,11 @@ void GLimp_Init (void);
 void GLimp_Shutdown (void);
 void GLimp_EndFrame (void);
 
+qboolean GLimp_SpawnRenderThread (void (*function) (void));
+void *GLimp_RendererSleep (void);
+void GLimp_FrontEndSleep (void);
+void GLimp_WakeRenderer (void *data);
+
 void GLimp_LogComment (char *comment);
 
 // NOTE TTimo linux works with float gamma value, not the gamma table
@@ -1338,6 +1417,7 @@ LIGHTS
 
 void R_DlightBmodel (bmodel_t *bmodel);
 void R_SetupEntityLighting (const trRefdef_t *refdef, trRefEntity_t *ent);
+void R_PrelightEntities (void);
 void R_TransformDlights (int count, dlight_t *dl, orientationr_t *or);
 int R_LightForPoint (vec3_t point, vec3_t ambientLight, vec3_t directedLight, vec3_t lightDir);
 
@@ -1365,7 +1445,20 @@ CURVE TESSELATION
 
 #define PATCH_STITCHING
 
+// a subdivided patch before it is copied out to a srfGridMesh_t,
+// so the subdivision can run on the job threads
+typedef struct
+{
+	int			width;
+	int			height;
+	drawVert_t	ctrl[MAX_GRID_SIZE][MAX_GRID_SIZE];
+	float		errorTable[2][MAX_GRID_SIZE];
+} gridWork_t;
+
+void R_SubdividePatch (int width, int height, drawVert_t points[MAX_PATCH_SIZE*MAX_PATCH_SIZE], gridWork_t *work);
 srfGridMesh_t *R_SubdividePatchToGrid (int width, int height, drawVert_t points[MAX_PATCH_SIZE*MAX_PATCH_SIZE]);
+srfGridMesh_t *R_CreateSurfaceGridMesh (int width, int height,
+	drawVert_t ctrl[MAX_GRID_SIZE][MAX_GRID_SIZE], float errorTable[2][MAX_GRID_SIZE]);
 srfGridMesh_t *R_GridInsertColumn (srfGridMesh_t *grid, int column, int row, vec3_t point, float loderror);
 srfGridMesh_t *R_GridInsertRow (srfGridMesh_t *grid, int row, int column, vec3_t point, float loderror);
 void R_FreeSurfaceGridMesh (srfGridMesh_t *grid);
@@ -1426,6 +1519,7 @@ RENDERER BACK END FUNCTIONS
 */
 
 void RB_ExecuteRenderCommands (const void *data);
+void RB_RenderThread (void);
 
 /*
 =============================================================
@@ -1529,6 +1623,7 @@ typedef enum
 typedef struct
 {
 	drawSurf_t	drawSurfs[MAX_DRAWSURFS];
+	drawSurf_t	sortScratch[MAX_DRAWSURFS];	// R_SortDrawSurfList ping-pongs through this
 	dlight_t	dlights[MAX_DLIGHTS];
 	trRefEntity_t	entities[MAX_ENTITIES];
 	srfPoly_t	polys[MAX_POLYS];
@@ -1536,13 +1631,25 @@ typedef struct
 	renderCommandList_t	commands;
 } backEndData_t;
 
-extern	backEndData_t	backEndData;
+extern	backEndData_t	backEndData[SMP_FRAMES];
+
+extern	volatile qboolean	renderThreadActive;
+
+extern	int		c_blockedOnRender;
+extern	int		c_blockedOnMain;
+
+void R_InitCommandBuffers (void);
+void R_ShutdownCommandBuffers (void);
 
 
 void *R_GetCommandBuffer (int bytes);
 void RB_ExecuteRenderCommands (const void *data);
+void QDECL RB_Printf (int printLevel, const char *fmt, ...);
+void QDECL RB_Error (int code, const char *fmt, ...);
 
 void R_SyncRenderThread (void);
+void R_WaitRenderThread (void);
+void R_WriteScreenshot (void);
 
 void R_AddDrawSurfCmd (drawSurf_t *drawSurfs, int numDrawSurfs);
 
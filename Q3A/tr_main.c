@@ -761,6 +761,9 @@ static qboolean SurfIsOffscreen (const drawSurf_t *drawSurf, vec4_t clipDest[128
 
 	R_RotateForViewer (&tr.viewParms);
 
+	// the surface is tesselated into the back end's buffers
+	R_WaitRenderThread ();
+
 	R_DecomposeSort (drawSurf->sort, &entityNum, &shader, &fogNum, &dlighted);
 	RB_BeginSurface (shader, fogNum);
 	rb_surfaceTable[*drawSurf->surface] (drawSurf->surface);
@@ -1129,6 +1132,349 @@ recurse:
 }
 
 
+/*
+=================
+radix sort
+
+The sort keys are 32 bit unsigned so they go through a stable LSD radix
+sort, 11 bits per pass.  All three histograms are built in one read of
+the list and a pass whose digit is the same for every surface is skipped,
+which is usually the case for the fog/dlight bits and often for the top
+shader bits.
+=================
+*/
+#define	RADIX_BITS		11
+#define	RADIX_SIZE		(1 << RADIX_BITS)
+#define	RADIX_MASK		(RADIX_SIZE - 1)
+#define	RADIX_PASSES	3
+
+// below this many surfaces qsortFast wins over clearing and scanning the histograms
+#define	RADIX_MIN_SURFS	768
+
+static void R_RadixSortDrawSurfs (drawSurf_t *drawSurfs, drawSurf_t *scratch, int numDrawSurfs)
+{
+	int			histogram[RADIX_PASSES][RADIX_SIZE];
+	drawSurf_t	*src = drawSurfs;
+	drawSurf_t	*dst = scratch;
+	int			i, pass, shift;
+
+	Com_Memset (histogram, 0, sizeof (histogram));
+
+	for (i = 0; i < numDrawSurfs; i++)
+	{
+		unsigned sort = drawSurfs[i].sort;
+
+		histogram[0][sort & RADIX_MASK]++;
+		histogram[1][(sort >> RADIX_BITS) & RADIX_MASK]++;
+		histogram[2][sort >> (RADIX_BITS * 2)]++;
+	}
+
+	for (pass = 0, shift = 0; pass < RADIX_PASSES; pass++, shift += RADIX_BITS)
+	{
+		int			*count = histogram[pass];
+		int			offset = 0;
+		drawSurf_t	*temp;
+
+		// every surface has the same digit so this pass would only copy
+		if (count[(src->sort >> shift) & RADIX_MASK] == numDrawSurfs)
+			continue;
+
+		// turn the counts into the first slot for each digit
+		for (i = 0; i < RADIX_SIZE; i++)
+		{
+			int c = count[i];
+
+			count[i] = offset;
+			offset += c;
+		}
+
+		for (i = 0; i < numDrawSurfs; i++)
+			dst[count[(src[i].sort >> shift) & RADIX_MASK]++] = src[i];
+
+		temp = src;
+		src = dst;
+		dst = temp;
+	}
+
+	// an odd number of passes leaves the result in the scratch buffer
+	if (src != drawSurfs)
+		Com_Memcpy (drawSurfs, src, numDrawSurfs * sizeof (drawSurf_t));
+}
+
+
+/*
+=================
+R_InsertionSortDrawSurfs
+
+Gives up and returns qfalse once more than maxMoves surfaces have been
+shifted.  The list is still a permutation of the original, so the caller
+can finish it with the radix sort.
+=================
+*/
+static qboolean R_InsertionSortDrawSurfs (drawSurf_t *drawSurfs, int numDrawSurfs, int maxMoves)
+{
+	for (int i = 1; i < numDrawSurfs; i++)
+	{
+		drawSurf_t	surf;
+		int			j;
+
+		if (drawSurfs[i].sort >= drawSurfs[i - 1].sort)
+			continue;
+
+		surf = drawSurfs[i];
+
+		for (j = i; j > 0 && drawSurfs[j - 1].sort > surf.sort; j--)
+			drawSurfs[j] = drawSurfs[j - 1];
+
+		drawSurfs[j] = surf;
+
+		if ((maxMoves -= i - j) < 0)
+			return qfalse;
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+R_SortDrawSurfList
+
+Lists that are already in order or close to it (2D scenes, a list
+sorted again for the same view) are finished in place.  The move budget
+stops a few badly placed surfaces from making that quadratic; anything
+over it goes to the radix sort, or to qsortFast for short lists.
+=================
+*/
+void R_SortDrawSurfList (drawSurf_t *drawSurfs, int numDrawSurfs)
+{
+	if (R_InsertionSortDrawSurfs (drawSurfs, numDrawSurfs, numDrawSurfs))
+		return;
+
+	if (numDrawSurfs < RADIX_MIN_SURFS)
+		qsortFast (drawSurfs, numDrawSurfs, sizeof (drawSurf_t));
+	else R_RadixSortDrawSurfs (drawSurfs, backEndData[tr.smpFrame].sortScratch, numDrawSurfs);
+}
+
+
+/*
+=================
+R_SortCapture
+
+sortcapture <name> [frames] saves the sort keys of every R_SortDrawSurfs
+call over the next few frames to sortcapture/<name>.dsk, as a list count
+followed by each list's length and keys.  sortbench replays them.
+
+A busy capture can grow to many megabytes, so it lives in malloc memory
+rather than the zone.  If malloc fails the lists captured so far are
+written at the end of the frame.
+=================
+*/
+#define	MAX_SORT_CAPTURE_FRAMES	100
+
+static char		r_sortCaptureName[MAX_QPATH];
+static int		r_sortCaptureFrames;
+static unsigned	*r_sortCapture;
+static int		r_sortCaptureSize;
+static int		r_sortCaptureUsed;
+static qboolean	r_sortCaptureFull;
+
+static void R_CaptureSortKeys (const drawSurf_t *drawSurfs, int numDrawSurfs)
+{
+	if (r_sortCaptureFull)
+		return;
+
+	if (r_sortCaptureUsed + 1 + numDrawSurfs > r_sortCaptureSize)
+	{
+		int			size = (r_sortCaptureSize + 1 + numDrawSurfs) * 2;
+		unsigned	*capture = realloc (r_sortCapture, size * sizeof (unsigned));
+
+		if (!capture)
+		{
+			ri.Printf (PRINT_WARNING, "sort capture out of memory after %i lists\n", r_sortCapture[0]);
+			r_sortCaptureFull = qtrue;
+			r_sortCaptureFrames = 1;
+			return;
+		}
+
+		r_sortCapture = capture;
+		r_sortCaptureSize = size;
+	}
+
+	// slot 0 holds the number of lists
+	r_sortCapture[0]++;
+	r_sortCapture[r_sortCaptureUsed++] = numDrawSurfs;
+
+	for (int i = 0; i < numDrawSurfs; i++)
+		r_sortCapture[r_sortCaptureUsed++] = drawSurfs[i].sort;
+}
+
+
+void R_SortCapture_f (void)
+{
+	if (ri.Cmd_Argc () < 2)
+	{
+		ri.Printf (PRINT_ALL, "usage: sortcapture <name> [frames]\n");
+		return;
+	}
+
+	if (r_sortCapture)
+	{
+		ri.Printf (PRINT_ALL, "a sort capture is already running\n");
+		return;
+	}
+
+	Com_sprintf (r_sortCaptureName, sizeof (r_sortCaptureName), "sortcapture/%s.dsk", ri.Cmd_Argv (1));
+
+	r_sortCaptureFrames = (ri.Cmd_Argc () > 2) ? atoi (ri.Cmd_Argv (2)) : 1;
+
+	if (r_sortCaptureFrames < 1) r_sortCaptureFrames = 1;
+	if (r_sortCaptureFrames > MAX_SORT_CAPTURE_FRAMES) r_sortCaptureFrames = MAX_SORT_CAPTURE_FRAMES;
+
+	r_sortCaptureSize = MAX_DRAWSURFS;
+	r_sortCaptureUsed = 1;
+	r_sortCaptureFull = qfalse;
+	r_sortCapture = malloc (r_sortCaptureSize * sizeof (unsigned));
+
+	if (!r_sortCapture)
+	{
+		ri.Printf (PRINT_WARNING, "sortcapture: couldn't allocate %i keys\n", r_sortCaptureSize);
+		return;
+	}
+
+	r_sortCapture[0] = 0;
+}
+
+
+/*
+=================
+R_EndSortCapture
+
+Called at the end of every frame
+=================
+*/
+void R_EndSortCapture (void)
+{
+	if (!r_sortCapture || --r_sortCaptureFrames > 0)
+		return;
+
+	ri.FS_WriteFile (r_sortCaptureName, r_sortCapture, r_sortCaptureUsed * sizeof (unsigned));
+	ri.Printf (PRINT_ALL, "Wrote %i sort lists to %s\n", r_sortCapture[0], r_sortCaptureName);
+
+	free (r_sortCapture);
+	r_sortCapture = NULL;
+	r_sortCaptureSize = r_sortCaptureUsed = 0;
+}
+
+
+/*
+=================
+R_SortBench_f
+
+sortbench <name> [passes] times qsortFast against R_SortDrawSurfList on
+the lists in a sortcapture file, once from capture order and once from
+already sorted input, and checks that both give the same key order.
+=================
+*/
+void R_SortBench_f (void)
+{
+	unsigned	*capture, *keys;
+	drawSurf_t	*surfs, *sorted;
+	int			length, numLists, passes;
+	int			qsortUsec = 0, radixUsec = 0, sortedUsec = 0, totalSurfs = 0;
+	qboolean	ok = qtrue;
+
+	if (ri.Cmd_Argc () < 2)
+	{
+		ri.Printf (PRINT_ALL, "usage: sortbench <name> [passes]\n");
+		return;
+	}
+
+	passes = (ri.Cmd_Argc () > 2) ? atoi (ri.Cmd_Argv (2)) : 100;
+
+	if (passes < 1) passes = 1;
+
+	length = ri.FS_ReadFile (va ("sortcapture/%s.dsk", ri.Cmd_Argv (1)), (void **) &capture);
+
+	if (length < (int) sizeof (unsigned))
+	{
+		ri.Printf (PRINT_ALL, "couldn't load sortcapture/%s.dsk\n", ri.Cmd_Argv (1));
+		return;
+	}
+
+	surfs = ri.Hunk_AllocateTempMemory (MAX_DRAWSURFS * 2 * sizeof (drawSurf_t));
+	sorted = surfs + MAX_DRAWSURFS;
+	numLists = capture[0];
+	keys = capture + 1;
+
+	for (int list = 0; list < numLists; list++)
+	{
+		int numSurfs = *keys++;
+		int start;
+
+		if (numSurfs < 1 || numSurfs > MAX_DRAWSURFS || (byte *) (keys + numSurfs) > (byte *) capture + length)
+		{
+			ri.Printf (PRINT_ALL, "sortcapture/%s.dsk is damaged at list %i\n", ri.Cmd_Argv (1), list);
+			break;
+		}
+
+		for (int pass = 0; pass < passes; pass++)
+		{
+			for (int i = 0; i < numSurfs; i++)
+			{
+				surfs[i].sort = keys[i];
+				surfs[i].surface = NULL;
+			}
+
+			start = ri.Microseconds ();
+			qsortFast (surfs, numSurfs, sizeof (drawSurf_t));
+			qsortUsec += ri.Microseconds () - start;
+		}
+
+		for (int pass = 0; pass < passes; pass++)
+		{
+			for (int i = 0; i < numSurfs; i++)
+			{
+				sorted[i].sort = keys[i];
+				sorted[i].surface = NULL;
+			}
+
+			start = ri.Microseconds ();
+			R_SortDrawSurfList (sorted, numSurfs);
+			radixUsec += ri.Microseconds () - start;
+		}
+
+		for (int i = 0; i < numSurfs; i++)
+		{
+			if (sorted[i].sort != surfs[i].sort)
+				ok = qfalse;
+		}
+
+		// and again with the output of the last sort, as a fully coherent frame would be
+		for (int pass = 0; pass < passes; pass++)
+		{
+			start = ri.Microseconds ();
+			R_SortDrawSurfList (sorted, numSurfs);
+			sortedUsec += ri.Microseconds () - start;
+		}
+
+		totalSurfs += numSurfs;
+		keys += numSurfs;
+	}
+
+	ri.Hunk_FreeTempMemory (surfs);
+	ri.FS_FreeFile (capture);
+
+	if (!totalSurfs)
+		return;
+
+	ri.Printf (PRINT_ALL, "%i lists, %i surfaces, %i passes%s\n", numLists, totalSurfs, passes, ok ? "" : " (ORDER MISMATCH)");
+	ri.Printf (PRINT_ALL, "qsortFast:   %8.3f msec per pass\n", qsortUsec * 0.001 / passes);
+	ri.Printf (PRINT_ALL, "radix:       %8.3f msec per pass\n", radixUsec * 0.001 / passes);
+	ri.Printf (PRINT_ALL, "presorted:   %8.3f msec per pass\n", sortedUsec * 0.001 / passes);
+}
+
+
 //==========================================================================================
 
 /*
@@ -1189,8 +1535,11 @@ void R_SortDrawSurfs (drawSurf_t *drawSurfs, int numDrawSurfs)
 	if (numDrawSurfs > MAX_DRAWSURFS)
 		numDrawSurfs = MAX_DRAWSURFS;
 
+	if (r_sortCapture)
+		R_CaptureSortKeys (drawSurfs, numDrawSurfs);
+
 	// sort the drawsurfs by sort type, then orientation, then shader
-	qsortFast (drawSurfs, numDrawSurfs, sizeof (drawSurf_t));
+	R_SortDrawSurfList (drawSurfs, numDrawSurfs);
 
 	// check for any pass through drawing, which
 	// may cause another view to be rendered first
@@ -1232,6 +1581,9 @@ void R_AddEntitySurfaces (void)
 	if (!r_drawentities->integer)
 		return;
 
+	// light the entities in parallel, the surfaces are still added in order
+	R_PrelightEntities ();
+
 	for (tr.currentEntityNum = 0; tr.currentEntityNum < tr.refdef.num_entities; tr.currentEntityNum++)
 	{
 		ent = tr.currentEntity = &tr.refdef.entities[tr.currentEntityNum];
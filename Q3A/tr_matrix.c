@@ -292,7 +292,8 @@ static void RB_UpdateMVPMatrix (void)
 	// and send them all to our shaders
 	// (this assumes that the layout is consistent and matches what we've used here, which it will be
 	// so long as we use the VSREG_ defines everywhere and don't change them
-	d3d_Device->lpVtbl->SetVertexShaderConstantF (d3d_Device, VSREG_MVPMATRIX, (float *) r_mvp_matrix, 12);
+	if (!r_nullBackend->integer)
+		d3d_Device->lpVtbl->SetVertexShaderConstantF (d3d_Device, VSREG_MVPMATRIX, (float *) r_mvp_matrix, 12);
 }
 
 
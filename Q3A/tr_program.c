@@ -311,6 +311,9 @@ void R_ProgramOnResetDevice (void)
 
 void GL_InitPrograms (void)
 {
+	if (r_nullBackend->integer)
+		return;
+
 	// statically linking to d3dcompiler.lib causes it to use d3dcompiler_47.dll which is not on Windows 7 so link dynamically instead
 	if (!hInstCompiler)
 	{
@@ -466,6 +469,9 @@ void R_CreateHLSLProgramFromShader (shader_t *sh)
 		// set the TMU that will be used by this stage
 		pStage->TMU = i;
 
+		// nothing to compile for
+		if (r_nullBackend->integer) continue;
+
 		D3D_SHADER_MACRO stageDefines[128];	// fixme - make this big enough?
 		int currStageDefine = numStaticDefines;
 
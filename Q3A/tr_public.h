@@ -24,7 +24,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "tr_types.h"
 
-#define	REF_API_VERSION		8
+#define	REF_API_VERSION		11
 
 //
 // these are the functions exported by the refresh module
@@ -110,6 +110,7 @@ typedef struct
 	// milliseconds should only be used for profiling, never
 	// for anything game related.  Get time from the refdef
 	int (*Milliseconds)(void);
+	int (*Microseconds)(void);
 
 	// stack based memory allocation for per-level things that
 	// won't be freed
@@ -152,6 +153,20 @@ typedef struct
 	int (*CIN_PlayCinematic)(const char *arg0, int xpos, int ypos, int width, int height, int bits);
 	e_status (*CIN_RunCinematic) (int handle);
 
+	// stage times for map_loadtime
+	void	(*BeginLoadStage)(const char *name);
+	void	(*EndLoadStage)(void);
+
+	// the engine's job threads, see Sys_RunJobs; job functions
+	// must not call back into any of the other imports
+	int		(*ThreadCount)(void);
+	void	(*RunJobs)(void (*func)(void *data, int index), void *data, int count);
+
+	// per-thread scratch that is cleared every frame, see Frame_Alloc
+	void	*(*FrameAlloc)(int size);
+	frameMark_t	(*FrameMark)(void);
+	void	(*FrameRelease)(frameMark_t mark);
+
 } refimport_t;
 
 
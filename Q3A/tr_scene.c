@@ -45,7 +45,14 @@ R_ToggleSmpFrame
 */
 void R_ToggleSmpFrame (void)
 {
-	backEndData.commands.used = 0;
+	if (glConfig.smpActive)
+	{
+		// flip to the buffers the render thread isn't reading
+		tr.smpFrame ^= 1;
+	}
+	else tr.smpFrame = 0;
+
+	backEndData[tr.smpFrame].commands.used = 0;
 
 	r_firstSceneDrawSurf = 0;
 
@@ -141,11 +148,11 @@ void RE_AddPolyToScene (qhandle_t hShader, int numVerts, const polyVert_t *verts
 			return;
 		}
 
-		poly = &backEndData.polys[r_numpolys];
+		poly = &backEndData[tr.smpFrame].polys[r_numpolys];
 		poly->surfaceType = SF_POLY;
 		poly->hShader = hShader;
 		poly->numVerts = numVerts;
-		poly->verts = &backEndData.polyVerts[r_numpolyverts];
+		poly->verts = &backEndData[tr.smpFrame].polyVerts[r_numpolyverts];
 
 		Com_Memcpy (poly->verts, &verts[numVerts*j], numVerts * sizeof (*verts));
 
@@ -206,8 +213,8 @@ void RE_AddRefEntityToScene (const refEntity_t *ent)
 	if (ent->reType < 0 || ent->reType >= RT_MAX_REF_ENTITY_TYPE)
 		ri.Error (ERR_DROP, "RE_AddRefEntityToScene: bad reType %i", ent->reType);
 
-	backEndData.entities[r_numentities].e = *ent;
-	backEndData.entities[r_numentities].lightingCalculated = qfalse;
+	backEndData[tr.smpFrame].entities[r_numentities].e = *ent;
+	backEndData[tr.smpFrame].entities[r_numentities].lightingCalculated = qfalse;
 
 	r_numentities++;
 }
@@ -230,7 +237,7 @@ void RE_AddDynamicLightToScene (const vec3_t org, float intensity, float r, floa
 	if (intensity <= 0)
 		return;
 
-	dlight_t *dl = &backEndData.dlights[r_numdlights++];
+	dlight_t *dl = &backEndData[tr.smpFrame].dlights[r_numdlights++];
 
 	VectorCopy (org, dl->origin);
 
@@ -279,6 +286,7 @@ void RE_RenderScene (const refdef_t *fd)
 {
 	viewParms_t		parms;
 	int				startTime;
+	int				startUsec;
 
 	if (!QGL_CheckScene ())
 		return;
@@ -289,6 +297,7 @@ void RE_RenderScene (const refdef_t *fd)
 		return;
 
 	startTime = ri.Milliseconds ();
+	startUsec = ri.Microseconds ();
 
 	if (!tr.world && !(fd->rdflags & RDF_NOWORLDMODEL))
 		ri.Error (ERR_DROP, "R_RenderScene: NULL worldmodel");
@@ -336,16 +345,16 @@ void RE_RenderScene (const refdef_t *fd)
 	tr.refdef.floatTime = tr.refdef.time * 0.001f;
 
 	tr.refdef.numDrawSurfs = r_firstSceneDrawSurf;
-	tr.refdef.drawSurfs = backEndData.drawSurfs;
+	tr.refdef.drawSurfs = backEndData[tr.smpFrame].drawSurfs;
 
 	tr.refdef.num_entities = r_numentities - r_firstSceneEntity;
-	tr.refdef.entities = &backEndData.entities[r_firstSceneEntity];
+	tr.refdef.entities = &backEndData[tr.smpFrame].entities[r_firstSceneEntity];
 
 	tr.refdef.num_dlights = r_numdlights - r_firstSceneDlight;
-	tr.refdef.dlights = &backEndData.dlights[r_firstSceneDlight];
+	tr.refdef.dlights = &backEndData[tr.smpFrame].dlights[r_firstSceneDlight];
 
 	tr.refdef.numPolys = r_numpolys - r_firstScenePoly;
-	tr.refdef.polys = &backEndData.polys[r_firstScenePoly];
+	tr.refdef.polys = &backEndData[tr.smpFrame].polys[r_firstScenePoly];
 
 	// turn off dynamic lighting globally by clearing all the
 	// dlights if it needs to be disabled or if vertex lighting is enabled
@@ -388,5 +397,6 @@ void RE_RenderScene (const refdef_t *fd)
 	r_firstScenePoly = r_numpolys;
 
 	tr.frontEndMsec += ri.Milliseconds () - startTime;
+	tr.frontEndUsec += ri.Microseconds () - startUsec;
 }
 
@@ -63,6 +63,12 @@ static void R_TransferStaticVertexes (shaderCommands_t *input)
 	int offset = r_firststaticvert * sizeof (stagestaticvert_t);
 	int size = input->numVertexes * sizeof (stagestaticvert_t);
 
+	if (r_nullBackend->integer)
+	{
+		r_firststaticvert += input->numVertexes;
+		return;
+	}
+
 	if (SUCCEEDED (r_stageStaticVertexBuffer->lpVtbl->Lock (r_stageStaticVertexBuffer, offset, size, (void **) &verts, lockmode)))
 	{
 		memcpy (verts, r_stagestaticverts, input->numVertexes * sizeof (stagestaticvert_t));
@@ -89,6 +95,12 @@ static void R_TransferDynamicVertexes (stagedynamicvert_t *data, int numVertexes
 	int offset = r_firstdynamicvert * sizeof (stagedynamicvert_t);
 	int size = numVertexes * sizeof (stagedynamicvert_t);
 
+	if (r_nullBackend->integer)
+	{
+		r_firstdynamicvert += numVertexes;
+		return;
+	}
+
 	if (SUCCEEDED (r_stageDynamicVertexBuffer->lpVtbl->Lock (r_stageDynamicVertexBuffer, offset, size, (void **) &verts, lockmode)))
 	{
 		memcpy (verts, data, numVertexes * sizeof (stagedynamicvert_t));
@@ -115,6 +127,9 @@ static void R_TransferIndexes (shaderCommands_t *input)
 	int offset = r_firstindex * sizeof (unsigned short);
 	int size = input->numIndexes * sizeof (unsigned short);
 
+	if (r_nullBackend->integer)
+		return;
+
 	if (SUCCEEDED (r_stageIndexBuffer->lpVtbl->Lock (r_stageIndexBuffer, offset, size, (void **) &ndx, lockmode)))
 	{
 		memcpy (ndx, input->indexes, input->numIndexes * sizeof (unsigned short));
@@ -133,6 +148,9 @@ R_DrawElements
 */
 static void R_DrawElements (shaderCommands_t *input)
 {
+	if (r_nullBackend->integer)
+		return;
+
 	// issue the draw call
 	d3d_Device->lpVtbl->DrawIndexedPrimitive (
 		d3d_Device,
@@ -166,7 +184,13 @@ static void R_BindAnimatedImage (int tmu, textureBundle_t *bundle)
 {
 	if (bundle->isVideoMap)
 	{
-		ri.CIN_RunCinematic (bundle->videoMapHandle);
+		// the render thread can't decode, which reads files and allocates, so
+		// it leaves advancing the cinematic to the main thread, see R_BackEndRequests
+		if (glConfig.smpActive)
+			backEnd.cinematicsDrawn |= 1 << bundle->videoMapHandle;
+		else
+			ri.CIN_RunCinematic (bundle->videoMapHandle);
+
 		ri.CIN_UploadCinematic (bundle->videoMapHandle);
 		return;
 	}
@@ -226,6 +250,9 @@ Perform dynamic lighting with another rendering pass
 */
 static void ProjectDlightTexture (void)
 {
+	if (r_nullBackend->integer)
+		return;
+
 	for (int l = 0; l < backEnd.refdef.num_dlights; l++)
 	{
 		dlight_t *dl = &backEnd.refdef.dlights[l];
@@ -528,10 +555,12 @@ static void ComputeTexCoords (shaderStage_t *pStage)
 		break;
 
 	case TCGEN_ENVIRONMENT_MAPPED:
+		if (r_nullBackend->integer) break;
 		d3d_Device->lpVtbl->SetPixelShaderConstantF (d3d_Device, PSREG_VIEWORIGIN, backEnd.or.viewOrigin, 1);
 		break;
 
 	case TCGEN_VECTOR:
+		if (r_nullBackend->integer) break;
 		d3d_Device->lpVtbl->SetVertexShaderConstantF (d3d_Device, VSREG_TCGENVEC0, pStage->bundle.tcGenVectors[0], 1);
 		d3d_Device->lpVtbl->SetVertexShaderConstantF (d3d_Device, VSREG_TCGENVEC1, pStage->bundle.tcGenVectors[1], 1);
 		break;
@@ -592,7 +621,7 @@ static void ComputeTexCoords (shaderStage_t *pStage)
 		}
 	}
 
-	if (turb)
+	if (turb && !r_nullBackend->integer)
 	{
 		// send turbulent factors
 		d3d_Device->lpVtbl->SetVertexShaderConstantF (d3d_Device, VSREG_TMODTURBTIME, turbTime, 1);
@@ -703,10 +732,10 @@ void RB_EndSurface (void)
 		return;
 
 	if (input->indexes[SHADER_MAX_INDEXES - 1] != 0)
-		ri.Error (ERR_DROP, "RB_EndSurface() - SHADER_MAX_INDEXES hit");
+		RB_Error (ERR_DROP, "RB_EndSurface() - SHADER_MAX_INDEXES hit");
 
 	if (r_stagestaticverts[SHADER_MAX_VERTEXES - 1].xyz[0] != 0)
-		ri.Error (ERR_DROP, "RB_EndSurface() - SHADER_MAX_VERTEXES hit");
+		RB_Error (ERR_DROP, "RB_EndSurface() - SHADER_MAX_VERTEXES hit");
 
 	if (tess.shader == tr.shadowShader)
 	{
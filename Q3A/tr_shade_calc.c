@@ -45,7 +45,7 @@ static float *TableForFunc (genFunc_t func)
 		break;
 	}
 
-	ri.Error (ERR_DROP, "TableForFunc called with invalid function '%d' in shader '%s'\n", func, tess.shader->name);
+	RB_Error (ERR_DROP, "TableForFunc called with invalid function '%d' in shader '%s'\n", func, tess.shader->name);
 	return NULL;
 }
 
@@ -317,10 +317,10 @@ static void AutospriteDeform (void)
 	vec3_t	leftDir, upDir;
 
 	if (tess.numVertexes & 3)
-		ri.Printf (PRINT_WARNING, "Autosprite shader %s had odd vertex count", tess.shader->name);
+		RB_Printf (PRINT_WARNING, "Autosprite shader %s had odd vertex count\n", tess.shader->name);
 
 	if (tess.numIndexes != (tess.numVertexes >> 2) * 6)
-		ri.Printf (PRINT_WARNING, "Autosprite shader %s had odd index count", tess.shader->name);
+		RB_Printf (PRINT_WARNING, "Autosprite shader %s had odd index count\n", tess.shader->name);
 
 	oldVerts = tess.numVertexes;
 	tess.numVertexes = 0;
@@ -399,10 +399,10 @@ static void Autosprite2Deform (void)
 	vec3_t	forward;
 
 	if (tess.numVertexes & 3)
-		ri.Printf (PRINT_WARNING, "Autosprite2 shader %s had odd vertex count", tess.shader->name);
+		RB_Printf (PRINT_WARNING, "Autosprite2 shader %s had odd vertex count\n", tess.shader->name);
 
 	if (tess.numIndexes != (tess.numVertexes >> 2) * 6)
-		ri.Printf (PRINT_WARNING, "Autosprite2 shader %s had odd index count", tess.shader->name);
+		RB_Printf (PRINT_WARNING, "Autosprite2 shader %s had odd index count\n", tess.shader->name);
 
 	if (backEnd.currentEntity != &tr.worldEntity)
 		GlobalVectorToLocal (backEnd.viewParms.or.axis[0], forward);
@@ -858,6 +858,9 @@ void RB_CalcDiffuseColor (void)
 
 void RB_SetupTCModTransform (int modstage, texModInfo_t *tmi)
 {
+	if (r_nullBackend->integer)
+		return;
+
 	d3d_Device->lpVtbl->SetPixelShaderConstantF (d3d_Device, PSREG_TMODMATRIX0 + modstage, tmi->matrix[0], 1);
 	d3d_Device->lpVtbl->SetPixelShaderConstantF (d3d_Device, PSREG_TRANSLATE0 + modstage, float4 (tmi->translate[0], tmi->translate[1], 0, 0), 1);
 }
@@ -942,6 +945,9 @@ void RB_SetupTCGenFog (void)
 
 	RB_CalcFogParms (&tr.world->fogs[tess.fogNum], &fogparms);
 
+	if (r_nullBackend->integer)
+		return;
+
 	d3d_Device->lpVtbl->SetPixelShaderConstantF (d3d_Device, PSREG_FOGDISTANCE, fogparms.DistanceVector, 1);
 	d3d_Device->lpVtbl->SetPixelShaderConstantF (d3d_Device, PSREG_FOGDEPTH, fogparms.DepthVector, 1);
 	d3d_Device->lpVtbl->SetPixelShaderConstantF (d3d_Device, PSREG_FOGEYET, float4 (fogparms.eyeT, 0, 0, 0), 1);
@@ -1740,7 +1740,7 @@ sortedIndex.
 */
 static void FixRenderCommandList (int newShader)
 {
-	renderCommandList_t	*cmdList = &backEndData.commands;
+	renderCommandList_t	*cmdList = &backEndData[tr.smpFrame].commands;
 
 	if (cmdList)
 	{
@@ -2211,6 +2211,11 @@ shader_t *R_FindShader (const char *name, int lightmapIndex, qboolean mipRawImag
 		}
 	}
 
+	// make sure the render thread is stopped, because we are probably
+	// going to have to upload an image and resort the shaders
+	if (glConfig.smpActive)
+		R_SyncRenderThread ();
+
 	// clear the global shader
 	Com_Memset (&shader, 0, sizeof (shader));
 	Com_Memset (&stages, 0, sizeof (stages));
@@ -2334,6 +2339,10 @@ qhandle_t RE_RegisterShaderFromImage (const char *name, int lightmapIndex, image
 		}
 	}
 
+	// make sure the render thread is stopped
+	if (glConfig.smpActive)
+		R_SyncRenderThread ();
+
 	// clear the global shader
 	Com_Memset (&shader, 0, sizeof (shader));
 	Com_Memset (&stages, 0, sizeof (stages));
@@ -49,6 +49,7 @@ static const skypolyvert_t skyboxpolys[6][4] = {
 static void R_DrawSkyBox (image_t *boximages[], int stateBits)
 {
 	if (!boximages[0] || boximages[0] == tr.defaultImage) return;
+	if (r_nullBackend->integer) return;
 
 	GL_State (stateBits);
 	RB_SetProgram (&r_skyboxProgram);
@@ -76,7 +77,9 @@ void R_BuildCloudData (void)
 
 	R_IdentityMatrix (&skyMatrix);
 	R_TranslateMatrix (&skyMatrix, -backEnd.viewParms.or.origin[0], -backEnd.viewParms.or.origin[1], -backEnd.viewParms.or.origin[2]);
-	d3d_Device->lpVtbl->SetVertexShaderConstantF (d3d_Device, VSREG_SKYMATRIX, skyMatrix.m16, 4);
+
+	if (!r_nullBackend->integer)
+		d3d_Device->lpVtbl->SetVertexShaderConstantF (d3d_Device, VSREG_SKYMATRIX, skyMatrix.m16, 4);
 
 	// set up for drawing
 	tess.numVertexes = 8;
@@ -58,11 +58,11 @@ void RB_CheckOverflow (int verts, int indexes)
 
 	if (verts >= SHADER_MAX_VERTEXES)
 	{
-		ri.Error (ERR_DROP, "RB_CheckOverflow: verts > MAX (%d > %d)", verts, SHADER_MAX_VERTEXES);
+		RB_Error (ERR_DROP, "RB_CheckOverflow: verts > MAX (%d > %d)", verts, SHADER_MAX_VERTEXES);
 	}
 	if (indexes >= SHADER_MAX_INDEXES)
 	{
-		ri.Error (ERR_DROP, "RB_CheckOverflow: indices > MAX (%d > %d)", indexes, SHADER_MAX_INDEXES);
+		RB_Error (ERR_DROP, "RB_CheckOverflow: indices > MAX (%d > %d)", indexes, SHADER_MAX_INDEXES);
 	}
 
 	RB_BeginSurface (tess.shader, tess.fogNum);
@@ -242,7 +242,7 @@ void RB_SurfaceTriangles (srfTriangles_t *srf)
 	byte		*color;
 	int			dlightBits;
 
-	dlightBits = srf->dlightBits;
+	dlightBits = srf->dlightBits[backEnd.smpFrame];
 	tess.dlightBits |= dlightBits;
 
 	RB_CHECKOVERFLOW (srf->numVerts, srf->numIndexes);
@@ -746,7 +746,7 @@ void RB_SurfaceFace (srfSurfaceFace_t *surf)
 
 	RB_CHECKOVERFLOW (surf->numPoints, surf->numIndices);
 
-	dlightBits = surf->dlightBits;
+	dlightBits = surf->dlightBits[backEnd.smpFrame];
 	tess.dlightBits |= dlightBits;
 
 	indices = (unsigned *) (((char  *) surf) + surf->ofsIndices);
@@ -837,7 +837,7 @@ void RB_SurfaceGrid (srfGridMesh_t *cv)
 	int		numVertexes;
 	int		dlightBits;
 
-	dlightBits = cv->dlightBits;
+	dlightBits = cv->dlightBits[backEnd.smpFrame];
 	tess.dlightBits |= dlightBits;
 
 	// determine the allowable discrepance
@@ -1034,7 +1034,7 @@ void RB_SurfaceEntity (surfaceType_t *surfType)
 
 void RB_SurfaceBad (surfaceType_t *surfType)
 {
-	ri.Printf (PRINT_ALL, "Bad surface tesselated.\n");
+	RB_Printf (PRINT_ALL, "Bad surface tesselated.\n");
 }
 
 #if 0
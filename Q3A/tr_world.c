@@ -21,6 +21,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "tr_local.h"
 
+#include <xmmintrin.h>
+
 
 
 /*
@@ -52,7 +54,7 @@ Returns true if the grid is completely culled away.
 Also sets the clipped hint bit in tess
 =================
 */
-static qboolean	R_CullGrid (srfGridMesh_t *cv)
+static qboolean	R_CullGrid (srfGridMesh_t *cv, frontEndCounters_t *pc)
 {
 	int 	boxCull;
 	int 	sphereCull;
@@ -75,33 +77,33 @@ static qboolean	R_CullGrid (srfGridMesh_t *cv)
 	// check for trivial reject
 	if (sphereCull == CULL_OUT)
 	{
-		tr.pc.c_sphere_cull_patch_out++;
+		pc->c_sphere_cull_patch_out++;
 		return qtrue;
 	}
 	// check bounding box if necessary
 	else if (sphereCull == CULL_CLIP)
 	{
-		tr.pc.c_sphere_cull_patch_clip++;
+		pc->c_sphere_cull_patch_clip++;
 
 		boxCull = R_CullLocalBox (cv->meshBounds);
 
 		if (boxCull == CULL_OUT)
 		{
-			tr.pc.c_box_cull_patch_out++;
+			pc->c_box_cull_patch_out++;
 			return qtrue;
 		}
 		else if (boxCull == CULL_IN)
 		{
-			tr.pc.c_box_cull_patch_in++;
+			pc->c_box_cull_patch_in++;
 		}
 		else
 		{
-			tr.pc.c_box_cull_patch_clip++;
+			pc->c_box_cull_patch_clip++;
 		}
 	}
 	else
 	{
-		tr.pc.c_sphere_cull_patch_in++;
+		pc->c_sphere_cull_patch_in++;
 	}
 
 	return qfalse;
@@ -118,7 +120,7 @@ added to the sorting list.
 This will also allow mirrors on both sides of a model without recursion.
 ================
 */
-static qboolean	R_CullSurface (surfaceType_t *surface, shader_t *shader)
+static qboolean	R_CullSurface (surfaceType_t *surface, shader_t *shader, frontEndCounters_t *pc)
 {
 	srfSurfaceFace_t *sface;
 	float			d;
@@ -130,7 +132,7 @@ static qboolean	R_CullSurface (surfaceType_t *surface, shader_t *shader)
 
 	if (*surface == SF_GRID)
 	{
-		return R_CullGrid ((srfGridMesh_t *) surface);
+		return R_CullGrid ((srfGridMesh_t *) surface, pc);
 	}
 
 	if (*surface == SF_TRIANGLES)
@@ -179,7 +181,7 @@ static qboolean	R_CullSurface (surfaceType_t *surface, shader_t *shader)
 }
 
 
-static int R_DlightFace (srfSurfaceFace_t *face, int dlightBits)
+static int R_DlightFace (srfSurfaceFace_t *face, int dlightBits, frontEndCounters_t *pc)
 {
 	for (int i = 0; i < tr.refdef.num_dlights; i++)
 	{
@@ -197,14 +199,14 @@ static int R_DlightFace (srfSurfaceFace_t *face, int dlightBits)
 	}
 
 	if (!dlightBits)
-		tr.pc.c_dlightSurfacesCulled++;
+		pc->c_dlightSurfacesCulled++;
 
-	face->dlightBits = dlightBits;
+	face->dlightBits[tr.smpFrame] = dlightBits;
 
 	return dlightBits;
 }
 
-static int R_DlightGrid (srfGridMesh_t *grid, int dlightBits)
+static int R_DlightGrid (srfGridMesh_t *grid, int dlightBits, frontEndCounters_t *pc)
 {
 	for (int i = 0; i < tr.refdef.num_dlights; i++)
 	{
@@ -226,9 +228,9 @@ static int R_DlightGrid (srfGridMesh_t *grid, int dlightBits)
 	}
 
 	if (!dlightBits)
-		tr.pc.c_dlightSurfacesCulled++;
+		pc->c_dlightSurfacesCulled++;
 
-	grid->dlightBits = dlightBits;
+	grid->dlightBits[tr.smpFrame] = dlightBits;
 	return dlightBits;
 }
 
@@ -236,7 +238,7 @@ static int R_DlightGrid (srfGridMesh_t *grid, int dlightBits)
 static int R_DlightTrisurf (srfTriangles_t *surf, int dlightBits)
 {
 	// FIXME: more dlight culling to trisurfs...
-	surf->dlightBits = dlightBits;
+	surf->dlightBits[tr.smpFrame] = dlightBits;
 	return dlightBits;
 }
 
@@ -249,18 +251,18 @@ that is touched by one or more dlights, so try to throw out
 more dlights if possible.
 ====================
 */
-static int R_DlightSurface (msurface_t *surf, int dlightBits)
+static int R_DlightSurface (msurface_t *surf, int dlightBits, frontEndCounters_t *pc)
 {
 	if (*surf->data == SF_FACE)
-		dlightBits = R_DlightFace ((srfSurfaceFace_t *) surf->data, dlightBits);
+		dlightBits = R_DlightFace ((srfSurfaceFace_t *) surf->data, dlightBits, pc);
 	else if (*surf->data == SF_GRID)
-		dlightBits = R_DlightGrid ((srfGridMesh_t *) surf->data, dlightBits);
+		dlightBits = R_DlightGrid ((srfGridMesh_t *) surf->data, dlightBits, pc);
 	else if (*surf->data == SF_TRIANGLES)
 		dlightBits = R_DlightTrisurf ((srfTriangles_t *) surf->data, dlightBits);
 	else dlightBits = 0;
 
 	if (dlightBits)
-		tr.pc.c_dlightSurfaces++;
+		pc->c_dlightSurfaces++;
 
 	return dlightBits;
 }
@@ -283,7 +285,7 @@ static void R_AddWorldSurface (msurface_t *surf, int dlightBits)
 	// FIXME: bmodel fog?
 
 	// try to cull before dlighting or adding
-	if (R_CullSurface (surf->data, surf->shader))
+	if (R_CullSurface (surf->data, surf->shader, &tr.pc))
 	{
 		return;
 	}
@@ -291,7 +293,7 @@ static void R_AddWorldSurface (msurface_t *surf, int dlightBits)
 	// check for dlighting
 	if (dlightBits)
 	{
-		dlightBits = R_DlightSurface (surf, dlightBits);
+		dlightBits = R_DlightSurface (surf, dlightBits, &tr.pc);
 		dlightBits = (dlightBits != 0);
 	}
 
@@ -346,177 +348,529 @@ WORLD MODEL
 */
 
 
+/*
+================
+R_SetupCullPlanes
+
+The four frustum planes side by side, so a box can be tested against all
+of them at once.  Set up before the world jobs run.
+================
+*/
+typedef struct
+{
+	__m128		normal[3];		// x, y and z of each plane
+	__m128		dist;
+} cullPlanes_t;
+
+static cullPlanes_t	r_cullPlanes;
+
+static void R_SetupCullPlanes (void)
+{
+	cplane_t	*frustum = tr.viewParms.frustum;
+	int			i;
+
+	for (i = 0; i < 3; i++)
+	{
+		r_cullPlanes.normal[i] = _mm_setr_ps (frustum[0].normal[i], frustum[1].normal[i], frustum[2].normal[i], frustum[3].normal[i]);
+	}
+
+	r_cullPlanes.dist = _mm_setr_ps (frustum[0].dist, frustum[1].dist, frustum[2].dist, frustum[3].dist);
+}
+
+/*
+================
+R_CullBox
+
+BoxOnPlaneSide against each frustum plane in planeBits, four planes at a
+time.  The planes the box is completely in front of are cleared from
+planeBits, because everything inside the box is in front of them as well.
+Returns CULL_OUT, CULL_CLIP, or CULL_IN once no planes are left.
+================
+*/
+static int R_CullBox (const vec3_t mins, const vec3_t maxs, int *planeBits)
+{
+	__m128	lo, hi;
+	__m128	dist1, dist2;
+	int		front, back;
+
+	// per axis, the larger product comes from the corner furthest
+	// along the normal and the smaller one from the nearest corner
+	lo = _mm_mul_ps (r_cullPlanes.normal[0], _mm_set1_ps (mins[0]));
+	hi = _mm_mul_ps (r_cullPlanes.normal[0], _mm_set1_ps (maxs[0]));
+	dist1 = _mm_max_ps (lo, hi);
+	dist2 = _mm_min_ps (lo, hi);
+
+	lo = _mm_mul_ps (r_cullPlanes.normal[1], _mm_set1_ps (mins[1]));
+	hi = _mm_mul_ps (r_cullPlanes.normal[1], _mm_set1_ps (maxs[1]));
+	dist1 = _mm_add_ps (dist1, _mm_max_ps (lo, hi));
+	dist2 = _mm_add_ps (dist2, _mm_min_ps (lo, hi));
+
+	lo = _mm_mul_ps (r_cullPlanes.normal[2], _mm_set1_ps (mins[2]));
+	hi = _mm_mul_ps (r_cullPlanes.normal[2], _mm_set1_ps (maxs[2]));
+	dist1 = _mm_add_ps (dist1, _mm_max_ps (lo, hi));
+	dist2 = _mm_add_ps (dist2, _mm_min_ps (lo, hi));
+
+	front = _mm_movemask_ps (_mm_cmpge_ps (dist1, r_cullPlanes.dist));
+	back = _mm_movemask_ps (_mm_cmplt_ps (dist2, r_cullPlanes.dist));
+
+	// completely behind any one plane
+	if (*planeBits & back & ~front)
+	{
+		return CULL_OUT;
+	}
+
+	*planeBits &= ~(front & ~back);
+
+	return *planeBits ? CULL_CLIP : CULL_IN;
+}
+
+/*
+================
+R_CullNode
+
+Returns qtrue if nothing under the cull node can be visible
+================
+*/
+static qboolean R_CullNode (int nodeNum, int *planeBits)
+{
+	const mcullnode_t	*node = &tr.world->cullNodes[nodeNum];
+
+	// if the node wasn't marked as potentially visible, exit
+	if (node->visframe != tr.visCount)
+	{
+		return qtrue;
+	}
+
+	// if the bounding volume is outside the frustum, nothing
+	// inside can be visible OPTIMIZE: don't do this all the way to leafs?
+	if (r_nocull->integer || !*planeBits)
+	{
+		return qfalse;
+	}
+
+	return (R_CullBox (node->mins, node->maxs, planeBits) == CULL_OUT);
+}
+
+/*
+================
+R_NodeDlights
+
+Determines which dlights are needed on each side of a decision node
+================
+*/
+static void R_NodeDlights (mnode_t *node, int dlightBits, int newDlights[2])
+{
+	int		i;
+
+	newDlights[0] = 0;
+	newDlights[1] = 0;
+
+	for (i = 0; dlightBits && i < tr.refdef.num_dlights; i++)
+	{
+		dlight_t	*dl;
+		float		dist;
+
+		if (dlightBits & (1 << i))
+		{
+			dl = &tr.refdef.dlights[i];
+			dist = DotProduct (dl->origin, node->plane->normal) - node->plane->dist;
+
+			if (dist > -dl->radius)
+			{
+				newDlights[0] |= (1 << i);
+			}
+			if (dist < dl->radius)
+			{
+				newDlights[1] |= (1 << i);
+			}
+		}
+	}
+}
+
+
+/*
+The world walk is split into jobs in three steps, so the draw surfaces
+come out in exactly the order a single threaded walk would add them:
+
+1. the top of the tree is expanded into subtrees, in walk order, and each
+   subtree job collects its visible leafs into its own range of one array
+2. the leafs are walked in order on the main thread, which bounds the view
+   and picks the first leaf of each surface that spans several of them
+3. those surfaces are culled and dlighted in chunks, each chunk writing its
+   own draw surfaces and counters, which are appended in chunk order
+
+The walk goes over tr.world->cullNodes, and a leaf passes the frustum
+planes it hasn't been found completely inside of on to its surfaces.
+*/
+
+#define	MAX_WORLD_NODE_JOBS		64
+#define	WORLD_SURFS_PER_JOB		256
+
+typedef struct
+{
+	mnode_t		*leaf;
+	int			planeBits;
+	int			dlightBits;
+} worldLeaf_t;
+
+typedef struct
+{
+	int			nodeNum;		// into tr.world->cullNodes
+	int			planeBits;
+	int			dlightBits;
+
+	worldLeaf_t	*leafs;			// room for all the leafs under the node
+	int			numLeafs;
+} worldNodeJob_t;
+
+typedef struct
+{
+	msurface_t	*surf;
+	int			planeBits;
+	int			dlightBits;
+} worldSurf_t;
+
+typedef struct
+{
+	worldSurf_t			*surfs;
+	int					numSurfs;
+
+	drawSurf_t			*drawSurfs;		// room for numSurfs
+	int					numDrawSurfs;
+	frontEndCounters_t	pc;
+} worldSurfJob_t;
+
+
 /*
 ================
 R_RecursiveWorldNode
 ================
 */
-static void R_RecursiveWorldNode (mnode_t *node, int planeBits, int dlightBits)
+static void R_RecursiveWorldNode (worldNodeJob_t *job, int nodeNum, int planeBits, int dlightBits)
 {
+	const mcullnode_t	*nodes = tr.world->cullNodes;
 
 	do
 	{
 		int			newDlights[2];
 
-		// if the node wasn't marked as potentially visible, exit
-		if (node->visframe != tr.visCount)
+		if (R_CullNode (nodeNum, &planeBits))
 		{
 			return;
 		}
 
-		// if the bounding volume is outside the frustum, nothing
-		// inside can be visible OPTIMIZE: don't do this all the way to leafs?
+		if (nodes[nodeNum].next == nodeNum + 1)
+		{
+			break;
+		}
 
-		if (!r_nocull->integer)
+		// node is just a decision point, so go down both sides
+		// since we don't care about sort orders, just go positive to negative
+		R_NodeDlights (tr.world->cullNodeSources[nodeNum], dlightBits, newDlights);
+
+		// recurse down the children, front side first
+		R_RecursiveWorldNode (job, nodeNum + 1, planeBits, newDlights[0]);
+
+		// tail recurse
+		nodeNum = nodes[nodeNum + 1].next;
+		dlightBits = newDlights[1];
+	} while (1);
+
+	// leaf node, the surfaces are added in R_AddWorldLeafs
+	job->leafs[job->numLeafs].leaf = tr.world->cullNodeSources[nodeNum];
+	job->leafs[job->numLeafs].planeBits = planeBits;
+	job->leafs[job->numLeafs].dlightBits = dlightBits;
+	job->numLeafs++;
+}
+
+static void R_WorldNodeJob (void *data, int index)
+{
+	worldNodeJob_t *job = (worldNodeJob_t *) data + index;
+
+	R_RecursiveWorldNode (job, job->nodeNum, job->planeBits, job->dlightBits);
+}
+
+/*
+================
+R_SplitWorldNodes
+
+Expands the top of the tree a level at a time until there are enough
+subtrees to keep the job threads busy.  Every expanded node has already
+been culled, the nodes that are left are culled by their job.
+================
+*/
+static int R_SplitWorldNodes (worldNodeJob_t *jobs, int dlightBits)
+{
+	const mcullnode_t	*nodes = tr.world->cullNodes;
+	worldNodeJob_t		split[MAX_WORLD_NODE_JOBS];
+	int					numJobs, numSplit;
+	int					i;
+	qboolean			expanded;
+
+	jobs[0].nodeNum = 0;
+	jobs[0].planeBits = 15;
+	jobs[0].dlightBits = dlightBits;
+	numJobs = 1;
+
+	while (numJobs < MAX_WORLD_NODE_JOBS / 2)
+	{
+		expanded = qfalse;
+		numSplit = 0;
+
+		for (i = 0; i < numJobs; i++)
 		{
-			int		r;
+			int			nodeNum = jobs[i].nodeNum;
+			int			planeBits = jobs[i].planeBits;
+			int			newDlights[2];
 
-			if (planeBits & 1)
+			// leafs, and nodes whose children wouldn't fit any more, stay as they are
+			if (nodes[nodeNum].next == nodeNum + 1 || numSplit + (numJobs - i) + 1 > MAX_WORLD_NODE_JOBS)
 			{
-				r = BoxOnPlaneSide (node->mins, node->maxs, &tr.viewParms.frustum[0]);
-				if (r == 2)
-				{
-					return;						// culled
-				}
-				if (r == 1)
-				{
-					planeBits &= ~1;			// all descendants will also be in front
-				}
+				split[numSplit++] = jobs[i];
+				continue;
 			}
 
-			if (planeBits & 2)
-			{
-				r = BoxOnPlaneSide (node->mins, node->maxs, &tr.viewParms.frustum[1]);
-				if (r == 2)
-				{
-					return;						// culled
-				}
-				if (r == 1)
-				{
-					planeBits &= ~2;			// all descendants will also be in front
-				}
-			}
+			expanded = qtrue;
 
-			if (planeBits & 4)
+			if (R_CullNode (nodeNum, &planeBits))
 			{
-				r = BoxOnPlaneSide (node->mins, node->maxs, &tr.viewParms.frustum[2]);
-				if (r == 2)
-				{
-					return;						// culled
-				}
-				if (r == 1)
-				{
-					planeBits &= ~4;			// all descendants will also be in front
-				}
+				continue;
 			}
 
-			if (planeBits & 8)
-			{
-				r = BoxOnPlaneSide (node->mins, node->maxs, &tr.viewParms.frustum[3]);
-				if (r == 2)
-				{
-					return;						// culled
-				}
-				if (r == 1)
-				{
-					planeBits &= ~8;			// all descendants will also be in front
-				}
-			}
+			R_NodeDlights (tr.world->cullNodeSources[nodeNum], jobs[i].dlightBits, newDlights);
+
+			split[numSplit].nodeNum = nodeNum + 1;
+			split[numSplit].planeBits = planeBits;
+			split[numSplit].dlightBits = newDlights[0];
+			numSplit++;
 
+			split[numSplit].nodeNum = nodes[nodeNum + 1].next;
+			split[numSplit].planeBits = planeBits;
+			split[numSplit].dlightBits = newDlights[1];
+			numSplit++;
 		}
 
-		if (node->contents != -1)
+		Com_Memcpy (jobs, split, numSplit * sizeof (*jobs));
+		numJobs = numSplit;
+
+		if (!expanded)
 		{
 			break;
 		}
+	}
 
-		// node is just a decision point, so go down both sides
-		// since we don't care about sort orders, just go positive to negative
+	return numJobs;
+}
 
-		// determine which dlights are needed
-		newDlights[0] = 0;
-		newDlights[1] = 0;
-		if (dlightBits)
+/*
+================
+R_AddWorldLeafs
+
+Bounds the view with the visible leafs and gathers their surfaces, each
+with the planes and dlights of the first leaf it was found in.  Returns
+the number of surfaces.
+================
+*/
+static int R_AddWorldLeafs (worldNodeJob_t *jobs, int numJobs, worldSurf_t *surfs)
+{
+	int			numSurfs = 0;
+	int			i, j, c;
+	msurface_t	*surf, **mark;
+
+	for (i = 0; i < numJobs; i++)
+	{
+		for (j = 0; j < jobs[i].numLeafs; j++)
 		{
-			int	i;
+			worldLeaf_t	*leaf = &jobs[i].leafs[j];
 
-			for (i = 0; i < tr.refdef.num_dlights; i++)
-			{
-				dlight_t	*dl;
-				float		dist;
+			tr.pc.c_leafs++;
 
-				if (dlightBits & (1 << i))
+			// add to z buffer bounds
+			AddPointToBounds (leaf->leaf->mins, tr.viewParms.visBounds[0], tr.viewParms.visBounds[1]);
+			AddPointToBounds (leaf->leaf->maxs, tr.viewParms.visBounds[0], tr.viewParms.visBounds[1]);
+
+			// add the individual surfaces
+			mark = leaf->leaf->firstmarksurface;
+			c = leaf->leaf->nummarksurfaces;
+			while (c--)
+			{
+				// the surface may have already been added if it
+				// spans multiple leafs
+				surf = *mark++;
+				if (surf->viewCount == tr.viewCount)
 				{
-					dl = &tr.refdef.dlights[i];
-					dist = DotProduct (dl->origin, node->plane->normal) - node->plane->dist;
-
-					if (dist > -dl->radius)
-					{
-						newDlights[0] |= (1 << i);
-					}
-					if (dist < dl->radius)
-					{
-						newDlights[1] |= (1 << i);
-					}
+					continue;
 				}
+
+				surf->viewCount = tr.viewCount;
+				surfs[numSurfs].surf = surf;
+				surfs[numSurfs].planeBits = leaf->planeBits;
+				surfs[numSurfs].dlightBits = leaf->dlightBits;
+				numSurfs++;
 			}
 		}
+	}
 
-		// recurse down the children, front side first
-		R_RecursiveWorldNode (node->children[0], planeBits, newDlights[0]);
+	return numSurfs;
+}
 
-		// tail recurse
-		node = node->children[1];
-		dlightBits = newDlights[1];
-	} while (1);
+/*
+================
+R_CullWorldSurfaces
+
+Frustum culls the job's surfaces by their bounds, keeping the ones that
+are left in order, and returns how many that is.  A surface that spans
+several leafs can stick out of the one it was found in, so skipping the
+planes that leaf was inside of may keep a surface that could have been
+culled, but never culls one that is visible.
 
+Surfaces with deformVertexes are left alone, autosprite and move/wave/bulge
+deforms can carry the vertexes out of the bounds the surface was loaded with.
+================
+*/
+static int R_CullWorldSurfaces (worldSurfJob_t *job)
+{
+	vec3_t	*bounds;
+	int		numSurfs = 0;
+	int		i, cull;
+
+	if (r_nocull->integer)
 	{
-		// leaf node, so add mark surfaces
-		int			c;
-		msurface_t	*surf, **mark;
+		return job->numSurfs;
+	}
 
-		tr.pc.c_leafs++;
+	for (i = 0; i < job->numSurfs; i++)
+	{
+		worldSurf_t		*ws = &job->surfs[i];
+		surfaceType_t	type = *ws->surf->data;
 
-		// add to z buffer bounds
-		if (node->mins[0] < tr.viewParms.visBounds[0][0])
+		if (type == SF_FACE || type == SF_TRIANGLES || type == SF_GRID)
 		{
-			tr.viewParms.visBounds[0][0] = node->mins[0];
-		}
-		if (node->mins[1] < tr.viewParms.visBounds[0][1])
-		{
-			tr.viewParms.visBounds[0][1] = node->mins[1];
-		}
-		if (node->mins[2] < tr.viewParms.visBounds[0][2])
-		{
-			tr.viewParms.visBounds[0][2] = node->mins[2];
-		}
+			if (type == SF_GRID && r_nocurves->integer)
+			{
+				continue;
+			}
 
-		if (node->maxs[0] > tr.viewParms.visBounds[1][0])
-		{
-			tr.viewParms.visBounds[1][0] = node->maxs[0];
-		}
-		if (node->maxs[1] > tr.viewParms.visBounds[1][1])
-		{
-			tr.viewParms.visBounds[1][1] = node->maxs[1];
+			cull = CULL_IN;
+
+			if (ws->planeBits && !ws->surf->shader->numDeforms)
+			{
+				bounds = tr.world->surfaceBounds + (ws->surf - tr.world->surfaces) * 2;
+				cull = R_CullBox (bounds[0], bounds[1], &ws->planeBits);
+			}
+
+			if (type == SF_GRID)
+			{
+				if (cull == CULL_OUT)
+				{
+					job->pc.c_box_cull_patch_out++;
+				}
+				else if (cull == CULL_IN)
+				{
+					job->pc.c_box_cull_patch_in++;
+				}
+				else
+				{
+					job->pc.c_box_cull_patch_clip++;
+				}
+			}
+
+			if (cull == CULL_OUT)
+			{
+				continue;
+			}
 		}
-		if (node->maxs[2] > tr.viewParms.visBounds[1][2])
+
+		job->surfs[numSurfs++] = *ws;
+	}
+
+	return numSurfs;
+}
+
+/*
+================
+R_WorldSurfaceJob
+
+Same as R_AddWorldSurface, except that the draw surfaces and counters
+go to the job
+================
+*/
+static void R_WorldSurfaceJob (void *data, int index)
+{
+	worldSurfJob_t	*job = (worldSurfJob_t *) data + index;
+	int				i, numSurfs;
+
+	Com_Memset (&job->pc, 0, sizeof (job->pc));
+	job->numDrawSurfs = 0;
+
+	numSurfs = R_CullWorldSurfaces (job);
+
+	for (i = 0; i < numSurfs; i++)
+	{
+		msurface_t	*surf = job->surfs[i].surf;
+		int			dlightBits = job->surfs[i].dlightBits;
+		drawSurf_t	*drawSurf;
+
+		// the bounds took care of the frustum, which leaves the face plane
+		if (*surf->data == SF_FACE && R_CullSurface (surf->data, surf->shader, &job->pc))
 		{
-			tr.viewParms.visBounds[1][2] = node->maxs[2];
+			continue;
 		}
 
-		// add the individual surfaces
-		mark = node->firstmarksurface;
-		c = node->nummarksurfaces;
-		while (c--)
+		// check for dlighting
+		if (dlightBits)
 		{
-			// the surface may have already been added if it
-			// spans multiple leafs
-			surf = *mark;
-			R_AddWorldSurface (surf, dlightBits);
-			mark++;
+			dlightBits = R_DlightSurface (surf, dlightBits, &job->pc);
+			dlightBits = (dlightBits != 0);
 		}
+
+		// same sort as R_AddDrawSurf
+		drawSurf = &job->drawSurfs[job->numDrawSurfs++];
+		drawSurf->sort = (surf->shader->sortedIndex << QSORT_SHADERNUM_SHIFT) | tr.shiftedEntityNum | (surf->fogIndex << QSORT_FOGNUM_SHIFT) | dlightBits;
+		drawSurf->surface = surf->data;
+	}
+}
+
+/*
+================
+R_RunWorldJobs
+
+r_parallelSurfaces 0 runs the same steps on the main thread, for comparing
+front end times
+================
+*/
+static void R_RunWorldJobs (void (*func)(void *data, int index), void *data, int count)
+{
+	int		i;
+
+	if (r_parallelSurfaces->integer)
+	{
+		ri.RunJobs (func, data, count);
+		return;
 	}
 
+	for (i = 0; i < count; i++)
+	{
+		func (data, i);
+	}
+}
+
+/*
+================
+R_AddCounters
+================
+*/
+static void R_AddCounters (const frontEndCounters_t *pc)
+{
+	const int	*in = (const int *) pc;
+	int			*out = (int *) &tr.pc;
+	int			i;
+
+	// the counters are all ints
+	for (i = 0; i < sizeof (frontEndCounters_t) / sizeof (int); i++)
+	{
+		out[i] += in[i];
+	}
 }
 
 
@@ -594,20 +948,54 @@ qboolean R_inPVS (const vec3_t p1, const vec3_t p2)
 	return qtrue;
 }
 
+/*
+===============
+R_FindVisCache
+
+Returns the entry holding the cull nodes marked for the cluster and area
+mask, or NULL after setting *victim to the least recently used entry
+===============
+*/
+static visCacheEntry_t *R_FindVisCache (int cluster, visCacheEntry_t **victim)
+{
+	visCacheEntry_t	*entry;
+	int				i;
+
+	*victim = tr.world->visCache;
+
+	for (i = 0, entry = tr.world->visCache; i < VIS_CACHE_SIZE; i++, entry++)
+	{
+		if (entry->cluster == cluster && !memcmp (entry->areamask, tr.refdef.areamask, sizeof (entry->areamask)))
+		{
+			return entry;
+		}
+
+		if (entry->lastUsed < (*victim)->lastUsed)
+		{
+			*victim = entry;
+		}
+	}
+
+	return NULL;
+}
+
 /*
 ===============
 R_MarkLeaves
 
 Mark the leaves and nodes that are in the PVS for the current
-cluster
+cluster.  The nodes marked for the last few clusters and area masks are
+kept in tr.world->visCache, so going back to one of them (a portal view
+every frame, or running around an arena) only has to stamp its list.
 ===============
 */
 static void R_MarkLeaves (void)
 {
-	const byte	*vis;
-	mnode_t	*leaf, *parent;
-	int		i;
-	int		cluster;
+	const byte		*vis;
+	mnode_t			*leaf, *parent;
+	visCacheEntry_t	*entry, *victim;
+	int				i;
+	int				cluster;
 
 	// lockpvs lets designers walk around to determine the
 	// extent of the current pvs
@@ -644,16 +1032,45 @@ static void R_MarkLeaves (void)
 
 	if (r_novis->integer || tr.viewCluster == -1)
 	{
-		for (i = 0; i<tr.world->numnodes; i++)
+		for (i = 0; i < tr.world->numCullNodes; i++)
 		{
-			if (tr.world->nodes[i].contents != CONTENTS_SOLID)
+			if (tr.world->cullNodeSources[i]->contents != CONTENTS_SOLID)
 			{
-				tr.world->nodes[i].visframe = tr.visCount;
+				tr.world->cullNodes[i].visframe = tr.visCount;
 			}
 		}
 		return;
 	}
 
+	victim = NULL;
+
+	if (r_visCache->integer)
+	{
+		entry = R_FindVisCache (tr.viewCluster, &victim);
+
+		if (entry)
+		{
+			for (i = 0; i < entry->numNodes; i++)
+			{
+				tr.world->cullNodes[entry->nodes[i]].visframe = tr.visCount;
+			}
+
+			entry->lastUsed = tr.visCount;
+			tr.world->visCacheHits++;
+			tr.pc.c_visCacheHits++;
+			return;
+		}
+
+		// record what gets marked in place of the oldest entry
+		victim->cluster = tr.viewCluster;
+		Com_Memcpy (victim->areamask, tr.refdef.areamask, sizeof (victim->areamask));
+		victim->lastUsed = tr.visCount;
+		victim->numNodes = 0;
+	}
+
+	tr.world->visCacheMisses++;
+	tr.pc.c_visCacheMisses++;
+
 	vis = R_ClusterPVS (tr.viewCluster);
 
 	for (i = 0, leaf = tr.world->nodes; i<tr.world->numnodes; i++, leaf++)
@@ -679,10 +1096,17 @@ static void R_MarkLeaves (void)
 		parent = leaf;
 		do
 		{
-			if (parent->visframe == tr.visCount)
+			mcullnode_t *cull = &tr.world->cullNodes[parent->cullNum];
+
+			if (cull->visframe == tr.visCount)
 				break;
-			parent->visframe = tr.visCount;
+			cull->visframe = tr.visCount;
 			parent = parent->parent;
+
+			if (victim)
+			{
+				victim->nodes[victim->numNodes++] = cull - tr.world->cullNodes;
+			}
 		} while (parent);
 	}
 }
@@ -695,6 +1119,15 @@ R_AddWorldSurfaces
 */
 void R_AddWorldSurfaces (void)
 {
+	frameMark_t		mark;
+	worldNodeJob_t	*nodeJobs;
+	worldLeaf_t		*leafs;
+	worldSurfJob_t	*surfJobs;
+	worldSurf_t		*surfs;
+	drawSurf_t		*drawSurfs;
+	int				numNodeJobs, numLeafs, numSurfs, numSurfJobs;
+	int				i, j;
+
 	if (!r_drawworld->integer)
 	{
 		return;
@@ -719,6 +1152,52 @@ void R_AddWorldSurfaces (void)
 	{
 		tr.refdef.num_dlights = 32;
 	}
-	R_RecursiveWorldNode (tr.world->nodes, 15, (1 << tr.refdef.num_dlights) - 1);
+
+	R_SetupCullPlanes ();
+
+	mark = ri.FrameMark ();
+
+	nodeJobs = ri.FrameAlloc (MAX_WORLD_NODE_JOBS * sizeof (*nodeJobs));
+	numNodeJobs = R_SplitWorldNodes (nodeJobs, (1 << tr.refdef.num_dlights) - 1);
+
+	leafs = ri.FrameAlloc (tr.world->nodes->numLeafs * sizeof (*leafs));
+	for (i = 0, numLeafs = 0; i < numNodeJobs; i++)
+	{
+		nodeJobs[i].leafs = leafs + numLeafs;
+		nodeJobs[i].numLeafs = 0;
+		numLeafs += tr.world->cullNodeSources[nodeJobs[i].nodeNum]->numLeafs;
+	}
+
+	R_RunWorldJobs (R_WorldNodeJob, nodeJobs, numNodeJobs);
+
+	surfs = ri.FrameAlloc (tr.world->numsurfaces * sizeof (*surfs));
+	numSurfs = R_AddWorldLeafs (nodeJobs, numNodeJobs, surfs);
+
+	numSurfJobs = (numSurfs + WORLD_SURFS_PER_JOB - 1) / WORLD_SURFS_PER_JOB;
+	surfJobs = ri.FrameAlloc (numSurfJobs * sizeof (*surfJobs));
+	drawSurfs = ri.FrameAlloc (numSurfs * sizeof (*drawSurfs));
+
+	for (i = 0; i < numSurfJobs; i++)
+	{
+		surfJobs[i].surfs = surfs + i * WORLD_SURFS_PER_JOB;
+		surfJobs[i].numSurfs = (i == numSurfJobs - 1) ? numSurfs - i * WORLD_SURFS_PER_JOB : WORLD_SURFS_PER_JOB;
+		surfJobs[i].drawSurfs = drawSurfs + i * WORLD_SURFS_PER_JOB;
+	}
+
+	R_RunWorldJobs (R_WorldSurfaceJob, surfJobs, numSurfJobs);
+
+	// append in job order so the list matches a single threaded walk
+	for (i = 0; i < numSurfJobs; i++)
+	{
+		R_AddCounters (&surfJobs[i].pc);
+
+		for (j = 0; j < surfJobs[i].numDrawSurfs; j++)
+		{
+			tr.refdef.drawSurfs[tr.refdef.numDrawSurfs & DRAWSURF_MASK] = surfJobs[i].drawSurfs[j];
+			tr.refdef.numDrawSurfs++;
+		}
+	}
+
+	ri.FrameRelease (mark);
 }
 
@@ -2222,6 +2222,37 @@ extern int unzCloseCurrentFile (unzFile file)
 }
 
 
+/*
+  Inflate a whole raw deflate stream that is already in memory, as found
+  after the local header of a zip entry.
+  Pass one byte more than the compressed size in inLen when it is readable,
+  inflate needs the dummy byte to report Z_STREAM_END without a zlib header.
+  return the number of unsigned chars written to out or an error code <0
+  */
+extern int unzInflateBuffer (const void *in, unsigned inLen, void *out, unsigned outLen)
+{
+	z_stream stream;
+	int err;
+
+	Com_Memset (&stream, 0, sizeof (stream));
+	err = inflateInit2 (&stream, -MAX_WBITS);
+	if (err != Z_OK)
+		return err;
+
+	stream.next_in = (Byte*) in;
+	stream.avail_in = (uInt) inLen;
+	stream.next_out = (Byte*) out;
+	stream.avail_out = (uInt) outLen;
+
+	err = inflate (&stream, Z_SYNC_FLUSH);
+	inflateEnd (&stream);
+
+	if (err != Z_OK && err != Z_STREAM_END)
+		return err;
+	return (int) stream.total_out;
+}
+
+
 /*
   Get the global comment string of the ZipFile, in the szComment buffer.
   uSizeBuf is the size of the szComment buffer.
@@ -309,6 +309,13 @@ extern int unzReadCurrentFile (unzFile file, void* buf, unsigned len);
   (UNZ_ERRNO for IO error, or zLib error for uncompress error)
   */
 
+extern int unzInflateBuffer (const void *in, unsigned inLen, void *out, unsigned outLen);
+
+/*
+  Inflate a raw deflate stream that is already in memory into out.
+  return the number of unsigned chars written, or (if <0) the error code
+  */
+
 extern long unztell (unzFile file);
 
 /*
@@ -44,8 +44,13 @@ int		vm_debugLevel;
 vm_t	vmTable[MAX_VM];
 
 
+cvar_t	*vm_traceSyscalls;
+
 void VM_VmInfo_f (void);
 void VM_VmProfile_f (void);
+static void VM_ProfileForVM (vm_t *vm);
+static void VM_TraceOpen (vm_t *vm);
+static void VM_TraceClose (vm_t *vm);
 
 
 // converts a VM pointer to a C pointer and
@@ -70,6 +75,7 @@ void VM_Init (void)
 	Cvar_Get ("vm_cgame", "2", CVAR_ARCHIVE);	// !@# SHIP WITH SET TO 2
 	Cvar_Get ("vm_game", "2", CVAR_ARCHIVE);	// !@# SHIP WITH SET TO 2
 	Cvar_Get ("vm_ui", "2", CVAR_ARCHIVE);		// !@# SHIP WITH SET TO 2
+	vm_traceSyscalls = Cvar_Get ("vm_traceSyscalls", "0", CVAR_LATCH);
 
 	Cmd_AddCommand ("vmprofile", VM_VmProfile_f);
 	Cmd_AddCommand ("vminfo", VM_VmInfo_f);
@@ -447,6 +453,28 @@ vm_t *VM_Restart (vm_t *vm)
 	return vm;
 }
 
+/*
+================
+VM_WantsCompiled
+
+vm_game, vm_cgame or vm_ui set to 2 asks for the load time compiler,
+which only exists for x86-64 System V targets
+================
+*/
+static qboolean VM_WantsCompiled (const char *module)
+{
+#ifdef VM_X86_64_COMPILER
+	if (!Q_stricmp (module, "qagame"))
+	{
+		module = "game";
+	}
+
+	return Cvar_VariableIntegerValue (va ("vm_%s", module)) >= 2;
+#else
+	return qfalse;
+#endif
+}
+
 /*
 ================
 VM_Create
@@ -557,11 +585,21 @@ vm_t *VM_Create (const char *module, int (*systemCalls) (int *))
 	vm->instructionPointersLength = header->instructionCount * 4;
 	vm->instructionPointers = Hunk_Alloc (vm->instructionPointersLength, h_high);
 
+	// the stack is implicitly at the end of the image
+	vm->programStack = vm->dataMask + 1;
+	vm->stackBottom = vm->programStack - STACK_SIZE;
+
 	// copy or compile the instructions
 	vm->codeLength = header->codeLength;
 
-	// VMs are no longer compiled
-	VM_PrepareInterpreter (vm, header);
+	if (VM_WantsCompiled (module))
+	{
+		VM_Compile (vm, header);
+	}
+	else
+	{
+		VM_PrepareInterpreter (vm, header);
+	}
 
 	// free the original file
 	FS_FreeFile (header);
@@ -569,9 +607,10 @@ vm_t *VM_Create (const char *module, int (*systemCalls) (int *))
 	// load the map file
 	VM_LoadSymbols (vm);
 
-	// the stack is implicitly at the end of the image
-	vm->programStack = vm->dataMask + 1;
-	vm->stackBottom = vm->programStack - STACK_SIZE;
+	if (vm_traceSyscalls->integer)
+	{
+		VM_TraceOpen (vm);
+	}
 
 	Com_Printf ("%s loaded in %d bytes on the hunk\n", module, remaining - Hunk_MemoryRemaining ());
 
@@ -585,6 +624,12 @@ VM_Free
 */
 void VM_Free (vm_t *vm)
 {
+	VM_ProfileForVM (vm);
+	VM_TraceClose (vm);
+
+#ifdef VM_X86_64_COMPILER
+	VM_FreeCompiled (vm);
+#endif
 	Com_Memset (vm, 0, sizeof (*vm));
 	currentVM = NULL;
 	lastVM = NULL;
@@ -594,6 +639,11 @@ void VM_Clear (void)
 {
 	for (int i = 0; i < MAX_VM; i++)
 	{
+		VM_ProfileForVM (&vmTable[i]);
+		VM_TraceClose (&vmTable[i]);
+#ifdef VM_X86_64_COMPILER
+		VM_FreeCompiled (&vmTable[i]);
+#endif
 		Com_Memset (&vmTable[i], 0, sizeof (vm_t));
 	}
 
@@ -613,6 +663,26 @@ void *VM_ArgPtr (int intValue)
 	return (void *) (currentVM->dataBase + (intValue & currentVM->dataMask));
 }
 
+/*
+==============
+VM_ArgRangeValid
+
+Returns qtrue if size bytes starting at the module address intValue
+fit inside the data segment of the current vm.  VM_ArgPtr only masks
+the start address, so a syscall taking an array must check its end.
+==============
+*/
+qboolean VM_ArgRangeValid (int intValue, int size)
+{
+	unsigned	offset;
+
+	if (currentVM == NULL || size < 0)
+		return qfalse;
+
+	offset = intValue & currentVM->dataMask;
+	return (unsigned) size <= (unsigned) currentVM->dataMask + 1 - offset;
+}
+
 void *VM_ExplicitArgPtr (vm_t *vm, int intValue)
 {
 	if (!intValue)
@@ -627,6 +697,19 @@ void *VM_ExplicitArgPtr (vm_t *vm, int intValue)
 	return (void *) (vm->dataBase + (intValue & vm->dataMask));
 }
 
+/*
+==============
+VM_InstructionsExecuted
+
+Running total of bytecode instructions the interpreter has executed,
+counting both halves of a superinstruction
+==============
+*/
+unsigned long long VM_InstructionsExecuted (vm_t *vm)
+{
+	return vm->instructionsExecuted;
+}
+
 
 /*
 ==============
@@ -658,12 +741,32 @@ int	QDECL VM_Call (vm_t *vm, int callnum, ...)
 {
 	vm_t	*oldVM;
 	int		r;
+	int		*args;
+#if !id386
+	int		argBuffer[10];
+	va_list	ap;
+	int		i;
+#endif
 
 	if (!vm)
 	{
 		Com_Error (ERR_FATAL, "VM_Call with NULL vm");
 	}
 
+#if id386
+	args = &callnum;
+#else
+	// the arguments are only contiguous on the stack with the x86 calling convention
+	argBuffer[0] = callnum;
+	va_start (ap, callnum);
+	for (i = 1; i < 10; i++)
+	{
+		argBuffer[i] = va_arg (ap, int);
+	}
+	va_end (ap);
+	args = argBuffer;
+#endif
+
 	oldVM = currentVM;
 	currentVM = vm;
 	lastVM = vm;
@@ -673,8 +776,21 @@ int	QDECL VM_Call (vm_t *vm, int callnum, ...)
 		Com_Printf ("VM_Call( %i )\n", callnum);
 	}
 
-	// VMs are no longer compiled
-	r = VM_CallInterpreted (vm, &callnum);
+	// a fresh call into the vm, so anything left on the shadow stack
+	// is from an error that dropped out of the middle of a call
+	if (vm->programStack == vm->dataMask + 1)
+	{
+		vm->profileDepth = 0;
+	}
+
+	if (vm->compiled)
+	{
+		r = VM_CallCompiled (vm, args);
+	}
+	else
+	{
+		r = VM_CallInterpreted (vm, args);
+	}
 
 	if (oldVM != NULL) // bk001220 - assert(currentVM!=NULL) for oldVM==NULL
 		currentVM = oldVM;
@@ -683,76 +799,508 @@ int	QDECL VM_Call (vm_t *vm, int callnum, ...)
 
 //=================================================================
 
-static int QDECL VM_ProfileSort (const void *a, const void *b)
+/*
+=============================================================================
+
+SAMPLING PROFILER
+
+While a profile is running a sampler thread looks at the shadow call stack
+of the profiled vm every millisecond.  The innermost entry of each sample
+gets the exclusive time, every function on the stack gets inclusive time
+once, and the whole stack is kept for the collapsed stack export.  The
+interpreter and the compiled code keep the shadow stack the same way, so
+this works for both without DEBUG_VM.
+
+=============================================================================
+*/
+
+#define	MAX_PROFILE_SYSCALLS	1024
+#define	MAX_PROFILE_STACKS		4096		// must be a power of two
+
+typedef struct
+{
+	int			count;
+	int			depth;
+	int			frames[VM_PROFILE_DEPTH];	// outermost first
+} vmProfileStack_t;
+
+typedef struct
+{
+	vm_t		*vm;
+	int			numInstructions;
+
+	// samples per function, by the instruction number of its OP_ENTER
+	int			*exclusive;
+	int			*inclusive;
+	int			*lastSample;		// so recursive functions only count once per sample
+
+	int			syscalls[MAX_PROFILE_SYSCALLS];
+
+	int			numSamples;			// including the ones taken outside the vm
+	int			vmSamples;
+	int			badSamples;			// caught the shadow stack in the middle of a change
+	int			droppedStacks;
+
+	int			startTime;
+	int			msec;				// filled in when stopped
+
+	vmProfileStack_t	stacks[MAX_PROFILE_STACKS];
+} vmProfile_t;
+
+static vmProfile_t	*vmProfile;
+static qboolean		vmProfileRunning;
+
+/*
+==============
+VM_ProfileSyscall
+==============
+*/
+static int VM_ProfileSyscall (int frame)
+{
+	int		num;
+
+	num = -1 - frame;
+	if (num >= MAX_PROFILE_SYSCALLS)
+	{
+		num = MAX_PROFILE_SYSCALLS - 1;
+	}
+
+	return num;
+}
+
+/*
+==============
+VM_ProfileSample
+
+Runs on the sampler thread
+==============
+*/
+static void VM_ProfileSample (void)
 {
-	vmSymbol_t	*sa, *sb;
+	vmProfile_t			*p;
+	vmProfileStack_t	*s;
+	int					frames[VM_PROFILE_DEPTH];
+	int					depth, n;
+	int					i, f;
+	unsigned			hash;
+
+	p = vmProfile;
+	p->numSamples++;
+
+	depth = p->vm->profileDepth;
+	if (depth <= 0)
+	{
+		return;
+	}
 
-	sa = *(vmSymbol_t **) a;
-	sb = *(vmSymbol_t **) b;
+	n = depth < VM_PROFILE_DEPTH ? depth : VM_PROFILE_DEPTH;
+	for (i = 0; i < n; i++)
+	{
+		frames[i] = p->vm->profileStack[(depth - n + i) & VM_PROFILE_MASK];
+	}
 
-	if (sa->profileCount < sb->profileCount)
+	// throw it away if the main thread moved while we were copying
+	if (p->vm->profileDepth != depth)
 	{
-		return -1;
+		p->badSamples++;
+		return;
 	}
-	if (sa->profileCount > sb->profileCount)
+
+	for (i = 0; i < n; i++)
 	{
-		return 1;
+		if (frames[i] >= p->numInstructions)
+		{
+			p->badSamples++;
+			return;
+		}
 	}
-	return 0;
+
+	p->vmSamples++;
+
+	f = frames[n - 1];
+	if (f < 0)
+	{
+		p->syscalls[VM_ProfileSyscall (f)]++;
+	}
+	else
+	{
+		p->exclusive[f]++;
+	}
+
+	hash = n;
+	for (i = 0; i < n; i++)
+	{
+		f = frames[i];
+		hash = (hash ^ f) * 16777619;
+
+		if (f >= 0 && p->lastSample[f] != p->vmSamples)
+		{
+			p->lastSample[f] = p->vmSamples;
+			p->inclusive[f]++;
+		}
+	}
+
+	// find or add the stack
+	for (i = 0; i < MAX_PROFILE_STACKS; i++)
+	{
+		s = &p->stacks[(hash + i) & (MAX_PROFILE_STACKS - 1)];
+
+		if (!s->count)
+		{
+			s->depth = n;
+			Com_Memcpy (s->frames, frames, n * sizeof (frames[0]));
+			s->count = 1;
+			return;
+		}
+
+		if (s->depth == n && !memcmp (s->frames, frames, n * sizeof (frames[0])))
+		{
+			s->count++;
+			return;
+		}
+	}
+
+	p->droppedStacks++;
 }
 
 /*
 ==============
-VM_VmProfile_f
+VM_ProfileFree
+==============
+*/
+static void VM_ProfileFree (void)
+{
+	if (vmProfileRunning)
+	{
+		Sys_StopSampler ();
+		vmProfileRunning = qfalse;
+	}
 
+	if (vmProfile)
+	{
+		Z_Free (vmProfile->exclusive);
+		Z_Free (vmProfile);
+		vmProfile = NULL;
+	}
+}
+
+/*
+==============
+VM_ProfileForVM
+
+Called when a vm goes away
 ==============
 */
-void VM_VmProfile_f (void)
+static void VM_ProfileForVM (vm_t *vm)
+{
+	if (vmProfile && vmProfile->vm == vm)
+	{
+		VM_ProfileFree ();
+	}
+}
+
+/*
+==============
+VM_ProfileName
+==============
+*/
+static const char *VM_ProfileName (vm_t *vm, int frame)
 {
+	static char	name[MAX_QPATH];
+
+	if (frame < 0)
+	{
+		Com_sprintf (name, sizeof (name), "syscall_%i", VM_ProfileSyscall (frame));
+		return name;
+	}
+
+	if (vm->numSymbols)
+	{
+		return VM_ValueToFunctionSymbol (vm, vm->instructionPointers[frame])->symName;
+	}
+
+	Com_sprintf (name, sizeof (name), "func_%i", frame);
+	return name;
+}
+
+/*
+==============
+VM_ProfileStart
+==============
+*/
+static void VM_ProfileStart (void)
+{
+	const char	*name;
 	vm_t		*vm;
-	vmSymbol_t	**sorted, *sym;
 	int			i;
-	double		total;
 
-	if (!lastVM)
+	name = Cmd_Argc () > 2 ? Cmd_Argv (2) : "game";
+	if (!Q_stricmp (name, "game"))
+	{
+		name = "qagame";
+	}
+
+	vm = NULL;
+	for (i = 0; i < MAX_VM; i++)
+	{
+		if (vmTable[i].name[0] && !Q_stricmp (vmTable[i].name, name))
+		{
+			vm = &vmTable[i];
+			break;
+		}
+	}
+
+	if (!vm)
 	{
+		Com_Printf ("No vm named %s\n", name);
 		return;
 	}
 
-	vm = lastVM;
+	VM_ProfileFree ();
+
+	vmProfile = Z_Malloc (sizeof (*vmProfile));
+	vmProfile->vm = vm;
+	vmProfile->numInstructions = vm->instructionCount;
+	vmProfile->exclusive = Z_Malloc (vm->instructionCount * 3 * sizeof (int));
+	vmProfile->inclusive = vmProfile->exclusive + vm->instructionCount;
+	vmProfile->lastSample = vmProfile->inclusive + vm->instructionCount;
+	vmProfile->startTime = Sys_Milliseconds ();
 
-	if (!vm->numSymbols)
+	if (!Sys_StartSampler (VM_ProfileSample, 1))
 	{
+		Com_Printf ("Couldn't start the sampler\n");
+		VM_ProfileFree ();
 		return;
 	}
 
-	sorted = Z_Malloc (vm->numSymbols * sizeof (*sorted));
-	sorted[0] = vm->symbols;
-	total = sorted[0]->profileCount;
-	for (i = 1; i < vm->numSymbols; i++)
+	vmProfileRunning = qtrue;
+
+	Com_Printf ("Profiling %s\n", vm->name);
+}
+
+/*
+==============
+VM_ProfileStop
+==============
+*/
+static void VM_ProfileStop (void)
+{
+	if (!vmProfileRunning)
 	{
-		sorted[i] = sorted[i - 1]->next;
-		total += sorted[i]->profileCount;
+		Com_Printf ("No profile running\n");
+		return;
 	}
 
-	qsort (sorted, vm->numSymbols, sizeof (*sorted), VM_ProfileSort);
+	Sys_StopSampler ();
+	vmProfileRunning = qfalse;
 
-	for (i = 0; i < vm->numSymbols; i++)
+	vmProfile->msec = Sys_Milliseconds () - vmProfile->startTime;
+
+	Com_Printf ("Stopped profiling %s, %i samples\n", vmProfile->vm->name, vmProfile->numSamples);
+}
+
+static int	*vmProfileSortCounts;
+
+static int QDECL VM_ProfileSort (const void *a, const void *b)
+{
+	return vmProfileSortCounts[*(const int *) b] - vmProfileSortCounts[*(const int *) a];
+}
+
+/*
+==============
+VM_ProfileReport
+==============
+*/
+static void VM_ProfileReport (void)
+{
+	vmProfile_t	*p;
+	int			*sorted;
+	int			i, count, numSorted;
+	int			msec, numSamples;
+	float		msecPerSample;
+
+	p = vmProfile;
+	if (!p)
 	{
-		int		perc;
+		Com_Printf ("No profile, use vmprofile start [game|cgame|ui]\n");
+		return;
+	}
+
+	count = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 20;
 
-		sym = sorted[i];
+	// the sampler may still be running, so take the counts once
+	numSamples = p->numSamples;
+	msec = vmProfileRunning ? Sys_Milliseconds () - p->startTime : p->msec;
 
-		perc = 100 * (float) sym->profileCount / total;
-		Com_Printf ("%2i%% %9i %s\n", perc, sym->profileCount, sym->symName);
-		sym->profileCount = 0;
+	if (numSamples < 1)
+	{
+		Com_Printf ("No samples yet\n");
+		return;
+	}
+
+	msecPerSample = (float) msec / numSamples;
+
+	Com_Printf ("%s: %i samples over %.2f sec, %i in the vm (%.1f%%), %i discarded\n",
+		p->vm->name, numSamples, msec * 0.001f, p->vmSamples, 100.0f * p->vmSamples / numSamples, p->badSamples);
+
+	sorted = Z_Malloc ((p->numInstructions + MAX_PROFILE_SYSCALLS) * sizeof (*sorted));
+
+	// functions, by exclusive time
+	numSorted = 0;
+	for (i = 0; i < p->numInstructions; i++)
+	{
+		if (p->inclusive[i])
+		{
+			sorted[numSorted++] = i;
+		}
 	}
 
-	Com_Printf ("    %9.0f total\n", total);
+	vmProfileSortCounts = p->exclusive;
+	qsort (sorted, numSorted, sizeof (*sorted), VM_ProfileSort);
+
+	Com_Printf ("  excl ms excl%%   incl ms incl%% function\n");
+	for (i = 0; i < numSorted && i < count; i++)
+	{
+		Com_Printf ("%9.1f %5.1f %9.1f %5.1f %s\n",
+			p->exclusive[sorted[i]] * msecPerSample, 100.0f * p->exclusive[sorted[i]] / numSamples,
+			p->inclusive[sorted[i]] * msecPerSample, 100.0f * p->inclusive[sorted[i]] / numSamples,
+			VM_ProfileName (p->vm, sorted[i]));
+	}
+
+	// system calls
+	numSorted = 0;
+	for (i = 0; i < MAX_PROFILE_SYSCALLS; i++)
+	{
+		if (p->syscalls[i])
+		{
+			sorted[numSorted++] = i;
+		}
+	}
+
+	vmProfileSortCounts = p->syscalls;
+	qsort (sorted, numSorted, sizeof (*sorted), VM_ProfileSort);
+
+	Com_Printf ("       ms     %%  syscall\n");
+	for (i = 0; i < numSorted && i < count; i++)
+	{
+		Com_Printf ("%9.1f %5.1f  %i\n", p->syscalls[sorted[i]] * msecPerSample,
+			100.0f * p->syscalls[sorted[i]] / numSamples, sorted[i]);
+	}
 
 	Z_Free (sorted);
 }
 
+/*
+==============
+VM_ProfileExport
+
+One line per distinct stack, outermost function first, in the collapsed
+format that flamegraph.pl and speedscope read
+==============
+*/
+static void VM_ProfileExport (void)
+{
+	vmProfile_t			*p;
+	vmProfileStack_t	*s;
+	fileHandle_t		f;
+	char				line[VM_PROFILE_DEPTH * MAX_QPATH];
+	int					i, j;
+
+	p = vmProfile;
+	if (!p)
+	{
+		Com_Printf ("No profile, use vmprofile start [game|cgame|ui]\n");
+		return;
+	}
+
+	if (vmProfileRunning)
+	{
+		Com_Printf ("Stop the profile first\n");
+		return;
+	}
+
+	if (Cmd_Argc () < 3)
+	{
+		Com_Printf ("usage: vmprofile export <filename>\n");
+		return;
+	}
+
+	f = FS_FOpenFileWrite (Cmd_Argv (2));
+	if (!f)
+	{
+		Com_Printf ("Couldn't open %s\n", Cmd_Argv (2));
+		return;
+	}
+
+	for (i = 0; i < MAX_PROFILE_STACKS; i++)
+	{
+		s = &p->stacks[i];
+		if (!s->count)
+		{
+			continue;
+		}
+
+		line[0] = 0;
+		for (j = 0; j < s->depth; j++)
+		{
+			if (j)
+			{
+				Q_strcat (line, sizeof (line), ";");
+			}
+			Q_strcat (line, sizeof (line), VM_ProfileName (p->vm, s->frames[j]));
+		}
+
+		FS_Printf (f, "%s %i\n", line, s->count);
+	}
+
+	FS_FCloseFile (f);
+
+	Com_Printf ("Wrote %s", Cmd_Argv (2));
+	if (p->droppedStacks)
+	{
+		Com_Printf (", %i samples didn't fit in the stack table", p->droppedStacks);
+	}
+	Com_Printf ("\n");
+}
+
+/*
+==============
+VM_VmProfile_f
+
+vmprofile start [game|cgame|ui]
+vmprofile stop
+vmprofile report [count]
+vmprofile export <filename>
+==============
+*/
+void VM_VmProfile_f (void)
+{
+	const char	*cmd;
+
+	cmd = Cmd_Argc () > 1 ? Cmd_Argv (1) : "report";
+
+	if (!Q_stricmp (cmd, "start"))
+	{
+		VM_ProfileStart ();
+	}
+	else if (!Q_stricmp (cmd, "stop"))
+	{
+		VM_ProfileStop ();
+	}
+	else if (!Q_stricmp (cmd, "report"))
+	{
+		VM_ProfileReport ();
+	}
+	else if (!Q_stricmp (cmd, "export"))
+	{
+		VM_ProfileExport ();
+	}
+	else
+	{
+		Com_Printf ("usage: vmprofile <start [game|cgame|ui] | stop | report [count] | export <filename>>\n");
+	}
+}
+
 /*
 ==============
 VM_VmInfo_f
@@ -776,10 +1324,17 @@ void VM_VmInfo_f (void)
 
 		Com_Printf ("%s : ", vm->name);
 
-		// VMs are no longer compiled
-		Com_Printf ("interpreted\n");
+		if (vm->compiled)
+		{
+			Com_Printf ("compiled on load\n");
+		}
+		else
+		{
+			Com_Printf ("interpreted\n");
+		}
 		Com_Printf ("    code length : %7i\n", vm->codeLength);
 		Com_Printf ("    table length: %7i\n", vm->instructionPointersLength);
+		Com_Printf ("    instructions: %7i\n", vm->instructionCount);
 		Com_Printf ("    data length : %7i\n", vm->dataMask + 1);
 	}
 }
@@ -807,6 +1362,99 @@ void VM_LogSyscalls (int *args)
 
 
 
+/*
+===============================================================================
+
+SYSCALL TRACES
+
+With vm_traceSyscalls set, every module loaded afterwards writes each
+system call it makes to <module>.interpreted.trace or <module>.compiled.trace
+in the current directory: the call number, the program stack, the first
+eight arguments and the return value.  The data images are laid out the
+same way whichever way the module runs, so pointer arguments match too.
+
+This is how the compiler is checked against the interpreter.  Record a
+session with journal 1, play it back twice with journal 2, once with
+vm_game 0 and once with vm_game 2, and compare the two traces; the first
+line that differs is the first system call that saw a different module
+state.  The return values of the *_MILLISECONDS calls come from the system
+clock, not the journal, so those lines differ between any two runs.
+
+===============================================================================
+*/
+
+/*
+===============
+VM_TraceSyscall
+===============
+*/
+static int VM_TraceSyscall (int *args)
+{
+	vm_t	*vm;
+	int		stack;
+	int		count;
+	int		r;
+
+	vm = currentVM;
+	stack = (byte *) args - vm->dataBase;
+	count = ++vm->traceCount;
+
+	r = vm->moduleSystemCall (args);
+
+	if (vm->traceFile)
+	{
+		fprintf (vm->traceFile, "%i: %i (%i) %i %i %i %i %i %i %i %i = %i\n", count, stack, args[0],
+			args[1], args[2], args[3], args[4], args[5], args[6], args[7], args[8], r);
+	}
+
+	return r;
+}
+
+/*
+===============
+VM_TraceOpen
+===============
+*/
+static void VM_TraceOpen (vm_t *vm)
+{
+	char	filename[MAX_QPATH];
+
+	Com_sprintf (filename, sizeof (filename), "%s.%s.trace", vm->name,
+		vm->compiled ? "compiled" : "interpreted");
+
+	vm->traceFile = fopen (filename, "w");
+	if (!vm->traceFile)
+	{
+		Com_Printf ("Couldn't open %s for writing\n", filename);
+		return;
+	}
+
+	Com_Printf ("Tracing %s system calls to %s\n", vm->name, filename);
+
+	vm->traceCount = 0;
+	vm->moduleSystemCall = vm->systemCall;
+	vm->systemCall = VM_TraceSyscall;
+}
+
+/*
+===============
+VM_TraceClose
+===============
+*/
+static void VM_TraceClose (vm_t *vm)
+{
+	if (!vm->traceFile)
+	{
+		return;
+	}
+
+	fclose (vm->traceFile);
+	vm->traceFile = NULL;
+	vm->systemCall = vm->moduleSystemCall;
+}
+
+
+
 #ifdef oDLL_ONLY // bk010215 - for DLL_ONLY dedicated servers/builds w/o VM
 int	VM_CallCompiled (vm_t *vm, int *args)
 {
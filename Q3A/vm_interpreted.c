@@ -151,6 +151,105 @@ void VM_StackTrace (vm_t *vm, int programCounter, int programStack)
 }
 
 
+/*
+=============================================================================
+
+The code image handed to the interpreter is not the raw bytecode: every
+instruction is decoded at load time into a fixed size slot of two ints,
+opcode and operand, with branch targets already turned into slot offsets.
+
+Common pairs of instructions are then fused into superinstructions.  The
+fused opcode replaces the first instruction of the pair and skips the second
+when it's done, but the second instruction is left in its own slot, so a
+jump into the middle of a pair still works and no jump target analysis is
+needed.  Only CONST and LOCAL start a pair, and neither can end one, so
+pairs never overlap.
+
+With GCC each handler dispatches the next instruction itself through a table
+of label addresses, which gives every handler its own indirect branch to
+predict.  Compilers without label addresses use the switch.
+
+=============================================================================
+*/
+
+// superinstructions, only ever produced by VM_PrepareInterpreter
+enum
+{
+	OP_LOCAL_LOAD4 = OP_CVFI + 1,
+	OP_CONST_ADD,
+	OP_CONST_JUMP,
+
+	OP_CONST_EQ,
+	OP_CONST_NE,
+	OP_CONST_LTI,
+	OP_CONST_LEI,
+	OP_CONST_GTI,
+	OP_CONST_GEI,
+	OP_CONST_LTU,
+	OP_CONST_LEU,
+	OP_CONST_GTU,
+	OP_CONST_GEU,
+
+	OP_NUM_INTERPRETED
+};
+
+#if defined( __GNUC__ ) && !defined( DEBUG_VM )
+#define	VM_THREADED_DISPATCH
+#endif
+
+static cvar_t	*vm_fuseOps;
+
+/*
+====================
+VM_FuseInstructions
+
+Returns the superinstruction for op followed by next, or 0
+====================
+*/
+static int VM_FuseInstructions (int op, int next)
+{
+	if (op == OP_LOCAL)
+	{
+		return next == OP_LOAD4 ? OP_LOCAL_LOAD4 : 0;
+	}
+
+	if (op != OP_CONST)
+	{
+		return 0;
+	}
+
+	switch (next)
+	{
+	case OP_ADD:
+		return OP_CONST_ADD;
+	case OP_JUMP:
+		return OP_CONST_JUMP;
+	case OP_EQ:
+		return OP_CONST_EQ;
+	case OP_NE:
+		return OP_CONST_NE;
+	case OP_LTI:
+		return OP_CONST_LTI;
+	case OP_LEI:
+		return OP_CONST_LEI;
+	case OP_GTI:
+		return OP_CONST_GTI;
+	case OP_GEI:
+		return OP_CONST_GEI;
+	case OP_LTU:
+		return OP_CONST_LTU;
+	case OP_LEU:
+		return OP_CONST_LEU;
+	case OP_GTU:
+		return OP_CONST_GTU;
+	case OP_GEU:
+		return OP_CONST_GEU;
+	default:
+		return 0;
+	}
+}
+
+
 /*
 ====================
 VM_PrepareInterpreter
@@ -158,17 +257,23 @@ VM_PrepareInterpreter
 */
 void VM_PrepareInterpreter (vm_t *vm, vmHeader_t *header)
 {
-	int		op;
+	int		op, fused;
 	int		pc;
 	byte	*code;
 	int		instruction;
 	int		*codeBase;
+	int		numFused;
+
+	if (!vm_fuseOps)
+	{
+		vm_fuseOps = Cvar_Get ("vm_fuseOps", "1", CVAR_ARCHIVE);
+	}
 
-	vm->codeBase = Hunk_Alloc (vm->codeLength * 4, h_high);			// we're now int aligned
+	vm->instructionCount = header->instructionCount;
+	vm->codeBase = Hunk_Alloc (header->instructionCount * 8, h_high);
 	//	memcpy( vm->codeBase, (byte *)header + header->codeOffset, vm->codeLength );
 
-	// we don't need to translate the instructions, but we still need
-	// to find each instructions starting point for jumps
+	// decode every instruction into its slot
 	pc = 0;
 	instruction = 0;
 	code = (byte *) header + header->codeOffset;
@@ -176,16 +281,21 @@ void VM_PrepareInterpreter (vm_t *vm, vmHeader_t *header)
 
 	while (instruction < header->instructionCount)
 	{
-		vm->instructionPointers[instruction] = pc;
-		instruction++;
+		if (pc >= header->codeLength)
+		{
+			Com_Error (ERR_FATAL, "VM_PrepareInterpreter: pc > header->codeLength");
+		}
 
 		op = code[pc];
-		codeBase[pc] = op;
-		if (pc > header->codeLength)
+		if (op > OP_CVFI)
 		{
-			Com_Error (ERR_FATAL, "VM_PrepareInterpreter: pc > header->codeLength");
+			Com_Error (ERR_FATAL, "VM_PrepareInterpreter: bad opcode %i at %i", op, instruction);
 		}
 
+		vm->instructionPointers[instruction] = instruction * 2;
+		codeBase[instruction * 2] = op;
+		codeBase[instruction * 2 + 1] = 0;
+
 		pc++;
 
 		// these are the only opcodes that aren't a single byte
@@ -212,84 +322,61 @@ void VM_PrepareInterpreter (vm_t *vm, vmHeader_t *header)
 		case OP_GTF:
 		case OP_GEF:
 		case OP_BLOCK_COPY:
-			codeBase[pc + 0] = loadWord (&code[pc]);
+			codeBase[instruction * 2 + 1] = loadWord (&code[pc]);
 			pc += 4;
 			break;
 		case OP_ARG:
-			codeBase[pc + 0] = code[pc];
+			codeBase[instruction * 2 + 1] = code[pc];
 			pc += 1;
 			break;
 		default:
 			break;
 		}
 
+		// branch targets become slot offsets
+		if (op >= OP_EQ && op <= OP_GEF)
+		{
+			if ((unsigned) codeBase[instruction * 2 + 1] >= (unsigned) header->instructionCount)
+			{
+				Com_Error (ERR_FATAL, "VM_PrepareInterpreter: branch out of range at %i", instruction);
+			}
+			codeBase[instruction * 2 + 1] *= 2;
+		}
+
+		instruction++;
 	}
-	pc = 0;
-	instruction = 0;
-	code = (byte *) header + header->codeOffset;
-	codeBase = (int *) vm->codeBase;
 
-	while (instruction < header->instructionCount)
+	if (!vm_fuseOps->integer)
 	{
-		op = code[pc];
-		instruction++;
-		pc++;
-		switch (op)
+		return;
+	}
+
+	numFused = 0;
+	for (instruction = 0; instruction < header->instructionCount - 1; instruction++)
+	{
+		op = codeBase[instruction * 2];
+		fused = VM_FuseInstructions (op, codeBase[instruction * 2 + 2]);
+
+		if (!fused)
 		{
-		case OP_ENTER:
-		case OP_CONST:
-		case OP_LOCAL:
-		case OP_LEAVE:
-		case OP_EQ:
-		case OP_NE:
-		case OP_LTI:
-		case OP_LEI:
-		case OP_GTI:
-		case OP_GEI:
-		case OP_LTU:
-		case OP_LEU:
-		case OP_GTU:
-		case OP_GEU:
-		case OP_EQF:
-		case OP_NEF:
-		case OP_LTF:
-		case OP_LEF:
-		case OP_GTF:
-		case OP_GEF:
-		case OP_BLOCK_COPY:
-			switch (op)
+			continue;
+		}
+
+		// a constant jump can have its target resolved now, if it's a valid one
+		if (fused == OP_CONST_JUMP)
+		{
+			if ((unsigned) codeBase[instruction * 2 + 1] >= (unsigned) header->instructionCount)
 			{
-			case OP_EQ:
-			case OP_NE:
-			case OP_LTI:
-			case OP_LEI:
-			case OP_GTI:
-			case OP_GEI:
-			case OP_LTU:
-			case OP_LEU:
-			case OP_GTU:
-			case OP_GEU:
-			case OP_EQF:
-			case OP_NEF:
-			case OP_LTF:
-			case OP_LEF:
-			case OP_GTF:
-			case OP_GEF:
-				codeBase[pc] = vm->instructionPointers[codeBase[pc]];
-				break;
-			default:
-				break;
+				continue;
 			}
-			pc += 4;
-			break;
-		case OP_ARG:
-			pc += 1;
-			break;
-		default:
-			break;
+			codeBase[instruction * 2 + 1] *= 2;
 		}
 
+		codeBase[instruction * 2] = fused;
+		numFused++;
 	}
+
+	Com_DPrintf ("%s: %i of %i instructions fused\n", vm->name, numFused, header->instructionCount);
 }
 
 /*
@@ -321,6 +408,21 @@ locals from sp
 
 #define	DEBUGSTR va("%s%i", VM_Indent(vm), opStack-stack )
 
+#ifdef VM_THREADED_DISPATCH
+#define	OPCODE(x)		op_##x
+#define	DISPATCH()		opcode = codeImage[programCounter]; r2 = codeImage[programCounter + 1]; \
+						programCounter += 2; executed++; goto *dispatchTable[opcode]
+#define	NEXT			{ r0 = opStack[0]; r1 = opStack[-1]; DISPATCH (); }
+#define	NEXT2			{ DISPATCH (); }
+#else
+#define	OPCODE(x)		case x
+#define	NEXT			goto nextInstruction
+#define	NEXT2			goto nextInstruction2
+#endif
+
+// the second half of a superinstruction
+#define	SKIP_FUSED()	programCounter += 2; executed++
+
 int	VM_CallInterpreted (vm_t *vm, int *args)
 {
 	int		stack[MAX_STACK];
@@ -332,9 +434,30 @@ int	VM_CallInterpreted (vm_t *vm, int *args)
 	int		*codeImage;
 	int		v1;
 	int		dataMask;
+	int		opcode, r0, r1, r2;
+	unsigned	executed;
 #ifdef DEBUG_VM
 	vmSymbol_t	*profileSymbol;
 #endif
+#ifdef VM_THREADED_DISPATCH
+	static const void	*dispatchTable[OP_NUM_INTERPRETED] =
+	{
+		&&op_OP_UNDEF, &&op_OP_IGNORE, &&op_OP_BREAK, &&op_OP_ENTER, &&op_OP_LEAVE, &&op_OP_CALL,
+		&&op_OP_PUSH, &&op_OP_POP, &&op_OP_CONST, &&op_OP_LOCAL, &&op_OP_JUMP,
+		&&op_OP_EQ, &&op_OP_NE, &&op_OP_LTI, &&op_OP_LEI, &&op_OP_GTI, &&op_OP_GEI,
+		&&op_OP_LTU, &&op_OP_LEU, &&op_OP_GTU, &&op_OP_GEU,
+		&&op_OP_EQF, &&op_OP_NEF, &&op_OP_LTF, &&op_OP_LEF, &&op_OP_GTF, &&op_OP_GEF,
+		&&op_OP_LOAD1, &&op_OP_LOAD2, &&op_OP_LOAD4, &&op_OP_STORE1, &&op_OP_STORE2, &&op_OP_STORE4,
+		&&op_OP_ARG, &&op_OP_BLOCK_COPY, &&op_OP_SEX8, &&op_OP_SEX16,
+		&&op_OP_NEGI, &&op_OP_ADD, &&op_OP_SUB, &&op_OP_DIVI, &&op_OP_DIVU, &&op_OP_MODI, &&op_OP_MODU,
+		&&op_OP_MULI, &&op_OP_MULU, &&op_OP_BAND, &&op_OP_BOR, &&op_OP_BXOR, &&op_OP_BCOM,
+		&&op_OP_LSH, &&op_OP_RSHI, &&op_OP_RSHU,
+		&&op_OP_NEGF, &&op_OP_ADDF, &&op_OP_SUBF, &&op_OP_DIVF, &&op_OP_MULF, &&op_OP_CVIF, &&op_OP_CVFI,
+		&&op_OP_LOCAL_LOAD4, &&op_OP_CONST_ADD, &&op_OP_CONST_JUMP,
+		&&op_OP_CONST_EQ, &&op_OP_CONST_NE, &&op_OP_CONST_LTI, &&op_OP_CONST_LEI, &&op_OP_CONST_GTI,
+		&&op_OP_CONST_GEI, &&op_OP_CONST_LTU, &&op_OP_CONST_LEU, &&op_OP_CONST_GTU, &&op_OP_CONST_GEU
+	};
+#endif
 
 	// interpret the code
 	vm->currentlyInterpreting = qtrue;
@@ -358,6 +481,7 @@ int	VM_CallInterpreted (vm_t *vm, int *args)
 	// not corrupt anything
 	opStack = stack;
 	programCounter = 0;
+	executed = 0;
 
 	programStack -= 48;
 
@@ -382,20 +506,22 @@ int	VM_CallInterpreted (vm_t *vm, int *args)
 	// main interpreter loop, will exit when a LEAVE instruction
 	// grabs the -1 program counter
 
-#define r2 codeImage[programCounter]
-
+#ifdef VM_THREADED_DISPATCH
+	NEXT;
+	{
+#else
 	while (1)
 	{
-		int		opcode, r0, r1;
-		//		unsigned int	r2;
-
 nextInstruction:
 		r0 = ((int *) opStack)[0];
 		r1 = ((int *) opStack)[-1];
 nextInstruction2:
-		opcode = codeImage[programCounter++];
+		opcode = codeImage[programCounter];
+		r2 = codeImage[programCounter + 1];
+		programCounter += 2;
+		executed++;
 #ifdef DEBUG_VM
-		if ((unsigned)programCounter > vm->codeLength ) {
+		if ((unsigned)programCounter > vm->instructionCount * 2 ) {
 			Com_Error( ERR_DROP, "VM pc out of range" );
 		}
 
@@ -415,71 +541,68 @@ nextInstruction2:
 		}
 
 		if ( vm_debugLevel > 1 ) {
-			Com_Printf( "%s %s\n", DEBUGSTR, opnames[opcode] );
+			Com_Printf( "%s %s\n", DEBUGSTR, opcode <= OP_CVFI ? opnames[opcode] : "superinstruction" );
 		}
 		profileSymbol->profileCount++;
 #endif
 
 		switch (opcode)
 		{
-#ifdef DEBUG_VM
 		default:
-			Com_Error( ERR_DROP, "Bad VM instruction" );  // this should be scanned on load!
+			Com_Error (ERR_DROP, "Bad VM instruction");  // this should be scanned on load!
 #endif
-		case OP_BREAK:
+		OPCODE (OP_UNDEF):
+		OPCODE (OP_IGNORE):
+			NEXT;
+		OPCODE (OP_BREAK):
 			vm->breakCount++;
-			goto nextInstruction2;
-		case OP_CONST:
+			NEXT2;
+		OPCODE (OP_CONST):
 			opStack++;
 			r1 = r0;
 			r0 = *opStack = r2;
-
-			programCounter += 4;
-			goto nextInstruction2;
-		case OP_LOCAL:
+			NEXT2;
+		OPCODE (OP_LOCAL):
 			opStack++;
 			r1 = r0;
 			r0 = *opStack = r2 + programStack;
+			NEXT2;
 
-			programCounter += 4;
-			goto nextInstruction2;
-
-		case OP_LOAD4:
+		OPCODE (OP_LOAD4):
 #ifdef DEBUG_VM
 			if ( *opStack & 3 ) {
 				Com_Error( ERR_DROP, "OP_LOAD4 misaligned" );
 			}
 #endif
 			r0 = *opStack = *(int *) &image[r0&dataMask];
-			goto nextInstruction2;
-		case OP_LOAD2:
+			NEXT2;
+		OPCODE (OP_LOAD2):
 			r0 = *opStack = *(unsigned short *) &image[r0&dataMask];
-			goto nextInstruction2;
-		case OP_LOAD1:
+			NEXT2;
+		OPCODE (OP_LOAD1):
 			r0 = *opStack = image[r0&dataMask];
-			goto nextInstruction2;
+			NEXT2;
 
-		case OP_STORE4:
+		OPCODE (OP_STORE4):
 			*(int *) &image[r1&(dataMask & ~3)] = r0;
 			opStack -= 2;
-			goto nextInstruction;
-		case OP_STORE2:
+			NEXT;
+		OPCODE (OP_STORE2):
 			*(short *) &image[r1&(dataMask & ~1)] = r0;
 			opStack -= 2;
-			goto nextInstruction;
-		case OP_STORE1:
+			NEXT;
+		OPCODE (OP_STORE1):
 			image[r1&dataMask] = r0;
 			opStack -= 2;
-			goto nextInstruction;
+			NEXT;
 
-		case OP_ARG:
+		OPCODE (OP_ARG):
 			// single byte offset from programStack
-			*(int *) &image[codeImage[programCounter] + programStack] = r0;
+			*(int *) &image[r2 + programStack] = r0;
 			opStack--;
-			programCounter += 1;
-			goto nextInstruction;
+			NEXT;
 
-		case OP_BLOCK_COPY:
+		OPCODE (OP_BLOCK_COPY):
 		{
 			int		*src, *dest;
 			int		i, count, srci, desti;
@@ -493,7 +616,7 @@ nextInstruction2:
 
 			src = (int *) &image[r0&dataMask];
 			dest = (int *) &image[r1&dataMask];
-			if (((int) src | (int) dest | count) & 3)
+			if ((srci | desti | count) & 3)
 			{
 				Com_Error (ERR_DROP, "OP_BLOCK_COPY not dword aligned");
 			}
@@ -502,12 +625,11 @@ nextInstruction2:
 			{
 				dest[i] = src[i];
 			}
-			programCounter += 4;
 			opStack -= 2;
 		}
-		goto nextInstruction;
+		NEXT;
 
-		case OP_CALL:
+		OPCODE (OP_CALL):
 			// save current program counter
 			*(int *) &image[programStack] = programCounter;
 
@@ -534,9 +656,15 @@ nextInstruction2:
 #endif
 				*(int *) &image[programStack + 4] = -1 - programCounter;
 
+				// the profiler sees system calls as -1 - syscall number
+				vm->profileStack[vm->profileDepth & VM_PROFILE_MASK] = programCounter;
+				vm->profileDepth++;
+
 				//VM_LogSyscalls((int *)&image[ programStack + 4 ] );
 				r = vm->systemCall ((int *) &image[programStack + 4]);
 
+				vm->profileDepth--;
+
 #ifdef DEBUG_VM
 				// this is just our stack frame pointer, only needed
 				// for debugging
@@ -556,33 +684,39 @@ nextInstruction2:
 			}
 			else
 			{
+				if (programCounter >= vm->instructionCount)
+				{
+					Com_Error (ERR_DROP, "VM call out of range");
+				}
 				programCounter = vm->instructionPointers[programCounter];
 			}
-			goto nextInstruction;
+			NEXT;
 
 			// push and pop are only needed for discarded or bad function return values
-		case OP_PUSH:
+		OPCODE (OP_PUSH):
 			opStack++;
-			goto nextInstruction;
-		case OP_POP:
+			NEXT;
+		OPCODE (OP_POP):
 			opStack--;
-			goto nextInstruction;
+			NEXT;
 
-		case OP_ENTER:
+		OPCODE (OP_ENTER):
 #ifdef DEBUG_VM
 			profileSymbol = VM_ValueToFunctionSymbol( vm, programCounter );
 #endif
+			vm->profileStack[vm->profileDepth & VM_PROFILE_MASK] = programCounter / 2 - 1;
+			vm->profileDepth++;
+
 			// get size of stack frame
 			v1 = r2;
 
-			programCounter += 4;
 			programStack -= v1;
 #ifdef DEBUG_VM
 			// save old stack frame for debugging traces
 			*(int *)&image[programStack+4] = programStack + v1;
 			if ( vm_debugLevel ) {
-				Com_Printf( "%s---> %s\n", DEBUGSTR, VM_ValueToSymbol( vm, programCounter - 5 ));
-				if ( vm->breakFunction && programCounter - 5 == vm->breakFunction ) {
+				Com_Printf( "%s---> %s\n", DEBUGSTR, VM_ValueToSymbol( vm, programCounter - 2 ));
+				if ( vm->breakFunction && programCounter - 2 == vm->breakFunction ) {
 					// this is to allow setting breakpoints here in the debugger
 					vm->breakCount++;
 					//					vm_debugLevel = 2;
@@ -591,8 +725,10 @@ nextInstruction2:
 				vm->callLevel++;
 			}
 #endif
-			goto nextInstruction;
-		case OP_LEAVE:
+			NEXT;
+		OPCODE (OP_LEAVE):
+			vm->profileDepth--;
+
 			// remove our stack frame
 			v1 = r2;
 
@@ -612,7 +748,14 @@ nextInstruction2:
 			{
 				goto done;
 			}
-			goto nextInstruction;
+
+			// the return address lives in vm memory, so it has to land on
+			// an opcode or the dispatch would run off the table
+			if ((programCounter & 1) || (unsigned) programCounter >= (unsigned) vm->instructionCount * 2)
+			{
+				Com_Error (ERR_DROP, "VM return out of range");
+			}
+			NEXT;
 
 			/*
 			===================================================================
@@ -620,331 +763,328 @@ nextInstruction2:
 			===================================================================
 			*/
 
-		case OP_JUMP:
+		OPCODE (OP_JUMP):
 			programCounter = r0;
+			if ((unsigned) programCounter >= (unsigned) vm->instructionCount)
+			{
+				Com_Error (ERR_DROP, "VM jump out of range");
+			}
 			programCounter = vm->instructionPointers[programCounter];
 			opStack--;
-			goto nextInstruction;
+			NEXT;
 
-		case OP_EQ:
+		OPCODE (OP_EQ):
 			opStack -= 2;
 			if (r1 == r0)
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			NEXT;
 
-		case OP_NE:
+		OPCODE (OP_NE):
 			opStack -= 2;
 			if (r1 != r0)
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			NEXT;
 
-		case OP_LTI:
+		OPCODE (OP_LTI):
 			opStack -= 2;
 			if (r1 < r0)
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			NEXT;
 
-		case OP_LEI:
+		OPCODE (OP_LEI):
 			opStack -= 2;
 			if (r1 <= r0)
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			NEXT;
 
-		case OP_GTI:
+		OPCODE (OP_GTI):
 			opStack -= 2;
 			if (r1 > r0)
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			NEXT;
 
-		case OP_GEI:
+		OPCODE (OP_GEI):
 			opStack -= 2;
 			if (r1 >= r0)
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			NEXT;
 
-		case OP_LTU:
+		OPCODE (OP_LTU):
 			opStack -= 2;
 			if (((unsigned) r1) < ((unsigned) r0))
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			NEXT;
 
-		case OP_LEU:
+		OPCODE (OP_LEU):
 			opStack -= 2;
 			if (((unsigned) r1) <= ((unsigned) r0))
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			NEXT;
 
-		case OP_GTU:
+		OPCODE (OP_GTU):
 			opStack -= 2;
 			if (((unsigned) r1) > ((unsigned) r0))
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			NEXT;
 
-		case OP_GEU:
+		OPCODE (OP_GEU):
 			opStack -= 2;
 			if (((unsigned) r1) >= ((unsigned) r0))
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			NEXT;
 
-		case OP_EQF:
+		OPCODE (OP_EQF):
 			if (((float *) opStack)[-1] == *(float *) opStack)
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				opStack -= 2;
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				opStack -= 2;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			opStack -= 2;
+			NEXT;
 
-		case OP_NEF:
+		OPCODE (OP_NEF):
 			if (((float *) opStack)[-1] != *(float *) opStack)
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				opStack -= 2;
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				opStack -= 2;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			opStack -= 2;
+			NEXT;
 
-		case OP_LTF:
+		OPCODE (OP_LTF):
 			if (((float *) opStack)[-1] < *(float *) opStack)
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				opStack -= 2;
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				opStack -= 2;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			opStack -= 2;
+			NEXT;
 
-		case OP_LEF:
+		OPCODE (OP_LEF):
 			if (((float *) opStack)[-1] <= *(float *) opStack)
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				opStack -= 2;
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				opStack -= 2;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			opStack -= 2;
+			NEXT;
 
-		case OP_GTF:
+		OPCODE (OP_GTF):
 			if (((float *) opStack)[-1] > *(float *) opStack)
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				opStack -= 2;
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				opStack -= 2;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			opStack -= 2;
+			NEXT;
 
-		case OP_GEF:
+		OPCODE (OP_GEF):
 			if (((float *) opStack)[-1] >= *(float *) opStack)
 			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				opStack -= 2;
-				goto nextInstruction;
-			}
-			else
-			{
-				programCounter += 4;
-				opStack -= 2;
-				goto nextInstruction;
+				programCounter = r2;
 			}
+			opStack -= 2;
+			NEXT;
 
 
 			//===================================================================
 
-		case OP_NEGI:
+		OPCODE (OP_NEGI):
 			*opStack = -r0;
-			goto nextInstruction;
-		case OP_ADD:
+			NEXT;
+		OPCODE (OP_ADD):
 			opStack[-1] = r1 + r0;
 			opStack--;
-			goto nextInstruction;
-		case OP_SUB:
+			NEXT;
+		OPCODE (OP_SUB):
 			opStack[-1] = r1 - r0;
 			opStack--;
-			goto nextInstruction;
-		case OP_DIVI:
+			NEXT;
+		OPCODE (OP_DIVI):
 			opStack[-1] = r1 / r0;
 			opStack--;
-			goto nextInstruction;
-		case OP_DIVU:
+			NEXT;
+		OPCODE (OP_DIVU):
 			opStack[-1] = ((unsigned) r1) / ((unsigned) r0);
 			opStack--;
-			goto nextInstruction;
-		case OP_MODI:
+			NEXT;
+		OPCODE (OP_MODI):
 			opStack[-1] = r1 % r0;
 			opStack--;
-			goto nextInstruction;
-		case OP_MODU:
+			NEXT;
+		OPCODE (OP_MODU):
 			opStack[-1] = ((unsigned) r1) % (unsigned) r0;
 			opStack--;
-			goto nextInstruction;
-		case OP_MULI:
+			NEXT;
+		OPCODE (OP_MULI):
 			opStack[-1] = r1 * r0;
 			opStack--;
-			goto nextInstruction;
-		case OP_MULU:
+			NEXT;
+		OPCODE (OP_MULU):
 			opStack[-1] = ((unsigned) r1) * ((unsigned) r0);
 			opStack--;
-			goto nextInstruction;
+			NEXT;
 
-		case OP_BAND:
+		OPCODE (OP_BAND):
 			opStack[-1] = ((unsigned) r1) & ((unsigned) r0);
 			opStack--;
-			goto nextInstruction;
-		case OP_BOR:
+			NEXT;
+		OPCODE (OP_BOR):
 			opStack[-1] = ((unsigned) r1) | ((unsigned) r0);
 			opStack--;
-			goto nextInstruction;
-		case OP_BXOR:
+			NEXT;
+		OPCODE (OP_BXOR):
 			opStack[-1] = ((unsigned) r1) ^ ((unsigned) r0);
 			opStack--;
-			goto nextInstruction;
-		case OP_BCOM:
+			NEXT;
+		OPCODE (OP_BCOM):
 			opStack[-1] = ~((unsigned) r0);
-			goto nextInstruction;
+			NEXT;
 
-		case OP_LSH:
+		OPCODE (OP_LSH):
 			opStack[-1] = r1 << r0;
 			opStack--;
-			goto nextInstruction;
-		case OP_RSHI:
+			NEXT;
+		OPCODE (OP_RSHI):
 			opStack[-1] = r1 >> r0;
 			opStack--;
-			goto nextInstruction;
-		case OP_RSHU:
+			NEXT;
+		OPCODE (OP_RSHU):
 			opStack[-1] = ((unsigned) r1) >> r0;
 			opStack--;
-			goto nextInstruction;
+			NEXT;
 
-		case OP_NEGF:
+		OPCODE (OP_NEGF):
 			*(float *) opStack = -*(float *) opStack;
-			goto nextInstruction;
-		case OP_ADDF:
+			NEXT;
+		OPCODE (OP_ADDF):
 			*(float *) (opStack - 1) = *(float *) (opStack - 1) + *(float *) opStack;
 			opStack--;
-			goto nextInstruction;
-		case OP_SUBF:
+			NEXT;
+		OPCODE (OP_SUBF):
 			*(float *) (opStack - 1) = *(float *) (opStack - 1) - *(float *) opStack;
 			opStack--;
-			goto nextInstruction;
-		case OP_DIVF:
+			NEXT;
+		OPCODE (OP_DIVF):
 			*(float *) (opStack - 1) = *(float *) (opStack - 1) / *(float *) opStack;
 			opStack--;
-			goto nextInstruction;
-		case OP_MULF:
+			NEXT;
+		OPCODE (OP_MULF):
 			*(float *) (opStack - 1) = *(float *) (opStack - 1) * *(float *) opStack;
 			opStack--;
-			goto nextInstruction;
+			NEXT;
 
-		case OP_CVIF:
+		OPCODE (OP_CVIF):
 			*(float *) opStack = (float) *opStack;
-			goto nextInstruction;
-		case OP_CVFI:
+			NEXT;
+		OPCODE (OP_CVFI):
 			*opStack = (int) *(float *) opStack;
-			goto nextInstruction;
-		case OP_SEX8:
+			NEXT;
+		OPCODE (OP_SEX8):
 			*opStack = (signed char) *opStack;
-			goto nextInstruction;
-		case OP_SEX16:
+			NEXT;
+		OPCODE (OP_SEX16):
 			*opStack = (short) *opStack;
-			goto nextInstruction;
+			NEXT;
+
+			/*
+			===================================================================
+			SUPERINSTRUCTIONS
+			===================================================================
+			*/
+
+		OPCODE (OP_LOCAL_LOAD4):
+			opStack++;
+			r1 = r0;
+			r0 = *opStack = *(int *) &image[(r2 + programStack) & dataMask];
+			SKIP_FUSED ();
+			NEXT2;
+
+		OPCODE (OP_CONST_ADD):
+			r0 = *opStack = r0 + r2;
+			SKIP_FUSED ();
+			NEXT2;
+
+		OPCODE (OP_CONST_JUMP):
+			// the target was checked and resolved at load time
+			programCounter = r2;
+			executed++;
+			NEXT2;
+
+			// the branch target is the operand of the second instruction
+		OPCODE (OP_CONST_EQ):
+			opStack--;
+			programCounter = r0 == r2 ? codeImage[programCounter + 1] : programCounter + 2;
+			executed++;
+			NEXT;
+		OPCODE (OP_CONST_NE):
+			opStack--;
+			programCounter = r0 != r2 ? codeImage[programCounter + 1] : programCounter + 2;
+			executed++;
+			NEXT;
+		OPCODE (OP_CONST_LTI):
+			opStack--;
+			programCounter = r0 < r2 ? codeImage[programCounter + 1] : programCounter + 2;
+			executed++;
+			NEXT;
+		OPCODE (OP_CONST_LEI):
+			opStack--;
+			programCounter = r0 <= r2 ? codeImage[programCounter + 1] : programCounter + 2;
+			executed++;
+			NEXT;
+		OPCODE (OP_CONST_GTI):
+			opStack--;
+			programCounter = r0 > r2 ? codeImage[programCounter + 1] : programCounter + 2;
+			executed++;
+			NEXT;
+		OPCODE (OP_CONST_GEI):
+			opStack--;
+			programCounter = r0 >= r2 ? codeImage[programCounter + 1] : programCounter + 2;
+			executed++;
+			NEXT;
+		OPCODE (OP_CONST_LTU):
+			opStack--;
+			programCounter = (unsigned) r0 < (unsigned) r2 ? codeImage[programCounter + 1] : programCounter + 2;
+			executed++;
+			NEXT;
+		OPCODE (OP_CONST_LEU):
+			opStack--;
+			programCounter = (unsigned) r0 <= (unsigned) r2 ? codeImage[programCounter + 1] : programCounter + 2;
+			executed++;
+			NEXT;
+		OPCODE (OP_CONST_GTU):
+			opStack--;
+			programCounter = (unsigned) r0 > (unsigned) r2 ? codeImage[programCounter + 1] : programCounter + 2;
+			executed++;
+			NEXT;
+		OPCODE (OP_CONST_GEU):
+			opStack--;
+			programCounter = (unsigned) r0 >= (unsigned) r2 ? codeImage[programCounter + 1] : programCounter + 2;
+			executed++;
+			NEXT;
+#ifndef VM_THREADED_DISPATCH
 		}
+#endif
 	}
 
 done:
 	vm->currentlyInterpreting = qfalse;
+	vm->instructionsExecuted += executed;
 
 	if (opStack != &stack[1])
 	{
@@ -122,6 +122,10 @@ typedef struct vmSymbol_s
 	char	symName[1];		// variable sized
 } vmSymbol_t;
 
+// the sampling profiler sees the innermost VM_PROFILE_DEPTH calls of the shadow stack
+#define	VM_PROFILE_DEPTH			32
+#define	VM_PROFILE_MASK				(VM_PROFILE_DEPTH - 1)
+
 #define	VM_OFFSET_PROGRAM_STACK		0
 #define	VM_OFFSET_SYSTEM_CALL		4
 
@@ -144,13 +148,16 @@ struct vm_s
 	// for interpreted modules
 	qboolean	currentlyInterpreting;
 
-	// VMs are no longer compiled
-	// qboolean	compiled;
+	// only x86-64 System V targets have a compiler, everything else interprets
+	qboolean	compiled;
 	byte		*codeBase;
 	int			codeLength;
 
 	int			*instructionPointers;
 	int			instructionPointersLength;
+	int			instructionCount;
+
+	unsigned long long	instructionsExecuted;	// by the interpreter, for vmbench
 
 	byte		*dataBase;
 	int			dataMask;
@@ -160,6 +167,18 @@ struct vm_s
 	int			numSymbols;
 	struct vmSymbol_s	*symbols;
 
+	// shadow call stack for the sampling profiler, kept by both the interpreter
+	// and the compiled code: instruction number of each function's OP_ENTER,
+	// or -1 - syscall number while a system call is running
+	volatile int	profileDepth;
+	volatile int	profileStack[VM_PROFILE_DEPTH];
+
+	// vm_traceSyscalls: systemCall is VM_TraceSyscall, which logs every
+	// system call the module makes and passes it on to moduleSystemCall
+	int			(*moduleSystemCall)(int *parms);
+	FILE		*traceFile;
+	int			traceCount;
+
 	int			callLevel;			// for debug indenting
 	int			breakFunction;		// increment breakCount on function entry to this
 	int			breakCount;
@@ -172,8 +191,13 @@ struct vm_s
 extern	vm_t	*currentVM;
 extern	int		vm_debugLevel;
 
+#if defined( __x86_64__ ) && !defined( _WIN32 )
+#define	VM_X86_64_COMPILER
+#endif
+
 void VM_Compile (vm_t *vm, vmHeader_t *header);
 int	VM_CallCompiled (vm_t *vm, int *args);
+void VM_FreeCompiled (vm_t *vm);
 
 void VM_PrepareInterpreter (vm_t *vm, vmHeader_t *header);
 int	VM_CallInterpreted (vm_t *vm, int *args);
@@ -23,6 +23,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "vm_local.h"
 
+#ifndef VM_X86_64_COMPILER
+
 #ifdef __FreeBSD__ // rb0101023
 #include <sys/types.h>
 #endif
@@ -1246,4 +1248,4 @@ int	VM_CallCompiled (vm_t *vm, int *args)
 }
 #endif // !DLL_ONLY
 
-
+#endif // !VM_X86_64_COMPILER
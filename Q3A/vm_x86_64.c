@@ -0,0 +1,920 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// vm_x86_64.c -- load time compiler and execution environment for x86-64 System V
+// vm_traceSyscalls compares it against the interpreter, see SYSCALL TRACES in vm.c
+
+#include "vm_local.h"
+
+#ifdef VM_X86_64_COMPILER
+
+#include <sys/mman.h>
+
+/*
+
+  rax	scratch
+  rcx	scratch (required for shifts)
+  rdx	scratch (required for divisions)
+  rbx	saves rsp while calling out of the generated code
+  rbp	opstack index, only bpl is ever changed so it wraps at 256
+  r12	vm->dataBase
+  r13	opstack base
+  r14	program stack
+  r15	native address of every instruction, for computed jumps and calls
+
+  Every VM function is entered with a native call, so OP_LEAVE is a plain
+  ret and the return address saved in the image is never read back.  The
+  opstack can't leave its 256 entries and every data access is masked with
+  vm->dataMask, so bad bytecode can't reach outside its own image.
+
+*/
+
+#define	OPSTACK_SIZE		256
+#define	OPSTACK_GUARD		4		// room for the [-1] and [+1] displacements at the wrap point
+
+#define	MAX_INSTRUCTION_SIZE	64
+
+#define	VM_OFFSET(field)	((int) (size_t) &((vm_t *) 0)->field)
+
+typedef int (*vmEntryPoint_t) (int *opStack, int programStack);
+
+typedef enum
+{
+	VM_JIT_JUMP_RANGE,
+	VM_JIT_CALL_RANGE,
+	VM_JIT_STACK_OVERFLOW
+} vmJitError_t;
+
+static	byte	*buf = NULL;
+static	int		compiledOfs = 0;
+
+// offsets of the shared routines at the head of the code
+static	int		callOfs;
+static	int		errorOfs[3];
+
+/*
+=================
+VM_JitError
+
+Called by the generated code, never returns
+=================
+*/
+static void VM_JitError (int error)
+{
+	switch (error)
+	{
+	case VM_JIT_JUMP_RANGE:
+		Com_Error (ERR_DROP, "VM jump out of range");
+	case VM_JIT_CALL_RANGE:
+		Com_Error (ERR_DROP, "VM call out of range");
+	default:
+		Com_Error (ERR_DROP, "VM stack overflow");
+	}
+}
+
+/*
+=================
+VM_JitBlockCopy
+
+Called by the generated code, same clamping as the interpreter
+=================
+*/
+static void VM_JitBlockCopy (vm_t *vm, int dest, int src, int count)
+{
+	int		*s, *d;
+	int		i, srci, desti;
+
+	srci = src & vm->dataMask;
+	desti = dest & vm->dataMask;
+	count = ((srci + count) & vm->dataMask) - srci;
+	count = ((desti + count) & vm->dataMask) - desti;
+
+	if ((srci | desti | count) & 3)
+	{
+		Com_Error (ERR_DROP, "OP_BLOCK_COPY not dword aligned");
+	}
+
+	s = (int *) &vm->dataBase[srci];
+	d = (int *) &vm->dataBase[desti];
+	for (i = (count >> 2) - 1; i >= 0; i--)
+	{
+		d[i] = s[i];
+	}
+}
+
+static void Emit1 (int v)
+{
+	buf[compiledOfs] = v;
+	compiledOfs++;
+}
+
+static void Emit4 (int v)
+{
+	Emit1 (v & 255);
+	Emit1 ((v >> 8) & 255);
+	Emit1 ((v >> 16) & 255);
+	Emit1 ((v >> 24) & 255);
+}
+
+// p is only ever an address to embed, so it takes the volatile profile fields too
+static void Emit8 (const volatile void *p)
+{
+	unsigned long long	v = (unsigned long long) p;
+
+	Emit4 ((int) v);
+	Emit4 ((int) (v >> 32));
+}
+
+static int Hex (int c)
+{
+	if (c >= 'a' && c <= 'f')
+	{
+		return 10 + c - 'a';
+	}
+	if (c >= 'A' && c <= 'F')
+	{
+		return 10 + c - 'A';
+	}
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+
+	Com_Error (ERR_DROP, "Hex: bad char '%c'", c);
+
+	return 0;
+}
+
+static void EmitString (const char *string)
+{
+	int		c1, c2;
+	int		v;
+
+	while (1)
+	{
+		c1 = string[0];
+		c2 = string[1];
+
+		v = (Hex (c1) << 4) | Hex (c2);
+		Emit1 (v);
+
+		if (!string[2])
+		{
+			break;
+		}
+		string += 3;
+	}
+}
+
+/*
+=================
+EmitRel32
+
+Displacement to a code offset from the end of the 4 byte field
+=================
+*/
+static void EmitRel32 (int target)
+{
+	Emit4 (target - (compiledOfs + 4));
+}
+
+/*
+=================
+EmitCallOut
+
+Calls the C function in rax with rsp aligned for the ABI
+=================
+*/
+static void EmitCallOut (void)
+{
+	EmitString ("48 89 E3");		// mov rbx, rsp
+	EmitString ("48 83 E4 F0");		// and rsp, -16
+	EmitString ("FF D0");			// call rax
+	EmitString ("48 89 DC");		// mov rsp, rbx
+}
+
+/*
+=================
+EmitCompare
+
+Pops two ints and branches on the condition code
+=================
+*/
+static void EmitCompare (vm_t *vm, int jcc, int target)
+{
+	EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+	EmitString ("41 8B 4C AD FC");	// mov ecx, [r13+rbp*4-4]
+	EmitString ("40 80 ED 02");		// sub bpl, 2
+	EmitString ("39 C1");			// cmp ecx, eax
+	Emit1 (0x0F);					// jcc target
+	Emit1 (jcc);
+	EmitRel32 (vm->instructionPointers[target]);
+}
+
+/*
+=================
+EmitCompareFloat
+
+Loads the two floats for a compare; swap puts the top of the stack on
+the left of the ucomiss so that less-than tests can use ja/jae, which
+are false for NaNs like the C compares in the interpreter
+=================
+*/
+static void EmitCompareFloat (qboolean swap)
+{
+	EmitString ("F3 41 0F 10 44 AD FC");	// movss xmm0, [r13+rbp*4-4]
+	EmitString ("F3 41 0F 10 4C AD 00");	// movss xmm1, [r13+rbp*4]
+	EmitString ("40 80 ED 02");				// sub bpl, 2
+
+	if (swap)
+	{
+		EmitString ("0F 2E C8");			// ucomiss xmm1, xmm0
+	}
+	else
+	{
+		EmitString ("0F 2E C1");			// ucomiss xmm0, xmm1
+	}
+}
+
+/*
+=================
+EmitBinaryOp
+
+[-1] = [-1] op [0], for the ops that can use a memory destination
+=================
+*/
+static void EmitBinaryOp (int op)
+{
+	EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+	EmitString ("40 FE CD");		// dec bpl
+	Emit1 (0x41);					// op [r13+rbp*4], eax
+	Emit1 (op);
+	EmitString ("44 AD 00");
+}
+
+/*
+=================
+EmitFloatOp
+=================
+*/
+static void EmitFloatOp (int op)
+{
+	EmitString ("F3 41 0F 10 44 AD FC");	// movss xmm0, [r13+rbp*4-4]
+	EmitString ("F3 41 0F");				// op xmm0, [r13+rbp*4]
+	Emit1 (op);
+	EmitString ("44 AD 00");
+	EmitString ("40 FE CD");				// dec bpl
+	EmitString ("F3 41 0F 11 44 AD 00");	// movss [r13+rbp*4], xmm0
+}
+
+/*
+=================
+EmitShift
+=================
+*/
+static void EmitShift (int modrm)
+{
+	EmitString ("41 8B 4C AD 00");	// mov ecx, [r13+rbp*4]
+	EmitString ("40 FE CD");		// dec bpl
+	EmitString ("41 D3");			// shift [r13+rbp*4], cl
+	Emit1 (modrm);
+	EmitString ("AD 00");
+}
+
+/*
+=================
+EmitDivide
+=================
+*/
+static void EmitDivide (qboolean isSigned, qboolean remainder)
+{
+	EmitString ("41 8B 4C AD 00");	// mov ecx, [r13+rbp*4]
+	EmitString ("40 FE CD");		// dec bpl
+	EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+
+	if (isSigned)
+	{
+		EmitString ("99");			// cdq
+		EmitString ("F7 F9");		// idiv ecx
+	}
+	else
+	{
+		EmitString ("31 D2");		// xor edx, edx
+		EmitString ("F7 F1");		// div ecx
+	}
+
+	if (remainder)
+	{
+		EmitString ("41 89 54 AD 00");	// mov [r13+rbp*4], edx
+	}
+	else
+	{
+		EmitString ("41 89 44 AD 00");	// mov [r13+rbp*4], eax
+	}
+}
+
+/*
+=================
+EmitRoutines
+
+The entry point and the code shared by all instructions
+=================
+*/
+static void EmitRoutines (vm_t *vm, void *instructionTable)
+{
+	int		i;
+
+	// int entry (int *opStack, int programStack)
+	EmitString ("53");				// push rbx
+	EmitString ("55");				// push rbp
+	EmitString ("41 54");			// push r12
+	EmitString ("41 55");			// push r13
+	EmitString ("41 56");			// push r14
+	EmitString ("41 57");			// push r15
+	EmitString ("49 89 FD");		// mov r13, rdi
+	EmitString ("41 89 F6");		// mov r14d, esi
+	EmitString ("31 ED");			// xor ebp, ebp
+	EmitString ("49 BC");			// mov r12, vm->dataBase
+	Emit8 (vm->dataBase);
+	EmitString ("49 BF");			// mov r15, instructionTable
+	Emit8 (instructionTable);
+	EmitString ("48 83 EC 08");		// sub rsp, 8
+	Emit1 (0xE8);					// call instruction 0
+	EmitRel32 (vm->instructionPointers[0]);
+	EmitString ("48 83 C4 08");		// add rsp, 8
+	EmitString ("89 E8");			// mov eax, ebp
+	EmitString ("41 5F");			// pop r15
+	EmitString ("41 5E");			// pop r14
+	EmitString ("41 5D");			// pop r13
+	EmitString ("41 5C");			// pop r12
+	EmitString ("5D");				// pop rbp
+	EmitString ("5B");				// pop rbx
+	EmitString ("C3");				// ret
+
+	// call to the instruction number in eax, or a system call if negative
+	callOfs = compiledOfs;
+	EmitString ("85 C0");			// test eax, eax
+	EmitString ("7C 0F");			// jl systemCall
+	Emit1 (0x3D);					// cmp eax, instructionCount
+	Emit4 (vm->instructionCount);
+	EmitString ("0F 83");			// jae callRangeError
+	EmitRel32 (errorOfs[VM_JIT_CALL_RANGE]);
+	EmitString ("41 FF 24 C7");		// jmp [r15+rax*8]
+
+	// systemCall:
+	EmitString ("F7 D0");			// not eax
+	EmitString ("41 8D 4E 04");		// lea ecx, [r14+4]
+	EmitString ("81 E1");			// and ecx, dataMask & ~3
+	Emit4 (vm->dataMask & ~3);
+	EmitString ("41 89 04 0C");		// mov [r12+rcx], eax
+	EmitString ("41 8D 56 FC");		// lea edx, [r14-4]
+	EmitString ("48 B8");			// mov rax, vm
+	Emit8 (vm);
+	EmitString ("89 10");			// mov [rax].programStack, edx
+	EmitString ("49 8D 3C 0C");		// lea rdi, [r12+rcx]
+	EmitString ("8B 90");			// mov edx, [rax].profileDepth
+	Emit4 (VM_OFFSET (profileDepth));
+	EmitString ("83 E2");			// and edx, VM_PROFILE_MASK
+	Emit1 (VM_PROFILE_MASK);
+	EmitString ("8B 0F");			// mov ecx, [rdi]
+	EmitString ("F7 D1");			// not ecx
+	EmitString ("89 8C 90");		// mov [rax].profileStack[rdx], ecx
+	Emit4 (VM_OFFSET (profileStack));
+	EmitString ("FF 80");			// inc dword [rax].profileDepth
+	Emit4 (VM_OFFSET (profileDepth));
+	EmitString ("48 89 E3");		// mov rbx, rsp
+	EmitString ("48 83 E4 F0");		// and rsp, -16
+	EmitString ("FF 50");			// call [rax].systemCall
+	Emit1 (VM_OFFSET (systemCall));
+	EmitString ("48 89 DC");		// mov rsp, rbx
+	EmitString ("48 B9");			// mov rcx, vm
+	Emit8 (vm);
+	EmitString ("FF 89");			// dec dword [rcx].profileDepth
+	Emit4 (VM_OFFSET (profileDepth));
+	EmitString ("40 FE C5");		// inc bpl
+	EmitString ("41 89 44 AD 00");	// mov [r13+rbp*4], eax
+	EmitString ("C3");				// ret
+
+	// runtime errors
+	for (i = 0; i < 3; i++)
+	{
+		errorOfs[i] = compiledOfs;
+		Emit1 (0xBF);				// mov edi, error
+		Emit4 (i);
+		EmitString ("48 83 E4 F0");	// and rsp, -16
+		EmitString ("48 B8");		// mov rax, VM_JitError
+		Emit8 (VM_JitError);
+		EmitString ("FF D0");		// call rax
+	}
+}
+
+/*
+=================
+VM_Compile
+=================
+*/
+void VM_Compile (vm_t *vm, vmHeader_t *header)
+{
+	int		op;
+	int		maxLength;
+	int		v;
+	int		i;
+	int		pass;
+	int		pc;
+	int		instruction;
+	byte	*code;
+	int		tableOfs, mappedLength;
+	void	**instructionTable;
+
+	maxLength = 1024 + header->instructionCount * MAX_INSTRUCTION_SIZE;
+	buf = Z_Malloc (maxLength);
+
+	vm->instructionCount = header->instructionCount;
+	Com_Memset (vm->instructionPointers, 0, vm->instructionPointersLength);
+
+	// the first pass finds the instruction offsets, the second fills in the
+	// branches; every instruction has the same size in both
+	for (pass = 0; pass < 2; pass++)
+	{
+		pc = 0;
+		instruction = 0;
+		code = (byte *) header + header->codeOffset;
+		compiledOfs = 0;
+
+		// the table is only read through r15, its address comes later
+		EmitRoutines (vm, NULL);
+
+		while (instruction < header->instructionCount)
+		{
+			if (compiledOfs > maxLength - MAX_INSTRUCTION_SIZE)
+			{
+				Com_Error (ERR_FATAL, "VM_CompileX86_64: maxLength exceeded");
+			}
+
+			vm->instructionPointers[instruction] = compiledOfs;
+			instruction++;
+
+			if (pc >= header->codeLength)
+			{
+				Com_Error (ERR_FATAL, "VM_CompileX86_64: pc > header->codeLength");
+			}
+
+			op = code[pc];
+			pc++;
+
+			// fetch the operand
+			switch (op)
+			{
+			case OP_ENTER:
+			case OP_CONST:
+			case OP_LOCAL:
+			case OP_LEAVE:
+			case OP_EQ:
+			case OP_NE:
+			case OP_LTI:
+			case OP_LEI:
+			case OP_GTI:
+			case OP_GEI:
+			case OP_LTU:
+			case OP_LEU:
+			case OP_GTU:
+			case OP_GEU:
+			case OP_EQF:
+			case OP_NEF:
+			case OP_LTF:
+			case OP_LEF:
+			case OP_GTF:
+			case OP_GEF:
+			case OP_BLOCK_COPY:
+				v = LittleLong (*(int *) &code[pc]);
+				pc += 4;
+				break;
+			case OP_ARG:
+				v = code[pc];
+				pc += 1;
+				break;
+			default:
+				v = 0;
+				break;
+			}
+
+			if (op >= OP_EQ && op <= OP_GEF && (unsigned) v >= (unsigned) header->instructionCount)
+			{
+				Com_Error (ERR_FATAL, "VM_CompileX86_64: branch out of range at %i", instruction - 1);
+			}
+
+			switch (op)
+			{
+			case OP_UNDEF:
+			case OP_IGNORE:
+				break;
+			case OP_BREAK:
+				EmitString ("48 B8");			// mov rax, &vm->breakCount
+				Emit8 (&vm->breakCount);
+				EmitString ("FF 00");			// inc dword [rax]
+				break;
+			case OP_ENTER:
+				EmitString ("48 B8");			// mov rax, &vm->profileDepth
+				Emit8 (&vm->profileDepth);
+				EmitString ("8B 10");			// mov edx, [rax]
+				EmitString ("83 E2");			// and edx, VM_PROFILE_MASK
+				Emit1 (VM_PROFILE_MASK);
+				EmitString ("C7 44 90");		// mov [rax].profileStack[rdx], instruction
+				Emit1 (VM_OFFSET (profileStack) - VM_OFFSET (profileDepth));
+				Emit4 (instruction - 1);
+				EmitString ("FF 00");			// inc dword [rax]
+				EmitString ("41 81 EE");		// sub r14d, v
+				Emit4 (v);
+				EmitString ("41 81 FE");		// cmp r14d, vm->stackBottom
+				Emit4 (vm->stackBottom);
+				EmitString ("0F 8C");			// jl stackOverflowError
+				EmitRel32 (errorOfs[VM_JIT_STACK_OVERFLOW]);
+				break;
+			case OP_LEAVE:
+				EmitString ("48 B8");			// mov rax, &vm->profileDepth
+				Emit8 (&vm->profileDepth);
+				EmitString ("FF 08");			// dec dword [rax]
+				EmitString ("41 81 C6");		// add r14d, v
+				Emit4 (v);
+				EmitString ("C3");				// ret
+				break;
+			case OP_CALL:
+				EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+				EmitString ("40 FE CD");		// dec bpl
+				Emit1 (0xE8);					// call callRoutine
+				EmitRel32 (callOfs);
+				break;
+			case OP_PUSH:
+				EmitString ("40 FE C5");		// inc bpl
+				break;
+			case OP_POP:
+				EmitString ("40 FE CD");		// dec bpl
+				break;
+			case OP_CONST:
+				EmitString ("40 FE C5");		// inc bpl
+				EmitString ("41 C7 44 AD 00");	// mov dword [r13+rbp*4], v
+				Emit4 (v);
+				break;
+			case OP_LOCAL:
+				EmitString ("41 8D 86");		// lea eax, [r14+v]
+				Emit4 (v);
+				EmitString ("40 FE C5");		// inc bpl
+				EmitString ("41 89 44 AD 00");	// mov [r13+rbp*4], eax
+				break;
+			case OP_JUMP:
+				EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+				EmitString ("40 FE CD");		// dec bpl
+				Emit1 (0x3D);					// cmp eax, instructionCount
+				Emit4 (header->instructionCount);
+				EmitString ("0F 83");			// jae jumpRangeError
+				EmitRel32 (errorOfs[VM_JIT_JUMP_RANGE]);
+				EmitString ("41 FF 24 C7");		// jmp [r15+rax*8]
+				break;
+
+			case OP_EQ:
+				EmitCompare (vm, 0x84, v);		// je
+				break;
+			case OP_NE:
+				EmitCompare (vm, 0x85, v);		// jne
+				break;
+			case OP_LTI:
+				EmitCompare (vm, 0x8C, v);		// jl
+				break;
+			case OP_LEI:
+				EmitCompare (vm, 0x8E, v);		// jle
+				break;
+			case OP_GTI:
+				EmitCompare (vm, 0x8F, v);		// jg
+				break;
+			case OP_GEI:
+				EmitCompare (vm, 0x8D, v);		// jge
+				break;
+			case OP_LTU:
+				EmitCompare (vm, 0x82, v);		// jb
+				break;
+			case OP_LEU:
+				EmitCompare (vm, 0x86, v);		// jbe
+				break;
+			case OP_GTU:
+				EmitCompare (vm, 0x87, v);		// ja
+				break;
+			case OP_GEU:
+				EmitCompare (vm, 0x83, v);		// jae
+				break;
+
+			case OP_EQF:
+				EmitCompareFloat (qfalse);
+				EmitString ("7A 06");			// jp skip
+				EmitString ("0F 84");			// je v
+				EmitRel32 (vm->instructionPointers[v]);
+				break;
+			case OP_NEF:
+				EmitCompareFloat (qfalse);
+				EmitString ("0F 8A");			// jp v
+				EmitRel32 (vm->instructionPointers[v]);
+				EmitString ("0F 85");			// jne v
+				EmitRel32 (vm->instructionPointers[v]);
+				break;
+			case OP_LTF:
+				EmitCompareFloat (qtrue);
+				EmitString ("0F 87");			// ja v
+				EmitRel32 (vm->instructionPointers[v]);
+				break;
+			case OP_LEF:
+				EmitCompareFloat (qtrue);
+				EmitString ("0F 83");			// jae v
+				EmitRel32 (vm->instructionPointers[v]);
+				break;
+			case OP_GTF:
+				EmitCompareFloat (qfalse);
+				EmitString ("0F 87");			// ja v
+				EmitRel32 (vm->instructionPointers[v]);
+				break;
+			case OP_GEF:
+				EmitCompareFloat (qfalse);
+				EmitString ("0F 83");			// jae v
+				EmitRel32 (vm->instructionPointers[v]);
+				break;
+
+			case OP_LOAD4:
+				EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+				Emit1 (0x25);					// and eax, dataMask
+				Emit4 (vm->dataMask);
+				EmitString ("41 8B 04 04");		// mov eax, [r12+rax]
+				EmitString ("41 89 44 AD 00");	// mov [r13+rbp*4], eax
+				break;
+			case OP_LOAD2:
+				EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+				Emit1 (0x25);					// and eax, dataMask
+				Emit4 (vm->dataMask);
+				EmitString ("41 0F B7 04 04");	// movzx eax, word [r12+rax]
+				EmitString ("41 89 44 AD 00");	// mov [r13+rbp*4], eax
+				break;
+			case OP_LOAD1:
+				EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+				Emit1 (0x25);					// and eax, dataMask
+				Emit4 (vm->dataMask);
+				EmitString ("41 0F B6 04 04");	// movzx eax, byte [r12+rax]
+				EmitString ("41 89 44 AD 00");	// mov [r13+rbp*4], eax
+				break;
+
+			case OP_STORE4:
+				EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+				EmitString ("41 8B 4C AD FC");	// mov ecx, [r13+rbp*4-4]
+				EmitString ("81 E1");			// and ecx, dataMask & ~3
+				Emit4 (vm->dataMask & ~3);
+				EmitString ("41 89 04 0C");		// mov [r12+rcx], eax
+				EmitString ("40 80 ED 02");		// sub bpl, 2
+				break;
+			case OP_STORE2:
+				EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+				EmitString ("41 8B 4C AD FC");	// mov ecx, [r13+rbp*4-4]
+				EmitString ("81 E1");			// and ecx, dataMask & ~1
+				Emit4 (vm->dataMask & ~1);
+				EmitString ("66 41 89 04 0C");	// mov [r12+rcx], ax
+				EmitString ("40 80 ED 02");		// sub bpl, 2
+				break;
+			case OP_STORE1:
+				EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+				EmitString ("41 8B 4C AD FC");	// mov ecx, [r13+rbp*4-4]
+				EmitString ("81 E1");			// and ecx, dataMask
+				Emit4 (vm->dataMask);
+				EmitString ("41 88 04 0C");		// mov [r12+rcx], al
+				EmitString ("40 80 ED 02");		// sub bpl, 2
+				break;
+
+			case OP_ARG:
+				EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+				EmitString ("40 FE CD");		// dec bpl
+				EmitString ("41 8D 8E");		// lea ecx, [r14+v]
+				Emit4 (v);
+				EmitString ("81 E1");			// and ecx, dataMask & ~3
+				Emit4 (vm->dataMask & ~3);
+				EmitString ("41 89 04 0C");		// mov [r12+rcx], eax
+				break;
+
+			case OP_BLOCK_COPY:
+				EmitString ("41 8B 54 AD 00");	// mov edx, [r13+rbp*4]
+				EmitString ("41 8B 74 AD FC");	// mov esi, [r13+rbp*4-4]
+				EmitString ("40 80 ED 02");		// sub bpl, 2
+				Emit1 (0xB9);					// mov ecx, v
+				Emit4 (v);
+				EmitString ("48 BF");			// mov rdi, vm
+				Emit8 (vm);
+				EmitString ("48 B8");			// mov rax, VM_JitBlockCopy
+				Emit8 (VM_JitBlockCopy);
+				EmitCallOut ();
+				break;
+
+			case OP_SEX8:
+				EmitString ("41 0F BE 44 AD 00");	// movsx eax, byte [r13+rbp*4]
+				EmitString ("41 89 44 AD 00");		// mov [r13+rbp*4], eax
+				break;
+			case OP_SEX16:
+				EmitString ("41 0F BF 44 AD 00");	// movsx eax, word [r13+rbp*4]
+				EmitString ("41 89 44 AD 00");		// mov [r13+rbp*4], eax
+				break;
+
+			case OP_NEGI:
+				EmitString ("41 F7 5C AD 00");	// neg dword [r13+rbp*4]
+				break;
+			case OP_ADD:
+				EmitBinaryOp (0x01);			// add
+				break;
+			case OP_SUB:
+				EmitBinaryOp (0x29);			// sub
+				break;
+			case OP_BAND:
+				EmitBinaryOp (0x21);			// and
+				break;
+			case OP_BOR:
+				EmitBinaryOp (0x09);			// or
+				break;
+			case OP_BXOR:
+				EmitBinaryOp (0x31);			// xor
+				break;
+			case OP_MULI:
+			case OP_MULU:
+				EmitString ("41 8B 44 AD 00");		// mov eax, [r13+rbp*4]
+				EmitString ("40 FE CD");			// dec bpl
+				EmitString ("41 0F AF 44 AD 00");	// imul eax, [r13+rbp*4]
+				EmitString ("41 89 44 AD 00");		// mov [r13+rbp*4], eax
+				break;
+			case OP_DIVI:
+				EmitDivide (qtrue, qfalse);
+				break;
+			case OP_DIVU:
+				EmitDivide (qfalse, qfalse);
+				break;
+			case OP_MODI:
+				EmitDivide (qtrue, qtrue);
+				break;
+			case OP_MODU:
+				EmitDivide (qfalse, qtrue);
+				break;
+			case OP_BCOM:
+				// the interpreter doesn't pop here either
+				EmitString ("41 8B 44 AD 00");	// mov eax, [r13+rbp*4]
+				EmitString ("F7 D0");			// not eax
+				EmitString ("41 89 44 AD FC");	// mov [r13+rbp*4-4], eax
+				break;
+			case OP_LSH:
+				EmitShift (0x64);				// shl
+				break;
+			case OP_RSHI:
+				EmitShift (0x7C);				// sar
+				break;
+			case OP_RSHU:
+				EmitShift (0x6C);				// shr
+				break;
+
+			case OP_NEGF:
+				EmitString ("41 81 74 AD 00");	// xor dword [r13+rbp*4], 0x80000000
+				Emit4 (0x80000000);
+				break;
+			case OP_ADDF:
+				EmitFloatOp (0x58);				// addss
+				break;
+			case OP_SUBF:
+				EmitFloatOp (0x5C);				// subss
+				break;
+			case OP_MULF:
+				EmitFloatOp (0x59);				// mulss
+				break;
+			case OP_DIVF:
+				EmitFloatOp (0x5E);				// divss
+				break;
+			case OP_CVIF:
+				EmitString ("F3 41 0F 2A 44 AD 00");	// cvtsi2ss xmm0, [r13+rbp*4]
+				EmitString ("F3 41 0F 11 44 AD 00");	// movss [r13+rbp*4], xmm0
+				break;
+			case OP_CVFI:
+				EmitString ("F3 41 0F 2C 44 AD 00");	// cvttss2si eax, [r13+rbp*4]
+				EmitString ("41 89 44 AD 00");			// mov [r13+rbp*4], eax
+				break;
+
+			default:
+				Com_Error (ERR_FATAL, "VM_CompileX86_64: bad opcode %i at offset %i", op, pc);
+			}
+		}
+	}
+
+	// copy to executable memory, with the address table behind the code
+	tableOfs = (compiledOfs + 15) & ~15;
+	mappedLength = tableOfs + header->instructionCount * sizeof (void *);
+
+	vm->codeBase = mmap (NULL, mappedLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (vm->codeBase == MAP_FAILED)
+	{
+		Com_Error (ERR_FATAL, "VM_CompileX86_64: mmap failed");
+	}
+	vm->codeLength = mappedLength;
+
+	instructionTable = (void **) (vm->codeBase + tableOfs);
+	for (i = 0; i < header->instructionCount; i++)
+	{
+		instructionTable[i] = vm->codeBase + vm->instructionPointers[i];
+	}
+
+	// the entry point needs the real table address
+	compiledOfs = 0;
+	EmitRoutines (vm, instructionTable);
+
+	Com_Memcpy (vm->codeBase, buf, tableOfs);
+	Z_Free (buf);
+	buf = NULL;
+
+	if (mprotect (vm->codeBase, mappedLength, PROT_READ | PROT_EXEC) < 0)
+	{
+		Com_Error (ERR_FATAL, "VM_CompileX86_64: mprotect failed");
+	}
+
+	vm->compiled = qtrue;
+
+	Com_Printf ("VM file %s compiled to %i bytes of code\n", vm->name, tableOfs);
+}
+
+/*
+=================
+VM_FreeCompiled
+=================
+*/
+void VM_FreeCompiled (vm_t *vm)
+{
+	if (vm->compiled && vm->codeBase)
+	{
+		munmap (vm->codeBase, vm->codeLength);
+	}
+
+	vm->codeBase = NULL;
+	vm->compiled = qfalse;
+}
+
+/*
+==============
+VM_CallCompiled
+==============
+*/
+int	VM_CallCompiled (vm_t *vm, int *args)
+{
+	int		stack[OPSTACK_SIZE + 2 * OPSTACK_GUARD];
+	int		*opStack;
+	int		programStack;
+	int		stackOnEntry;
+	byte	*image;
+	int		top;
+
+	// we might be called recursively, so this might not be the very top
+	programStack = stackOnEntry = vm->programStack;
+
+	// set up the stack frame
+	image = vm->dataBase;
+
+	programStack -= 48;
+
+	*(int *) &image[programStack + 44] = args[9];
+	*(int *) &image[programStack + 40] = args[8];
+	*(int *) &image[programStack + 36] = args[7];
+	*(int *) &image[programStack + 32] = args[6];
+	*(int *) &image[programStack + 28] = args[5];
+	*(int *) &image[programStack + 24] = args[4];
+	*(int *) &image[programStack + 20] = args[3];
+	*(int *) &image[programStack + 16] = args[2];
+	*(int *) &image[programStack + 12] = args[1];
+	*(int *) &image[programStack + 8] = args[0];
+	*(int *) &image[programStack + 4] = 0;	// return stack
+	*(int *) &image[programStack] = -1;	// never read, the generated code returns natively
+
+	// off we go into generated code...
+	opStack = stack + OPSTACK_GUARD;
+	top = ((vmEntryPoint_t) vm->codeBase) (opStack, programStack);
+
+	if (top != 1)
+	{
+		Com_Error (ERR_DROP, "opStack corrupted in compiled code");
+	}
+
+	vm->programStack = stackOnEntry;
+
+	return opStack[1];
+}
+
+#endif	// VM_X86_64_COMPILER
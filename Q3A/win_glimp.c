@@ -713,3 +713,121 @@ void GLimp_LogComment (char *comment)
 }
 
 
+
+/*
+===========================================================
+
+SMP acceleration
+
+The back end runs on its own thread and the main thread hands it one
+command list at a time.  Direct3D has no per thread context to move
+around, so unlike the GL version there is nothing to make current; the
+events alone keep the two threads off the device at the same time.
+
+The render thread isn't part of the job pool and shares Sys_ThreadIndex 0,
+and with it the zone's slab cache and the frame arena, with the main
+thread.  So the back end must not allocate or use the file system while
+it runs: cinematics are advanced and screenshots saved on the main thread
+by R_BackEndRequests, between command lists.  Nor may it print or call
+ri.Error: RB_Printf and RB_Error hold messages and errors in backEnd, and
+R_WaitRenderThread prints or raises them once the render thread is idle.
+
+===========================================================
+*/
+
+static HANDLE	renderCommandsEvent;
+static HANDLE	renderCompletedEvent;
+static HANDLE	renderActiveEvent;
+
+static void (*glimpRenderThread) (void);
+
+static DWORD WINAPI GLimp_RenderThreadWrapper (LPVOID param)
+{
+	glimpRenderThread ();
+	return 0;
+}
+
+
+/*
+=======================
+GLimp_SpawnRenderThread
+=======================
+*/
+static HANDLE	renderThreadHandle;
+static DWORD	renderThreadId;
+
+qboolean GLimp_SpawnRenderThread (void (*function) (void))
+{
+	renderCommandsEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
+	renderCompletedEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
+	renderActiveEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
+
+	glimpRenderThread = function;
+
+	renderThreadHandle = CreateThread (NULL, 0, GLimp_RenderThreadWrapper, NULL, 0, &renderThreadId);
+
+	if (!renderThreadHandle)
+	{
+		CloseHandle (renderCommandsEvent);
+		CloseHandle (renderCompletedEvent);
+		CloseHandle (renderActiveEvent);
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+
+static void *volatile smpData;
+
+void *GLimp_RendererSleep (void)
+{
+	void	*data;
+
+	ResetEvent (renderActiveEvent);
+
+	// after this, the front end can exit GLimp_FrontEndSleep
+	SetEvent (renderCompletedEvent);
+
+	WaitForSingleObject (renderCommandsEvent, INFINITE);
+
+	ResetEvent (renderCompletedEvent);
+	ResetEvent (renderCommandsEvent);
+
+	data = smpData;
+
+	// after this, the main thread can exit GLimp_WakeRenderer
+	SetEvent (renderActiveEvent);
+
+	return data;
+}
+
+
+void GLimp_FrontEndSleep (void)
+{
+	WaitForSingleObject (renderCompletedEvent, INFINITE);
+}
+
+
+void GLimp_WakeRenderer (void *data)
+{
+	smpData = data;
+
+	// after this, the renderer can continue through GLimp_RendererSleep
+	SetEvent (renderCommandsEvent);
+
+	WaitForSingleObject (renderActiveEvent, INFINITE);
+
+	// NULL tells the render thread to quit
+	if (!data)
+	{
+		WaitForSingleObject (renderThreadHandle, INFINITE);
+
+		CloseHandle (renderThreadHandle);
+		CloseHandle (renderCommandsEvent);
+		CloseHandle (renderCompletedEvent);
+		CloseHandle (renderActiveEvent);
+
+		renderThreadHandle = NULL;
+	}
+}
@@ -155,6 +155,7 @@ void Sys_Quit (void)
 {
 	timeEndPeriod (1);
 	IN_Shutdown ();
+	Sys_ShutdownJobs ();
 	Sys_DestroyConsole ();
 
 	exit (0);
@@ -438,6 +439,89 @@ void	Sys_FreeFileList (char **list)
 	Z_Free (list);
 }
 
+/*
+================
+Sys_OpenFileMapping
+
+Returns a read only mapping of the whole file, which stays
+valid after the file handle is closed
+================
+*/
+void *Sys_OpenFileMapping (const char *osPath, int *length)
+{
+	HANDLE	file;
+	HANDLE	mapping;
+	DWORD	size;
+
+	file = CreateFile (osPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return NULL;
+	}
+
+	size = GetFileSize (file, NULL);
+	mapping = CreateFileMapping (file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle (file);
+	if (!mapping)
+	{
+		return NULL;
+	}
+
+	*length = size;
+	return mapping;
+}
+
+/*
+================
+Sys_CloseFileMapping
+================
+*/
+void Sys_CloseFileMapping (void *mapping)
+{
+	CloseHandle ((HANDLE) mapping);
+}
+
+/*
+================
+Sys_MapFileView
+
+Views have to start on the allocation granularity, so the
+returned pointer is inside the view rather than its base
+================
+*/
+void *Sys_MapFileView (void *mapping, int offset, int length, void **view)
+{
+	static DWORD	granularity;
+	SYSTEM_INFO		info;
+	DWORD			base;
+	byte			*p;
+
+	if (!granularity)
+	{
+		GetSystemInfo (&info);
+		granularity = info.dwAllocationGranularity;
+	}
+
+	base = offset - offset % granularity;
+	p = MapViewOfFile ((HANDLE) mapping, FILE_MAP_READ, 0, base, offset - base + length);
+	*view = p;
+	if (!p)
+	{
+		return NULL;
+	}
+	return p + (offset - base);
+}
+
+/*
+================
+Sys_UnmapFileView
+================
+*/
+void Sys_UnmapFileView (void *view)
+{
+	UnmapViewOfFile (view);
+}
+
 //========================================================
 
 
@@ -1252,6 +1336,8 @@ void Sys_Init (void)
 
 	Cvar_Set ("username", Sys_GetCurrentUser ());
 
+	Sys_InitJobs ();
+
 	IN_Init ();		// FIXME: not in dedicated?
 }
 
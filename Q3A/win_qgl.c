@@ -225,13 +225,14 @@ qboolean QGL_InitDirect3D (HWND hWnd)
 	// get our present params and save them out
 	memcpy (&d3d_PresentParams, QGL_GetPresentParameters (hWnd, width, height, D3DFMT_UNKNOWN, 0, qfalse), sizeof (d3d_PresentParams));
 
-	// create it for first time
+	// create it for first time; with r_smp the render thread draws while the
+	// main thread owns the window, so let the runtime guard the device too
 	if (FAILED (d3d_Object->lpVtbl->CreateDevice (
 		d3d_Object,
 		0,
 		D3DDEVTYPE_HAL,
 		hWnd,
-		D3DCREATE_HARDWARE_VERTEXPROCESSING | D3DCREATE_NOWINDOWCHANGES | D3DCREATE_DISABLE_DRIVER_MANAGEMENT,
+		D3DCREATE_HARDWARE_VERTEXPROCESSING | D3DCREATE_NOWINDOWCHANGES | D3DCREATE_DISABLE_DRIVER_MANAGEMENT | (r_smp->integer ? D3DCREATE_MULTITHREADED : 0),
 		&d3d_PresentParams,
 		&d3d_Device)))
 	{
@@ -430,6 +431,13 @@ qboolean QGL_CheckScene (void)
 {
 	if (!tr.registered) return qfalse;
 
+	// there is no device or scene with the null back end
+	if (r_nullBackend->integer) return qtrue;
+
+	// the render thread has to be off the device before it can be reset
+	if (glState.deviceLost || r_swapInterval->modified)
+		R_WaitRenderThread ();
+
 	if (glState.deviceLost)
 	{
 		// attempt device recovery
@@ -446,18 +454,7 @@ qboolean QGL_CheckScene (void)
 		return qfalse;
 	}
 
-	// issue a beginscene call if we haven't had one yet
-	if (!glState.inBeginScene)
-	{
-		// always clear the rendertarget every frame
-		d3d_Device->lpVtbl->Clear (d3d_Device, 0, NULL, D3DCLEAR_TARGET, 0, 1.0f, 0);
-
-		if (SUCCEEDED (d3d_Device->lpVtbl->BeginScene (d3d_Device)))
-			glState.inBeginScene = qtrue;
-		else return qfalse;
-	}
-
-	// it's OK to draw now
+	// it's OK to draw now; the scene is begun by the back end
 	return qtrue;
 }
 
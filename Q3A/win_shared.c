@@ -54,6 +54,28 @@ int Sys_Milliseconds (void)
 	return sys_curtime;
 }
 
+/*
+================
+Sys_Microseconds
+================
+*/
+int Sys_Microseconds (void)
+{
+	static LARGE_INTEGER	frequency;
+	static LARGE_INTEGER	base;
+	LARGE_INTEGER			count;
+
+	if (!frequency.QuadPart)
+	{
+		QueryPerformanceFrequency (&frequency);
+		QueryPerformanceCounter (&base);
+	}
+
+	QueryPerformanceCounter (&count);
+
+	return (int) ((count.QuadPart - base.QuadPart) * 1000000 / frequency.QuadPart);
+}
+
 /*
 ================
 Sys_SnapVector
@@ -0,0 +1,454 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// win_thread.c -- worker thread pool for data-parallel jobs
+
+#include "q_shared.h"
+#include "qcommon.h"
+#include "win_local.h"
+
+/*
+=============================================================================
+
+A small fixed pool of worker threads that run one batch of jobs at a time.
+
+Sys_RunJobs hands out the indices [0, count) to the workers and to the
+calling thread, and doesn't return until every index has been processed and
+every worker that was woken for the batch has gone back to sleep, so nothing
+from one batch can leak into the next.
+
+Job functions must not call Com_Error, Com_Printf or anything else that
+touches shared engine state; record the problem and report it from the
+calling thread after Sys_RunJobs returns.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	qboolean			initialized;
+
+	HANDLE				threads[MAX_JOB_THREADS];
+	int					numThreads;
+	int					threadLimit;		// 0 = use all of them
+
+	HANDLE				wakeSemaphore;		// released once per worker wanted for a batch
+	HANDLE				doneEvent;			// set by the last participant out of a batch
+	CRITICAL_SECTION	dispatchLock;		// one batch at a time
+
+	volatile LONG		shutdown;
+
+	// the current batch
+	jobFunc_t			func;
+	void				*data;
+	LONG				count;
+	volatile LONG		nextIndex;
+	volatile LONG		participants;
+} jobPool_t;
+
+static jobPool_t	jobs;
+
+// set while a thread is running jobs, so nested batches run inline
+static __declspec(thread) int sys_inJob;
+
+// 0 for the main thread, 1 + worker number for the job threads
+static __declspec(thread) int sys_threadIndex;
+
+static cvar_t	*sys_jobThreads;
+
+
+/*
+================
+Sys_ProcessorCount
+================
+*/
+unsigned int Sys_ProcessorCount ()
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo (&info);
+
+	if (info.dwNumberOfProcessors < 1)
+	{
+		return 1;
+	}
+
+	return info.dwNumberOfProcessors;
+}
+
+
+/*
+================
+Sys_RunJobBatch
+
+Claims indices from the current batch until there are none left
+================
+*/
+static void Sys_RunJobBatch (void)
+{
+	LONG	index;
+
+	sys_inJob++;
+
+	while ((index = InterlockedIncrement (&jobs.nextIndex) - 1) < jobs.count)
+	{
+		jobs.func (jobs.data, index);
+	}
+
+	sys_inJob--;
+
+	if (InterlockedDecrement (&jobs.participants) == 0)
+	{
+		SetEvent (jobs.doneEvent);
+	}
+}
+
+
+/*
+================
+Sys_JobThread
+================
+*/
+static DWORD WINAPI Sys_JobThread (LPVOID param)
+{
+	sys_threadIndex = (int) (INT_PTR) param;
+
+	while (1)
+	{
+		WaitForSingleObject (jobs.wakeSemaphore, INFINITE);
+
+		if (jobs.shutdown)
+		{
+			break;
+		}
+
+		Sys_RunJobBatch ();
+	}
+
+	return 0;
+}
+
+
+/*
+================
+Sys_InitJobs
+================
+*/
+void Sys_InitJobs (void)
+{
+	int		i;
+	int		numThreads;
+	DWORD	threadId;
+
+	if (jobs.initialized)
+	{
+		return;
+	}
+
+	sys_jobThreads = Cvar_Get ("sys_jobThreads", "0", CVAR_ARCHIVE | CVAR_LATCH);
+
+	// by default leave the main thread its own core
+	if (sys_jobThreads->integer > 0)
+	{
+		numThreads = sys_jobThreads->integer;
+	}
+	else
+	{
+		numThreads = Sys_ProcessorCount () - 1;
+	}
+
+	if (numThreads > MAX_JOB_THREADS)
+	{
+		numThreads = MAX_JOB_THREADS;
+	}
+
+	InitializeCriticalSection (&jobs.dispatchLock);
+	jobs.wakeSemaphore = CreateSemaphore (NULL, 0, MAX_JOB_THREADS, NULL);
+	jobs.doneEvent = CreateEvent (NULL, FALSE, FALSE, NULL);
+	jobs.shutdown = 0;
+	jobs.numThreads = 0;
+
+	for (i = 0; i < numThreads; i++)
+	{
+		jobs.threads[jobs.numThreads] = CreateThread (NULL, 0, Sys_JobThread, (LPVOID) (INT_PTR) (jobs.numThreads + 1), 0, &threadId);
+
+		if (!jobs.threads[jobs.numThreads])
+		{
+			break;
+		}
+
+		jobs.numThreads++;
+	}
+
+	jobs.initialized = qtrue;
+
+	Com_Printf ("...using %i job threads\n", jobs.numThreads);
+}
+
+
+/*
+================
+Sys_ShutdownJobs
+================
+*/
+void Sys_ShutdownJobs (void)
+{
+	int		i;
+
+	if (!jobs.initialized)
+	{
+		return;
+	}
+
+	InterlockedExchange (&jobs.shutdown, 1);
+	ReleaseSemaphore (jobs.wakeSemaphore, jobs.numThreads, NULL);
+
+	WaitForMultipleObjects (jobs.numThreads, jobs.threads, TRUE, 5000);
+
+	for (i = 0; i < jobs.numThreads; i++)
+	{
+		CloseHandle (jobs.threads[i]);
+	}
+
+	CloseHandle (jobs.wakeSemaphore);
+	CloseHandle (jobs.doneEvent);
+	DeleteCriticalSection (&jobs.dispatchLock);
+
+	Com_Memset (&jobs, 0, sizeof (jobs));
+}
+
+
+/*
+================
+Sys_NumJobThreads
+
+Number of threads that take part in a batch, including the caller
+================
+*/
+int Sys_NumJobThreads (void)
+{
+	if (jobs.threadLimit > 0 && jobs.threadLimit < jobs.numThreads + 1)
+	{
+		return jobs.threadLimit;
+	}
+
+	return jobs.numThreads + 1;
+}
+
+
+/*
+================
+Sys_ThreadIndex
+
+Which of the job threads this is, so callers can keep per-thread scratch
+state in a plain array; the main thread and any thread that isn't part of
+the pool are 0
+================
+*/
+int Sys_ThreadIndex (void)
+{
+	return sys_threadIndex;
+}
+
+
+/*
+================
+Sys_ThreadCount
+
+One more than the highest index Sys_ThreadIndex can return
+================
+*/
+int Sys_ThreadCount (void)
+{
+	return jobs.numThreads + 1;
+}
+
+
+/*
+================
+Sys_SetJobThreadLimit
+
+Only used for benchmarking scaling; 0 restores the full pool
+================
+*/
+void Sys_SetJobThreadLimit (int limit)
+{
+	jobs.threadLimit = limit;
+}
+
+
+/*
+================
+Sys_RunJobs
+================
+*/
+void Sys_RunJobs (jobFunc_t func, void *data, int count)
+{
+	int		i;
+	int		wake;
+
+	if (count <= 0)
+	{
+		return;
+	}
+
+	// run it all here if there's nobody to help or we're already inside a job
+	if (!jobs.initialized || sys_inJob || count == 1 || Sys_NumJobThreads () == 1)
+	{
+		for (i = 0; i < count; i++)
+		{
+			func (data, i);
+		}
+
+		return;
+	}
+
+	EnterCriticalSection (&jobs.dispatchLock);
+
+	wake = Sys_NumJobThreads () - 1;
+
+	if (wake > count - 1)
+	{
+		wake = count - 1;
+	}
+
+	jobs.func = func;
+	jobs.data = data;
+	jobs.count = count;
+	jobs.participants = wake + 1;
+	InterlockedExchange (&jobs.nextIndex, 0);
+
+	ReleaseSemaphore (jobs.wakeSemaphore, wake, NULL);
+
+	Sys_RunJobBatch ();
+
+	WaitForSingleObject (jobs.doneEvent, INFINITE);
+
+	LeaveCriticalSection (&jobs.dispatchLock);
+}
+
+
+/*
+================
+Sys_AtomicAdd
+================
+*/
+int Sys_AtomicAdd (volatile int *value, int add)
+{
+	return InterlockedExchangeAdd ((volatile LONG *) value, add) + add;
+}
+
+
+/*
+================
+Sys_AtomicCompareExchange
+================
+*/
+int Sys_AtomicCompareExchange (volatile int *dest, int exchange, int comparand)
+{
+	return InterlockedCompareExchange ((volatile LONG *) dest, exchange, comparand);
+}
+
+
+/*
+=============================================================================
+
+SAMPLER
+
+A single thread that wakes up every few milliseconds to take a sample of
+whatever the main thread is doing, for the VM profiler.  The same rules as
+for job functions apply to the sample function.
+
+=============================================================================
+*/
+
+static HANDLE			samplerThread;
+static volatile LONG	samplerStop;
+static samplerFunc_t	samplerFunc;
+static int				samplerMsec;
+
+
+/*
+================
+Sys_SamplerThread
+================
+*/
+static DWORD WINAPI Sys_SamplerThread (LPVOID param)
+{
+	while (!samplerStop)
+	{
+		Sleep (samplerMsec);
+		samplerFunc ();
+	}
+
+	return 0;
+}
+
+
+/*
+================
+Sys_StartSampler
+================
+*/
+qboolean Sys_StartSampler (samplerFunc_t func, int msec)
+{
+	DWORD	threadId;
+
+	if (samplerThread)
+	{
+		return qfalse;
+	}
+
+	samplerFunc = func;
+	samplerMsec = msec > 0 ? msec : 1;
+	samplerStop = 0;
+
+	samplerThread = CreateThread (NULL, 0, Sys_SamplerThread, NULL, 0, &threadId);
+	if (!samplerThread)
+	{
+		return qfalse;
+	}
+
+	// it has to get the cpu when its sleep is over or the samples bunch up
+	SetThreadPriority (samplerThread, THREAD_PRIORITY_TIME_CRITICAL);
+
+	return qtrue;
+}
+
+
+/*
+================
+Sys_StopSampler
+================
+*/
+void Sys_StopSampler (void)
+{
+	if (!samplerThread)
+	{
+		return;
+	}
+
+	InterlockedExchange (&samplerStop, 1);
+	WaitForSingleObject (samplerThread, INFINITE);
+	CloseHandle (samplerThread);
+
+	samplerThread = NULL;
+}